@@ -465,6 +465,97 @@ FnMpUpdateTaskOffload(
             Handle, OffloadType, OffloadParameters, OffloadParametersLength, NULL);
 }
 
+FNMPAPI
+FNMPAPI_STATUS
+FnMpSetChecksumEmulation(
+    _In_ FNMP_HANDLE Handle,
+    _In_ BOOLEAN Transmit,
+    _In_ BOOLEAN Receive
+    )
+{
+    MINIPORT_SET_CHECKSUM_EMULATION_IN In = {0};
+
+    //
+    // Supports shared handles only. Enables or disables in-driver checksum
+    // offload emulation. On transmit, the miniport fills in the checksums
+    // requested by each NBL's checksum offload info. On receive, the miniport
+    // verifies each frame's checksums and sets the checksum offload info
+    // itself for each RX checksum offload currently enabled.
+    //
+    // The setting applies to the adapter and persists until changed.
+    //
+
+    In.Flags.Transmit = !!Transmit;
+    In.Flags.Receive = !!Receive;
+
+    return
+        FnIoctl(
+            Handle, FNMP_IOCTL_MINIPORT_SET_CHECKSUM_EMULATION, &In, sizeof(In), NULL, 0, NULL,
+            NULL);
+}
+
+FNMPAPI
+FNMPAPI_STATUS
+FnMpGetChecksumCounters(
+    _In_ FNMP_HANDLE Handle,
+    _Out_ MINIPORT_CHECKSUM_COUNTERS *Counters
+    )
+{
+    //
+    // Supports shared handles only. Returns the cumulative checksum offload
+    // emulation counters for the adapter.
+    //
+    return
+        FnIoctl(
+            Handle, FNMP_IOCTL_MINIPORT_GET_CHECKSUM_COUNTERS, NULL, 0, Counters,
+            sizeof(*Counters), NULL, NULL);
+}
+
+FNMPAPI
+UINT64
+FnMpLatencyBucketLowerBound(
+    _In_ UINT32 Bucket
+    )
+{
+    CONST UINT32 SubBucketCount = 1ui32 << MINIPORT_LATENCY_SUB_BUCKET_BITS;
+
+    //
+    // Returns the smallest latency, in nanoseconds, recorded in a bucket of
+    // MINIPORT_LATENCY_HISTOGRAM_DIRECTION.
+    //
+
+    if (Bucket < SubBucketCount) {
+        return Bucket;
+    }
+
+    return
+        (UINT64)(SubBucketCount + (Bucket & (SubBucketCount - 1))) <<
+            ((Bucket >> MINIPORT_LATENCY_SUB_BUCKET_BITS) - 1);
+}
+
+FNMPAPI
+FNMPAPI_STATUS
+FnMpGetLatencyHistogram(
+    _In_ FNMP_HANDLE Handle,
+    _In_ BOOLEAN Reset,
+    _Out_ MINIPORT_LATENCY_HISTOGRAM *Histogram
+    )
+{
+    MINIPORT_GET_LATENCY_HISTOGRAM_IN In = {0};
+
+    //
+    // Supports shared handles only. Returns the adapter's RX and TX NBL
+    // holding time histograms, optionally resetting them.
+    //
+
+    In.Flags.Reset = !!Reset;
+
+    return
+        FnIoctl(
+            Handle, FNMP_IOCTL_MINIPORT_GET_LATENCY_HISTOGRAM, &In, sizeof(In), Histogram,
+            sizeof(*Histogram), NULL, NULL);
+}
+
 FNMPAPI
 FNMPAPI_STATUS
 FnMpAllocatePort(
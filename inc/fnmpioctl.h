@@ -71,6 +71,12 @@ typedef struct _FNMP_OPEN_EXCLUSIVE {
     CTL_CODE(FILE_DEVICE_NETWORK, 17, METHOD_BUFFERED, FILE_WRITE_ACCESS)
 #define FNMP_IOCTL_TX_SET_FRAME \
     CTL_CODE(FILE_DEVICE_NETWORK, 18, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+#define FNMP_IOCTL_MINIPORT_SET_CHECKSUM_EMULATION \
+    CTL_CODE(FILE_DEVICE_NETWORK, 19, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+#define FNMP_IOCTL_MINIPORT_GET_CHECKSUM_COUNTERS \
+    CTL_CODE(FILE_DEVICE_NETWORK, 20, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+#define FNMP_IOCTL_MINIPORT_GET_LATENCY_HISTOGRAM \
+    CTL_CODE(FILE_DEVICE_NETWORK, 21, METHOD_BUFFERED, FILE_WRITE_ACCESS)
 
 //
 // Parameters for FNMP_IOCTL_MINIPORT_MTU.
@@ -151,4 +157,99 @@ typedef struct _MINIPORT_UPDATE_TASK_OFFLOAD_IN {
 // InputBufferLength: sizeof(NDIS_PORT_NUMBER)
 //
 
+//
+// Parameters for FNMP_IOCTL_MINIPORT_SET_CHECKSUM_EMULATION.
+//
+
+typedef struct _MINIPORT_SET_CHECKSUM_EMULATION_IN {
+    struct {
+        //
+        // Compute the checksums requested by each TX NBL's checksum offload
+        // info before the NBL is filtered or completed.
+        //
+        UINT32 Transmit : 1;
+
+        //
+        // Verify the checksums of each RX frame and replace its checksum
+        // offload info with the result, for each RX offload enabled on the
+        // miniport.
+        //
+        UINT32 Receive : 1;
+    } Flags;
+} MINIPORT_SET_CHECKSUM_EMULATION_IN;
+
+//
+// Parameters for FNMP_IOCTL_MINIPORT_GET_CHECKSUM_COUNTERS.
+//
+// OutputBuffer: MINIPORT_CHECKSUM_COUNTERS
+// OutputBufferLength: sizeof(MINIPORT_CHECKSUM_COUNTERS)
+//
+
+typedef struct _MINIPORT_CHECKSUM_PROTOCOL_COUNTERS {
+    UINT64 Transmit;
+    UINT64 ReceiveSucceeded;
+    UINT64 ReceiveFailed;
+} MINIPORT_CHECKSUM_PROTOCOL_COUNTERS;
+
+typedef struct _MINIPORT_CHECKSUM_COUNTERS {
+    MINIPORT_CHECKSUM_PROTOCOL_COUNTERS Ipv4;
+    MINIPORT_CHECKSUM_PROTOCOL_COUNTERS Tcp;
+    MINIPORT_CHECKSUM_PROTOCOL_COUNTERS Udp;
+
+    //
+    // Frames requesting emulation that could not be parsed, e.g. due to IPv6
+    // extension headers, truncated or malformed headers, or layer 4 lengths
+    // that overrun the frame. TX headers may span MDLs. Only the first NB of
+    // each RX NBL is checked.
+    //
+    UINT64 Unsupported;
+} MINIPORT_CHECKSUM_COUNTERS;
+
+//
+// Parameters for FNMP_IOCTL_MINIPORT_GET_LATENCY_HISTOGRAM.
+//
+// InputBuffer: MINIPORT_GET_LATENCY_HISTOGRAM_IN (optional)
+// InputBufferLength: sizeof(MINIPORT_GET_LATENCY_HISTOGRAM_IN) or 0
+// OutputBuffer: MINIPORT_LATENCY_HISTOGRAM
+// OutputBufferLength: sizeof(MINIPORT_LATENCY_HISTOGRAM)
+//
+
+typedef struct _MINIPORT_GET_LATENCY_HISTOGRAM_IN {
+    struct {
+        //
+        // Clear the histograms after they are read. Samples recorded
+        // concurrently with the reset may be lost.
+        //
+        UINT32 Reset : 1;
+    } Flags;
+} MINIPORT_GET_LATENCY_HISTOGRAM_IN;
+
+//
+// Latencies are recorded in nanoseconds into log-linear buckets: values below
+// 2^MINIPORT_LATENCY_SUB_BUCKET_BITS each have their own bucket, and every
+// larger power-of-two range is split into 2^MINIPORT_LATENCY_SUB_BUCKET_BITS
+// linear sub-buckets. Values beyond the range of the last bucket are recorded
+// in the last bucket.
+//
+#define MINIPORT_LATENCY_SUB_BUCKET_BITS 3
+#define MINIPORT_LATENCY_BUCKET_COUNT 256
+
+typedef struct _MINIPORT_LATENCY_HISTOGRAM_DIRECTION {
+    UINT64 Count;
+    UINT64 TotalNanoseconds;
+    UINT64 Buckets[MINIPORT_LATENCY_BUCKET_COUNT];
+} MINIPORT_LATENCY_HISTOGRAM_DIRECTION;
+
+typedef struct _MINIPORT_LATENCY_HISTOGRAM {
+    //
+    // Time from indicating an RX NBL to the stack returning it.
+    //
+    MINIPORT_LATENCY_HISTOGRAM_DIRECTION Receive;
+
+    //
+    // Time from the stack sending a TX NBL to fnmp completing it.
+    //
+    MINIPORT_LATENCY_HISTOGRAM_DIRECTION Transmit;
+} MINIPORT_LATENCY_HISTOGRAM;
+
 EXTERN_C_END
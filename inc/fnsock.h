@@ -111,12 +111,162 @@ EXTERN_C_START
 
 #endif
 
+/*
+ * WSAPoll event flags are defined in winsock2.h, which kernel mode callers do
+ * not include.
+ */
+#ifndef POLLRDNORM
+
+#define POLLRDNORM  0x0100
+#define POLLRDBAND  0x0200
+#define POLLIN      (POLLRDNORM | POLLRDBAND)
+#define POLLPRI     0x0400
+
+#define POLLWRNORM  0x0010
+#define POLLOUT     (POLLWRNORM)
+#define POLLWRBAND  0x0020
+
+#define POLLERR     0x0001
+#define POLLHUP     0x0002
+#define POLLNVAL    0x0004
+
+#endif
+
 #ifndef FNSOCKAPI
 #define FNSOCKAPI __declspec(dllimport)
 #endif
 
 DECLARE_HANDLE(FNSOCK_HANDLE);
 
+//
+// FnSock specific socket options, used with FnSockGetSockOpt at the
+// FNSOCK_SOL_FNSOCK level.
+//
+#define FNSOCK_SOL_FNSOCK 0x464E
+
+//
+// Returns an FNSOCK_RECV_STATISTICS structure. User mode WinSock does not
+// expose per-socket drop counters, so user mode reports only queued bytes.
+// RetainedPackets counts the queued datagrams kernel mode holds in their WSK
+// indications rather than in copies.
+//
+#define FNSOCK_SO_RECV_STATISTICS 1
+
+typedef struct _FNSOCK_RECV_STATISTICS {
+    UINT64 QueuedBytes;
+    UINT64 DroppedPackets;
+    UINT64 DroppedBytes;
+    UINT64 RetainedPackets;
+} FNSOCK_RECV_STATISTICS;
+
+//
+// Returns an FNSOCK_SEND_STATISTICS structure. Kernel mode counts each fire and
+// forget send until it completes, and blocks new sends while MaxOutstandingSends
+// are in flight. User mode reports zeroes.
+//
+#define FNSOCK_SO_SEND_STATISTICS 2
+
+typedef struct _FNSOCK_SEND_STATISTICS {
+    UINT32 OutstandingSends;
+    UINT32 PeakOutstandingSends;
+    UINT32 MaxOutstandingSends;
+} FNSOCK_SEND_STATISTICS;
+
+//
+// Describes one datagram for FnSockSendMsgBatch and FnSockRecvMsgBatch.
+//
+typedef struct _FNSOCK_MSG {
+    CHAR* Buffer;
+    INT BufferLength;
+
+    //
+    // The destination address. Used for sends only.
+    //
+    const struct sockaddr* Address;
+    INT AddressLength;
+
+    //
+    // For receives, ControlBufferLength is updated to the length of the
+    // received control data.
+    //
+    CMSGHDR* ControlBuffer;
+    INT ControlBufferLength;
+
+    //
+    // For receives, the flags of the received datagram.
+    //
+    INT Flags;
+
+    //
+    // The number of bytes sent or received, or -1 if this message failed.
+    //
+    INT BytesTransferred;
+} FNSOCK_MSG;
+
+DECLARE_HANDLE(FNSOCK_COMPLETION_QUEUE);
+
+#define FNSOCK_INFINITE ((UINT32)-1)
+
+typedef enum _FNSOCK_OPERATION {
+    FnSockOperationSend,
+    FnSockOperationRecv,
+    FnSockOperationAccept,
+    FnSockOperationConnect,
+} FNSOCK_OPERATION;
+
+//
+// Describes one completed asynchronous operation.
+//
+typedef struct _FNSOCK_COMPLETION {
+    FNSOCK_HANDLE Socket;
+    FNSOCK_OPERATION Operation;
+
+    //
+    // The caller context passed when the operation was posted.
+    //
+    VOID* Context;
+
+    //
+    // Zero on success, otherwise a WinSock error code.
+    //
+    INT Error;
+
+    //
+    // The number of bytes sent or received. Zero for accepts and connects.
+    //
+    INT BytesTransferred;
+
+    //
+    // For successful accepts, the accepted socket. The caller owns it.
+    //
+    FNSOCK_HANDLE AcceptedSocket;
+} FNSOCK_COMPLETION;
+
+//
+// Describes one socket for FnSockPoll. The layout matches WSAPOLLFD.
+//
+typedef struct _FNSOCK_POLL_FD {
+    FNSOCK_HANDLE Socket;
+    SHORT Events;
+    SHORT ReturnedEvents;
+} FNSOCK_POLL_FD;
+
+DECLARE_HANDLE(FNSOCK_RIO_HANDLE);
+
+typedef struct _FNSOCK_RIO_CONFIG {
+    //
+    // The size of each registered buffer, i.e. the largest datagram that can
+    // be sent or received.
+    //
+    UINT32 BufferSize;
+
+    //
+    // The number of registered buffers for outstanding sends and receives.
+    //
+    UINT32 SendBufferCount;
+    UINT32 RecvBufferCount;
+} FNSOCK_RIO_CONFIG;
+
 FNSOCKAPI
 PAGEDX
 _IRQL_requires_max_(PASSIVE_LEVEL)
@@ -291,6 +441,281 @@ FnSockRecvMsg(
     _In_ INT *Flags
     );
 
+//
+// Sends up to MessageCount datagrams, stopping at the first failure. Returns
+// the number of datagrams sent, or -1 if the first datagram failed. WSK sends
+// take no flags, so kernel mode fails the batch if Flags is non-zero.
+//
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockSendMsgBatch(
+    _In_ FNSOCK_HANDLE Socket,
+    _Inout_updates_(MessageCount) FNSOCK_MSG* Messages,
+    _In_ INT MessageCount,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _In_ INT Flags
+    );
+
+//
+// Waits for at least one datagram, then receives up to MessageCount datagrams
+// that are already queued without blocking further. Returns the number of
+// messages consumed, or -1 on failure. A datagram that could not be received
+// into its message, e.g. because the buffer is too small, is still consumed
+// and reports BytesTransferred == -1.
+//
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockRecvMsgBatch(
+    _In_ FNSOCK_HANDLE Socket,
+    _Inout_updates_(MessageCount) FNSOCK_MSG* Messages,
+    _In_ INT MessageCount,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _In_ INT Flags
+    );
+
+//
+// Sends Buffer as a single UDP super-buffer that the stack segments into
+// datagrams of SegmentSize bytes each (the last may be shorter), by attaching
+// UDP_SEND_MSG_SIZE control data. Returns BufferLength on success, or -1 on
+// failure; WSAEINVAL indicates the platform does not support segmentation.
+//
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockSendSegments(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_reads_bytes_(BufferLength) const CHAR* Buffer,
+    _In_ INT BufferLength,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _In_ INT Flags,
+    _In_reads_bytes_(AddressLength) const struct sockaddr* Address,
+    _In_ INT AddressLength,
+    _In_ UINT32 SegmentSize
+    );
+
+//
+// Parses control data returned by FnSockRecvMsg. If the received buffer was
+// coalesced from multiple datagrams (enabled via the IPPROTO_UDP
+// UDP_RECV_MAX_COALESCED_SIZE socket option), returns TRUE and the size of
+// each coalesced datagram (the last may be shorter).
+//
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+BOOLEAN
+FnSockGetCoalescedInfo(
+    _In_reads_bytes_(ControlBufferLength) const CMSGHDR* ControlBuffer,
+    _In_ INT ControlBufferLength,
+    _Out_ UINT32* SegmentSize
+    );
+
+//
+// Creates a completion queue for asynchronous socket operations. User mode is
+// backed by an I/O completion port; kernel mode queues sockets as they become
+// ready and completes their operations when the queue is drained.
+//
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockCreateCompletionQueue(
+    _Out_ FNSOCK_COMPLETION_QUEUE* Queue
+    );
+
+//
+// Closes a completion queue. All sockets associated with the queue must be
+// closed and their completions drained first.
+//
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+FnSockCloseCompletionQueue(
+    _In_ FNSOCK_COMPLETION_QUEUE Queue
+    );
+
+//
+// Associates a socket with a completion queue. A socket can be associated
+// with at most one queue, and must be associated before posting asynchronous
+// operations.
+//
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockAssociateCompletionQueue(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_ FNSOCK_COMPLETION_QUEUE Queue
+    );
+
+//
+// Posts an asynchronous send on a connected socket. The buffer must remain
+// valid until the operation completes.
+//
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockSendAsync(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_reads_bytes_(BufferLength) const CHAR* Buffer,
+    _In_ INT BufferLength,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _In_ INT Flags,
+    _In_opt_ VOID* Context
+    );
+
+//
+// Posts an asynchronous receive. Receives complete in the order they were
+// posted; stream receives complete with whatever data is available and with
+// zero bytes once the peer has disconnected. The buffer must remain valid
+// until the operation completes.
+//
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockRecvAsync(
+    _In_ FNSOCK_HANDLE Socket,
+    _Out_writes_bytes_(BufferLength) CHAR* Buffer,
+    _In_ INT BufferLength,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _In_ INT Flags,
+    _In_opt_ VOID* Context
+    );
+
+//
+// Posts an asynchronous accept on a listening socket.
+//
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockAcceptAsync(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_opt_ VOID* Context
+    );
+
+//
+// Posts an asynchronous connect on a stream socket, binding it to the
+// wildcard address first if it is not bound.
+//
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockConnectAsync(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_reads_bytes_(AddressLength) const struct sockaddr* Address,
+    _In_ INT AddressLength,
+    _In_opt_ VOID* Context
+    );
+
+//
+// Dequeues up to MaxCount completed operations, waiting up to TimeoutMs for
+// the first one. Returns the number of completions, zero on timeout, or -1 on
+// failure. Operations still pending when their socket is closed complete with
+// a nonzero Error.
+//
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockGetCompletions(
+    _In_ FNSOCK_COMPLETION_QUEUE Queue,
+    _Out_writes_to_(MaxCount, return) FNSOCK_COMPLETION* Completions,
+    _In_ INT MaxCount,
+    _In_ UINT32 TimeoutMs
+    );
+
+//
+// Waits until at least one socket is ready for the requested POLLIN or
+// POLLOUT events, with WSAPoll semantics: POLLHUP and POLLERR are always
+// reported, and a negative TimeoutMs waits indefinitely. Returns the number
+// of sockets with returned events, zero on timeout, or -1 on failure. Waiting
+// indefinitely without any sockets fails with WSAEINVAL.
+//
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockPoll(
+    _Inout_updates_(FdCount) FNSOCK_POLL_FD* Fds,
+    _In_ UINT32 FdCount,
+    _In_ INT TimeoutMs
+    );
+
+//
+// Registered I/O datagram sockets. User mode implements these on Winsock
+// Registered I/O: data is copied through a pool of preregistered buffers and
+// submitted and completed in batches, avoiding per-call buffer probing and
+// locking. Kernel mode has no registered I/O, so it implements the same API by
+// copying sends through a region of send buffers registered with WSK once, and
+// receiving on the regular batch path, letting one test source run in both
+// modes.
+//
+// A registered I/O socket must not be used by more than one thread at a time.
+//
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockRioCreate(
+    _In_ INT AddressFamily,
+    _In_ INT SocketType,
+    _In_ INT Protocol,
+    _In_ const FNSOCK_RIO_CONFIG* Config,
+    _Out_ FNSOCK_RIO_HANDLE* Socket
+    );
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+FnSockRioClose(
+    _In_ FNSOCK_RIO_HANDLE Socket
+    );
+
+//
+// Returns the underlying socket, e.g. for FnSockGetSockName or
+// FnSockSetSockOpt. The returned handle must not be closed or used for data.
+//
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_HANDLE
+FnSockRioGetSocket(
+    _In_ FNSOCK_RIO_HANDLE Socket
+    );
+
+//
+// Binds the socket and posts its receive buffers.
+//
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockRioBind(
+    _In_ FNSOCK_RIO_HANDLE Socket,
+    _In_reads_bytes_(AddressLength) const struct sockaddr* Address,
+    _In_ INT AddressLength
+    );
+
+//
+// Has the same semantics as FnSockSendMsgBatch, except that control data is
+// not supported. Blocks while all send buffers are in use. Kernel mode also
+// requires a non-empty payload for each datagram.
+//
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockRioSendBatch(
+    _In_ FNSOCK_RIO_HANDLE Socket,
+    _Inout_updates_(MessageCount) FNSOCK_MSG* Messages,
+    _In_ INT MessageCount
+    );
+
+//
+// Has the same semantics as FnSockRecvMsgBatch, including the SO_RCVTIMEO
+// timeout, except that control data is not supported.
+//
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockRioRecvBatch(
+    _In_ FNSOCK_RIO_HANDLE Socket,
+    _Inout_updates_(MessageCount) FNSOCK_MSG* Messages,
+    _In_ INT MessageCount
+    );
+
 FNSOCKAPI
 _IRQL_requires_max_(PASSIVE_LEVEL)
 INT
@@ -10,38 +10,372 @@
 
 EXTERN_C_START
 
+#define ISR_POOLTAG_OUTPUT 'OrsI' // IsrO
+#define ISR_POOLTAG_BATCH 'BrsI' // IsrB
+#define ISR_POOLTAG_ASYNC 'ArsI' // IsrA
+
+//
+// A client handle, which can be reused for any number of requests, including
+// concurrent ones.
+//
+typedef struct _ISR_CLIENT {
+    FNIOCTL_HANDLE Handle;
+    FILE_OBJECT *FileObject;
+} ISR_CLIENT;
+
 inline
-INT
-InvokeSystemRelay(
-    _In_z_ const CHAR *Command
+NTSTATUS
+IsrClientOpen(
+    _Out_ ISR_CLIENT *Client
     )
 {
-    INT Result = -1;
     NTSTATUS Status;
-    FNIOCTL_HANDLE Handle = NULL;
     ISR_OPEN_CLIENT *OpenClient;
     CHAR EaBuffer[ISR_OPEN_EA_LENGTH + sizeof(*OpenClient)];
 
+    RtlZeroMemory(Client, sizeof(*Client));
+
     OpenClient =
         (ISR_OPEN_CLIENT *)
             IsrInitializeEa(ISR_FILE_TYPE_CLIENT, EaBuffer, sizeof(EaBuffer));
 
     Status =
         FnIoctlOpen(
-            ISR_DEVICE_NAME, FILE_CREATE, EaBuffer, sizeof(EaBuffer), &Handle);
+            ISR_DEVICE_NAME, FILE_CREATE, EaBuffer, sizeof(EaBuffer), &Client->Handle);
+    if (!NT_SUCCESS(Status)) {
+        Client->Handle = NULL;
+        goto Exit;
+    }
+
+    //
+    // Asynchronous requests are sent directly to the file object.
+    //
+    Status =
+        ObReferenceObjectByHandle(
+            Client->Handle, 0, *IoFileObjectType, KernelMode,
+            (VOID **)&Client->FileObject, NULL);
+    if (!NT_SUCCESS(Status)) {
+        Client->FileObject = NULL;
+        goto Exit;
+    }
+
+Exit:
+
     if (!NT_SUCCESS(Status)) {
+        if (Client->Handle != NULL) {
+            FnIoctlClose(Client->Handle);
+            Client->Handle = NULL;
+        }
+    }
+
+    return Status;
+}
+
+//
+// Closes a client handle. Asynchronous requests may still complete afterwards.
+//
+inline
+VOID
+IsrClientClose(
+    _In_ ISR_CLIENT *Client
+    )
+{
+    if (Client->FileObject != NULL) {
+        ObDereferenceObject(Client->FileObject);
+        Client->FileObject = NULL;
+    }
+
+    if (Client->Handle != NULL) {
+        FnIoctlClose(Client->Handle);
+        Client->Handle = NULL;
+    }
+}
+
+//
+// Invokes a command and returns its exit code, or -1 on failure.
+//
+inline
+INT
+IsrClientInvoke(
+    _In_ ISR_CLIENT *Client,
+    _In_z_ const CHAR *Command
+    )
+{
+    INT Result = -1;
+
+    FnIoctl(
+        Client->Handle, ISR_IOCTL_INVOKE_SYSTEM_SUBMIT, (VOID *)Command,
+        (UINT32)strlen(Command) + 1, &Result, sizeof(Result), NULL, NULL);
+
+    return Result;
+}
+
+//
+// Invokes a batch of commands, either all in parallel or one at a time in
+// order, and returns each command's exit code, or -1 if it failed to run.
+//
+inline
+NTSTATUS
+IsrClientInvokeBatch(
+    _In_ ISR_CLIENT *Client,
+    _In_reads_(CommandCount) const CHAR *const *Commands,
+    _In_ UINT32 CommandCount,
+    _In_ BOOLEAN Ordered,
+    _Out_writes_(CommandCount) INT *Results
+    )
+{
+    NTSTATUS Status;
+    ISR_SUBMIT_BATCH_INPUT *Input = NULL;
+    SIZE_T InputSize = FIELD_OFFSET(ISR_SUBMIT_BATCH_INPUT, Commands);
+    CHAR *Command;
+
+    for (UINT32 Index = 0; Index < CommandCount; Index++) {
+        Results[Index] = -1;
+        InputSize += strlen(Commands[Index]) + 1;
+    }
+
+    Input =
+        (ISR_SUBMIT_BATCH_INPUT *)
+            ExAllocatePoolZero(NonPagedPoolNx, InputSize, ISR_POOLTAG_BATCH);
+    if (Input == NULL) {
+        Status = STATUS_NO_MEMORY;
         goto Exit;
     }
 
+    Input->Flags = Ordered ? ISR_BATCH_FLAG_ORDERED : 0;
+    Input->CommandCount = CommandCount;
+
+    Command = Input->Commands;
+    for (UINT32 Index = 0; Index < CommandCount; Index++) {
+        SIZE_T CommandSize = strlen(Commands[Index]) + 1;
+        RtlCopyMemory(Command, Commands[Index], CommandSize);
+        Command += CommandSize;
+    }
+
     Status =
         FnIoctl(
-            Handle, ISR_IOCTL_INVOKE_SYSTEM_SUBMIT, (VOID *)Command,
-            (UINT32)strlen(Command) + 1, &Result, sizeof(Result), NULL, NULL);
+            Client->Handle, ISR_IOCTL_INVOKE_SYSTEM_SUBMIT_BATCH, Input, (UINT32)InputSize,
+            Results, CommandCount * sizeof(*Results), NULL, NULL);
 
 Exit:
 
-    if (Handle != NULL) {
-        FnIoctlClose(Handle);
+    if (Input != NULL) {
+        ExFreePoolWithTag(Input, ISR_POOLTAG_BATCH);
+    }
+
+    return Status;
+}
+
+//
+// Notifies the caller of an asynchronous command's exit code, or -1 if it
+// failed to run.
+//
+typedef
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+ISR_INVOKE_COMPLETE_FN(
+    _In_opt_ VOID *Context,
+    _In_ INT Result
+    );
+
+typedef struct _ISR_ASYNC_INVOKE {
+    ISR_INVOKE_COMPLETE_FN *CompleteFn;
+    VOID *Context;
+    FILE_OBJECT *FileObject;
+
+    //
+    // The system buffer, holding the command and then its result.
+    //
+    DECLSPEC_ALIGN(8) CHAR Buffer[ANYSIZE_ARRAY];
+} ISR_ASYNC_INVOKE;
+
+_Function_class_(IO_COMPLETION_ROUTINE)
+inline
+NTSTATUS
+IsrClientInvokeAsyncComplete(
+    _In_ DEVICE_OBJECT *DeviceObject,
+    _In_ IRP *Irp,
+    _In_reads_opt_(_Inexpressible_("varies")) VOID *Context
+    )
+{
+    ISR_ASYNC_INVOKE *Async = (ISR_ASYNC_INVOKE *)Context;
+    INT Result = -1;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    if (NT_SUCCESS(Irp->IoStatus.Status) && Irp->IoStatus.Information >= sizeof(Result)) {
+        Result = *(INT *)Async->Buffer;
+    }
+
+    Async->CompleteFn(Async->Context, Result);
+
+    IoFreeIrp(Irp);
+    ObDereferenceObject(Async->FileObject);
+    ExFreePoolWithTag(Async, ISR_POOLTAG_ASYNC);
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+//
+// Invokes a command without waiting for it. If this succeeds, the completion
+// function is invoked exactly once, possibly before this returns.
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+inline
+NTSTATUS
+IsrClientInvokeAsync(
+    _In_ ISR_CLIENT *Client,
+    _In_z_ const CHAR *Command,
+    _In_ ISR_INVOKE_COMPLETE_FN *CompleteFn,
+    _In_opt_ VOID *Context
+    )
+{
+    NTSTATUS Status;
+    ISR_ASYNC_INVOKE *Async = NULL;
+    DEVICE_OBJECT *DeviceObject = IoGetRelatedDeviceObject(Client->FileObject);
+    IRP *Irp = NULL;
+    IO_STACK_LOCATION *IrpSp;
+    UINT32 CommandSize = (UINT32)strlen(Command) + 1;
+    UINT32 BufferSize = max(CommandSize, sizeof(INT));
+
+    if (CommandSize > ISR_MAX_COMMAND_LENGTH) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Async =
+        (ISR_ASYNC_INVOKE *)
+            ExAllocatePoolZero(
+                NonPagedPoolNx, FIELD_OFFSET(ISR_ASYNC_INVOKE, Buffer) + BufferSize,
+                ISR_POOLTAG_ASYNC);
+    if (Async == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    Async->CompleteFn = CompleteFn;
+    Async->Context = Context;
+    Async->FileObject = Client->FileObject;
+    RtlCopyMemory(Async->Buffer, Command, CommandSize);
+
+    Irp = IoAllocateIrp(DeviceObject->StackSize, FALSE);
+    if (Irp == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    Irp->RequestorMode = KernelMode;
+    Irp->Tail.Overlay.Thread = PsGetCurrentThread();
+    Irp->Tail.Overlay.OriginalFileObject = Client->FileObject;
+    Irp->AssociatedIrp.SystemBuffer = Async->Buffer;
+
+    IrpSp = IoGetNextIrpStackLocation(Irp);
+    IrpSp->MajorFunction = IRP_MJ_DEVICE_CONTROL;
+    IrpSp->FileObject = Client->FileObject;
+    IrpSp->Parameters.DeviceIoControl.IoControlCode = ISR_IOCTL_INVOKE_SYSTEM_SUBMIT;
+    IrpSp->Parameters.DeviceIoControl.InputBufferLength = CommandSize;
+    IrpSp->Parameters.DeviceIoControl.OutputBufferLength = sizeof(INT);
+
+    IoSetCompletionRoutine(Irp, IsrClientInvokeAsyncComplete, Async, TRUE, TRUE, TRUE);
+
+    //
+    // Keep the file object alive until the request completes, since the IRP
+    // does not reference it.
+    //
+    ObReferenceObject(Client->FileObject);
+    IoCallDriver(DeviceObject, Irp);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        if (Async != NULL) {
+            ExFreePoolWithTag(Async, ISR_POOLTAG_ASYNC);
+        }
+    }
+
+    return Status;
+}
+
+inline
+INT
+InvokeSystemRelay(
+    _In_z_ const CHAR *Command
+    )
+{
+    INT Result = -1;
+    ISR_CLIENT Client;
+
+    if (NT_SUCCESS(IsrClientOpen(&Client))) {
+        Result = IsrClientInvoke(&Client, Command);
+        IsrClientClose(&Client);
+    }
+
+    return Result;
+}
+
+//
+// Invokes a command and captures up to OutputSize bytes of its combined
+// stdout and stderr, bounded by ISR_MAX_OUTPUT_LENGTH. The output is not
+// null-terminated. Returns the command's exit code, or -1 on failure.
+//
+inline
+INT
+InvokeSystemRelayWithOutput(
+    _In_z_ const CHAR *Command,
+    _Out_writes_bytes_to_(OutputSize, *OutputLength) CHAR *Output,
+    _In_ UINT32 OutputSize,
+    _Out_ UINT32 *OutputLength,
+    _Out_opt_ BOOLEAN *OutputTruncated
+    )
+{
+    INT Result = -1;
+    NTSTATUS Status;
+    ISR_CLIENT Client = {0};
+    ISR_SUBMIT_CAPTURE_OUTPUT *Capture = NULL;
+    UINT32 CaptureSize;
+
+    *OutputLength = 0;
+    if (OutputTruncated != NULL) {
+        *OutputTruncated = FALSE;
+    }
+
+    OutputSize = min(OutputSize, ISR_MAX_OUTPUT_LENGTH);
+    CaptureSize = FIELD_OFFSET(ISR_SUBMIT_CAPTURE_OUTPUT, Output) + OutputSize;
+
+    Capture =
+        (ISR_SUBMIT_CAPTURE_OUTPUT *)
+            ExAllocatePoolZero(NonPagedPoolNx, CaptureSize, ISR_POOLTAG_OUTPUT);
+    if (Capture == NULL) {
+        goto Exit;
+    }
+
+    Status = IsrClientOpen(&Client);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status =
+        FnIoctl(
+            Client.Handle, ISR_IOCTL_INVOKE_SYSTEM_SUBMIT_CAPTURE, (VOID *)Command,
+            (UINT32)strlen(Command) + 1, Capture, CaptureSize, NULL, NULL);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    *OutputLength = min(Capture->OutputLength, OutputSize);
+    RtlCopyMemory(Output, Capture->Output, *OutputLength);
+    if (OutputTruncated != NULL) {
+        *OutputTruncated = !!(Capture->OutputFlags & ISR_OUTPUT_FLAG_TRUNCATED);
+    }
+    Result = Capture->Result;
+
+Exit:
+
+    IsrClientClose(&Client);
+
+    if (Capture != NULL) {
+        ExFreePoolWithTag(Capture, ISR_POOLTAG_OUTPUT);
     }
 
     return Result;
@@ -39,16 +39,64 @@ typedef struct _ISR_OPEN_SERVICE {
 //
 #define ISR_MAX_COMMAND_LENGTH 1024
 
+//
+// The maximum number of bytes of combined stdout and stderr captured for a
+// single command, and the maximum number of bytes posted per output chunk.
+//
+#define ISR_MAX_OUTPUT_LENGTH (64 * 1024)
+#define ISR_MAX_OUTPUT_CHUNK_LENGTH 4096
+
+//
+// The command's output should be captured and posted.
+//
+#define ISR_GET_FLAG_CAPTURE_OUTPUT 0x1
+
 typedef struct _ISR_GET_OUTPUT {
     UINT64 Id;
+    UINT32 Flags;
     CHAR Command[ISR_MAX_COMMAND_LENGTH];
 } ISR_GET_OUTPUT;
 
+//
+// Some of the command's output was dropped.
+//
+#define ISR_OUTPUT_FLAG_TRUNCATED 0x1
+
 typedef struct _ISR_POST_INPUT {
     UINT64 Id;
     INT Result;
+    UINT32 OutputFlags;
 } ISR_POST_INPUT;
 
+typedef struct _ISR_POST_OUTPUT_INPUT {
+    UINT64 Id;
+    CHAR Data[ISR_MAX_OUTPUT_CHUNK_LENGTH];
+} ISR_POST_OUTPUT_INPUT;
+
+#define ISR_MAX_BATCH_COMMAND_COUNT 256
+
+//
+// Run the batch's commands one at a time, in order, rather than in parallel.
+//
+#define ISR_BATCH_FLAG_ORDERED 0x1
+
+typedef struct _ISR_SUBMIT_BATCH_INPUT {
+    UINT32 Flags;
+    UINT32 CommandCount;
+
+    //
+    // CommandCount null-terminated commands, packed back to back.
+    //
+    CHAR Commands[ANYSIZE_ARRAY];
+} ISR_SUBMIT_BATCH_INPUT;
+
+typedef struct _ISR_SUBMIT_CAPTURE_OUTPUT {
+    INT Result;
+    UINT32 OutputFlags;
+    UINT32 OutputLength;
+    CHAR Output[ANYSIZE_ARRAY];
+} ISR_SUBMIT_CAPTURE_OUTPUT;
+
 //
 // Issued by kernel mode clients to enqueue an invoke system request.
 // The request is processed asynchronously and the result is returned upon completion.
@@ -83,6 +131,41 @@ typedef struct _ISR_POST_INPUT {
 #define ISR_IOCTL_INVOKE_SYSTEM_POST \
     CTL_CODE(FILE_DEVICE_NETWORK, 3, METHOD_BUFFERED, FILE_WRITE_ACCESS)
 
+//
+// Issued by kernel mode clients to enqueue an invoke system request and capture
+// the command's stdout and stderr. The captured output is bounded by both the
+// output buffer and ISR_MAX_OUTPUT_LENGTH.
+// Asynchronous.
+//
+// Input: char *Command
+// Output: ISR_SUBMIT_CAPTURE_OUTPUT, followed by up to OutputLength bytes.
+//
+#define ISR_IOCTL_INVOKE_SYSTEM_SUBMIT_CAPTURE \
+    CTL_CODE(FILE_DEVICE_NETWORK, 4, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
+//
+// Issued by invokesystemrelay user mode service to stream a chunk of captured
+// output for an invoke system request, before posting its result.
+// Synchronous.
+//
+// Input: ISR_POST_OUTPUT_INPUT, truncated to the chunk's length.
+// Output: None
+//
+#define ISR_IOCTL_INVOKE_SYSTEM_POST_OUTPUT \
+    CTL_CODE(FILE_DEVICE_NETWORK, 5, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
+//
+// Issued by kernel mode clients to enqueue a batch of invoke system requests,
+// either all at once or one at a time in order. Completes when every command
+// has completed. A command that could not be submitted has a result of -1.
+// Asynchronous.
+//
+// Input: ISR_SUBMIT_BATCH_INPUT
+// Output: int Results[CommandCount]
+//
+#define ISR_IOCTL_INVOKE_SYSTEM_SUBMIT_BATCH \
+    CTL_CODE(FILE_DEVICE_NETWORK, 6, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
 //
 // Helpers for opening handles.
 //
@@ -574,6 +574,478 @@ PktBuildQuicPacket(
             SrcConnIdLength, Payload, PayloadLength);
 }
 
+//
+// Descriptor for one QUIC packet within a coalesced datagram.
+//
+typedef struct _PKT_QUIC_PACKET {
+    UINT8 TypeAndSpecificBits;
+    BOOLEAN UseShortHeader;
+    UINT8 DestConnIdLength;
+    UINT8 SrcConnIdLength;
+    CONST UCHAR *DestConnId;
+    CONST UCHAR *SrcConnId;
+    CONST UCHAR *Payload;
+    UINT16 PayloadLength;
+} PKT_QUIC_PACKET;
+
+#define QUIC_VARINT_2_MAX 0x3FFF
+
+//
+// Build a UDP payload containing multiple QUIC v1 packets coalesced into a
+// single datagram (RFC 9000 section 12.2). Unlike PktBuildQuicPacket, long
+// header packets carry a two-byte Length field after the connection IDs so the
+// receiver can find the next packet. Only the last packet may use a short
+// header, since a short header packet extends to the end of the datagram.
+//
+inline
+_Success_(return != FALSE)
+BOOLEAN
+PktBuildQuicCoalescedPackets(
+    _Out_writes_bytes_(*BufferSize) VOID *Buffer,
+    _Inout_ UINT32 *BufferSize,
+    _In_reads_(PacketCount) CONST PKT_QUIC_PACKET *Packets,
+    _In_ UINT32 PacketCount
+    )
+{
+    UINT8 *Cursor = (UINT8 *)Buffer;
+    CONST UINT32 Version = 1;
+    UINT32 TotalLength = 0;
+
+    if (PacketCount == 0) {
+        return FALSE;
+    }
+
+    for (UINT32 Index = 0; Index < PacketCount; Index++) {
+        CONST PKT_QUIC_PACKET *Packet = &Packets[Index];
+
+        if (Packet->UseShortHeader) {
+            if (Index != PacketCount - 1) {
+                return FALSE;
+            }
+
+            TotalLength += sizeof(UINT8) + Packet->DestConnIdLength + Packet->PayloadLength;
+        } else {
+            if (Packet->PayloadLength > QUIC_VARINT_2_MAX) {
+                return FALSE;
+            }
+
+            TotalLength +=
+                sizeof(UINT8) + sizeof(Version) + sizeof(Packet->DestConnIdLength) +
+                Packet->DestConnIdLength + sizeof(Packet->SrcConnIdLength) +
+                Packet->SrcConnIdLength + sizeof(UINT16) + Packet->PayloadLength;
+        }
+    }
+
+    if (*BufferSize < TotalLength || TotalLength > MAXUINT16) {
+        return FALSE;
+    }
+
+    for (UINT32 Index = 0; Index < PacketCount; Index++) {
+        CONST PKT_QUIC_PACKET *Packet = &Packets[Index];
+        UINT32 PacketLength = (UINT32)(((UINT8 *)Buffer + TotalLength) - Cursor);
+
+        if (Packet->UseShortHeader) {
+            if (!PktBuildQuicPacketShortHeader(
+                    Cursor, &PacketLength, Packet->TypeAndSpecificBits, Packet->DestConnId,
+                    Packet->DestConnIdLength, Packet->Payload, Packet->PayloadLength)) {
+                return FALSE;
+            }
+
+            Cursor += PacketLength;
+            continue;
+        }
+
+        //
+        // Set the Header Form bit to 1 for a long header, and Fixed bit to 1
+        //
+        *Cursor++ = 0xC0 | (0x3F & Packet->TypeAndSpecificBits);
+
+        RtlCopyMemory(Cursor, &Version, sizeof(Version));
+        Cursor += sizeof(Version);
+
+        *Cursor++ = Packet->DestConnIdLength;
+        RtlCopyMemory(Cursor, Packet->DestConnId, Packet->DestConnIdLength);
+        Cursor += Packet->DestConnIdLength;
+
+        *Cursor++ = Packet->SrcConnIdLength;
+        RtlCopyMemory(Cursor, Packet->SrcConnId, Packet->SrcConnIdLength);
+        Cursor += Packet->SrcConnIdLength;
+
+        //
+        // Two-byte variable-length integer encoding of the payload length.
+        //
+        *Cursor++ = (UINT8)(0x40 | (Packet->PayloadLength >> 8));
+        *Cursor++ = (UINT8)Packet->PayloadLength;
+
+        if (Packet->Payload != NULL) {
+            RtlCopyMemory(Cursor, Packet->Payload, Packet->PayloadLength);
+        }
+        Cursor += Packet->PayloadLength;
+    }
+
+    *BufferSize = TotalLength;
+    return TRUE;
+}
+
+//
+// Split a datagram built by PktBuildQuicCoalescedPackets. On input, *Offset is
+// the offset of the next packet within the datagram; on success, the packet
+// and its payload are returned and *Offset is advanced past the packet.
+//
+inline
+_Success_(return != FALSE)
+BOOLEAN
+PktParseQuicCoalescedPacket(
+    _In_reads_bytes_(DatagramLength) CONST UCHAR *Datagram,
+    _In_ UINT32 DatagramLength,
+    _In_ UINT8 DestConnIdLength,
+    _Inout_ UINT32 *Offset,
+    _Out_ PKT_QUIC_PACKET *Packet
+    )
+{
+    CONST UCHAR *Cursor;
+    CONST UCHAR *End = Datagram + DatagramLength;
+
+    if (*Offset >= DatagramLength) {
+        return FALSE;
+    }
+
+    Cursor = Datagram + *Offset;
+    RtlZeroMemory(Packet, sizeof(*Packet));
+    Packet->TypeAndSpecificBits = *Cursor & 0x3F;
+
+    if ((*Cursor++ & 0x80) == 0) {
+        //
+        // Short header packets carry no connection ID length, so the caller
+        // supplies the length it negotiated.
+        //
+        if ((UINT32)(End - Cursor) < DestConnIdLength) {
+            return FALSE;
+        }
+
+        if ((UINT32)(End - Cursor) - DestConnIdLength > MAXUINT16) {
+            return FALSE;
+        }
+
+        Packet->UseShortHeader = TRUE;
+        Packet->DestConnIdLength = DestConnIdLength;
+        Packet->DestConnId = Cursor;
+        Cursor += DestConnIdLength;
+        Packet->Payload = Cursor;
+        Packet->PayloadLength = (UINT16)(End - Cursor);
+        *Offset = DatagramLength;
+        return TRUE;
+    }
+
+    if ((UINT32)(End - Cursor) < sizeof(UINT32) + sizeof(UINT8)) {
+        return FALSE;
+    }
+    Cursor += sizeof(UINT32);
+
+    Packet->DestConnIdLength = *Cursor++;
+    if ((UINT32)(End - Cursor) < Packet->DestConnIdLength + sizeof(UINT8)) {
+        return FALSE;
+    }
+    Packet->DestConnId = Cursor;
+    Cursor += Packet->DestConnIdLength;
+
+    Packet->SrcConnIdLength = *Cursor++;
+    if ((UINT32)(End - Cursor) < Packet->SrcConnIdLength + sizeof(UINT16)) {
+        return FALSE;
+    }
+    Packet->SrcConnId = Cursor;
+    Cursor += Packet->SrcConnIdLength;
+
+    if ((Cursor[0] & 0xC0) != 0x40) {
+        return FALSE;
+    }
+    Packet->PayloadLength = (UINT16)(((Cursor[0] & 0x3F) << 8) | Cursor[1]);
+    Cursor += sizeof(UINT16);
+
+    if ((UINT32)(End - Cursor) < Packet->PayloadLength) {
+        return FALSE;
+    }
+    Packet->Payload = Cursor;
+    Cursor += Packet->PayloadLength;
+
+    *Offset = (UINT32)(Cursor - Datagram);
+    return TRUE;
+}
+
+//
+// Returns the number of datagrams a UDP segmentation offload sender emits for
+// the given payload: N full segments plus a trailing short segment, if any.
+//
+inline
+UINT32
+PktUdpSegmentCount(
+    _In_ UINT32 PayloadLength,
+    _In_ UINT32 SegmentSize
+    )
+{
+    if (SegmentSize == 0) {
+        return 0;
+    }
+
+    return (PayloadLength + SegmentSize - 1) / SegmentSize;
+}
+
+//
+// Build a UDP super-frame: a single set of Ethernet, IP and UDP headers
+// followed by PayloadLength bytes, to be sent with USO (or GSO) metadata
+// carrying SegmentSize. As with LSO, the IP and UDP length fields describe the
+// whole super-frame when it fits and are zero otherwise, and the UDP checksum
+// field is seeded with the pseudo-header checksum excluding the length so the
+// segmenter can complete it per segment.
+//
+inline
+_Success_(return != FALSE)
+BOOLEAN
+PktBuildUdpSuperFrame(
+    _Out_ VOID *Buffer,
+    _Inout_ UINT32 *BufferSize,
+    _In_ CONST UCHAR *Payload,
+    _In_ UINT32 PayloadLength,
+    _In_ UINT16 SegmentSize,
+    _In_ CONST ETHERNET_ADDRESS *EthernetDestination,
+    _In_ CONST ETHERNET_ADDRESS *EthernetSource,
+    _In_ ADDRESS_FAMILY AddressFamily,
+    _In_ CONST VOID *IpDestination,
+    _In_ CONST VOID *IpSource,
+    _In_ UINT16 PortDestination,
+    _In_ UINT16 PortSource
+    )
+{
+    CONST UINT32 HeaderLength = UDP_HEADER_BACKFILL(AddressFamily);
+    CONST UINT32 UdpLength = sizeof(UDP_HDR) + PayloadLength;
+    UINT32 IpLength;
+    UINT8 AddressLength;
+
+    if (SegmentSize == 0 || PayloadLength == 0 ||
+        PayloadLength > MAXUINT32 - HeaderLength ||
+        *BufferSize < HeaderLength + PayloadLength) {
+        return FALSE;
+    }
+
+    ETHERNET_HEADER *EthernetHeader = (ETHERNET_HEADER *)Buffer;
+    EthernetHeader->Destination = *EthernetDestination;
+    EthernetHeader->Source = *EthernetSource;
+    EthernetHeader->Type =
+        htons(AddressFamily == AF_INET ? ETHERNET_TYPE_IPV4 : ETHERNET_TYPE_IPV6);
+    Buffer = EthernetHeader + 1;
+
+    if (AddressFamily == AF_INET) {
+        IPV4_HEADER *IpHeader = (IPV4_HEADER *)Buffer;
+
+        IpLength = sizeof(*IpHeader) + UdpLength;
+        RtlZeroMemory(IpHeader, sizeof(*IpHeader));
+        IpHeader->Version = IPV4_VERSION;
+        IpHeader->HeaderLength = sizeof(*IpHeader) >> 2;
+        IpHeader->TotalLength = IpLength > MAXUINT16 ? 0 : htons((UINT16)IpLength);
+        IpHeader->TimeToLive = 1;
+        IpHeader->Protocol = IPPROTO_UDP;
+        AddressLength = sizeof(IN_ADDR);
+        RtlCopyMemory(&IpHeader->SourceAddress, IpSource, AddressLength);
+        RtlCopyMemory(&IpHeader->DestinationAddress, IpDestination, AddressLength);
+        IpHeader->HeaderChecksum = PktChecksum(0, IpHeader, sizeof(*IpHeader));
+
+        Buffer = IpHeader + 1;
+    } else {
+        IPV6_HEADER *IpHeader = (IPV6_HEADER *)Buffer;
+
+        IpLength = UdpLength;
+        RtlZeroMemory(IpHeader, sizeof(*IpHeader));
+        IpHeader->VersionClassFlow = IPV6_VERSION;
+        IpHeader->PayloadLength = IpLength > MAXUINT16 ? 0 : htons((UINT16)IpLength);
+        IpHeader->NextHeader = IPPROTO_UDP;
+        IpHeader->HopLimit = 1;
+        AddressLength = sizeof(IN6_ADDR);
+        RtlCopyMemory(&IpHeader->SourceAddress, IpSource, AddressLength);
+        RtlCopyMemory(&IpHeader->DestinationAddress, IpDestination, AddressLength);
+
+        Buffer = IpHeader + 1;
+    }
+
+    UDP_HDR *UdpHeader = (UDP_HDR *)Buffer;
+    UdpHeader->uh_sport = PortSource;
+    UdpHeader->uh_dport = PortDestination;
+    UdpHeader->uh_ulen = UdpLength > MAXUINT16 ? 0 : htons((UINT16)UdpLength);
+    UdpHeader->uh_sum =
+        PktPseudoHeaderChecksum(IpSource, IpDestination, AddressLength, 0, IPPROTO_UDP);
+
+    RtlCopyMemory(UdpHeader + 1, Payload, PayloadLength);
+
+    *BufferSize = HeaderLength + PayloadLength;
+
+    return TRUE;
+}
+
+inline
+_Success_(return != FALSE)
+BOOLEAN
+PktParseUdpFrame(
+    _In_reads_bytes_(FrameSize) UCHAR *Frame,
+    _In_ UINT32 FrameSize,
+    _Out_ ADDRESS_FAMILY *AddressFamily,
+    _Out_ UDP_HDR **UdpHdr,
+    _Outptr_opt_result_maybenull_ VOID **Payload,
+    _Out_opt_ UINT32 *PayloadLength
+    )
+{
+    ETHERNET_HEADER *EthHdr;
+    UINT32 Offset = 0;
+
+    if (FrameSize < sizeof(*EthHdr)) {
+        return FALSE;
+    }
+
+    EthHdr = (ETHERNET_HEADER *)Frame;
+    Offset += sizeof(*EthHdr);
+    if (EthHdr->Type == htons(ETHERNET_TYPE_IPV4)) {
+        if (FrameSize < Offset + sizeof(IPV4_HEADER)) {
+            return FALSE;
+        }
+        IPV4_HEADER *Ip = (IPV4_HEADER *)&Frame[Offset];
+        if (Ip->Protocol != IPPROTO_UDP || Ip->HeaderLength < sizeof(*Ip) / 4) {
+            return FALSE;
+        }
+        *AddressFamily = AF_INET;
+        Offset += Ip->HeaderLength * 4;
+    } else if (EthHdr->Type == htons(ETHERNET_TYPE_IPV6)) {
+        if (FrameSize < Offset + sizeof(IPV6_HEADER)) {
+            return FALSE;
+        }
+        IPV6_HEADER *Ip = (IPV6_HEADER *)&Frame[Offset];
+        if (Ip->NextHeader != IPPROTO_UDP) {
+            return FALSE;
+        }
+        *AddressFamily = AF_INET6;
+        Offset += sizeof(IPV6_HEADER);
+    } else {
+        return FALSE;
+    }
+
+    if (FrameSize < Offset + sizeof(UDP_HDR)) {
+        return FALSE;
+    }
+
+    //
+    // Use the frame size rather than the UDP length, which is zero for
+    // super-frames larger than 64KB.
+    //
+    *UdpHdr = (UDP_HDR *)&Frame[Offset];
+    Offset += sizeof(UDP_HDR);
+
+    if (Payload != NULL) {
+        *Payload = &Frame[Offset];
+    }
+
+    if (PayloadLength != NULL) {
+        *PayloadLength = FrameSize - Offset;
+    }
+
+    return TRUE;
+}
+
+//
+// Emit segment SegmentIndex of a UDP super-frame as a standalone, checksummed
+// UDP frame, as a segmentation offload would put it on the wire. Use this to
+// check captured USO/GSO output segment by segment.
+//
+inline
+_Success_(return != FALSE)
+BOOLEAN
+PktSplitUdpSuperFrame(
+    _In_reads_bytes_(SuperFrameSize) UCHAR *SuperFrame,
+    _In_ UINT32 SuperFrameSize,
+    _In_ UINT16 SegmentSize,
+    _In_ UINT32 SegmentIndex,
+    _Out_writes_bytes_(*BufferSize) VOID *Buffer,
+    _Inout_ UINT32 *BufferSize
+    )
+{
+    ADDRESS_FAMILY AddressFamily;
+    UDP_HDR *UdpHeader;
+    UCHAR *Payload;
+    UINT32 PayloadLength;
+    UINT32 SegmentOffset;
+    UINT32 SegmentLength;
+    UINT32 HeaderLength;
+    UINT32 IpLength;
+
+    if (!PktParseUdpFrame(
+            SuperFrame, SuperFrameSize, &AddressFamily, &UdpHeader, (VOID **)&Payload,
+            &PayloadLength)) {
+        return FALSE;
+    }
+
+    if (SegmentIndex >= PktUdpSegmentCount(PayloadLength, SegmentSize)) {
+        return FALSE;
+    }
+
+    SegmentOffset = SegmentIndex * SegmentSize;
+    SegmentLength = PayloadLength - SegmentOffset;
+    if (SegmentLength > SegmentSize) {
+        SegmentLength = SegmentSize;
+    }
+    HeaderLength = (UINT32)(Payload - SuperFrame);
+
+    //
+    // Each segment is a standalone datagram, so its IP and UDP lengths must
+    // fit in 16 bits.
+    //
+    IpLength = HeaderLength - sizeof(ETHERNET_HEADER) + SegmentLength;
+    if (AddressFamily == AF_INET6) {
+        IpLength -= sizeof(IPV6_HEADER);
+    }
+
+    if (IpLength > MAXUINT16 || *BufferSize < HeaderLength + SegmentLength) {
+        return FALSE;
+    }
+
+    RtlCopyMemory(Buffer, SuperFrame, HeaderLength);
+    RtlCopyMemory((UCHAR *)Buffer + HeaderLength, Payload + SegmentOffset, SegmentLength);
+
+    CONST UINT16 UdpLength = (UINT16)(sizeof(UDP_HDR) + SegmentLength);
+    UCHAR *IpHeader = (UCHAR *)Buffer + sizeof(ETHERNET_HEADER);
+    UDP_HDR *SegmentUdpHeader = (UDP_HDR *)((UCHAR *)Buffer + HeaderLength - sizeof(UDP_HDR));
+    CONST VOID *IpSource;
+    CONST VOID *IpDestination;
+    UINT8 AddressLength;
+
+    if (AddressFamily == AF_INET) {
+        IPV4_HEADER *Ip = (IPV4_HEADER *)IpHeader;
+        Ip->TotalLength = htons((UINT16)((Ip->HeaderLength * 4) + UdpLength));
+        Ip->HeaderChecksum = 0;
+        Ip->HeaderChecksum = PktChecksum(0, Ip, (UINT16)(Ip->HeaderLength * 4));
+        IpSource = &Ip->SourceAddress;
+        IpDestination = &Ip->DestinationAddress;
+        AddressLength = sizeof(IN_ADDR);
+    } else {
+        IPV6_HEADER *Ip = (IPV6_HEADER *)IpHeader;
+        Ip->PayloadLength = htons(UdpLength);
+        IpSource = &Ip->SourceAddress;
+        IpDestination = &Ip->DestinationAddress;
+        AddressLength = sizeof(IN6_ADDR);
+    }
+
+    SegmentUdpHeader->uh_ulen = htons(UdpLength);
+    SegmentUdpHeader->uh_sum =
+        PktPseudoHeaderChecksum(IpSource, IpDestination, AddressLength, UdpLength, IPPROTO_UDP);
+    SegmentUdpHeader->uh_sum = PktChecksum(0, SegmentUdpHeader, UdpLength);
+
+    if (SegmentUdpHeader->uh_sum == 0 && AddressFamily == AF_INET6) {
+        //
+        // UDPv6 requires a non-zero checksum field.
+        //
+        SegmentUdpHeader->uh_sum = (UINT16)~0;
+    }
+
+    *BufferSize = HeaderLength + SegmentLength;
+
+    return TRUE;
+}
+
 inline
 _Success_(return != FALSE)
 BOOLEAN
@@ -681,6 +1153,427 @@ PktStringToInetAddressA(
 
 EXTERN_C_END
 
+#ifdef __cplusplus
+
+//
+// C++ frame templates.
+//
+// The C builders above resolve the address family, header layout and
+// checksum inputs on every call. The templates below fix the address family
+// and L4 protocol at compile time, and a frame template pre-renders every
+// header byte and the constant parts of the IP and L4 checksums for a single
+// flow, so each subsequent frame costs a header copy, a payload copy and a
+// checksum over the L4 bytes.
+//
+
+#if !defined(_KERNEL_MODE) && defined(_MSVC_LANG) && _MSVC_LANG >= 202002L
+#include <span>
+#define __pkthlp_span
+#endif
+
+constexpr
+UINT16
+PktByteSwap16(
+    _In_ UINT16 Value
+    )
+{
+    return (UINT16)((Value << 8) | (Value >> 8));
+}
+
+template<ADDRESS_FAMILY AddressFamily>
+struct PktIpTraits;
+
+template<>
+struct PktIpTraits<AF_INET> {
+    using Header = IPV4_HEADER;
+    using Address = IN_ADDR;
+    static constexpr UINT16 EthernetType = ETHERNET_TYPE_IPV4;
+};
+
+template<>
+struct PktIpTraits<AF_INET6> {
+    using Header = IPV6_HEADER;
+    using Address = IN6_ADDR;
+    static constexpr UINT16 EthernetType = ETHERNET_TYPE_IPV6;
+};
+
+template<IPPROTO Protocol>
+struct PktL4Traits;
+
+template<>
+struct PktL4Traits<IPPROTO_UDP> {
+    using Header = UDP_HDR;
+
+    static
+    UINT16 *
+    Checksum(
+        _In_ Header *L4Header
+        )
+    {
+        return &L4Header->uh_sum;
+    }
+};
+
+template<>
+struct PktL4Traits<IPPROTO_TCP> {
+    using Header = TCP_HDR;
+
+    static
+    UINT16 *
+    Checksum(
+        _In_ Header *L4Header
+        )
+    {
+        return &L4Header->th_sum;
+    }
+};
+
+//
+// Compile-time layout of an Ethernet + IP + L4 frame without IP extension
+// headers or TCP options.
+//
+template<ADDRESS_FAMILY AddressFamily, IPPROTO Protocol>
+struct PktFrameLayout {
+    using Ip = PktIpTraits<AddressFamily>;
+    using L4 = PktL4Traits<Protocol>;
+
+    static constexpr UINT32 IpOffset = sizeof(ETHERNET_HEADER);
+    static constexpr UINT32 L4Offset = IpOffset + sizeof(typename Ip::Header);
+    static constexpr UINT32 PayloadOffset = L4Offset + sizeof(typename L4::Header);
+    static constexpr UINT32 HeaderLength = PayloadOffset;
+    static constexpr UINT8 AddressLength = sizeof(typename Ip::Address);
+
+    //
+    // IPv4 carries the total length including the IP header in 16 bits, while
+    // IPv6 carries only the IP payload length.
+    //
+    static constexpr UINT32 MaxPayloadLength =
+        MAXUINT16 - sizeof(typename L4::Header) -
+            (AddressFamily == AF_INET ? sizeof(typename Ip::Header) : 0);
+};
+
+static_assert(
+    PktFrameLayout<AF_INET, IPPROTO_UDP>::HeaderLength == UDP_HEADER_BACKFILL(AF_INET),
+    "UDPv4 layout mismatch");
+static_assert(
+    PktFrameLayout<AF_INET6, IPPROTO_UDP>::HeaderLength == UDP_HEADER_BACKFILL(AF_INET6),
+    "UDPv6 layout mismatch");
+static_assert(
+    PktFrameLayout<AF_INET, IPPROTO_TCP>::HeaderLength == TCP_HEADER_BACKFILL(AF_INET),
+    "TCPv4 layout mismatch");
+static_assert(
+    PktFrameLayout<AF_INET6, IPPROTO_TCP>::HeaderLength == TCP_HEADER_BACKFILL(AF_INET6),
+    "TCPv6 layout mismatch");
+
+//
+// Pre-rendered headers for a single flow. Ports are in network order and
+// sequence numbers, acknowledgements and windows are in host order, matching
+// the C builders.
+//
+template<ADDRESS_FAMILY AddressFamily, IPPROTO Protocol>
+class PktFrameTemplateBase {
+public:
+    using Layout = PktFrameLayout<AddressFamily, Protocol>;
+    using IpAddress = typename Layout::Ip::Address;
+
+protected:
+    PktFrameTemplateBase(
+        _In_ CONST ETHERNET_ADDRESS *EthernetDestination,
+        _In_ CONST ETHERNET_ADDRESS *EthernetSource,
+        _In_ CONST IpAddress *IpDestination,
+        _In_ CONST IpAddress *IpSource
+        )
+    {
+        RtlZeroMemory(Header, sizeof(Header));
+
+        ETHERNET_HEADER *EthernetHeader = (ETHERNET_HEADER *)Header;
+        EthernetHeader->Destination = *EthernetDestination;
+        EthernetHeader->Source = *EthernetSource;
+        EthernetHeader->Type = PktByteSwap16(Layout::Ip::EthernetType);
+
+        InitializeIpHeader(
+            (typename Layout::Ip::Header *)(Header + Layout::IpOffset), IpDestination, IpSource);
+
+        UINT32 Checksum = 0;
+        Checksum += PktPartialChecksum(IpSource, Layout::AddressLength);
+        Checksum += PktPartialChecksum(IpDestination, Layout::AddressLength);
+        Checksum += (Protocol << 8);
+        PseudoHeaderChecksum = PktChecksumFold(Checksum);
+    }
+
+    //
+    // Emits the headers and payload, patches the lengths, and returns the L4
+    // header for protocol-specific fields. The caller must finish with
+    // FinalizeChecksum once all L4 header fields are written.
+    //
+    _Success_(return != NULL)
+    UCHAR *
+    Emit(
+        _Out_writes_bytes_(*BufferSize) VOID *Buffer,
+        _Inout_ UINT32 *BufferSize,
+        _In_opt_ CONST UCHAR *Payload,
+        _In_ UINT16 PayloadLength
+        ) const
+    {
+        CONST UINT32 TotalLength = Layout::HeaderLength + PayloadLength;
+        CONST UINT16 L4Length = (UINT16)(Layout::HeaderLength - Layout::L4Offset + PayloadLength);
+        UCHAR *Frame = (UCHAR *)Buffer;
+
+        if (*BufferSize < TotalLength || PayloadLength > Layout::MaxPayloadLength) {
+            return NULL;
+        }
+
+        RtlCopyMemory(Frame, Header, sizeof(Header));
+        if (Payload != NULL) {
+            RtlCopyMemory(Frame + Layout::PayloadOffset, Payload, PayloadLength);
+        }
+
+        SetIpLength((typename Layout::Ip::Header *)(Frame + Layout::IpOffset), L4Length);
+
+        *BufferSize = TotalLength;
+
+        return Frame + Layout::L4Offset;
+    }
+
+    UINT16
+    FinalizeChecksum(
+        _Inout_updates_bytes_(L4Length) UCHAR *L4Header,
+        _In_ UINT16 L4Length
+        ) const
+    {
+        UINT32 Checksum = PseudoHeaderChecksum;
+        Checksum += PktByteSwap16(L4Length);
+
+        *Layout::L4::Checksum((typename Layout::L4::Header *)L4Header) = 0;
+
+        return PktChecksum(PktChecksumFold(Checksum), L4Header, L4Length);
+    }
+
+    UCHAR Header[Layout::HeaderLength];
+
+private:
+    VOID
+    InitializeIpHeader(
+        _Out_ IPV4_HEADER *IpHeader,
+        _In_ CONST IN_ADDR *IpDestination,
+        _In_ CONST IN_ADDR *IpSource
+        )
+    {
+        IpHeader->Version = IPV4_VERSION;
+        IpHeader->HeaderLength = sizeof(*IpHeader) >> 2;
+        IpHeader->TimeToLive = 1;
+        IpHeader->Protocol = (UINT8)Protocol;
+        IpHeader->SourceAddress = *IpSource;
+        IpHeader->DestinationAddress = *IpDestination;
+
+        //
+        // Everything but the total length is fixed per flow.
+        //
+        IpHeaderChecksum = PktPartialChecksum(IpHeader, sizeof(*IpHeader));
+    }
+
+    VOID
+    InitializeIpHeader(
+        _Out_ IPV6_HEADER *IpHeader,
+        _In_ CONST IN6_ADDR *IpDestination,
+        _In_ CONST IN6_ADDR *IpSource
+        )
+    {
+        IpHeader->VersionClassFlow = IPV6_VERSION;
+        IpHeader->NextHeader = (UINT8)Protocol;
+        IpHeader->HopLimit = 1;
+        IpHeader->SourceAddress = *IpSource;
+        IpHeader->DestinationAddress = *IpDestination;
+        IpHeaderChecksum = 0;
+    }
+
+    VOID
+    SetIpLength(
+        _Inout_ IPV4_HEADER *IpHeader,
+        _In_ UINT16 L4Length
+        ) const
+    {
+        CONST UINT16 TotalLength = PktByteSwap16((UINT16)(sizeof(*IpHeader) + L4Length));
+        IpHeader->TotalLength = TotalLength;
+        IpHeader->HeaderChecksum =
+            ~PktChecksumFold((UINT32)IpHeaderChecksum + TotalLength);
+    }
+
+    VOID
+    SetIpLength(
+        _Inout_ IPV6_HEADER *IpHeader,
+        _In_ UINT16 L4Length
+        ) const
+    {
+        IpHeader->PayloadLength = PktByteSwap16(L4Length);
+    }
+
+    UINT16 PseudoHeaderChecksum;
+    UINT16 IpHeaderChecksum;
+};
+
+template<ADDRESS_FAMILY AddressFamily>
+class PktUdpFrameTemplate : public PktFrameTemplateBase<AddressFamily, IPPROTO_UDP> {
+    using Base = PktFrameTemplateBase<AddressFamily, IPPROTO_UDP>;
+
+public:
+    using typename Base::Layout;
+    using typename Base::IpAddress;
+
+    PktUdpFrameTemplate(
+        _In_ CONST ETHERNET_ADDRESS *EthernetDestination,
+        _In_ CONST ETHERNET_ADDRESS *EthernetSource,
+        _In_ CONST IpAddress *IpDestination,
+        _In_ CONST IpAddress *IpSource,
+        _In_ UINT16 PortDestination,
+        _In_ UINT16 PortSource
+        ) :
+        Base(EthernetDestination, EthernetSource, IpDestination, IpSource)
+    {
+        UDP_HDR *UdpHeader = (UDP_HDR *)(this->Header + Layout::L4Offset);
+        UdpHeader->uh_sport = PortSource;
+        UdpHeader->uh_dport = PortDestination;
+    }
+
+    _Success_(return != FALSE)
+    BOOLEAN
+    Build(
+        _Out_writes_bytes_(*BufferSize) VOID *Buffer,
+        _Inout_ UINT32 *BufferSize,
+        _In_opt_ CONST UCHAR *Payload,
+        _In_ UINT16 PayloadLength
+        ) const
+    {
+        CONST UINT16 UdpLength = (UINT16)(sizeof(UDP_HDR) + PayloadLength);
+        UDP_HDR *UdpHeader = (UDP_HDR *)this->Emit(Buffer, BufferSize, Payload, PayloadLength);
+
+        if (UdpHeader == NULL) {
+            return FALSE;
+        }
+
+        UdpHeader->uh_ulen = PktByteSwap16(UdpLength);
+        UdpHeader->uh_sum = this->FinalizeChecksum((UCHAR *)UdpHeader, UdpLength);
+
+        if (UdpHeader->uh_sum == 0 && AddressFamily == AF_INET6) {
+            //
+            // UDPv6 requires a non-zero checksum field.
+            //
+            UdpHeader->uh_sum = (UINT16)~0;
+        }
+
+        return TRUE;
+    }
+
+#ifdef __pkthlp_span
+    //
+    // Returns the emitted frame, or an empty span if the buffer is too small.
+    //
+    std::span<UCHAR>
+    Build(
+        _In_ std::span<UCHAR> Buffer,
+        _In_ std::span<CONST UCHAR> Payload
+        ) const
+    {
+        UINT32 FrameLength = Buffer.size() > MAXUINT32 ? MAXUINT32 : (UINT32)Buffer.size();
+
+        if (Payload.size() > Layout::MaxPayloadLength ||
+            !Build(Buffer.data(), &FrameLength, Payload.data(), (UINT16)Payload.size())) {
+            return {};
+        }
+
+        return Buffer.first(FrameLength);
+    }
+#endif
+};
+
+template<ADDRESS_FAMILY AddressFamily>
+class PktTcpFrameTemplate : public PktFrameTemplateBase<AddressFamily, IPPROTO_TCP> {
+    using Base = PktFrameTemplateBase<AddressFamily, IPPROTO_TCP>;
+
+public:
+    using typename Base::Layout;
+    using typename Base::IpAddress;
+
+    PktTcpFrameTemplate(
+        _In_ CONST ETHERNET_ADDRESS *EthernetDestination,
+        _In_ CONST ETHERNET_ADDRESS *EthernetSource,
+        _In_ CONST IpAddress *IpDestination,
+        _In_ CONST IpAddress *IpSource,
+        _In_ UINT16 PortDestination,
+        _In_ UINT16 PortSource
+        ) :
+        Base(EthernetDestination, EthernetSource, IpDestination, IpSource)
+    {
+        TCP_HDR *TcpHeader = (TCP_HDR *)(this->Header + Layout::L4Offset);
+        TcpHeader->th_sport = PortSource;
+        TcpHeader->th_dport = PortDestination;
+        TcpHeader->th_len = sizeof(TCP_HDR) / 4;
+    }
+
+    _Success_(return != FALSE)
+    BOOLEAN
+    Build(
+        _Out_writes_bytes_(*BufferSize) VOID *Buffer,
+        _Inout_ UINT32 *BufferSize,
+        _In_opt_ CONST UCHAR *Payload,
+        _In_ UINT16 PayloadLength,
+        _In_ UINT32 ThSeq, // host order
+        _In_ UINT32 ThAck, // host order
+        _In_ UINT8 ThFlags,
+        _In_ UINT16 ThWin // host order
+        ) const
+    {
+        TCP_HDR *TcpHeader = (TCP_HDR *)this->Emit(Buffer, BufferSize, Payload, PayloadLength);
+
+        if (TcpHeader == NULL) {
+            return FALSE;
+        }
+
+        TcpHeader->th_seq = htonl(ThSeq);
+        TcpHeader->th_ack = htonl(ThAck);
+        TcpHeader->th_win = PktByteSwap16(ThWin);
+        TcpHeader->th_flags = ThFlags;
+        TcpHeader->th_sum =
+            this->FinalizeChecksum(
+                (UCHAR *)TcpHeader, (UINT16)(sizeof(TCP_HDR) + PayloadLength));
+
+        return TRUE;
+    }
+
+#ifdef __pkthlp_span
+    //
+    // Returns the emitted frame, or an empty span if the buffer is too small.
+    //
+    std::span<UCHAR>
+    Build(
+        _In_ std::span<UCHAR> Buffer,
+        _In_ std::span<CONST UCHAR> Payload,
+        _In_ UINT32 ThSeq,
+        _In_ UINT32 ThAck,
+        _In_ UINT8 ThFlags,
+        _In_ UINT16 ThWin
+        ) const
+    {
+        UINT32 FrameLength = Buffer.size() > MAXUINT32 ? MAXUINT32 : (UINT32)Buffer.size();
+
+        if (Payload.size() > Layout::MaxPayloadLength ||
+            !Build(
+                Buffer.data(), &FrameLength, Payload.data(), (UINT16)Payload.size(), ThSeq, ThAck,
+                ThFlags, ThWin)) {
+            return {};
+        }
+
+        return Buffer.first(FrameLength);
+    }
+#endif
+};
+
+#ifdef __pkthlp_span
+#undef __pkthlp_span
+#endif
+
+#endif // __cplusplus
+
 #ifdef __pkthlp_NTSTATUS
 #undef STATUS_SUCCESS
 #endif
@@ -10,34 +10,51 @@ EXTERN_C_START
 #define WSKCLIENT_UNKNOWN_BYTES ((ULONG)-1)
 #define WSKCLIENT_INFINITE ((ULONG)-1)
 
-typedef struct _WSKCONNECTEX_COMPLETION {
-    PIRP Irp;
-    WSK_BUF WskBuf;
-    KEVENT Event;
-    NTSTATUS Status;
-    BOOLEAN BufLocked;
-} WSKCONNECTEX_COMPLETION, *PWSKCONNECTEX_COMPLETION;
+//
+// Invoked once an async request handed to WskSetCompletionCallback completes,
+// at IRQL <= DISPATCH_LEVEL. Information is the number of bytes transferred,
+// or the accepted PWSK_SOCKET for accept requests.
+//
+typedef
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+WSKCLIENT_COMPLETION_CALLBACK(
+    _In_opt_ PVOID Context,
+    _In_ NTSTATUS Status,
+    _In_ ULONG_PTR Information
+    );
 
-typedef struct _WSKDISCONNECT_COMPLETION {
+//
+// Completion context of async connect, accept, disconnect, send and receive
+// requests. Contexts and their IRPs are cached and reused across requests.
+//
+typedef struct _WSK_IOREQUEST_COMPLETION {
+    SLIST_ENTRY CacheLink;
     PIRP Irp;
     WSK_BUF WskBuf;
     KEVENT Event;
     NTSTATUS Status;
-    BOOLEAN BufLocked;
-} WSKDISCONNECT_COMPLETION, *PWSKDISCONNECT_COMPLETION;
 
-typedef struct _WSKACCEPT_COMPLETION {
-    PIRP Irp;
-    KEVENT Event;
-    NTSTATUS Status;
-} WSKACCEPT_COMPLETION, *PWSKACCEPT_COMPLETION;
+    //
+    // The IRP and the owner each hold a reference, as does the shared timer
+    // while a callback timeout is queued. The last reference delivers the
+    // callback, or wakes the awaiting owner.
+    //
+    LONG PendingRefs;
+    LONG State;
+    WSKCLIENT_COMPLETION_CALLBACK *Callback;
+    PVOID CallbackContext;
+    LIST_ENTRY TimerLink;
+    struct _WSK_IOREQUEST_COMPLETION *TimerNext;
+    UINT64 Deadline;
+    BOOLEAN TimedOut;
 
-typedef struct _WSK_IOREQUEST_COMPLETION {
-    PIRP Irp;
-    WSK_BUF WskBuf;
-    KEVENT Event;
-    NTSTATUS Status;
     BOOLEAN BufLocked;
+    BOOLEAN BufRegistered;
+    PMDL CachedMdl;
+    PVOID MessageBufs;
+    ULONG MessageCount;
+    PVOID CachedMessageBufs;
     DECLSPEC_ALIGN(MEMORY_ALLOCATION_ALIGNMENT) CHAR ControlData[128];
 } WSKIOREQUEST_COMPLETION, *PWSKIOREQUEST_COMPLETION;
 
@@ -51,6 +68,39 @@ WskClientDereg(
     VOID
     );
 
+//
+// Describes and locks a buffer once, so that repeated sends from it via
+// WskSendRegisteredAsync or WskSendToRegisteredAsync skip building and locking
+// an MDL. The buffer must remain valid until it is deregistered.
+//
+NTSTATUS
+WskRegisterBuffer(
+    char *Buf,
+    ULONG BufLen,
+    BOOLEAN BufIsNonPagedPool,
+    _Out_ PVOID* RegisteredBuffer
+    );
+
+VOID
+WskDeregisterBuffer(
+    _In_ PVOID RegisteredBuffer
+    );
+
+//
+// Completes an async request through Callback instead of an *Await call.
+// Works with any completion returned by a *Async function, which must not be
+// used after this call. Callback may run before this returns. If the request
+// is still pending after TimeoutMs it is cancelled by a shared timer, and
+// Callback receives STATUS_TIMEOUT.
+//
+VOID
+WskSetCompletionCallback(
+    _In_ PVOID AsyncCompletion,
+    _In_ ULONG TimeoutMs,
+    _In_ WSKCLIENT_COMPLETION_CALLBACK *Callback,
+    _In_opt_ PVOID CallbackContext
+    );
+
 NTSTATUS
 WskSocketSync(
     int WskSockType, // e.g. WSK_FLAG_STREAM_SOCKET
@@ -174,12 +224,12 @@ WskDisconnectAsync(
     ULONG BufLen,
     BOOLEAN BufIsNonPagedPool,
     ULONG Flags,
-    _Out_ PWSKDISCONNECT_COMPLETION* DisconnectCompletion
+    _Out_ PVOID* DisconnectCompletion
     );
 
 NTSTATUS
 WskDisconnectAwait(
-    _Inout_ PWSKDISCONNECT_COMPLETION Completion,
+    _Inout_ PVOID DisconnectCompletion,
     _In_ ULONG TimeoutMs
     );
 
@@ -226,6 +276,17 @@ WskSendAsync(
     _Out_ PVOID* SendCompletion
     );
 
+NTSTATUS
+WskSendRegisteredAsync(
+    PWSK_SOCKET Sock,
+    int SockType,
+    PVOID RegisteredBuffer,
+    ULONG Offset,
+    ULONG Length,
+    ULONG Flags,
+    _Out_ PVOID* SendCompletion
+    );
+
 NTSTATUS
 WskSendAwait(
     _Inout_ PVOID SendCompletion,
@@ -278,6 +339,59 @@ WskReceiveAwait(
     _Out_opt_ ULONG *BytesReceived
     );
 
+//
+// Invoked in ring order for each completed receive of a pipeline, at IRQL <=
+// DISPATCH_LEVEL. Buf is re-armed for another receive once this returns.
+// A failure status or zero BytesReceived ends the pipeline.
+//
+typedef
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+WSKCLIENT_RECEIVE_CALLBACK(
+    _In_opt_ PVOID Context,
+    _In_ NTSTATUS Status,
+    _In_ char *Buf,
+    _In_ ULONG BytesReceived
+    );
+
+//
+// Keeps BufCount receives in flight on a stream socket, one per BufLen-sized
+// buffer in the ring at Bufs. Completed buffers are handed to Callback if one
+// is provided; otherwise they are retrieved with WskReceivePipelineGet.
+// On success, caller must follow up with a call to WskReceivePipelineDestroy.
+//
+NTSTATUS
+WskReceivePipelineCreate(
+    PWSK_SOCKET Sock,
+    int SockType,
+    char *Bufs,
+    ULONG BufLen,
+    ULONG BufCount,
+    BOOLEAN BufIsNonPagedPool,
+    _In_opt_ WSKCLIENT_RECEIVE_CALLBACK *Callback,
+    _In_opt_ PVOID CallbackContext,
+    _Out_ PVOID* ReceivePipeline
+    );
+
+//
+// Returns the next completed buffer of a pipeline created without a callback.
+// The buffer returned by the previous call is re-armed first. Once a failure
+// status or zero BytesReceived has ended the stream, later calls return that
+// status immediately, with no buffer and zero BytesReceived.
+//
+NTSTATUS
+WskReceivePipelineGet(
+    _In_ PVOID ReceivePipeline,
+    _In_ ULONG TimeoutMs,
+    _Outptr_ char **Buf,
+    _Out_ ULONG *BytesReceived
+    );
+
+VOID
+WskReceivePipelineDestroy(
+    _In_ PVOID ReceivePipeline
+    );
+
 NTSTATUS
 WskSendToSync(
     PWSK_SOCKET Sock,
@@ -303,6 +417,50 @@ WskSendToAsync(
     _Out_ PVOID* SendCompletion
     );
 
+NTSTATUS
+WskSendToRegisteredAsync(
+    PWSK_SOCKET Sock,
+    PVOID RegisteredBuffer,
+    ULONG Offset,
+    ULONG Length,
+    _In_ PSOCKADDR RemoteAddr,
+    ULONG ControlLen,
+    _When_(ControlLen > 0, _In_) _When_(ControlLen == 0, _In_opt_) const CMSGHDR *Control,
+    _Out_ PVOID* SendCompletion
+    );
+
+typedef struct _WSKCLIENT_MESSAGE {
+    char *Buf;
+    ULONG BufLen;
+} WSKCLIENT_MESSAGE;
+
+//
+// Sends each message as a separate datagram to the same remote address and
+// with the same control data, chained into a single WskSendMessages request.
+// Returns STATUS_NOT_SUPPORTED if the platform lacks WskSendMessages. The
+// completion may also be awaited with WskSendToAwait, which reports the total
+// number of bytes sent.
+//
+NTSTATUS
+WskSendMessagesAsync(
+    PWSK_SOCKET Sock,
+    _In_reads_(MessageCount) const WSKCLIENT_MESSAGE *Messages,
+    ULONG MessageCount,
+    BOOLEAN BufIsNonPagedPool,
+    _In_opt_ PSOCKADDR RemoteAddr,
+    ULONG ControlLen,
+    _When_(ControlLen > 0, _In_) _When_(ControlLen == 0, _In_opt_) const CMSGHDR *Control,
+    _Out_ PVOID* SendCompletion
+    );
+
+NTSTATUS
+WskSendMessagesAwait(
+    _Inout_ PVOID SendCompletion,
+    _In_ ULONG TimeoutMs,
+    _In_ ULONG MessageCount,
+    _Out_writes_opt_(MessageCount) ULONG *BytesSent
+    );
+
 NTSTATUS
 WskSendToAwait(
     _Inout_ PVOID SendCompletion,
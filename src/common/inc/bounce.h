@@ -37,3 +37,15 @@ BounceBuffer(
     _In_ SIZE_T BufferSize,
     _In_ UINT32 Alignment
     );
+
+//
+// Copies an untrusted buffer directly into caller-provided kernel memory.
+//
+NTSTATUS
+BounceCopy(
+    _Out_writes_bytes_(BufferSize) VOID *Destination,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _In_opt_ CONST VOID *Buffer,
+    _In_ SIZE_T BufferSize,
+    _In_ UINT32 Alignment
+    );
@@ -91,7 +91,7 @@ typedef struct DECLSPEC_ALIGN(MEMORY_ALLOCATION_ALIGNMENT) _ENQUEUE_NBL_CONTEXT
 
 #define FNIO_ENQUEUE_NBL_CONTEXT_SIZE sizeof(ENQUEUE_NBL_CONTEXT)
 
-_IRQL_requires_max_(DISPATCH_LEVEL)
+_IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS
 FnIoEnqueueFrameBegin(
     _In_ KPROCESSOR_MODE RequestorMode,
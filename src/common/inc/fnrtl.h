@@ -58,6 +58,7 @@ extern "C" {
 #define RTL_MILLISEC_TO_100NANOSEC(m) ((m) * 10000ui64)
 #define RTL_SEC_TO_100NANOSEC(s) ((s) * 10000000ui64)
 #define RTL_SEC_TO_MILLISEC(s) ((s) * 1000ui64)
+#define RTL_SEC_TO_NANOSEC(s) ((s) * 1000000000ui64)
 
 #ifndef ReadUInt64NoFence
 #define ReadUInt64NoFence ReadULong64NoFence
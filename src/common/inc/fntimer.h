@@ -8,6 +8,13 @@
 #include <fnrtl.h>
 #include "pooltag.h"
 
+//
+// Timers are multiplexed onto a per-driver hierarchical timer wheel serviced
+// by a single system thread. Arming and cancelling a timer is O(1); the wheel
+// thread only wakes when the next occupied slot comes due.
+//
+
+DECLARE_HANDLE(FN_TIMER_WHEEL_HANDLE);
 DECLARE_HANDLE(FN_TIMER_HANDLE);
 
 typedef
@@ -17,90 +24,348 @@ FN_TIMER_CALLBACK(
     _In_ VOID *CallbackContext
     );
 
+#define FN_TIMER_WHEEL_TICK_MS 10
+#define FN_TIMER_WHEEL_ROOT_BITS 8
+#define FN_TIMER_WHEEL_ROOT_SLOTS (1ui32 << FN_TIMER_WHEEL_ROOT_BITS)
+#define FN_TIMER_WHEEL_ROOT_MASK (FN_TIMER_WHEEL_ROOT_SLOTS - 1)
+#define FN_TIMER_WHEEL_LEVEL_BITS 6
+#define FN_TIMER_WHEEL_LEVEL_SLOTS (1ui32 << FN_TIMER_WHEEL_LEVEL_BITS)
+#define FN_TIMER_WHEEL_LEVEL_MASK (FN_TIMER_WHEEL_LEVEL_SLOTS - 1)
+#define FN_TIMER_WHEEL_LEVEL_COUNT 3
+
+typedef struct _FN_TIMER_WHEEL FN_TIMER_WHEEL;
+
 typedef struct _FN_TIMER {
+    LIST_ENTRY Link;
+    FN_TIMER_WHEEL *Wheel;
     FN_TIMER_CALLBACK *Callback;
     VOID *CallbackContext;
-    HANDLE ThreadHandle;
-    KEVENT CloseEvent;
-    LARGE_INTEGER Timeout;
+    UINT64 IntervalTicks;
+    UINT64 ExpiryTick;
+    BOOLEAN Closing;
 } FN_TIMER;
 
+typedef struct _FN_TIMER_WHEEL {
+    KSPIN_LOCK Lock;
+    UINT64 CurrentTick;
+    UINT64 NextWakeTick;
+    UINT32 TimerCount;
+    BOOLEAN Stopping;
+    FN_TIMER *RunningTimer;
+    VOID *Thread;
+    KEVENT WakeEvent;
+    KEVENT CallbackEvent;
+    LIST_ENTRY ExpiredList;
+
+    //
+    // The root level has one slot per tick; each higher level has one slot per
+    // full revolution of the level beneath it. Timers cascade down a level as
+    // the wheel wraps, and expire from the root level.
+    //
+    LIST_ENTRY Root[FN_TIMER_WHEEL_ROOT_SLOTS];
+    LIST_ENTRY Levels[FN_TIMER_WHEEL_LEVEL_COUNT][FN_TIMER_WHEEL_LEVEL_SLOTS];
+} FN_TIMER_WHEEL;
+
+inline
+UINT64
+FnTimerWheelQueryTick(
+    VOID
+    )
+{
+    //
+    // Use unbiased interrupt time so the wheel does not replay the ticks that
+    // elapsed while the system was asleep.
+    //
+    return KeQueryUnbiasedInterruptTime() / RTL_MILLISEC_TO_100NANOSEC(FN_TIMER_WHEEL_TICK_MS);
+}
+
+inline
+_Requires_lock_held_(Wheel->Lock)
+VOID
+FnTimerWheelInsert(
+    _Inout_ FN_TIMER_WHEEL *Wheel,
+    _Inout_ FN_TIMER *Timer
+    )
+{
+    UINT64 Delta = Timer->ExpiryTick - Wheel->CurrentTick;
+    UINT32 Shift = FN_TIMER_WHEEL_ROOT_BITS;
+    UINT32 Level = 0;
+
+    if (Delta < FN_TIMER_WHEEL_ROOT_SLOTS) {
+        InsertTailList(&Wheel->Root[Timer->ExpiryTick & FN_TIMER_WHEEL_ROOT_MASK], &Timer->Link);
+        return;
+    }
+
+    while (Level < FN_TIMER_WHEEL_LEVEL_COUNT - 1 &&
+            Delta >= (1ui64 << (Shift + FN_TIMER_WHEEL_LEVEL_BITS))) {
+        Shift += FN_TIMER_WHEEL_LEVEL_BITS;
+        Level++;
+    }
+
+    if (Delta >= (1ui64 << (Shift + FN_TIMER_WHEEL_LEVEL_BITS))) {
+        //
+        // Clamp intervals beyond the range of the wheel (days) to its maximum.
+        //
+        Timer->ExpiryTick =
+            Wheel->CurrentTick + (1ui64 << (Shift + FN_TIMER_WHEEL_LEVEL_BITS)) - 1;
+    }
+
+    InsertTailList(
+        &Wheel->Levels[Level][(Timer->ExpiryTick >> Shift) & FN_TIMER_WHEEL_LEVEL_MASK],
+        &Timer->Link);
+}
+
+inline
+_Requires_lock_held_(Wheel->Lock)
+VOID
+FnTimerWheelArm(
+    _Inout_ FN_TIMER_WHEEL *Wheel,
+    _Inout_ FN_TIMER *Timer
+    )
+{
+    Timer->ExpiryTick = Wheel->CurrentTick + Timer->IntervalTicks;
+    FnTimerWheelInsert(Wheel, Timer);
+
+    if (Timer->ExpiryTick < Wheel->NextWakeTick) {
+        KeSetEvent(&Wheel->WakeEvent, IO_NO_INCREMENT, FALSE);
+    }
+}
+
+inline
+_Requires_lock_held_(Wheel->Lock)
+VOID
+FnTimerWheelCascade(
+    _Inout_ FN_TIMER_WHEEL *Wheel,
+    _Inout_ LIST_ENTRY *Slot
+    )
+{
+    LIST_ENTRY List;
+
+    if (IsListEmpty(Slot)) {
+        return;
+    }
+
+    //
+    // Detach the slot before reinserting its timers, since a timer may land
+    // back in the same slot.
+    //
+    List = *Slot;
+    List.Flink->Blink = &List;
+    List.Blink->Flink = &List;
+    InitializeListHead(Slot);
+
+    while (!IsListEmpty(&List)) {
+        FN_TIMER *Timer = CONTAINING_RECORD(RemoveHeadList(&List), FN_TIMER, Link);
+        FnTimerWheelInsert(Wheel, Timer);
+    }
+}
+
+inline
+_Requires_lock_held_(Wheel->Lock)
+VOID
+FnTimerWheelAdvance(
+    _Inout_ FN_TIMER_WHEEL *Wheel,
+    _In_ UINT64 NowTick
+    )
+{
+    while (Wheel->CurrentTick < NowTick) {
+        UINT32 Index;
+        LIST_ENTRY *Slot;
+
+        Wheel->CurrentTick++;
+        Index = (UINT32)(Wheel->CurrentTick & FN_TIMER_WHEEL_ROOT_MASK);
+
+        if (Index == 0) {
+            UINT32 Shift = FN_TIMER_WHEEL_ROOT_BITS;
+
+            for (UINT32 Level = 0; Level < FN_TIMER_WHEEL_LEVEL_COUNT; Level++) {
+                UINT32 LevelIndex =
+                    (UINT32)((Wheel->CurrentTick >> Shift) & FN_TIMER_WHEEL_LEVEL_MASK);
+
+                FnTimerWheelCascade(Wheel, &Wheel->Levels[Level][LevelIndex]);
+
+                if (LevelIndex != 0) {
+                    break;
+                }
+
+                Shift += FN_TIMER_WHEEL_LEVEL_BITS;
+            }
+        }
+
+        Slot = &Wheel->Root[Index];
+
+        while (!IsListEmpty(Slot)) {
+            InsertTailList(&Wheel->ExpiredList, RemoveHeadList(Slot));
+        }
+    }
+}
+
+inline
+_Requires_lock_held_(Wheel->Lock)
+UINT64
+FnTimerWheelNextTick(
+    _In_ CONST FN_TIMER_WHEEL *Wheel
+    )
+{
+    CONST UINT32 Remaining =
+        FN_TIMER_WHEEL_ROOT_SLOTS - (UINT32)(Wheel->CurrentTick & FN_TIMER_WHEEL_ROOT_MASK);
+
+    //
+    // Sleep until the next occupied root slot, or until the root level wraps
+    // and timers cascade down from the higher levels.
+    //
+    for (UINT32 Offset = 1; Offset < Remaining; Offset++) {
+        UINT64 Tick = Wheel->CurrentTick + Offset;
+
+        if (!IsListEmpty(&Wheel->Root[Tick & FN_TIMER_WHEEL_ROOT_MASK])) {
+            return Tick;
+        }
+    }
+
+    return Wheel->CurrentTick + Remaining;
+}
+
 inline
 _IRQL_requires_same_
 _Function_class_(KSTART_ROUTINE)
 VOID
-FnTimerWorker(
+FnTimerWheelWorker(
     _In_ VOID *Context
     )
 {
-    FN_TIMER *Timer = Context;
-    NTSTATUS Status;
+    FN_TIMER_WHEEL *Wheel = (FN_TIMER_WHEEL *)Context;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&Wheel->Lock, &OldIrql);
+
+    while (!Wheel->Stopping) {
+        LARGE_INTEGER Timeout;
+        LARGE_INTEGER *TimeoutPointer = NULL;
+        UINT64 NowTick;
+
+        FnTimerWheelAdvance(Wheel, FnTimerWheelQueryTick());
+
+        while (!IsListEmpty(&Wheel->ExpiredList)) {
+            FN_TIMER *Timer =
+                CONTAINING_RECORD(RemoveHeadList(&Wheel->ExpiredList), FN_TIMER, Link);
 
-    while ((Status = FnWaitObject(&Timer->CloseEvent, &Timer->Timeout)) == STATUS_TIMEOUT) {
-        Timer->Callback(Timer->CallbackContext);
+            InitializeListHead(&Timer->Link);
+            Wheel->RunningTimer = Timer;
+            KeReleaseSpinLock(&Wheel->Lock, OldIrql);
+
+            Timer->Callback(Timer->CallbackContext);
+
+            KeAcquireSpinLock(&Wheel->Lock, &OldIrql);
+            Wheel->RunningTimer = NULL;
+            KeSetEvent(&Wheel->CallbackEvent, IO_NO_INCREMENT, FALSE);
+
+            if (!Timer->Closing) {
+                FnTimerWheelArm(Wheel, Timer);
+            }
+        }
+
+        if (Wheel->Stopping) {
+            break;
+        }
+
+        NowTick = FnTimerWheelQueryTick();
+
+        if (Wheel->TimerCount == 0) {
+            Wheel->NextWakeTick = MAXUINT64;
+        } else {
+            Wheel->NextWakeTick = FnTimerWheelNextTick(Wheel);
+
+            if (Wheel->NextWakeTick <= NowTick) {
+                continue;
+            }
+
+            Timeout.QuadPart =
+                -1i64 * (INT64)RTL_MILLISEC_TO_100NANOSEC(
+                    (Wheel->NextWakeTick - NowTick) * FN_TIMER_WHEEL_TICK_MS);
+            TimeoutPointer = &Timeout;
+        }
+
+        KeClearEvent(&Wheel->WakeEvent);
+        KeReleaseSpinLock(&Wheel->Lock, OldIrql);
+
+        FnWaitObject(&Wheel->WakeEvent, TimeoutPointer);
+
+        KeAcquireSpinLock(&Wheel->Lock, &OldIrql);
     }
 
-    ASSERT(Status == STATUS_SUCCESS);
+    KeReleaseSpinLock(&Wheel->Lock, OldIrql);
 }
 
 inline
 VOID
-FnTimerDestroy(
-    FN_TIMER *Timer
+FnTimerWheelDestroy(
+    FN_TIMER_WHEEL *Wheel
     )
 {
-    if (Timer->ThreadHandle != NULL) {
-        ObDereferenceObject(Timer->ThreadHandle);
+    if (Wheel->Thread != NULL) {
+        ObDereferenceObject(Wheel->Thread);
     }
 
-    ExFreePoolWithTag(Timer, POOLTAG_TIMER);
+    ExFreePoolWithTag(Wheel, POOLTAG_TIMER_WHEEL);
 }
 
 inline
 _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS
-FnTimerCreate(
-    _Out_ FN_TIMER_HANDLE *Handle,
-    _In_ FN_TIMER_CALLBACK *Callback,
-    _In_ VOID *CallbackContext,
-    _In_ UINT32 IntervalMs
+FnTimerWheelCreate(
+    _Out_ FN_TIMER_WHEEL_HANDLE *Handle
     )
 {
     NTSTATUS Status;
-    FN_TIMER *Timer;
+    FN_TIMER_WHEEL *Wheel;
     HANDLE ThreadHandle = NULL;
 
-    Timer = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Timer), POOLTAG_TIMER);
-    if (Timer == NULL) {
+    Wheel =
+        (FN_TIMER_WHEEL *)
+            ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Wheel), POOLTAG_TIMER_WHEEL);
+    if (Wheel == NULL) {
         Status = STATUS_NO_MEMORY;
         goto Exit;
     }
 
-    Timer->Callback = Callback;
-    Timer->CallbackContext = CallbackContext;
-    Timer->Timeout.QuadPart = -1i64 * RTL_MILLISEC_TO_100NANOSEC(IntervalMs);
-    KeInitializeEvent(&Timer->CloseEvent, NotificationEvent, FALSE);
+    KeInitializeSpinLock(&Wheel->Lock);
+    KeInitializeEvent(&Wheel->WakeEvent, NotificationEvent, FALSE);
+    KeInitializeEvent(&Wheel->CallbackEvent, NotificationEvent, FALSE);
+    InitializeListHead(&Wheel->ExpiredList);
+    Wheel->CurrentTick = FnTimerWheelQueryTick();
+    Wheel->NextWakeTick = MAXUINT64;
+
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Wheel->Root); Index++) {
+        InitializeListHead(&Wheel->Root[Index]);
+    }
+
+    for (UINT32 Level = 0; Level < FN_TIMER_WHEEL_LEVEL_COUNT; Level++) {
+        for (UINT32 Index = 0; Index < FN_TIMER_WHEEL_LEVEL_SLOTS; Index++) {
+            InitializeListHead(&Wheel->Levels[Level][Index]);
+        }
+    }
 
     Status =
         PsCreateSystemThread(
             &ThreadHandle, THREAD_ALL_ACCESS, NULL, NULL, NULL,
-            FnTimerWorker, Timer);
+            FnTimerWheelWorker, Wheel);
     if (!NT_SUCCESS(Status)) {
         goto Exit;
     }
 
     Status =
         ObReferenceObjectByHandle(
-            ThreadHandle, THREAD_ALL_ACCESS, *PsThreadType, KernelMode, &Timer->ThreadHandle,
-            NULL);
+            ThreadHandle, THREAD_ALL_ACCESS, *PsThreadType, KernelMode, &Wheel->Thread, NULL);
     FRE_ASSERT(NT_SUCCESS(Status));
 
-    *Handle = (FN_TIMER_HANDLE)Timer;
+    *Handle = (FN_TIMER_WHEEL_HANDLE)Wheel;
 
 Exit:
 
     if (!NT_SUCCESS(Status)) {
-        FnTimerDestroy(Timer);
+        if (Wheel != NULL) {
+            FnTimerWheelDestroy(Wheel);
+        }
     }
 
     if (ThreadHandle != NULL) {
@@ -110,6 +375,79 @@ Exit:
     return Status;
 }
 
+inline
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+FnTimerWheelClose(
+    _In_ FN_TIMER_WHEEL_HANDLE Handle
+    )
+{
+    FN_TIMER_WHEEL *Wheel = (FN_TIMER_WHEEL *)Handle;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&Wheel->Lock, &OldIrql);
+    ASSERT(Wheel->TimerCount == 0);
+    Wheel->Stopping = TRUE;
+    KeSetEvent(&Wheel->WakeEvent, IO_NO_INCREMENT, FALSE);
+    KeReleaseSpinLock(&Wheel->Lock, OldIrql);
+
+    NT_VERIFY(FnWaitObject(Wheel->Thread, NULL) == STATUS_SUCCESS);
+
+    FnTimerWheelDestroy(Wheel);
+}
+
+inline
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+FnTimerCreate(
+    _In_ FN_TIMER_WHEEL_HANDLE WheelHandle,
+    _Out_ FN_TIMER_HANDLE *Handle,
+    _In_ FN_TIMER_CALLBACK *Callback,
+    _In_ VOID *CallbackContext,
+    _In_ UINT32 IntervalMs
+    )
+{
+    FN_TIMER_WHEEL *Wheel = (FN_TIMER_WHEEL *)WheelHandle;
+    FN_TIMER *Timer;
+    KIRQL OldIrql;
+
+    Timer = (FN_TIMER *)ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Timer), POOLTAG_TIMER);
+    if (Timer == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    Timer->Wheel = Wheel;
+    Timer->Callback = Callback;
+    Timer->CallbackContext = CallbackContext;
+    Timer->IntervalTicks =
+        max(1ui64, ((UINT64)IntervalMs + FN_TIMER_WHEEL_TICK_MS - 1) / FN_TIMER_WHEEL_TICK_MS);
+
+    KeAcquireSpinLock(&Wheel->Lock, &OldIrql);
+
+    //
+    // The wheel thread only ticks when it wakes, so the wheel may lag the
+    // current time; catch up before arming relative to it. An empty wheel has
+    // nothing to expire and can jump straight to the current time.
+    //
+    if (Wheel->TimerCount++ == 0) {
+        Wheel->CurrentTick = max(Wheel->CurrentTick, FnTimerWheelQueryTick());
+    } else {
+        FnTimerWheelAdvance(Wheel, FnTimerWheelQueryTick());
+    }
+
+    FnTimerWheelArm(Wheel, Timer);
+
+    if (!IsListEmpty(&Wheel->ExpiredList)) {
+        KeSetEvent(&Wheel->WakeEvent, IO_NO_INCREMENT, FALSE);
+    }
+
+    KeReleaseSpinLock(&Wheel->Lock, OldIrql);
+
+    *Handle = (FN_TIMER_HANDLE)Timer;
+
+    return STATUS_SUCCESS;
+}
+
 inline
 _IRQL_requires_max_(PASSIVE_LEVEL)
 VOID
@@ -118,9 +456,33 @@ FnTimerClose(
     )
 {
     FN_TIMER *Timer = (FN_TIMER *)Handle;
+    FN_TIMER_WHEEL *Wheel = Timer->Wheel;
+    KIRQL OldIrql;
+
+    //
+    // Timers cannot be closed from their own callback.
+    //
+    ASSERT(PsGetCurrentThread() != Wheel->Thread);
 
-    NT_VERIFY(KeSetEvent(&Timer->CloseEvent, IO_NO_INCREMENT, FALSE) == FALSE);
-    NT_VERIFY(FnWaitObject(Timer->ThreadHandle, NULL) == STATUS_SUCCESS);
+    KeAcquireSpinLock(&Wheel->Lock, &OldIrql);
 
-    FnTimerDestroy(Timer);
+    Timer->Closing = TRUE;
+
+    //
+    // Wait for any in-progress callback to return; the timer is not rearmed
+    // once it is marked as closing.
+    //
+    while (Wheel->RunningTimer == Timer) {
+        KeClearEvent(&Wheel->CallbackEvent);
+        KeReleaseSpinLock(&Wheel->Lock, OldIrql);
+        NT_VERIFY(FnWaitObject(&Wheel->CallbackEvent, NULL) == STATUS_SUCCESS);
+        KeAcquireSpinLock(&Wheel->Lock, &OldIrql);
+    }
+
+    RemoveEntryList(&Timer->Link);
+    Wheel->TimerCount--;
+
+    KeReleaseSpinLock(&Wheel->Lock, OldIrql);
+
+    ExFreePoolWithTag(Timer, POOLTAG_TIMER);
 }
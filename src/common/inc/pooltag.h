@@ -11,13 +11,16 @@
 #define POOLTAG_FNIO_BUFFER                'fBoI' // IoBf
 
 #define POOLTAG_MP_ADAPTER                 'dApM' // MpAd
+#define POOLTAG_MP_CHECKSUM                'cCpM' // MpCc
 #define POOLTAG_MP_EXCLUSIVE               'xEpM' // MpEx
+#define POOLTAG_MP_LATENCY                 'aLpM' // MpLa
 #define POOLTAG_MP_OID                     'iOpM' // MpOi
 #define POOLTAG_MP_PORT                    'tPpM' // MpPt
 #define POOLTAG_MP_RSS                     'sRpM' // MpRs
 #define POOLTAG_MP_SHARED                  'hSpM' // MpSh
 #define POOLTAG_MP_SHARED_RX               'rSpM' // MpSr
 #define POOLTAG_MP_SHARED_TX               'tSpM' // MpSt
+#define POOLTAG_MP_STATISTICS              'cSpM' // MpSc
 
 #define POOLTAG_LWF_FILTER                 'iFfL' // LfFi
 #define POOLTAG_LWF_NBL                    'bNfL' // LfNb
@@ -35,5 +38,9 @@
 #define POOLTAG_FNSOCK_SEND                'sSsF' // FsSs
 #define POOLTAG_FNSOCK_RECV                'rSsF' // FsSr
 #define POOLTAG_FNSOCK_ACCEPT              'aSsF' // FsSa
+#define POOLTAG_FNSOCK_QUEUE               'qSsF' // FsSq
+#define POOLTAG_FNSOCK_ASYNC               'oSsF' // FsSo
+#define POOLTAG_FNSOCK_POLL                'pSsF' // FsSp
 
 #define POOLTAG_TIMER                      'mtnF' // Fntm
+#define POOLTAG_TIMER_WHEEL                'wtnF' // Fntw
@@ -69,20 +69,58 @@ BounceBuffer(
         goto Exit;
     }
 
+    //
+    // The allocation is entirely overwritten by the copy, or freed if the copy
+    // fails, so skip zeroing it.
+    //
     Bounce->Buffer =
-        ExAllocatePoolZero(NonPagedPoolNx, BufferSize, POOLTAG_BOUNCE_BUFFER);
+        ExAllocatePoolUninitialized(NonPagedPoolNx, BufferSize, POOLTAG_BOUNCE_BUFFER);
     if (Bounce->Buffer == NULL) {
         Status = STATUS_NO_MEMORY;
         goto Exit;
     }
 
+    Status = BounceCopy(Bounce->Buffer, RequestorMode, Buffer, BufferSize, Alignment);
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        BounceCleanup(Bounce);
+    }
+
+    return Status;
+}
+
+__declspec(code_seg("PAGE"))
+NTSTATUS
+BounceCopy(
+    _Out_writes_bytes_(BufferSize) VOID *Destination,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _In_opt_ CONST VOID *Buffer,
+    _In_ SIZE_T BufferSize,
+    _In_ UINT32 Alignment
+    )
+{
+    NTSTATUS Status;
+
+    PAGED_CODE();
+    ASSERT(Alignment <= MEMORY_ALLOCATION_ALIGNMENT);
+
+    if (BufferSize == 0) {
+        //
+        // Nothing to do.
+        //
+        Status = STATUS_SUCCESS;
+        goto Exit;
+    }
+
     __try {
         if (RequestorMode != KernelMode) {
             #pragma warning(suppress:6387) // Buffer could be NULL.
             ProbeForRead((VOID *)Buffer, BufferSize, Alignment);
         }
         #pragma warning(suppress:6387) // Buffer could be NULL.
-        RtlCopyVolatileMemory(Bounce->Buffer, Buffer, BufferSize);
+        RtlCopyVolatileMemory(Destination, Buffer, BufferSize);
     } __except (EXCEPTION_EXECUTE_HANDLER) {
         Status = GetExceptionCode();
         goto Exit;
@@ -92,9 +130,5 @@ BounceBuffer(
 
 Exit:
 
-    if (!NT_SUCCESS(Status)) {
-        BounceCleanup(Bounce);
-    }
-
     return Status;
 }
@@ -14,7 +14,7 @@ FnIoEnqueueGetNblContext(
     return (ENQUEUE_NBL_CONTEXT *)NET_BUFFER_LIST_CONTEXT_DATA_START(NetBufferList);
 }
 
-_IRQL_requires_max_(DISPATCH_LEVEL)
+_IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS
 FnIoEnqueueFrameBegin(
     _In_ KPROCESSOR_MODE RequestorMode,
@@ -85,9 +85,16 @@ FnIoEnqueueFrameBegin(
         }
 
         //
-        // Copy the whole RX buffer, including leading and trailing bytes.
+        // Copy the whole RX buffer, including leading and trailing bytes,
+        // straight from the requestor into the MDL.
         //
-        RtlCopyMemory(MdlBuffer, RxBuffer->VirtualAddress, RxBuffer->BufferLength);
+        Status =
+            BounceCopy(
+                MdlBuffer, RequestorMode, RxBuffer->VirtualAddress, RxBuffer->BufferLength,
+                __alignof(UCHAR));
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
 
         //
         // Fix up the trailing bytes of the final MDL.
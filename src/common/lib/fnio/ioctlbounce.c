@@ -11,12 +11,6 @@ FnIoIoctlCleanupEnqueue(
     )
 {
     if (EnqueueIn->Frame.Buffers != NULL) {
-        for (UINT32 BufferIndex = 0; BufferIndex < EnqueueIn->Frame.BufferCount; BufferIndex++) {
-            if (EnqueueIn->Frame.Buffers[BufferIndex].VirtualAddress != NULL) {
-                BounceFree(EnqueueIn->Frame.Buffers[BufferIndex].VirtualAddress);
-            }
-        }
-
         BounceFree(EnqueueIn->Frame.Buffers);
     }
 }
@@ -30,14 +24,13 @@ FnIoIoctlBounceEnqueue(
     )
 {
     NTSTATUS Status;
-    BOUNCE_BUFFER Buffers, Buffer;
+    BOUNCE_BUFFER Buffers;
     CONST DATA_ENQUEUE_IN *IoBuffer = InputBuffer;
     UINT32 BufferCount;
     SIZE_T BufferArraySize;
 
     RtlZeroMemory(EnqueueIn, sizeof(*EnqueueIn));
     BounceInitialize(&Buffers);
-    BounceInitialize(&Buffer);
 
     if (InputBufferLength < sizeof(*IoBuffer)) {
         Status = STATUS_BUFFER_TOO_SMALL;
@@ -75,6 +68,11 @@ FnIoIoctlBounceEnqueue(
 
     EnqueueIn->Frame.Buffers = BounceRelease(&Buffers);
 
+    //
+    // Validate the trusted buffer array. The buffer data itself is not bounced
+    // here: the virtual addresses remain untrusted, and the data is copied
+    // directly into the frame's own memory when the frame is built.
+    //
     while (EnqueueIn->Frame.BufferCount < BufferCount) {
         CONST UINT32 BufferIndex = EnqueueIn->Frame.BufferCount;
         CONST DATA_BUFFER *RxBuffer = &EnqueueIn->Frame.Buffers[BufferIndex];
@@ -95,22 +93,11 @@ FnIoIoctlBounceEnqueue(
             goto Exit;
         }
 
-        //
-        // Bounce each user buffer into a trusted kernel buffer.
-        //
-        Status =
-            BounceBuffer(
-                &Buffer, RequestorMode, RxBuffer->VirtualAddress, RxBuffer->BufferLength,
-                __alignof(UCHAR));
-        if (!NT_SUCCESS(Status)) {
-            goto Exit;
-        }
-
-        EnqueueIn->Frame.Buffers[BufferIndex] = *RxBuffer;
-        EnqueueIn->Frame.Buffers[BufferIndex].VirtualAddress = BounceRelease(&Buffer);
         EnqueueIn->Frame.BufferCount++;
     }
 
+    Status = STATUS_SUCCESS;
+
 Exit:
 
     if (!NT_SUCCESS(Status)) {
@@ -118,7 +105,6 @@ Exit:
         RtlZeroMemory(EnqueueIn, sizeof(*EnqueueIn));
     }
 
-    BounceCleanup(&Buffer);
     BounceCleanup(&Buffers);
 
     return Status;
@@ -10,16 +10,29 @@
 #include <fnioctl_um.h>
 #include "invokesystemrelayioctl.h"
 
+#include "shell.h"
 #include "trace.h"
 
 #include "main.tmh"
 
 #define SVCNAME "isrsvc"
 
+//
+// The number of workers, each with its own get request outstanding, can be
+// configured via the WorkerCount DWORD value under the service's Parameters
+// registry key. Setting the PersistentShell DWORD value to 1 runs commands on
+// a persistent interpreter per worker instead of via system().
+//
+#define SVC_PARAMETERS_KEY "SYSTEM\\CurrentControlSet\\Services\\" SVCNAME "\\Parameters"
+#define SVC_DEFAULT_WORKER_COUNT 8
+#define SVC_MAX_WORKER_COUNT MAXIMUM_WAIT_OBJECTS
+
 static SERVICE_STATUS SvcStatus;
 static SERVICE_STATUS_HANDLE SvcStatusHandle;
-static BOOLEAN Stopping = FALSE;
+static volatile BOOLEAN Stopping = FALSE;
+static HANDLE StopEvent = NULL;
 static FNIOCTL_HANDLE IsrHandle = NULL;
+static BOOLEAN UsePersistentShell = FALSE;
 
 //
 // Called to update SCM of the service status.
@@ -68,12 +81,15 @@ SvcCtrlHandler(
         ReportSvcStatus(SERVICE_STOP_PENDING, NO_ERROR, 0);
 
         //
-        // Mark the service as stopping.
+        // Mark the service as stopping, and abandon the workers' waits for
+        // command output.
         //
         Stopping = TRUE;
+        SetEvent(StopEvent);
 
         //
-        // Cancel any pending IO (most likely the get IOCTL is pending).
+        // Cancel any pending IO (most likely the workers' get IOCTLs are
+        // pending).
         //
         if (!CancelIoEx(IsrHandle, NULL)) {
             TraceError(TRACE_CONTROL, "CancelIoEx failed with %d", GetLastError());
@@ -86,16 +102,94 @@ SvcCtrlHandler(
    }
 }
 
+//
+// Streams a request's captured output to the driver in chunks.
+//
+typedef struct _SVC_OUTPUT {
+    UINT32 ChunkLength;
+    UINT32 TotalLength;
+    UINT32 Flags;
+    ISR_POST_OUTPUT_INPUT Chunk;
+} SVC_OUTPUT;
+
+static
+VOID
+FlushOutput(
+    _Inout_ SVC_OUTPUT *Output
+    )
+{
+    HRESULT Result;
+
+    if (Output->ChunkLength == 0) {
+        return;
+    }
+
+    Result =
+        FnIoctl(
+            IsrHandle, ISR_IOCTL_INVOKE_SYSTEM_POST_OUTPUT, &Output->Chunk,
+            FIELD_OFFSET(ISR_POST_OUTPUT_INPUT, Data) + Output->ChunkLength,
+            NULL, 0, NULL, NULL);
+    if (FAILED(Result)) {
+        TraceError(TRACE_CONTROL, "ISR_IOCTL_INVOKE_SYSTEM_POST_OUTPUT failed with %d", Result);
+        Output->Flags |= ISR_OUTPUT_FLAG_TRUNCATED;
+    }
+
+    Output->ChunkLength = 0;
+}
+
 static
 VOID
+AppendOutput(
+    _In_opt_ VOID *Context,
+    _In_reads_bytes_(Length) const CHAR *Data,
+    _In_ UINT32 Length
+    )
+{
+    SVC_OUTPUT *Output = (SVC_OUTPUT *)Context;
+    UINT32 CopyLength;
+
+    //
+    // Keep draining output beyond the capture limit, so the command does not
+    // block writing it, but drop it.
+    //
+    if (Length > ISR_MAX_OUTPUT_LENGTH - Output->TotalLength) {
+        Length = ISR_MAX_OUTPUT_LENGTH - Output->TotalLength;
+        Output->Flags |= ISR_OUTPUT_FLAG_TRUNCATED;
+    }
+
+    while (Length > 0) {
+        CopyLength = (UINT32)min(Length, sizeof(Output->Chunk.Data) - Output->ChunkLength);
+        RtlCopyMemory(Output->Chunk.Data + Output->ChunkLength, Data, CopyLength);
+        Output->ChunkLength += CopyLength;
+        Output->TotalLength += CopyLength;
+        Data += CopyLength;
+        Length -= CopyLength;
+
+        if (Output->ChunkLength == sizeof(Output->Chunk.Data)) {
+            FlushOutput(Output);
+        }
+    }
+}
+
+static
+DWORD
+WINAPI
 DoServiceWork(
-    VOID
+    _In_ VOID *Context
     )
 {
+    SVC_SHELL *Shell = (SVC_SHELL *)Context;
     HRESULT Result;
     INT CommandResult;
     ISR_GET_OUTPUT Get;
     ISR_POST_INPUT Post;
+    SVC_OUTPUT *Output;
+
+    Output = (SVC_OUTPUT *)malloc(sizeof(*Output));
+    if (Output == NULL) {
+        TraceError(TRACE_CONTROL, "Failed to allocate output buffer");
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
 
     while (!Stopping) {
         //
@@ -119,11 +213,36 @@ DoServiceWork(
         // Process the request.
         //
         TraceInfo(TRACE_CONTROL, "Running request Id=%llu, Command=%s", Get.Id, Get.Command);
-        CommandResult = system(Get.Command);
+        RtlZeroMemory(Output, FIELD_OFFSET(SVC_OUTPUT, Chunk.Data));
+        Output->Chunk.Id = Get.Id;
+
+        if (UsePersistentShell) {
+            Result =
+                ShellRun(
+                    Shell, Get.Command,
+                    (Get.Flags & ISR_GET_FLAG_CAPTURE_OUTPUT) ? AppendOutput : NULL, Output,
+                    &CommandResult);
+            if (FAILED(Result)) {
+                TraceError(TRACE_CONTROL, "ShellRun failed with %d", Result);
+                CommandResult = -1;
+            }
+        } else if (Get.Flags & ISR_GET_FLAG_CAPTURE_OUTPUT) {
+            Result =
+                ShellRunOnce(StopEvent, Get.Command, AppendOutput, Output, &CommandResult);
+            if (FAILED(Result)) {
+                TraceError(TRACE_CONTROL, "ShellRunOnce failed with %d", Result);
+                CommandResult = -1;
+            }
+        } else {
+            CommandResult = system(Get.Command);
+        }
+
+        FlushOutput(Output);
 
         RtlZeroMemory(&Post, sizeof(Post));
         Post.Id = Get.Id;
         Post.Result = CommandResult;
+        Post.OutputFlags = Output->Flags;
 
         //
         // Post the status to the driver.
@@ -138,6 +257,93 @@ DoServiceWork(
             continue;
         }
     }
+
+    ShellCleanup(Shell);
+    free(Output);
+
+    return 0;
+}
+
+static
+DWORD
+GetParameter(
+    _In_z_ const CHAR *Name,
+    _In_ DWORD DefaultValue
+    )
+{
+    DWORD Value;
+    DWORD Size = sizeof(Value);
+    LSTATUS Error;
+
+    Error =
+        RegGetValueA(
+            HKEY_LOCAL_MACHINE, SVC_PARAMETERS_KEY, Name, RRF_RT_REG_DWORD, NULL,
+            &Value, &Size);
+    if (Error != ERROR_SUCCESS) {
+        Value = DefaultValue;
+    }
+
+    return Value;
+}
+
+static
+DWORD
+RunServiceWorkers(
+    VOID
+    )
+{
+    DWORD ExitCode;
+    HANDLE Workers[SVC_MAX_WORKER_COUNT];
+    SVC_SHELL Shells[SVC_MAX_WORKER_COUNT];
+    UINT32 WorkerCount;
+    UINT32 StartedCount = 0;
+
+    WorkerCount =
+        min(max(GetParameter("WorkerCount", SVC_DEFAULT_WORKER_COUNT), 1),
+            SVC_MAX_WORKER_COUNT);
+    UsePersistentShell = GetParameter("PersistentShell", FALSE) != FALSE;
+
+    TraceInfo(
+        TRACE_CONTROL, "WorkerCount=%u UsePersistentShell=%u",
+        WorkerCount, UsePersistentShell);
+
+    while (StartedCount < WorkerCount) {
+        ShellInitialize(&Shells[StartedCount], StopEvent);
+        Workers[StartedCount] =
+            CreateThread(NULL, 0, DoServiceWork, &Shells[StartedCount], 0, NULL);
+        if (Workers[StartedCount] == NULL) {
+            ExitCode = GetLastError();
+            TraceError(TRACE_CONTROL, "CreateThread failed with %d", ExitCode);
+            Stopping = TRUE;
+            SetEvent(StopEvent);
+            CancelIoEx(IsrHandle, NULL);
+            goto Exit;
+        }
+
+        StartedCount++;
+    }
+
+    ExitCode = NO_ERROR;
+
+Exit:
+
+    //
+    // Wait for all workers to exit. A worker may be between checking the stop
+    // flag and pending its next get when the service is stopped, so keep
+    // canceling IO until every worker has observed the flag.
+    //
+    while (StartedCount > 0 &&
+            WaitForMultipleObjects(StartedCount, Workers, TRUE, 1000) == WAIT_TIMEOUT) {
+        if (Stopping) {
+            CancelIoEx(IsrHandle, NULL);
+        }
+    }
+
+    for (UINT32 Index = 0; Index < StartedCount; Index++) {
+        CloseHandle(Workers[Index]);
+    }
+
+    return ExitCode;
 }
 
 //
@@ -180,6 +386,13 @@ SvcMain(
 
     ReportSvcStatus(SERVICE_START_PENDING, NO_ERROR, 3000);
 
+    StopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (StopEvent == NULL) {
+        ExitCode = GetLastError();
+        TraceError(TRACE_CONTROL, "CreateEventW failed with %d", ExitCode);
+        goto Exit;
+    }
+
     OpenService =
         (ISR_OPEN_SERVICE *)
             IsrInitializeEa(ISR_FILE_TYPE_SERVICE, EaBuffer, sizeof(EaBuffer));
@@ -203,8 +416,7 @@ SvcMain(
 
     ReportSvcStatus(SERVICE_RUNNING, NO_ERROR, 0);
 
-    DoServiceWork();
-    ExitCode = NO_ERROR;
+    ExitCode = RunServiceWorkers();
 
 Exit:
 
@@ -212,6 +424,10 @@ Exit:
         FnIoctlClose(IsrHandle);
     }
 
+    if (StopEvent != NULL) {
+        CloseHandle(StopEvent);
+    }
+
     ReportSvcStatus(SERVICE_STOPPED, ExitCode, 0);
 
     return;
@@ -0,0 +1,661 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#include <windows.h>
+#include <strsafe.h>
+#include <stdlib.h>
+
+#include "shell.h"
+#include "trace.h"
+
+#include "shell.tmh"
+
+//
+// Echo is turned off so that only command output is written to the output
+// pipe, and AutoRun commands are skipped.
+//
+#define SHELL_COMMAND_LINE "cmd.exe /Q /D /K"
+#define SHELL_ONCE_COMMAND_PREFIX "cmd.exe /c "
+
+//
+// Each command is followed by a line echoing a marker and the command's exit
+// code, which delimits the command's output. The error level is reset before
+// each command, since built-in commands may not set it.
+//
+#define SHELL_MARKER_FORMAT "ISRSVC-DONE-%llu:"
+#define SHELL_MARKER_LENGTH 64
+#define SHELL_RESET_ERRORLEVEL "(call )\r\n"
+
+//
+// Each command is written to a batch script owned by the shell, which the
+// shell then calls, since setlocal has no effect outside a batch script. The
+// command runs between setlocal and endlocal, so that changes it makes to the
+// working directory or environment do not carry over to later commands, and in
+// a block with its stdin redirected from NUL, so that it cannot read the
+// trailer or later commands from the shell's input. The exit code is expanded
+// before endlocal runs.
+//
+#define SHELL_SCRIPT_NAME_FORMAT "%sisrsvc-shell-%u.cmd"
+#define SHELL_SCRIPT_PREFIX "setlocal\r\n("
+#define SHELL_SCRIPT_SUFFIX ") <NUL\r\nendlocal & exit /b %ERRORLEVEL%\r\n"
+
+//
+// The output pipe is a named pipe so that reads can be abandoned: a fresh
+// shell must answer within SHELL_START_TIMEOUT_MS, and any read gives up once
+// the shell's stop event is signaled.
+//
+#define SHELL_PIPE_NAME_FORMAT "\\\\.\\pipe\\isrsvc-shell-%u-%u"
+#define SHELL_PIPE_NAME_LENGTH 64
+
+#define SHELL_READ_BUFFER_SIZE 4096
+#define SHELL_START_TIMEOUT_MS 10000
+#define SHELL_EXIT_TIMEOUT_MS 5000
+
+static volatile LONG ShellPipeSequence;
+
+VOID
+ShellInitialize(
+    _Out_ SVC_SHELL *Shell,
+    _In_opt_ HANDLE StopEvent
+    )
+{
+    RtlZeroMemory(Shell, sizeof(*Shell));
+    Shell->StopEvent = StopEvent;
+}
+
+VOID
+ShellCleanup(
+    _Inout_ SVC_SHELL *Shell
+    )
+{
+    if (Shell->Input != NULL) {
+        CloseHandle(Shell->Input);
+        Shell->Input = NULL;
+    }
+
+    if (Shell->Output != NULL) {
+        CloseHandle(Shell->Output);
+        Shell->Output = NULL;
+    }
+
+    if (Shell->OutputEvent != NULL) {
+        CloseHandle(Shell->OutputEvent);
+        Shell->OutputEvent = NULL;
+    }
+
+    if (Shell->Process != NULL) {
+        //
+        // Wait for the interpreter to exit so that it no longer holds the
+        // script open.
+        //
+        TerminateProcess(Shell->Process, ERROR_PROCESS_ABORTED);
+        WaitForSingleObject(Shell->Process, SHELL_EXIT_TIMEOUT_MS);
+        CloseHandle(Shell->Process);
+        Shell->Process = NULL;
+    }
+
+    if (Shell->ScriptPath[0] != '\0') {
+        DeleteFileA(Shell->ScriptPath);
+        Shell->ScriptPath[0] = '\0';
+    }
+}
+
+static
+HRESULT
+ShellWrite(
+    _In_ SVC_SHELL *Shell,
+    _In_z_ const CHAR *Data
+    )
+{
+    DWORD Length = (DWORD)strlen(Data);
+    DWORD Written;
+
+    if (!WriteFile(Shell->Input, Data, Length, &Written, NULL)) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return (Written == Length) ? S_OK : E_FAIL;
+}
+
+//
+// Replaces the shell's batch script with one that runs the command.
+//
+static
+HRESULT
+ShellWriteScript(
+    _In_ SVC_SHELL *Shell,
+    _In_z_ const CHAR *Command
+    )
+{
+    HRESULT Result = S_OK;
+    const CHAR *Parts[] = { SHELL_SCRIPT_PREFIX, Command, SHELL_SCRIPT_SUFFIX };
+    HANDLE Script;
+    DWORD Length;
+    DWORD Written;
+
+    Script =
+        CreateFileA(
+            Shell->ScriptPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY,
+            NULL);
+    if (Script == INVALID_HANDLE_VALUE) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Parts); Index++) {
+        Length = (DWORD)strlen(Parts[Index]);
+        if (!WriteFile(Script, Parts[Index], Length, &Written, NULL)) {
+            Result = HRESULT_FROM_WIN32(GetLastError());
+            break;
+        }
+        if (Written != Length) {
+            Result = E_FAIL;
+            break;
+        }
+    }
+
+    CloseHandle(Script);
+    return Result;
+}
+
+//
+// Reads the next chunk of output, or fails with ERROR_TIMEOUT if none arrives
+// within TimeoutMs or the shell is stopped first.
+//
+static
+HRESULT
+ShellRead(
+    _In_ SVC_SHELL *Shell,
+    _Out_writes_bytes_to_(Length, *BytesRead) CHAR *Buffer,
+    _In_ DWORD Length,
+    _In_ DWORD TimeoutMs,
+    _Out_ DWORD *BytesRead
+    )
+{
+    OVERLAPPED Overlapped = {0};
+    HANDLE Events[2];
+    DWORD EventCount = 0;
+    DWORD Error;
+
+    *BytesRead = 0;
+    Overlapped.hEvent = Shell->OutputEvent;
+
+    if (!ReadFile(Shell->Output, Buffer, Length, NULL, &Overlapped)) {
+        Error = GetLastError();
+        if (Error != ERROR_IO_PENDING) {
+            return HRESULT_FROM_WIN32(Error);
+        }
+
+        Events[EventCount++] = Shell->OutputEvent;
+        if (Shell->StopEvent != NULL) {
+            Events[EventCount++] = Shell->StopEvent;
+        }
+
+        if (WaitForMultipleObjects(EventCount, Events, FALSE, TimeoutMs) != WAIT_OBJECT_0) {
+            //
+            // The read refers to Buffer, so wait for the cancellation to
+            // finish before returning. The shell is recycled, so any output
+            // read in the meantime is discarded.
+            //
+            CancelIoEx(Shell->Output, &Overlapped);
+            GetOverlappedResult(Shell->Output, &Overlapped, BytesRead, TRUE);
+            *BytesRead = 0;
+            return HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+        }
+    }
+
+    if (!GetOverlappedResult(Shell->Output, &Overlapped, BytesRead, FALSE)) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return S_OK;
+}
+
+static
+const CHAR *
+ShellFindMarker(
+    _In_reads_(Length) const CHAR *Buffer,
+    _In_ SIZE_T Length,
+    _In_z_ const CHAR *Marker
+    )
+{
+    SIZE_T MarkerLength = strlen(Marker);
+
+    //
+    // Command output is not necessarily text, so it may contain nulls.
+    //
+    for (SIZE_T Offset = 0; Offset + MarkerLength <= Length; Offset++) {
+        if (RtlEqualMemory(Buffer + Offset, Marker, MarkerLength)) {
+            return Buffer + Offset;
+        }
+    }
+
+    return NULL;
+}
+
+//
+// Reads output until the marker line, and returns the exit code it carries.
+// Fails if no output arrives for TimeoutMs.
+//
+static
+HRESULT
+ShellReadToMarker(
+    _In_ SVC_SHELL *Shell,
+    _In_z_ const CHAR *Marker,
+    _In_ DWORD TimeoutMs,
+    _In_opt_ SHELL_OUTPUT_FN *OutputFn,
+    _In_opt_ VOID *OutputContext,
+    _Out_ INT *CommandResult
+    )
+{
+    CHAR Buffer[SHELL_READ_BUFFER_SIZE];
+    SIZE_T Length = 0;
+    SIZE_T MarkerLength = strlen(Marker);
+    const CHAR *Found;
+    const CHAR *LineEnd;
+    DWORD BytesRead;
+    HRESULT Result;
+
+    for (;;) {
+        Result =
+            ShellRead(
+                Shell, Buffer + Length, (DWORD)(sizeof(Buffer) - 1 - Length), TimeoutMs,
+                &BytesRead);
+        if (FAILED(Result)) {
+            return Result;
+        }
+
+        Length += BytesRead;
+        Buffer[Length] = '\0';
+
+        Found = ShellFindMarker(Buffer, Length, Marker);
+        if (Found == NULL) {
+            //
+            // Keep enough trailing output to match a marker split across reads.
+            //
+            SIZE_T Keep = min(Length, MarkerLength - 1);
+            if (OutputFn != NULL && Length > Keep) {
+                OutputFn(OutputContext, Buffer, (UINT32)(Length - Keep));
+            }
+            MoveMemory(Buffer, Buffer + Length - Keep, Keep);
+            Length = Keep;
+            continue;
+        }
+
+        if (OutputFn != NULL && Found > Buffer) {
+            OutputFn(OutputContext, Buffer, (UINT32)(Found - Buffer));
+        }
+
+        LineEnd = (const CHAR *)memchr(Found, '\n', Buffer + Length - Found);
+        if (LineEnd != NULL) {
+            *CommandResult = strtol(Found + MarkerLength, NULL, 10);
+            return S_OK;
+        }
+
+        //
+        // The exit code has not been fully read yet.
+        //
+        Length = Buffer + Length - Found;
+        MoveMemory(Buffer, Found, Length);
+    }
+}
+
+//
+// Starts an interpreter with its stdin, stdout and stderr redirected to pipes
+// owned by the shell.
+//
+static
+HRESULT
+ShellCreateProcess(
+    _Inout_ SVC_SHELL *Shell,
+    _Inout_z_ CHAR *CommandLine
+    )
+{
+    HRESULT Result;
+    SECURITY_ATTRIBUTES Inherit = { sizeof(Inherit), NULL, TRUE };
+    HANDLE ChildInput = NULL;
+    HANDLE ChildOutput = NULL;
+    HANDLE InheritedHandles[2];
+    CHAR PipeName[SHELL_PIPE_NAME_LENGTH];
+    STARTUPINFOEXA StartupInfo = {0};
+    PROCESS_INFORMATION ProcessInfo = {0};
+    SIZE_T AttributeListSize = 0;
+    BOOLEAN AttributeListInitialized = FALSE;
+
+    StringCchPrintfA(
+        PipeName, sizeof(PipeName), SHELL_PIPE_NAME_FORMAT, GetCurrentProcessId(),
+        (UINT32)InterlockedIncrement(&ShellPipeSequence));
+
+    if (!CreatePipe(&ChildInput, &Shell->Input, &Inherit, 0) ||
+        !SetHandleInformation(Shell->Input, HANDLE_FLAG_INHERIT, 0)) {
+        Result = HRESULT_FROM_WIN32(GetLastError());
+        TraceError(TRACE_CONTROL, "Creating shell pipes failed with %d", Result);
+        goto Exit;
+    }
+
+    Shell->Output =
+        CreateNamedPipeA(
+            PipeName, PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+            PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1, 0,
+            SHELL_READ_BUFFER_SIZE, 0, NULL);
+    if (Shell->Output == INVALID_HANDLE_VALUE) {
+        Shell->Output = NULL;
+        Result = HRESULT_FROM_WIN32(GetLastError());
+        TraceError(TRACE_CONTROL, "Creating shell pipes failed with %d", Result);
+        goto Exit;
+    }
+
+    ChildOutput =
+        CreateFileA(PipeName, GENERIC_WRITE, 0, &Inherit, OPEN_EXISTING, 0, NULL);
+    if (ChildOutput == INVALID_HANDLE_VALUE) {
+        ChildOutput = NULL;
+        Result = HRESULT_FROM_WIN32(GetLastError());
+        TraceError(TRACE_CONTROL, "Creating shell pipes failed with %d", Result);
+        goto Exit;
+    }
+
+    Shell->OutputEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (Shell->OutputEvent == NULL) {
+        Result = HRESULT_FROM_WIN32(GetLastError());
+        TraceError(TRACE_CONTROL, "CreateEventW failed with %d", Result);
+        goto Exit;
+    }
+
+    //
+    // Workers start shells concurrently, so restrict inheritance to this
+    // shell's own pipe ends; otherwise another shell could hold them open.
+    //
+    InitializeProcThreadAttributeList(NULL, 1, 0, &AttributeListSize);
+    StartupInfo.lpAttributeList = (LPPROC_THREAD_ATTRIBUTE_LIST)malloc(AttributeListSize);
+    if (StartupInfo.lpAttributeList == NULL) {
+        Result = E_OUTOFMEMORY;
+        goto Exit;
+    }
+
+    if (!InitializeProcThreadAttributeList(
+            StartupInfo.lpAttributeList, 1, 0, &AttributeListSize)) {
+        Result = HRESULT_FROM_WIN32(GetLastError());
+        TraceError(TRACE_CONTROL, "InitializeProcThreadAttributeList failed with %d", Result);
+        goto Exit;
+    }
+    AttributeListInitialized = TRUE;
+
+    InheritedHandles[0] = ChildInput;
+    InheritedHandles[1] = ChildOutput;
+    if (!UpdateProcThreadAttribute(
+            StartupInfo.lpAttributeList, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST,
+            InheritedHandles, sizeof(InheritedHandles), NULL, NULL)) {
+        Result = HRESULT_FROM_WIN32(GetLastError());
+        TraceError(TRACE_CONTROL, "UpdateProcThreadAttribute failed with %d", Result);
+        goto Exit;
+    }
+
+    StartupInfo.StartupInfo.cb = sizeof(StartupInfo);
+    StartupInfo.StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+    StartupInfo.StartupInfo.hStdInput = ChildInput;
+    StartupInfo.StartupInfo.hStdOutput = ChildOutput;
+    StartupInfo.StartupInfo.hStdError = ChildOutput;
+
+    if (!CreateProcessA(
+            NULL, CommandLine, NULL, NULL, TRUE,
+            CREATE_NO_WINDOW | EXTENDED_STARTUPINFO_PRESENT, NULL, NULL,
+            &StartupInfo.StartupInfo, &ProcessInfo)) {
+        Result = HRESULT_FROM_WIN32(GetLastError());
+        TraceError(TRACE_CONTROL, "CreateProcessA failed with %d", Result);
+        goto Exit;
+    }
+
+    CloseHandle(ProcessInfo.hThread);
+    Shell->Process = ProcessInfo.hProcess;
+
+    TraceInfo(TRACE_CONTROL, "Started shell ProcessId=%u", ProcessInfo.dwProcessId);
+
+Exit:
+
+    if (AttributeListInitialized) {
+        DeleteProcThreadAttributeList(StartupInfo.lpAttributeList);
+    }
+
+    if (StartupInfo.lpAttributeList != NULL) {
+        free(StartupInfo.lpAttributeList);
+    }
+
+    if (ChildInput != NULL) {
+        CloseHandle(ChildInput);
+    }
+
+    if (ChildOutput != NULL) {
+        CloseHandle(ChildOutput);
+    }
+
+    if (FAILED(Result)) {
+        ShellCleanup(Shell);
+    }
+
+    return Result;
+}
+
+static
+HRESULT
+ShellStart(
+    _Inout_ SVC_SHELL *Shell
+    )
+{
+    HRESULT Result;
+    CHAR CommandLine[] = SHELL_COMMAND_LINE;
+    CHAR Marker[SHELL_MARKER_LENGTH];
+    CHAR Sync[SHELL_MARKER_LENGTH + 32];
+    CHAR TempPath[MAX_PATH];
+    INT SyncResult;
+
+    Result = ShellCreateProcess(Shell, CommandLine);
+    if (FAILED(Result)) {
+        goto Exit;
+    }
+
+    //
+    // The script is named after the interpreter, which is the only process
+    // that runs it.
+    //
+    if (GetTempPathA(sizeof(TempPath), TempPath) == 0) {
+        Result = HRESULT_FROM_WIN32(GetLastError());
+        TraceError(TRACE_CONTROL, "GetTempPathA failed with %d", Result);
+        goto Exit;
+    }
+
+    Result =
+        StringCchPrintfA(
+            Shell->ScriptPath, sizeof(Shell->ScriptPath), SHELL_SCRIPT_NAME_FORMAT, TempPath,
+            GetProcessId(Shell->Process));
+    if (FAILED(Result)) {
+        Shell->ScriptPath[0] = '\0';
+        TraceError(TRACE_CONTROL, "Formatting the shell script path failed with %d", Result);
+        goto Exit;
+    }
+
+    //
+    // Skip past the interpreter's banner.
+    //
+    StringCchPrintfA(Marker, sizeof(Marker), SHELL_MARKER_FORMAT, ++Shell->Sequence);
+    StringCchPrintfA(Sync, sizeof(Sync), "echo %s0\r\n", Marker);
+
+    Result = ShellWrite(Shell, Sync);
+    if (FAILED(Result)) {
+        TraceError(TRACE_CONTROL, "Writing to shell failed with %d", Result);
+        goto Exit;
+    }
+
+    Result = ShellReadToMarker(Shell, Marker, SHELL_START_TIMEOUT_MS, NULL, NULL, &SyncResult);
+    if (FAILED(Result)) {
+        TraceError(TRACE_CONTROL, "Reading from shell failed with %d", Result);
+        goto Exit;
+    }
+
+Exit:
+
+    if (FAILED(Result)) {
+        ShellCleanup(Shell);
+    }
+
+    return Result;
+}
+
+HRESULT
+ShellRun(
+    _Inout_ SVC_SHELL *Shell,
+    _In_z_ const CHAR *Command,
+    _In_opt_ SHELL_OUTPUT_FN *OutputFn,
+    _In_opt_ VOID *OutputContext,
+    _Out_ INT *CommandResult
+    )
+{
+    HRESULT Result;
+    CHAR Marker[SHELL_MARKER_LENGTH];
+    CHAR Call[MAX_PATH + 16];
+    CHAR Trailer[SHELL_MARKER_LENGTH + 32];
+    DWORD ExitCode;
+
+    *CommandResult = -1;
+
+    //
+    // The shell may have exited since the last command; retry once on a new
+    // shell if the command could not be written.
+    //
+    for (UINT32 Attempt = 0; Attempt < 2; Attempt++) {
+        if (Shell->Process == NULL) {
+            Result = ShellStart(Shell);
+            if (FAILED(Result)) {
+                return Result;
+            }
+        }
+
+        Result = ShellWriteScript(Shell, Command);
+        if (FAILED(Result)) {
+            TraceError(TRACE_CONTROL, "Writing shell script failed with %d", Result);
+            return Result;
+        }
+
+        StringCchPrintfA(Call, sizeof(Call), "call \"%s\"\r\n", Shell->ScriptPath);
+
+        Result = ShellWrite(Shell, SHELL_RESET_ERRORLEVEL);
+        if (SUCCEEDED(Result)) {
+            Result = ShellWrite(Shell, Call);
+        }
+        if (SUCCEEDED(Result)) {
+            break;
+        }
+
+        TraceError(TRACE_CONTROL, "Writing to shell failed with %d", Result);
+        ShellCleanup(Shell);
+    }
+
+    if (FAILED(Result)) {
+        return Result;
+    }
+
+    StringCchPrintfA(Marker, sizeof(Marker), SHELL_MARKER_FORMAT, ++Shell->Sequence);
+    StringCchPrintfA(Trailer, sizeof(Trailer), "echo %s%%ERRORLEVEL%%\r\n", Marker);
+
+    Result = ShellWrite(Shell, Trailer);
+    if (SUCCEEDED(Result)) {
+        Result =
+            ShellReadToMarker(
+                Shell, Marker, INFINITE, OutputFn, OutputContext, CommandResult);
+    }
+
+    if (FAILED(Result)) {
+        //
+        // The command may have exited the shell itself, in which case the
+        // shell's exit code is the command's result. Either way, the shell is
+        // recycled. A stopped read leaves the command running, so the shell
+        // is terminated without waiting for it.
+        //
+        if (Result != HRESULT_FROM_WIN32(ERROR_TIMEOUT) &&
+            WaitForSingleObject(Shell->Process, SHELL_EXIT_TIMEOUT_MS) == WAIT_OBJECT_0 &&
+            GetExitCodeProcess(Shell->Process, &ExitCode)) {
+            *CommandResult = (INT)ExitCode;
+            Result = S_OK;
+        } else {
+            TraceError(TRACE_CONTROL, "Shell failed with %d", Result);
+        }
+
+        ShellCleanup(Shell);
+    }
+
+    return Result;
+}
+
+HRESULT
+ShellRunOnce(
+    _In_opt_ HANDLE StopEvent,
+    _In_z_ const CHAR *Command,
+    _In_ SHELL_OUTPUT_FN *OutputFn,
+    _In_opt_ VOID *OutputContext,
+    _Out_ INT *CommandResult
+    )
+{
+    HRESULT Result;
+    SVC_SHELL Shell;
+    CHAR *CommandLine = NULL;
+    SIZE_T CommandLineSize;
+    CHAR Buffer[SHELL_READ_BUFFER_SIZE];
+    DWORD BytesRead;
+    DWORD ExitCode;
+
+    *CommandResult = -1;
+    ShellInitialize(&Shell, StopEvent);
+
+    CommandLineSize = sizeof(SHELL_ONCE_COMMAND_PREFIX) + strlen(Command);
+    CommandLine = (CHAR *)malloc(CommandLineSize);
+    if (CommandLine == NULL) {
+        Result = E_OUTOFMEMORY;
+        goto Exit;
+    }
+
+    StringCchPrintfA(CommandLine, CommandLineSize, "%s%s", SHELL_ONCE_COMMAND_PREFIX, Command);
+
+    Result = ShellCreateProcess(&Shell, CommandLine);
+    if (FAILED(Result)) {
+        goto Exit;
+    }
+
+    //
+    // The interpreter reads no input.
+    //
+    CloseHandle(Shell.Input);
+    Shell.Input = NULL;
+
+    for (;;) {
+        Result = ShellRead(&Shell, Buffer, sizeof(Buffer), INFINITE, &BytesRead);
+        if (Result == HRESULT_FROM_WIN32(ERROR_TIMEOUT)) {
+            TraceError(TRACE_CONTROL, "Reading from shell failed with %d", Result);
+            goto Exit;
+        }
+        if (FAILED(Result) || BytesRead == 0) {
+            break;
+        }
+
+        OutputFn(OutputContext, Buffer, BytesRead);
+    }
+
+    if (WaitForSingleObject(Shell.Process, INFINITE) != WAIT_OBJECT_0 ||
+        !GetExitCodeProcess(Shell.Process, &ExitCode)) {
+        Result = HRESULT_FROM_WIN32(GetLastError());
+        TraceError(TRACE_CONTROL, "Waiting for shell failed with %d", Result);
+        goto Exit;
+    }
+
+    *CommandResult = (INT)ExitCode;
+    Result = S_OK;
+
+Exit:
+
+    ShellCleanup(&Shell);
+
+    if (CommandLine != NULL) {
+        free(CommandLine);
+    }
+
+    return Result;
+}
@@ -0,0 +1,80 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+//
+// A persistent command interpreter that runs commands one at a time, avoiding
+// the cost of starting a new interpreter for each command.
+//
+typedef struct _SVC_SHELL {
+    HANDLE Process;
+    HANDLE Input;
+    HANDLE Output;
+    HANDLE OutputEvent;
+    HANDLE StopEvent;
+    UINT64 Sequence;
+    CHAR ScriptPath[MAX_PATH];
+} SVC_SHELL;
+
+//
+// Receives a command's combined stdout and stderr as it is read.
+//
+typedef
+VOID
+SHELL_OUTPUT_FN(
+    _In_opt_ VOID *Context,
+    _In_reads_bytes_(Length) const CHAR *Data,
+    _In_ UINT32 Length
+    );
+
+//
+// Once StopEvent is signaled, waits for command output are abandoned and the
+// interpreter is recycled.
+//
+VOID
+ShellInitialize(
+    _Out_ SVC_SHELL *Shell,
+    _In_opt_ HANDLE StopEvent
+    );
+
+//
+// Terminates the interpreter, if it is running.
+//
+VOID
+ShellCleanup(
+    _Inout_ SVC_SHELL *Shell
+    );
+
+//
+// Runs a command and returns its exit code, as system() would. The interpreter
+// is started on first use, and is recycled if it exits or fails. The command
+// runs from a batch script between setlocal and endlocal, so changes it makes
+// to the working directory or environment do not carry over, and with its
+// stdin redirected from NUL, so it cannot consume the commands that follow it.
+// It must not contain unbalanced parentheses, and percent signs are expanded
+// as in a batch script.
+//
+HRESULT
+ShellRun(
+    _Inout_ SVC_SHELL *Shell,
+    _In_z_ const CHAR *Command,
+    _In_opt_ SHELL_OUTPUT_FN *OutputFn,
+    _In_opt_ VOID *OutputContext,
+    _Out_ INT *CommandResult
+    );
+
+//
+// Runs a command on a new interpreter, as system() would, and captures its
+// output.
+//
+HRESULT
+ShellRunOnce(
+    _In_opt_ HANDLE StopEvent,
+    _In_z_ const CHAR *Command,
+    _In_ SHELL_OUTPUT_FN *OutputFn,
+    _In_opt_ VOID *OutputContext,
+    _Out_ INT *CommandResult
+    );
@@ -7,26 +7,179 @@
 
 #include "client.tmh"
 
-static CLIENT_USER_CONTEXT *ClientUserContext;
 static UINT64 UniqueId;
 
+//
+// Tracks the commands of a batch submit IRP, which references it via
+// DriverContext. Requests in a batch have consecutive IDs starting at BaseId.
+//
+typedef struct _CLIENT_BATCH {
+    UINT64 BaseId;
+    BOOLEAN Ordered;
+    UINT32 CommandCount;
+    UINT32 NextIndex;
+    CONST CHAR *NextCommand;
+    LONG PendingCount;
+    INT *Results;
+} CLIENT_BATCH;
+
+#define CLIENT_IRP_BATCH(Irp) ((CLIENT_BATCH *)(Irp)->Tail.Overlay.DriverContext[0])
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+ClientBatchRelease(
+    _In_ IRP *Irp
+    )
+{
+    CLIENT_BATCH *Batch = CLIENT_IRP_BATCH(Irp);
+
+    if (InterlockedDecrement(&Batch->PendingCount) > 0) {
+        return;
+    }
+
+    //
+    // Results are collected separately, since the system buffer still holds
+    // the batch's commands until every command has been submitted.
+    //
+    RtlCopyMemory(
+        Irp->AssociatedIrp.SystemBuffer, Batch->Results,
+        Batch->CommandCount * sizeof(*Batch->Results));
+    Irp->IoStatus.Information = Batch->CommandCount * sizeof(*Batch->Results);
+    Irp->IoStatus.Status = STATUS_SUCCESS;
+
+    TraceInfo(
+        TRACE_CONTROL, "Completing client batch Irp=%p CommandCount=%u",
+        Irp, Batch->CommandCount);
+
+    Irp->Tail.Overlay.DriverContext[0] = NULL;
+    ExFreePoolWithTag(Batch, POOLTAG_ISR_CLIENT);
+
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+}
+
+//
+// Submits the batch's next command. Returns STATUS_NO_MORE_ENTRIES if there
+// are none left.
+//
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+ClientBatchPushNext(
+    _In_ IRP *Irp
+    )
+{
+    CLIENT_BATCH *Batch = CLIENT_IRP_BATCH(Irp);
+    NTSTATUS Status;
+    UINT32 Index;
+    CONST CHAR *Command;
+
+    if (Batch->NextIndex == Batch->CommandCount) {
+        return STATUS_NO_MORE_ENTRIES;
+    }
+
+    Index = Batch->NextIndex++;
+    Command = Batch->NextCommand;
+    Batch->NextCommand += strlen(Command) + 1;
+
+    InterlockedIncrement(&Batch->PendingCount);
+
+    Status = RqClientPushRequest(Batch->BaseId + Index, Irp, Command, NULL, 0);
+    if (!NT_SUCCESS(Status)) {
+        TraceError(
+            TRACE_CONTROL, "Failed to submit batch command Irp=%p Index=%u Status=%!STATUS!",
+            Irp, Index, Status);
+        Batch->Results[Index] = -1;
+        InterlockedDecrement(&Batch->PendingCount);
+    }
+
+    return Status;
+}
+
+//
+// Submits the next command of an ordered batch, skipping any that fail to be
+// submitted.
+//
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+ClientBatchPushOrdered(
+    _In_ IRP *Irp
+    )
+{
+    NTSTATUS Status;
+
+    do {
+        Status = ClientBatchPushNext(Irp);
+    } while (!NT_SUCCESS(Status) && Status != STATUS_NO_MORE_ENTRIES);
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+ClientBatchRequestComplete(
+    _In_ IRP *Irp,
+    _In_ UINT64 Id,
+    _In_ INT Result
+    )
+{
+    CLIENT_BATCH *Batch = CLIENT_IRP_BATCH(Irp);
+
+    Batch->Results[Id - Batch->BaseId] = Result;
+
+    //
+    // The completed command's reference is released only after the next
+    // command, if any, has taken its own.
+    //
+    if (Batch->Ordered) {
+        ClientBatchPushOrdered(Irp);
+    }
+
+    ClientBatchRelease(Irp);
+}
+
 _IRQL_requires_max_(PASSIVE_LEVEL)
 VOID
 ClientRequestComplete(
     _In_ UINT64 Id,
     _In_ VOID *Context,
-    _In_ INT Result
+    _In_ INT Result,
+    _In_ UINT32 OutputLength,
+    _In_ UINT32 OutputFlags
     )
 {
     IRP *Irp = (IRP *)Context;
-    INT *Output = (INT *)Irp->AssociatedIrp.SystemBuffer;
+    IO_STACK_LOCATION *IrpSp = IoGetCurrentIrpStackLocation(Irp);
 
-    UNREFERENCED_PARAMETER(Id);
+    if (IrpSp->Parameters.DeviceIoControl.IoControlCode ==
+            ISR_IOCTL_INVOKE_SYSTEM_SUBMIT_BATCH) {
+        ClientBatchRequestComplete(Irp, Id, Result);
+        return;
+    }
 
-    TraceInfo(TRACE_CONTROL, "Completing client request Irp=%p", Irp);
+    TraceInfo(
+        TRACE_CONTROL, "Completing client request Irp=%p OutputLength=%u",
+        Irp, OutputLength);
+
+    if (IrpSp->Parameters.DeviceIoControl.IoControlCode ==
+            ISR_IOCTL_INVOKE_SYSTEM_SUBMIT_CAPTURE) {
+        ISR_SUBMIT_CAPTURE_OUTPUT *Output = Irp->AssociatedIrp.SystemBuffer;
+
+        //
+        // The output itself was captured in place.
+        //
+        Output->Result = Result;
+        Output->OutputFlags = OutputFlags;
+        Output->OutputLength = OutputLength;
+        Irp->IoStatus.Information =
+            FIELD_OFFSET(ISR_SUBMIT_CAPTURE_OUTPUT, Output) + OutputLength;
+    } else {
+        INT *Output = (INT *)Irp->AssociatedIrp.SystemBuffer;
+
+        *Output = Result;
+        Irp->IoStatus.Information = sizeof(*Output);
+    }
 
-    *Output = Result;
-    Irp->IoStatus.Information = sizeof(*Output);
     Irp->IoStatus.Status = STATUS_SUCCESS;
     IoCompleteRequest(Irp, IO_NO_INCREMENT);
 }
@@ -37,20 +190,28 @@ NTSTATUS
 ClientIrpSubmit(
     CLIENT_USER_CONTEXT *UserContext,
     _In_ IRP *Irp,
-    _In_ IO_STACK_LOCATION *IrpSp
+    _In_ IO_STACK_LOCATION *IrpSp,
+    _In_ BOOLEAN CaptureOutput
     )
 {
     NTSTATUS Status;
     SIZE_T InputBufferLength;
     SIZE_T OutputBufferLength;
+    SIZE_T MinOutputBufferLength;
+    CHAR *Output = NULL;
+    UINT32 OutputCapacity = 0;
 
     TraceEnter(TRACE_CONTROL, "UserContext=%p Irp=%p", UserContext, Irp);
 
     InputBufferLength = IrpSp->Parameters.DeviceIoControl.InputBufferLength;
     OutputBufferLength = IrpSp->Parameters.DeviceIoControl.OutputBufferLength;
 
-    if (InputBufferLength > ISR_MAX_COMMAND_LENGTH ||
-        OutputBufferLength < sizeof(INT)) {
+    MinOutputBufferLength =
+        CaptureOutput ? FIELD_OFFSET(ISR_SUBMIT_CAPTURE_OUTPUT, Output) : sizeof(INT);
+
+    if (InputBufferLength == 0 ||
+        InputBufferLength > ISR_MAX_COMMAND_LENGTH ||
+        OutputBufferLength < MinOutputBufferLength) {
         TraceError(
             TRACE_CONTROL, "Invalid input InputBufferLength=%Iu OututBufferLength=%Iu",
             InputBufferLength, OutputBufferLength);
@@ -64,23 +225,149 @@ ClientIrpSubmit(
         goto Exit;
     }
 
+    if (CaptureOutput) {
+        //
+        // The command is copied into the request before the system buffer is
+        // reused for output.
+        //
+        Output =
+            (CHAR *)Irp->AssociatedIrp.SystemBuffer +
+                FIELD_OFFSET(ISR_SUBMIT_CAPTURE_OUTPUT, Output);
+        OutputCapacity =
+            (UINT32)min(
+                OutputBufferLength - FIELD_OFFSET(ISR_SUBMIT_CAPTURE_OUTPUT, Output),
+                ISR_MAX_OUTPUT_LENGTH);
+    }
+
+    //
+    // The request may complete as soon as it is pushed, so pend the IRP first.
+    //
+    IoMarkIrpPending(Irp);
+
     Status =
         RqClientPushRequest(
             InterlockedIncrement64((LONG64 *)&UniqueId), Irp,
-            Irp->AssociatedIrp.SystemBuffer);
+            Irp->AssociatedIrp.SystemBuffer, Output, OutputCapacity);
     if (!NT_SUCCESS(Status)) {
+        Irp->IoStatus.Status = Status;
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+    }
+
+    Status = STATUS_PENDING;
+
+    TraceInfo(
+        TRACE_CONTROL, "Pending client request UserContext=%p Irp=%p",
+        UserContext, Irp);
+
+Exit:
+
+    TraceExitStatus(TRACE_CONTROL);
+
+    return Status;
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+ClientIrpSubmitBatch(
+    CLIENT_USER_CONTEXT *UserContext,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    SIZE_T InputBufferLength;
+    SIZE_T OutputBufferLength;
+    SIZE_T CommandsLength;
+    CONST ISR_SUBMIT_BATCH_INPUT *Input = Irp->AssociatedIrp.SystemBuffer;
+    CLIENT_BATCH *Batch;
+    SIZE_T Offset = 0;
+    UINT32 CommandCount = 0;
+
+    TraceEnter(TRACE_CONTROL, "UserContext=%p Irp=%p", UserContext, Irp);
+
+    InputBufferLength = IrpSp->Parameters.DeviceIoControl.InputBufferLength;
+    OutputBufferLength = IrpSp->Parameters.DeviceIoControl.OutputBufferLength;
+
+    if (InputBufferLength <= FIELD_OFFSET(ISR_SUBMIT_BATCH_INPUT, Commands) ||
+        Input->CommandCount == 0 ||
+        Input->CommandCount > ISR_MAX_BATCH_COMMAND_COUNT ||
+        OutputBufferLength < Input->CommandCount * sizeof(INT)) {
+        TraceError(
+            TRACE_CONTROL, "Invalid input InputBufferLength=%Iu OututBufferLength=%Iu",
+            InputBufferLength, OutputBufferLength);
+        Status = STATUS_INVALID_PARAMETER;
         goto Exit;
     }
 
     //
-    // TODO: Fix race condition where request is completed before we mark it pending.
+    // The commands must exactly fill the rest of the input buffer.
     //
+    CommandsLength = InputBufferLength - FIELD_OFFSET(ISR_SUBMIT_BATCH_INPUT, Commands);
+    while (Offset < CommandsLength && CommandCount < Input->CommandCount) {
+        SIZE_T CommandLength =
+            strnlen(
+                Input->Commands + Offset,
+                min(CommandsLength - Offset, ISR_MAX_COMMAND_LENGTH));
+
+        if (Offset + CommandLength == CommandsLength ||
+            CommandLength == ISR_MAX_COMMAND_LENGTH) {
+            break;
+        }
+
+        Offset += CommandLength + 1;
+        CommandCount++;
+    }
+
+    if (Offset != CommandsLength || CommandCount != Input->CommandCount) {
+        TraceError(TRACE_CONTROL, "Invalid input commands");
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Batch =
+        ExAllocatePoolZero(
+            NonPagedPoolNx, sizeof(*Batch) + CommandCount * sizeof(*Batch->Results),
+            POOLTAG_ISR_CLIENT);
+    if (Batch == NULL) {
+        TraceError(TRACE_CONTROL, "Failed to allocate batch");
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Exit;
+    }
+
+    Batch->BaseId =
+        InterlockedAdd64((LONG64 *)&UniqueId, CommandCount) - CommandCount + 1;
+    Batch->Ordered = !!(Input->Flags & ISR_BATCH_FLAG_ORDERED);
+    Batch->CommandCount = CommandCount;
+    Batch->NextCommand = Input->Commands;
+    Batch->Results = (INT *)(Batch + 1);
+
+    //
+    // The submitter holds a reference until it has pushed the commands it
+    // will, so that the batch cannot complete underneath it.
+    //
+    Batch->PendingCount = 1;
+    Irp->Tail.Overlay.DriverContext[0] = Batch;
+
     IoMarkIrpPending(Irp);
-    Status = STATUS_PENDING;
 
     TraceInfo(
-        TRACE_CONTROL, "Pending client request UserContext=%p Irp=%p",
-        UserContext, Irp);
+        TRACE_CONTROL, "Pending client batch UserContext=%p Irp=%p CommandCount=%u Ordered=%u",
+        UserContext, Irp, CommandCount, Batch->Ordered);
+
+    if (Batch->Ordered) {
+        //
+        // The rest of the commands are submitted as each one completes.
+        //
+        ClientBatchPushOrdered(Irp);
+    } else {
+        while (ClientBatchPushNext(Irp) != STATUS_NO_MORE_ENTRIES) {
+            NOTHING;
+        }
+    }
+
+    ClientBatchRelease(Irp);
+    Status = STATUS_PENDING;
 
 Exit:
 
@@ -102,7 +389,15 @@ ClientIrpDeviceIoControl(
 
     switch (IrpSp->Parameters.DeviceIoControl.IoControlCode) {
     case ISR_IOCTL_INVOKE_SYSTEM_SUBMIT:
-        Status = ClientIrpSubmit(UserContext, Irp, IrpSp);
+        Status = ClientIrpSubmit(UserContext, Irp, IrpSp, FALSE);
+        break;
+
+    case ISR_IOCTL_INVOKE_SYSTEM_SUBMIT_CAPTURE:
+        Status = ClientIrpSubmit(UserContext, Irp, IrpSp, TRUE);
+        break;
+
+    case ISR_IOCTL_INVOKE_SYSTEM_SUBMIT_BATCH:
+        Status = ClientIrpSubmitBatch(UserContext, Irp, IrpSp);
         break;
 
     default:
@@ -139,11 +434,6 @@ ClientIrpClose(
 
     UNREFERENCED_PARAMETER(Irp);
 
-    RqClientDeregister();
-
-    InterlockedCompareExchangePointer(
-        (PVOID volatile *)&ClientUserContext, NULL, UserContext);
-
     TraceInfo(TRACE_CONTROL, "Client closed UserContext=%p", UserContext);
 
     ClientCleanup(UserContext);
@@ -182,18 +472,6 @@ ClientIrpCreate(
         goto Exit;
     }
 
-    if (InterlockedCompareExchangePointer(
-            (PVOID volatile *)&ClientUserContext, UserContext, NULL) != NULL) {
-        TraceError(TRACE_CONTROL, "Multiple clients not supported");
-        Status = STATUS_TOO_MANY_SESSIONS;
-        goto Exit;
-    }
-
-    Status = RqClientRegister(ClientRequestComplete);
-    if (!NT_SUCCESS(Status)) {
-        goto Exit;
-    }
-
     UserContext->Header.ObjectType = ISR_FILE_TYPE_CLIENT;
     UserContext->Header.Dispatch = &ClientFileDispatch;
 
@@ -206,11 +484,31 @@ Exit:
 
     if (!NT_SUCCESS(Status)) {
         if (UserContext != NULL) {
-            InterlockedCompareExchangePointer(
-                (PVOID volatile *)&ClientUserContext, NULL, UserContext);
             ClientCleanup(UserContext);
         }
     }
 
     return Status;
 }
+
+//
+// Any number of client handles may be open; all of them share the request
+// queue's single client registration.
+//
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+ClientInitialize(
+    VOID
+    )
+{
+    return RqClientRegister(ClientRequestComplete);
+}
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+ClientUninitialize(
+    VOID
+    )
+{
+    RqClientDeregister();
+}
@@ -17,3 +17,15 @@ ClientIrpCreate(
     _In_ VOID *InputBuffer,
     _In_ SIZE_T InputBufferLength
     );
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+ClientInitialize(
+    VOID
+    );
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+ClientUninitialize(
+    VOID
+    );
@@ -215,6 +215,8 @@ DriverUnload(
 
     ServiceUninitialize();
 
+    ClientUninitialize();
+
     RqUninitialize();
 
     if (IsrDeviceObject != NULL) {
@@ -264,6 +266,11 @@ DriverEntry(
         goto Exit;
     }
 
+    Status = ClientInitialize();
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
     Status = ServiceInitialize();
     if (!NT_SUCCESS(Status)) {
         goto Exit;
@@ -29,15 +29,21 @@ NTSTATUS
 RqClientPushRequest(
     _In_ UINT64 Id,
     _In_ VOID *Context,
-    _In_z_ CHAR *Command
+    _In_z_ CONST CHAR *Command,
+    _Out_writes_bytes_opt_(OutputCapacity) CHAR *Output,
+    _In_ UINT32 OutputCapacity
     )
 {
     NTSTATUS Status;
     KIRQL OldIrql;
     ISR_REQUEST *Request;
     BOOLEAN WasListEmpty = FALSE;
+    SIZE_T CommandSize = strlen(Command) + 1;
 
-    Request = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Request), POOLTAG_ISR_REQUEST);
+    Request =
+        ExAllocatePoolZero(
+            NonPagedPoolNx, FIELD_OFFSET(ISR_REQUEST, Command) + CommandSize,
+            POOLTAG_ISR_REQUEST);
     if (Request == NULL) {
         TraceError(TRACE_CONTROL, "Failed to allocate request");
         Status = STATUS_NO_MEMORY;
@@ -46,7 +52,9 @@ RqClientPushRequest(
 
     Request->Id = Id;
     Request->ClientContext = Context;
-    strcpy_s(Request->Command, sizeof(Request->Command), Command);
+    Request->Output = Output;
+    Request->OutputCapacity = (Output != NULL) ? OutputCapacity : 0;
+    strcpy_s(Request->Command, CommandSize, Command);
 
     KeAcquireSpinLock(&Lock, &OldIrql);
 
@@ -108,11 +116,35 @@ RqServicePopRequest(
     return Status;
 }
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+RqServiceAppendRequestOutput(
+    _Inout_ ISR_REQUEST *Request,
+    _In_reads_bytes_(Length) CONST CHAR *Data,
+    _In_ UINT32 Length
+    )
+{
+    UINT32 CopyLength;
+
+    if (Request->Output == NULL) {
+        return;
+    }
+
+    CopyLength = min(Length, Request->OutputCapacity - Request->OutputLength);
+    RtlCopyMemory(Request->Output + Request->OutputLength, Data, CopyLength);
+    Request->OutputLength += CopyLength;
+
+    if (CopyLength < Length) {
+        Request->OutputFlags |= ISR_OUTPUT_FLAG_TRUNCATED;
+    }
+}
+
 _IRQL_requires_max_(PASSIVE_LEVEL)
 VOID
 RqServiceCompleteRequest(
     _In_ ISR_REQUEST *Request,
-    _In_ INT Result
+    _In_ INT Result,
+    _In_ UINT32 OutputFlags
     )
 {
     NTSTATUS Status;
@@ -130,13 +162,46 @@ RqServiceCompleteRequest(
     KeReleaseSpinLock(&Lock, OldIrql);
 
     if (NT_SUCCESS(Status)) {
-        Client.RequestComplete(Request->Id, Request->ClientContext, Result);
+        Client.RequestComplete(
+            Request->Id, Request->ClientContext, Result, Request->OutputLength,
+            Request->OutputFlags | OutputFlags);
         ExReleaseRundownProtection(&Client.Rundown);
     }
 
     ExFreePoolWithTag(Request, POOLTAG_ISR_REQUEST);
 }
 
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+RqServiceCompleteQueuedRequests(
+    _In_ INT Result
+    )
+{
+    KIRQL OldIrql;
+    LIST_ENTRY Requests;
+
+    InitializeListHead(&Requests);
+
+    KeAcquireSpinLock(&Lock, &OldIrql);
+
+    NT_ASSERT(!Service.IsRegistered);
+
+    while (!IsListEmpty(&Queue)) {
+        InsertTailList(&Requests, RemoveHeadList(&Queue));
+    }
+
+    KeReleaseSpinLock(&Lock, OldIrql);
+
+    while (!IsListEmpty(&Requests)) {
+        ISR_REQUEST *Request =
+            CONTAINING_RECORD(RemoveHeadList(&Requests), ISR_REQUEST, Link);
+
+        TraceInfo(TRACE_CONTROL, "Completing queued request Id=%llu", Request->Id);
+
+        RqServiceCompleteRequest(Request, Result, 0);
+    }
+}
+
 _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS
 RqClientRegister(
@@ -18,7 +18,9 @@ VOID
 CLIENT_REQUEST_COMPLETE_FN(
     _In_ UINT64 Id,
     _In_ VOID *Context,
-    _In_ INT Result
+    _In_ INT Result,
+    _In_ UINT32 OutputLength,
+    _In_ UINT32 OutputFlags
     );
 
 //
@@ -45,13 +47,17 @@ RqClientDeregister(
 //
 // Push a request onto the queue to be processed.
 // If successful, the result will be returned via the completion callback.
+// If an output buffer is provided, the command's output is captured into it,
+// and the buffer must remain valid until the request completes.
 //
 _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS
 RqClientPushRequest(
     _In_ UINT64 Id,
     _In_ VOID *Context,
-    _In_z_ CHAR *Command
+    _In_z_ CONST CHAR *Command,
+    _Out_writes_bytes_opt_(OutputCapacity) CHAR *Output,
+    _In_ UINT32 OutputCapacity
     );
 
 //
@@ -59,10 +65,22 @@ RqClientPushRequest(
 //
 
 typedef struct _ISR_REQUEST {
+    //
+    // Links the request into the queue, and into the service's list of active
+    // requests once it has been popped.
+    //
     LIST_ENTRY Link;
     UINT64 Id;
     VOID *ClientContext;
-    CHAR Command[ISR_MAX_COMMAND_LENGTH];
+    CHAR *Output;
+    UINT32 OutputCapacity;
+    UINT32 OutputLength;
+    UINT32 OutputFlags;
+
+    //
+    // Sized to fit the command.
+    //
+    CHAR Command[ANYSIZE_ARRAY];
 } ISR_REQUEST;
 
 //
@@ -106,6 +124,18 @@ RqServicePopRequest(
     _Out_ ISR_REQUEST **Request
     );
 
+//
+// Append a chunk of output for the specified request, if its output is being
+// captured. Output beyond the client's buffer is dropped.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+RqServiceAppendRequestOutput(
+    _Inout_ ISR_REQUEST *Request,
+    _In_reads_bytes_(Length) CONST CHAR *Data,
+    _In_ UINT32 Length
+    );
+
 //
 // Post the result for the specified request.
 //
@@ -113,6 +143,17 @@ _IRQL_requires_max_(PASSIVE_LEVEL)
 VOID
 RqServiceCompleteRequest(
     _In_ ISR_REQUEST *Request,
+    _In_ INT Result,
+    _In_ UINT32 OutputFlags
+    );
+
+//
+// Post the specified result for every request still in the queue. The service
+// must already be deregistered, so no more requests can be queued.
+//
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+RqServiceCompleteQueuedRequests(
     _In_ INT Result
     );
 
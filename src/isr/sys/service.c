@@ -8,8 +8,13 @@
 #include "service.tmh"
 
 static KSPIN_LOCK Lock;
-static IRP *PendingIrp;
-static ISR_REQUEST *PendingRequest;
+
+//
+// Get IRPs pended by service workers, linked through Tail.Overlay.ListEntry,
+// and requests handed to workers that have not yet been posted.
+//
+static LIST_ENTRY PendingIrpList;
+static LIST_ENTRY ActiveRequestList;
 static SERVICE_USER_CONTEXT *ServiceUserContext;
 static DRIVER_CANCEL ServiceCancelGet;
 
@@ -35,10 +40,11 @@ ServiceCancelGet(
 
     KeAcquireSpinLockAtDpcLevel(&Lock);
 
-    NT_ASSERT(Irp == PendingIrp);
-    if (Irp == PendingIrp) {
-        PendingIrp = NULL;
-    }
+    //
+    // The IRP may have already been removed by a dispatcher that lost the
+    // race with cancellation, in which case its entry points to itself.
+    //
+    RemoveEntryList(&Irp->Tail.Overlay.ListEntry);
 
     KeReleaseSpinLock(&Lock, Irp->CancelIrql);
 
@@ -58,10 +64,48 @@ ServiceInitializeGetIrpOutput(
 
     RtlZeroMemory(Output, sizeof(*Output));
     Output->Id = Request->Id;
-    strcpy_s(Output->Command, sizeof(Request->Command), Request->Command);
+    if (Request->Output != NULL) {
+        Output->Flags |= ISR_GET_FLAG_CAPTURE_OUTPUT;
+    }
+    strcpy_s(Output->Command, sizeof(Output->Command), Request->Command);
     Irp->IoStatus.Information = sizeof(*Output);
 }
 
+//
+// Pends a get IRP until a request is available. Returns STATUS_PENDING, or
+// STATUS_CANCELLED if the IRP was canceled before its cancel routine was set.
+//
+static
+_Requires_lock_held_(Lock)
+NTSTATUS
+ServicePendGetIrp(
+    _In_ IRP *Irp
+    )
+{
+    IoMarkIrpPending(Irp);
+    InsertTailList(&PendingIrpList, &Irp->Tail.Overlay.ListEntry);
+
+    //
+    // Set up a cancel routine.
+    //
+    IoSetCancelRoutine(Irp, ServiceCancelGet);
+    if (Irp->Cancel) {
+        if (IoSetCancelRoutine(Irp, NULL) != NULL) {
+            //
+            // The cancellation routine will not run; cancel the IRP here.
+            //
+            RemoveEntryList(&Irp->Tail.Overlay.ListEntry);
+            return STATUS_CANCELLED;
+        }
+
+        //
+        // The cancellation routine will run.
+        //
+    }
+
+    return STATUS_PENDING;
+}
+
 static
 _IRQL_requires_max_(PASSIVE_LEVEL)
 VOID
@@ -71,33 +115,59 @@ ServiceRequestAvailable(
 {
     NTSTATUS Status;
     KIRQL OldIrql;
-    IRP *Irp = NULL;
+    IRP *Irp;
     ISR_REQUEST *Request;
+    LIST_ENTRY CompletedIrps;
 
-    KeAcquireSpinLock(&Lock, &OldIrql);
+    InitializeListHead(&CompletedIrps);
 
-    if (PendingIrp != NULL) {
-        Status = RqServicePopRequest(&Request);
-        NT_ASSERT(NT_SUCCESS(Status));
-        if (NT_SUCCESS(Status)) {
-            Irp = PendingIrp;
-            PendingIrp = NULL;
+    KeAcquireSpinLock(&Lock, &OldIrql);
 
-            ServiceInitializeGetIrpOutput(Irp, Request);
-            PendingRequest = Request;
+    //
+    // Hand out queued requests to as many waiting workers as possible. More
+    // requests may have been queued since this notification was raised, so
+    // keep going until either the workers or the requests run out.
+    //
+    while (!IsListEmpty(&PendingIrpList)) {
+        Irp =
+            CONTAINING_RECORD(
+                RemoveHeadList(&PendingIrpList), IRP, Tail.Overlay.ListEntry);
+        InitializeListHead(&Irp->Tail.Overlay.ListEntry);
+
+        if (IoSetCancelRoutine(Irp, NULL) == NULL) {
+            //
+            // The cancellation routine owns this IRP.
+            //
+            continue;
+        }
 
-            if (IoSetCancelRoutine(Irp, NULL) == NULL) {
-                Irp = NULL;
+        Status = RqServicePopRequest(&Request);
+        if (!NT_SUCCESS(Status)) {
+            if (ServicePendGetIrp(Irp) == STATUS_CANCELLED) {
+                Irp->IoStatus.Status = STATUS_CANCELLED;
+                InsertTailList(&CompletedIrps, &Irp->Tail.Overlay.ListEntry);
             }
+            break;
         }
+
+        ServiceInitializeGetIrpOutput(Irp, Request);
+        InsertTailList(&ActiveRequestList, &Request->Link);
+
+        Irp->IoStatus.Status = STATUS_SUCCESS;
+        InsertTailList(&CompletedIrps, &Irp->Tail.Overlay.ListEntry);
     }
 
     KeReleaseSpinLock(&Lock, OldIrql);
 
-    if (Irp != NULL) {
-        TraceInfo(TRACE_CONTROL, "Completing service get Irp=%p", Irp);
+    while (!IsListEmpty(&CompletedIrps)) {
+        Irp =
+            CONTAINING_RECORD(
+                RemoveHeadList(&CompletedIrps), IRP, Tail.Overlay.ListEntry);
+
+        TraceInfo(
+            TRACE_CONTROL, "Completing service get Irp=%p Status=%!STATUS!",
+            Irp, Irp->IoStatus.Status);
 
-        Irp->IoStatus.Status = STATUS_SUCCESS;
         IoCompleteRequest(Irp, IO_NO_INCREMENT);
     }
 }
@@ -135,54 +205,26 @@ ServiceIrpGet(
     KeAcquireSpinLock(&Lock, &OldIrql);
     LockAcquired = TRUE;
 
-    if (PendingIrp != NULL) {
-        TraceError(TRACE_CONTROL, "Parallel requests not supported");
-        Status = STATUS_NOT_SUPPORTED;
-        goto Exit;
-    }
-
-    if (PendingRequest != NULL) {
-        TraceError(
-            TRACE_CONTROL, "Getting request while one has not been completed not supported");
-        Status = STATUS_NOT_SUPPORTED;
-        goto Exit;
-    }
-
+    //
+    // Each service worker keeps its own get outstanding, so any number of
+    // requests may be in progress at once.
+    //
     Status = RqServicePopRequest(&Request);
     if (NT_SUCCESS(Status)) {
         ServiceInitializeGetIrpOutput(Irp, Request);
-        PendingRequest = Request;
+        InsertTailList(&ActiveRequestList, &Request->Link);
         Status = STATUS_SUCCESS;
         TraceInfo(
-            TRACE_CONTROL, "Pending service get UserContext=%p Irp=%p",
+            TRACE_CONTROL, "Completing service get UserContext=%p Irp=%p",
             UserContext, Irp);
     } else if (Status == STATUS_NOT_FOUND) {
         //
         // Pend the IRP.
         //
-        IoMarkIrpPending(Irp);
-        PendingIrp = Irp;
-        Status = STATUS_PENDING;
-
-        //
-        // Set up a cancel routine.
-        //
-        IoSetCancelRoutine(Irp, ServiceCancelGet);
-        if (Irp->Cancel) {
-            if (IoSetCancelRoutine(Irp, NULL) != NULL) {
-                //
-                // The cancellation routine will not run; cancel the IRP here
-                // and bail.
-                //
-                PendingIrp = NULL;
-                Status = STATUS_CANCELLED;
-            } else {
-                //
-                // The cancellation routine will run; bail.
-                //
-            }
-            goto Exit;
-        }
+        Status = ServicePendGetIrp(Irp);
+        TraceInfo(
+            TRACE_CONTROL, "Pending service get UserContext=%p Irp=%p",
+            UserContext, Irp);
     } else {
         TraceError(
             TRACE_CONTROL, "RqGetRequest failed Status=%!STATUS!", Status);
@@ -231,9 +273,15 @@ ServiceIrpPost(
 
     KeAcquireSpinLock(&Lock, &OldIrql);
 
-    if (Input->Id == PendingRequest->Id) {
-        Request = PendingRequest;
-        PendingRequest = NULL;
+    for (LIST_ENTRY *Entry = ActiveRequestList.Flink; Entry != &ActiveRequestList;
+            Entry = Entry->Flink) {
+        ISR_REQUEST *ActiveRequest = CONTAINING_RECORD(Entry, ISR_REQUEST, Link);
+
+        if (ActiveRequest->Id == Input->Id) {
+            RemoveEntryList(&ActiveRequest->Link);
+            Request = ActiveRequest;
+            break;
+        }
     }
 
     KeReleaseSpinLock(&Lock, OldIrql);
@@ -246,7 +294,7 @@ ServiceIrpPost(
         goto Exit;
     }
 
-    RqServiceCompleteRequest(Request, Input->Result);
+    RqServiceCompleteRequest(Request, Input->Result, Input->OutputFlags);
     Status = STATUS_SUCCESS;
 
     TraceInfo(
@@ -260,6 +308,70 @@ Exit:
     return Status;
 }
 
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+ServiceIrpPostOutput(
+    SERVICE_USER_CONTEXT *UserContext,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    KIRQL OldIrql;
+    ISR_POST_OUTPUT_INPUT *Input;
+    SIZE_T InputBufferLength;
+    UINT32 DataLength;
+
+    TraceEnter(TRACE_CONTROL, "UserContext=%p", UserContext);
+
+    InputBufferLength = IrpSp->Parameters.DeviceIoControl.InputBufferLength;
+
+    if (InputBufferLength < FIELD_OFFSET(ISR_POST_OUTPUT_INPUT, Data) ||
+        InputBufferLength > sizeof(*Input)) {
+        TraceError(
+            TRACE_CONTROL, "Invalid input InputBufferLength=%Iu",
+            InputBufferLength);
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Input = Irp->AssociatedIrp.SystemBuffer;
+    DataLength = (UINT32)(InputBufferLength - FIELD_OFFSET(ISR_POST_OUTPUT_INPUT, Data));
+    Status = STATUS_NOT_FOUND;
+
+    //
+    // Append under the lock, so the request cannot be completed concurrently.
+    //
+    KeAcquireSpinLock(&Lock, &OldIrql);
+
+    for (LIST_ENTRY *Entry = ActiveRequestList.Flink; Entry != &ActiveRequestList;
+            Entry = Entry->Flink) {
+        ISR_REQUEST *ActiveRequest = CONTAINING_RECORD(Entry, ISR_REQUEST, Link);
+
+        if (ActiveRequest->Id == Input->Id) {
+            RqServiceAppendRequestOutput(ActiveRequest, Input->Data, DataLength);
+            Status = STATUS_SUCCESS;
+            break;
+        }
+    }
+
+    KeReleaseSpinLock(&Lock, OldIrql);
+
+    if (!NT_SUCCESS(Status)) {
+        TraceError(
+            TRACE_CONTROL, "Request not found Id=%llu",
+            Input->Id);
+        goto Exit;
+    }
+
+Exit:
+
+    TraceExitStatus(TRACE_CONTROL);
+
+    return Status;
+}
+
 static
 _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS
@@ -280,6 +392,10 @@ ServiceIrpDeviceIoControl(
         Status = ServiceIrpPost(UserContext, Irp, IrpSp);
         break;
 
+    case ISR_IOCTL_INVOKE_SYSTEM_POST_OUTPUT:
+        Status = ServiceIrpPostOutput(UserContext, Irp, IrpSp);
+        break;
+
     default:
         TraceError(
             TRACE_CONTROL, "Invalid IOCTL Code=%u",
@@ -293,6 +409,40 @@ Exit:
     return Status;
 }
 
+//
+// Posts the specified result for every request handed to a worker whose
+// result has not been posted.
+//
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+ServiceCompleteActiveRequests(
+    _In_ INT Result
+    )
+{
+    KIRQL OldIrql;
+    LIST_ENTRY Requests;
+
+    InitializeListHead(&Requests);
+
+    KeAcquireSpinLock(&Lock, &OldIrql);
+
+    while (!IsListEmpty(&ActiveRequestList)) {
+        InsertTailList(&Requests, RemoveHeadList(&ActiveRequestList));
+    }
+
+    KeReleaseSpinLock(&Lock, OldIrql);
+
+    while (!IsListEmpty(&Requests)) {
+        ISR_REQUEST *Request =
+            CONTAINING_RECORD(RemoveHeadList(&Requests), ISR_REQUEST, Link);
+
+        TraceInfo(TRACE_CONTROL, "Completing active request Id=%llu", Request->Id);
+
+        RqServiceCompleteRequest(Request, Result, 0);
+    }
+}
+
 static
 VOID
 ServiceCleanup(
@@ -317,6 +467,14 @@ ServiceIrpClose(
 
     RqServiceDeregister();
 
+    //
+    // Once the service is gone, nothing will post the results of requests it
+    // was running or had yet to pick up, e.g. if the service was terminated.
+    // Fail them so their clients do not wait forever.
+    //
+    ServiceCompleteActiveRequests(-1);
+    RqServiceCompleteQueuedRequests(-1);
+
     InterlockedCompareExchangePointer(
         (PVOID volatile *)&ServiceUserContext, NULL, UserContext);
 
@@ -398,6 +556,8 @@ ServiceInitialize(
     )
 {
     KeInitializeSpinLock(&Lock);
+    InitializeListHead(&PendingIrpList);
+    InitializeListHead(&ActiveRequestList);
     return STATUS_SUCCESS;
 }
 
@@ -407,6 +567,6 @@ ServiceUninitialize(
     VOID
     )
 {
-    NT_ASSERT(PendingIrp == NULL);
-    NT_ASSERT(PendingRequest == NULL);
+    NT_ASSERT(IsListEmpty(&PendingIrpList));
+    NT_ASSERT(IsListEmpty(&ActiveRequestList));
 }
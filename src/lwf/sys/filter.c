@@ -137,6 +137,11 @@ FilterStart(
         goto Exit;
     }
 
+    Status = FnConvertNtStatusToNdisStatus(FnTimerWheelCreate(&LwfGlobalContext.TimerWheel));
+    if (Status != NDIS_STATUS_SUCCESS) {
+        goto Exit;
+    }
+
     FChars.MajorDriverVersion = 0;
     FChars.MinorDriverVersion = 1;
     FChars.Flags = NDIS_FILTER_DRIVER_SUPPORTS_L2_MTU_SIZE_CHANGE;
@@ -184,6 +189,11 @@ FilterStop(
         NdisFDeregisterFilterDriver(LwfGlobalContext.NdisDriverHandle);
         LwfGlobalContext.NdisDriverHandle = NULL;
     }
+
+    if (LwfGlobalContext.TimerWheel != NULL) {
+        FnTimerWheelClose(LwfGlobalContext.TimerWheel);
+        LwfGlobalContext.TimerWheel = NULL;
+    }
 }
 
 _Use_decl_annotations_
@@ -248,7 +258,8 @@ FilterAttach(
 
     Status =
         FnTimerCreate(
-            &Filter->WatchdogTimer, FilterWatchdogTimeout, Filter, RTL_SEC_TO_MILLISEC(1));
+            LwfGlobalContext.TimerWheel, &Filter->WatchdogTimer, FilterWatchdogTimeout, Filter,
+            RTL_SEC_TO_MILLISEC(1));
     if (!NT_SUCCESS(Status)) {
         Status = FnConvertNtStatusToNdisStatus(Status);
         goto Exit;
@@ -33,6 +33,7 @@ typedef struct _GLOBAL_CONTEXT {
     LIST_ENTRY FilterList;
     HANDLE NdisDriverHandle;
     UINT32 NdisVersion;
+    FN_TIMER_WHEEL_HANDLE TimerWheel;
 } GLOBAL_CONTEXT;
 
 extern GLOBAL_CONTEXT LwfGlobalContext;
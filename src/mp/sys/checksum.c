@@ -0,0 +1,680 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#include "precomp.h"
+#include "checksum.tmh"
+
+#define UDP_HEADER_LENGTH 8
+#define UDP_CHECKSUM_OFFSET 6
+#define TCP_CHECKSUM_OFFSET FIELD_OFFSET(TCP_HDR, th_sum)
+
+//
+// The longest contiguous header region the engine needs to parse: Ethernet,
+// an IPv4 header with options, and the fixed TCP header.
+//
+#define MP_CHECKSUM_MAX_HEADER_LENGTH \
+    (sizeof(ETHERNET_HEADER) + 60 + sizeof(TCP_HDR))
+
+typedef struct DECLSPEC_CACHEALIGN _MP_CHECKSUM_PROCESSOR {
+    MINIPORT_CHECKSUM_COUNTERS Counters;
+} MP_CHECKSUM_PROCESSOR;
+
+typedef struct _MP_CHECKSUM {
+    MINIPORT_SET_CHECKSUM_EMULATION_IN Emulation;
+    UINT32 ProcessorCount;
+    MP_CHECKSUM_PROCESSOR *Processors;
+} MP_CHECKSUM;
+
+typedef struct _MP_CHECKSUM_FRAME {
+    UINT32 IpOffset;
+    UINT32 IpHeaderLength;
+    UINT32 L4Offset;
+    UINT32 L4Length;
+    UINT8 Protocol;
+    BOOLEAN IsIpv4;
+    CONST VOID *SourceAddress;
+    CONST VOID *DestinationAddress;
+    UINT8 AddressLength;
+} MP_CHECKSUM_FRAME;
+
+static
+UINT16
+MpChecksumFold(
+    _In_ UINT64 Sum
+    )
+{
+    Sum = (UINT32)Sum + (Sum >> 32);
+    Sum = (UINT32)Sum + (Sum >> 32);
+    Sum = (UINT16)Sum + (Sum >> 16);
+    Sum = (UINT16)Sum + (Sum >> 16);
+
+    return (UINT16)Sum;
+}
+
+UINT16
+MpChecksumPartial(
+    _In_reads_bytes_(Length) CONST VOID *Buffer,
+    _In_ UINT32 Length
+    )
+{
+    CONST UCHAR *Cursor = Buffer;
+    UINT64 Sum = 0;
+    UINT64 Carry = 0;
+    UINT64 Word;
+
+    //
+    // Sum the buffer as 64-bit words, four words per iteration, and defer the
+    // end-around carries. Since 2^64 - 1 is a multiple of 2^16 - 1, the 64-bit
+    // ones' complement sum folds to the same 16-bit sum as adding one 16-bit
+    // word at a time, at a quarter of the additions.
+    //
+    while (Length >= 4 * sizeof(UINT64)) {
+        Word = *(UNALIGNED CONST UINT64 *)(Cursor + 0 * sizeof(UINT64));
+        Sum += Word;
+        Carry += Sum < Word;
+        Word = *(UNALIGNED CONST UINT64 *)(Cursor + 1 * sizeof(UINT64));
+        Sum += Word;
+        Carry += Sum < Word;
+        Word = *(UNALIGNED CONST UINT64 *)(Cursor + 2 * sizeof(UINT64));
+        Sum += Word;
+        Carry += Sum < Word;
+        Word = *(UNALIGNED CONST UINT64 *)(Cursor + 3 * sizeof(UINT64));
+        Sum += Word;
+        Carry += Sum < Word;
+
+        Cursor += 4 * sizeof(UINT64);
+        Length -= 4 * sizeof(UINT64);
+    }
+
+    while (Length >= sizeof(UINT64)) {
+        Word = *(UNALIGNED CONST UINT64 *)Cursor;
+        Sum += Word;
+        Carry += Sum < Word;
+
+        Cursor += sizeof(UINT64);
+        Length -= sizeof(UINT64);
+    }
+
+    if (Length > 0) {
+        //
+        // The tail starts on a 64-bit word boundary relative to the buffer, so
+        // zero-padding it preserves the byte lanes of a trailing odd byte.
+        //
+        Word = 0;
+        RtlCopyMemory(&Word, Cursor, Length);
+        Sum += Word;
+        Carry += Sum < Word;
+    }
+
+    Sum += Carry;
+    Carry = Sum < Carry;
+
+    return MpChecksumFold(Sum + Carry);
+}
+
+static
+_Success_(return != FALSE)
+BOOLEAN
+MpChecksumNetBuffer(
+    _In_ NET_BUFFER *NetBuffer,
+    _In_ UINT32 Offset,
+    _In_ UINT32 Length,
+    _Out_ UINT16 *Checksum
+    )
+{
+    MDL *Mdl = NET_BUFFER_CURRENT_MDL(NetBuffer);
+    UINT32 MdlOffset = NET_BUFFER_CURRENT_MDL_OFFSET(NetBuffer) + Offset;
+    UINT32 BytesSummed = 0;
+    UINT64 Sum = 0;
+
+    if (Offset > NET_BUFFER_DATA_LENGTH(NetBuffer) ||
+        Length > NET_BUFFER_DATA_LENGTH(NetBuffer) - Offset) {
+        return FALSE;
+    }
+
+    while (Length > 0) {
+        UCHAR *Va;
+        UINT32 FragmentLength;
+        UINT16 FragmentSum;
+
+        if (Mdl == NULL) {
+            return FALSE;
+        }
+
+        if (MdlOffset >= MmGetMdlByteCount(Mdl)) {
+            MdlOffset -= MmGetMdlByteCount(Mdl);
+            Mdl = Mdl->Next;
+            continue;
+        }
+
+        Va = MmGetSystemAddressForMdlSafe(Mdl, LowPagePriority | MdlMappingNoExecute);
+        if (Va == NULL) {
+            return FALSE;
+        }
+
+        FragmentLength = min(Length, MmGetMdlByteCount(Mdl) - MdlOffset);
+        FragmentSum = MpChecksumPartial(Va + MdlOffset, FragmentLength);
+
+        //
+        // A fragment starting at an odd offset has its bytes in swapped lanes.
+        //
+        if (BytesSummed & 1) {
+            FragmentSum = RtlUshortByteSwap(FragmentSum);
+        }
+
+        Sum += FragmentSum;
+        BytesSummed += FragmentLength;
+        Length -= FragmentLength;
+        MdlOffset = 0;
+        Mdl = Mdl->Next;
+    }
+
+    *Checksum = MpChecksumFold(Sum);
+
+    return TRUE;
+}
+
+static
+_Success_(return != FALSE)
+BOOLEAN
+MpChecksumWriteNetBuffer(
+    _In_ NET_BUFFER *NetBuffer,
+    _In_ UINT32 Offset,
+    _In_reads_bytes_(Length) CONST VOID *Buffer,
+    _In_ UINT32 Length
+    )
+{
+    MDL *Mdl = NET_BUFFER_CURRENT_MDL(NetBuffer);
+    UINT32 MdlOffset = NET_BUFFER_CURRENT_MDL_OFFSET(NetBuffer) + Offset;
+    CONST UCHAR *Cursor = Buffer;
+
+    if (Offset > NET_BUFFER_DATA_LENGTH(NetBuffer) ||
+        Length > NET_BUFFER_DATA_LENGTH(NetBuffer) - Offset) {
+        return FALSE;
+    }
+
+    //
+    // Header fields may straddle MDLs, so write them back through the chain.
+    //
+    while (Length > 0) {
+        UCHAR *Va;
+        UINT32 FragmentLength;
+
+        if (Mdl == NULL) {
+            return FALSE;
+        }
+
+        if (MdlOffset >= MmGetMdlByteCount(Mdl)) {
+            MdlOffset -= MmGetMdlByteCount(Mdl);
+            Mdl = Mdl->Next;
+            continue;
+        }
+
+        Va = MmGetSystemAddressForMdlSafe(Mdl, LowPagePriority | MdlMappingNoExecute);
+        if (Va == NULL) {
+            return FALSE;
+        }
+
+        FragmentLength = min(Length, MmGetMdlByteCount(Mdl) - MdlOffset);
+        RtlCopyMemory(Va + MdlOffset, Cursor, FragmentLength);
+
+        Cursor += FragmentLength;
+        Length -= FragmentLength;
+        MdlOffset = 0;
+        Mdl = Mdl->Next;
+    }
+
+    return TRUE;
+}
+
+static
+UINT16
+MpChecksumPseudoHeader(
+    _In_ CONST MP_CHECKSUM_FRAME *Frame
+    )
+{
+    UINT64 Sum = 0;
+
+    Sum += MpChecksumPartial(Frame->SourceAddress, Frame->AddressLength);
+    Sum += MpChecksumPartial(Frame->DestinationAddress, Frame->AddressLength);
+    Sum += RtlUshortByteSwap((UINT16)Frame->L4Length);
+    Sum += (UINT16)(Frame->Protocol << 8);
+
+    return MpChecksumFold(Sum);
+}
+
+static
+_Success_(return != FALSE)
+BOOLEAN
+MpChecksumParseFrame(
+    _In_reads_bytes_(HeaderLength) CONST UCHAR *Headers,
+    _In_ UINT32 HeaderLength,
+    _Out_ MP_CHECKSUM_FRAME *Frame
+    )
+{
+    CONST ETHERNET_HEADER *Ethernet = (CONST ETHERNET_HEADER *)Headers;
+    UINT32 L4HeaderLength;
+
+    RtlZeroMemory(Frame, sizeof(*Frame));
+
+    if (HeaderLength < sizeof(*Ethernet)) {
+        return FALSE;
+    }
+
+    Frame->IpOffset = sizeof(*Ethernet);
+
+    if (Ethernet->Type == RtlUshortByteSwap(ETHERNET_TYPE_IPV4)) {
+        CONST IPV4_HEADER *Ip = (CONST IPV4_HEADER *)(Headers + Frame->IpOffset);
+
+        if (HeaderLength < Frame->IpOffset + sizeof(*Ip)) {
+            return FALSE;
+        }
+
+        Frame->IsIpv4 = TRUE;
+        Frame->IpHeaderLength = Ip->HeaderLength * 4;
+        Frame->Protocol = Ip->Protocol;
+        Frame->SourceAddress = &Ip->SourceAddress;
+        Frame->DestinationAddress = &Ip->DestinationAddress;
+        Frame->AddressLength = sizeof(IN_ADDR);
+
+        if (Frame->IpHeaderLength < sizeof(*Ip) ||
+            RtlUshortByteSwap(Ip->TotalLength) < Frame->IpHeaderLength) {
+            return FALSE;
+        }
+
+        Frame->L4Length = RtlUshortByteSwap(Ip->TotalLength) - Frame->IpHeaderLength;
+    } else if (Ethernet->Type == RtlUshortByteSwap(ETHERNET_TYPE_IPV6)) {
+        CONST IPV6_HEADER *Ip = (CONST IPV6_HEADER *)(Headers + Frame->IpOffset);
+
+        if (HeaderLength < Frame->IpOffset + sizeof(*Ip)) {
+            return FALSE;
+        }
+
+        //
+        // Extension headers are not supported.
+        //
+        Frame->IpHeaderLength = sizeof(*Ip);
+        Frame->Protocol = Ip->NextHeader;
+        Frame->SourceAddress = &Ip->SourceAddress;
+        Frame->DestinationAddress = &Ip->DestinationAddress;
+        Frame->AddressLength = sizeof(IN6_ADDR);
+        Frame->L4Length = RtlUshortByteSwap(Ip->PayloadLength);
+    } else {
+        return FALSE;
+    }
+
+    Frame->L4Offset = Frame->IpOffset + Frame->IpHeaderLength;
+
+    if (Frame->Protocol == IPPROTO_TCP) {
+        L4HeaderLength = sizeof(TCP_HDR);
+    } else if (Frame->Protocol == IPPROTO_UDP) {
+        L4HeaderLength = UDP_HEADER_LENGTH;
+    } else {
+        //
+        // Only the IPv4 header checksum can be handled.
+        //
+        return Frame->IsIpv4 && HeaderLength >= Frame->L4Offset;
+    }
+
+    return
+        HeaderLength >= Frame->L4Offset + L4HeaderLength &&
+        Frame->L4Length >= L4HeaderLength;
+}
+
+static
+MINIPORT_SET_CHECKSUM_EMULATION_IN
+MpChecksumReadEmulation(
+    _In_ MP_CHECKSUM *Checksum
+    )
+{
+    MINIPORT_SET_CHECKSUM_EMULATION_IN Emulation;
+
+    *(ULONG *)&Emulation = ReadULongNoFence((ULONG *)&Checksum->Emulation);
+
+    return Emulation;
+}
+
+static
+MINIPORT_CHECKSUM_COUNTERS *
+MpChecksumGetProcessorCounters(
+    _In_ MP_CHECKSUM *Checksum
+    )
+{
+    UINT32 Index = KeGetCurrentProcessorIndex();
+
+    if (Index >= Checksum->ProcessorCount) {
+        Index = 0;
+    }
+
+    return &Checksum->Processors[Index].Counters;
+}
+
+//
+// Counters are only written by the current processor's slot; the interlocked
+// operation guards against preemption at passive level and is uncontended.
+//
+#define MpChecksumIncrement(Counters, Field) \
+    InterlockedIncrementNoFence64((LONG64 *)&(Counters)->Field)
+
+static
+VOID
+MpChecksumTransmitNetBuffer(
+    _In_ MP_CHECKSUM *Checksum,
+    _In_ NET_BUFFER *NetBuffer,
+    _In_ NDIS_TCP_IP_CHECKSUM_NET_BUFFER_LIST_INFO Info
+    )
+{
+    MINIPORT_CHECKSUM_COUNTERS *Counters = MpChecksumGetProcessorCounters(Checksum);
+    DECLSPEC_ALIGN(8) UCHAR Storage[MP_CHECKSUM_MAX_HEADER_LENGTH];
+    UINT32 HeaderLength = min(NET_BUFFER_DATA_LENGTH(NetBuffer), sizeof(Storage));
+    MP_CHECKSUM_FRAME Frame;
+    UCHAR *Headers;
+    UINT32 L4ChecksumOffset;
+    UINT16 L4Checksum;
+    UINT16 Sum;
+
+    //
+    // The headers may span MDLs, in which case they are parsed from a copy and
+    // the computed checksums are written back through the MDL chain.
+    //
+    Headers = NdisGetDataBuffer(NetBuffer, HeaderLength, Storage, 1, 0);
+    if (Headers == NULL || !MpChecksumParseFrame(Headers, HeaderLength, &Frame) ||
+        Frame.L4Offset + Frame.L4Length > NET_BUFFER_DATA_LENGTH(NetBuffer)) {
+        MpChecksumIncrement(Counters, Unsupported);
+        return;
+    }
+
+    if (Info.Transmit.IpHeaderChecksum && Frame.IsIpv4) {
+        IPV4_HEADER *Ip = (IPV4_HEADER *)(Headers + Frame.IpOffset);
+
+        Ip->HeaderChecksum = 0;
+        Ip->HeaderChecksum = ~MpChecksumPartial(Ip, Frame.IpHeaderLength);
+
+        if (MpChecksumWriteNetBuffer(
+                NetBuffer, Frame.IpOffset + FIELD_OFFSET(IPV4_HEADER, HeaderChecksum),
+                &Ip->HeaderChecksum, sizeof(Ip->HeaderChecksum))) {
+            MpChecksumIncrement(Counters, Ipv4.Transmit);
+        } else {
+            MpChecksumIncrement(Counters, Unsupported);
+        }
+    }
+
+    if (Info.Transmit.TcpChecksum && Frame.Protocol == IPPROTO_TCP) {
+        L4ChecksumOffset = Frame.L4Offset + TCP_CHECKSUM_OFFSET;
+    } else if (Info.Transmit.UdpChecksum && Frame.Protocol == IPPROTO_UDP) {
+        L4ChecksumOffset = Frame.L4Offset + UDP_CHECKSUM_OFFSET;
+    } else {
+        return;
+    }
+
+    L4Checksum = 0;
+    if (!MpChecksumWriteNetBuffer(NetBuffer, L4ChecksumOffset, &L4Checksum, sizeof(L4Checksum)) ||
+        !MpChecksumNetBuffer(NetBuffer, Frame.L4Offset, Frame.L4Length, &Sum)) {
+        MpChecksumIncrement(Counters, Unsupported);
+        return;
+    }
+
+    L4Checksum = ~MpChecksumFold((UINT32)Sum + MpChecksumPseudoHeader(&Frame));
+
+    if (Frame.Protocol == IPPROTO_UDP && L4Checksum == 0) {
+        //
+        // A zero UDP checksum means no checksum; transmit all ones instead.
+        //
+        L4Checksum = (UINT16)~0;
+    }
+
+    NT_VERIFY(
+        MpChecksumWriteNetBuffer(NetBuffer, L4ChecksumOffset, &L4Checksum, sizeof(L4Checksum)));
+
+    if (Frame.Protocol == IPPROTO_TCP) {
+        MpChecksumIncrement(Counters, Tcp.Transmit);
+    } else {
+        MpChecksumIncrement(Counters, Udp.Transmit);
+    }
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpChecksumTransmitNbls(
+    _In_ ADAPTER_CONTEXT *Adapter,
+    _In_ NET_BUFFER_LIST *NblChain
+    )
+{
+    MP_CHECKSUM *Checksum = Adapter->Shared->Checksum;
+
+    if (!MpChecksumReadEmulation(Checksum).Flags.Transmit) {
+        return;
+    }
+
+    for (NET_BUFFER_LIST *Nbl = NblChain; Nbl != NULL; Nbl = Nbl->Next) {
+        NDIS_TCP_IP_CHECKSUM_NET_BUFFER_LIST_INFO Info;
+
+        Info.Value = NET_BUFFER_LIST_INFO(Nbl, TcpIpChecksumNetBufferListInfo);
+
+        if (!Info.Transmit.IpHeaderChecksum && !Info.Transmit.TcpChecksum &&
+            !Info.Transmit.UdpChecksum) {
+            continue;
+        }
+
+        //
+        // Segmentation offloads checksum each segment on the wire; the large
+        // send buffer itself carries only the pseudo-header checksum.
+        //
+        if (NET_BUFFER_LIST_INFO(Nbl, TcpLargeSendNetBufferListInfo) != NULL ||
+            NET_BUFFER_LIST_INFO(Nbl, UdpSegmentationOffloadInfo) != NULL) {
+            continue;
+        }
+
+        for (NET_BUFFER *Nb = NET_BUFFER_LIST_FIRST_NB(Nbl); Nb != NULL;
+                Nb = NET_BUFFER_NEXT_NB(Nb)) {
+            MpChecksumTransmitNetBuffer(Checksum, Nb, Info);
+        }
+    }
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpChecksumReceiveNbl(
+    _In_ ADAPTER_CONTEXT *Adapter,
+    _In_ NET_BUFFER_LIST *Nbl
+    )
+{
+    MP_CHECKSUM *Checksum = Adapter->Shared->Checksum;
+    NET_BUFFER *NetBuffer = NET_BUFFER_LIST_FIRST_NB(Nbl);
+    CONST ADAPTER_OFFLOAD *Offload = &Adapter->OffloadConfig;
+    MINIPORT_CHECKSUM_COUNTERS *Counters;
+    NDIS_TCP_IP_CHECKSUM_NET_BUFFER_LIST_INFO Info = {0};
+    DECLSPEC_ALIGN(8) UCHAR Storage[MP_CHECKSUM_MAX_HEADER_LENGTH];
+    UINT32 HeaderLength;
+    MP_CHECKSUM_FRAME Frame;
+    CHECKSUM_OFFLOAD_STATE L4Offload;
+    UCHAR *Headers;
+    UINT16 Sum;
+
+    if (!MpChecksumReadEmulation(Checksum).Flags.Receive) {
+        return;
+    }
+
+    Counters = MpChecksumGetProcessorCounters(Checksum);
+
+    //
+    // The engine owns the receive checksum info: discard whatever the test
+    // supplied and report only what was verified.
+    //
+    NET_BUFFER_LIST_INFO(Nbl, TcpIpChecksumNetBufferListInfo) = 0;
+
+    HeaderLength = min(NET_BUFFER_DATA_LENGTH(NetBuffer), sizeof(Storage));
+    Headers = NdisGetDataBuffer(NetBuffer, HeaderLength, Storage, 1, 0);
+    if (Headers == NULL || !MpChecksumParseFrame(Headers, HeaderLength, &Frame) ||
+        Frame.L4Offset + Frame.L4Length > NET_BUFFER_DATA_LENGTH(NetBuffer)) {
+        MpChecksumIncrement(Counters, Unsupported);
+        return;
+    }
+
+    if (Frame.IsIpv4 && (Offload->IPChecksumOffloadIPv4 & ChecksumOffloadRx)) {
+        if (MpChecksumPartial(Headers + Frame.IpOffset, Frame.IpHeaderLength) == MAXUINT16) {
+            Info.Receive.IpChecksumSucceeded = TRUE;
+            MpChecksumIncrement(Counters, Ipv4.ReceiveSucceeded);
+        } else {
+            Info.Receive.IpChecksumFailed = TRUE;
+            MpChecksumIncrement(Counters, Ipv4.ReceiveFailed);
+        }
+    }
+
+    if (Frame.Protocol == IPPROTO_TCP) {
+        L4Offload =
+            Frame.IsIpv4 ? Offload->TCPChecksumOffloadIPv4 : Offload->TCPChecksumOffloadIPv6;
+
+        if (L4Offload & ChecksumOffloadRx) {
+            if (MpChecksumNetBuffer(NetBuffer, Frame.L4Offset, Frame.L4Length, &Sum) &&
+                MpChecksumFold((UINT32)Sum + MpChecksumPseudoHeader(&Frame)) == MAXUINT16) {
+                Info.Receive.TcpChecksumSucceeded = TRUE;
+                MpChecksumIncrement(Counters, Tcp.ReceiveSucceeded);
+            } else {
+                Info.Receive.TcpChecksumFailed = TRUE;
+                MpChecksumIncrement(Counters, Tcp.ReceiveFailed);
+            }
+        }
+    } else if (Frame.Protocol == IPPROTO_UDP) {
+        CONST UINT16 *L4Checksum =
+            (CONST UINT16 *)(Headers + Frame.L4Offset + UDP_CHECKSUM_OFFSET);
+
+        L4Offload =
+            Frame.IsIpv4 ? Offload->UDPChecksumOffloadIPv4 : Offload->UDPChecksumOffloadIPv6;
+
+        if (L4Offload & ChecksumOffloadRx) {
+            //
+            // A zero UDPv4 checksum means the sender did not compute one.
+            //
+            if ((Frame.IsIpv4 && *L4Checksum == 0) ||
+                (MpChecksumNetBuffer(NetBuffer, Frame.L4Offset, Frame.L4Length, &Sum) &&
+                    MpChecksumFold((UINT32)Sum + MpChecksumPseudoHeader(&Frame)) == MAXUINT16)) {
+                Info.Receive.UdpChecksumSucceeded = TRUE;
+                MpChecksumIncrement(Counters, Udp.ReceiveSucceeded);
+            } else {
+                Info.Receive.UdpChecksumFailed = TRUE;
+                MpChecksumIncrement(Counters, Udp.ReceiveFailed);
+            }
+        }
+    }
+
+    NET_BUFFER_LIST_INFO(Nbl, TcpIpChecksumNetBufferListInfo) = Info.Value;
+}
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+SharedIrpSetChecksumEmulation(
+    _In_ SHARED_CONTEXT *Shared,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    CONST MINIPORT_SET_CHECKSUM_EMULATION_IN *In = Irp->AssociatedIrp.SystemBuffer;
+    MP_CHECKSUM *Checksum = Shared->Adapter->Shared->Checksum;
+    NTSTATUS Status;
+
+    if (IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(*In)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    C_ASSERT(sizeof(Checksum->Emulation) == sizeof(ULONG));
+    WriteULongNoFence((ULONG *)&Checksum->Emulation, *(CONST ULONG *)In);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    return Status;
+}
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+SharedIrpGetChecksumCounters(
+    _In_ SHARED_CONTEXT *Shared,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    MINIPORT_CHECKSUM_COUNTERS *Out = Irp->AssociatedIrp.SystemBuffer;
+    MP_CHECKSUM *Checksum = Shared->Adapter->Shared->Checksum;
+    CONST UINT32 CounterCount = sizeof(*Out) / sizeof(UINT64);
+    NTSTATUS Status;
+
+    C_ASSERT(sizeof(MINIPORT_CHECKSUM_COUNTERS) % sizeof(UINT64) == 0);
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*Out)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    RtlZeroMemory(Out, sizeof(*Out));
+
+    for (UINT32 Index = 0; Index < Checksum->ProcessorCount; Index++) {
+        CONST UINT64 *Source = (CONST UINT64 *)&Checksum->Processors[Index].Counters;
+        UINT64 *Destination = (UINT64 *)Out;
+
+        for (UINT32 Counter = 0; Counter < CounterCount; Counter++) {
+            Destination[Counter] += ReadULong64NoFence(&Source[Counter]);
+        }
+    }
+
+    Irp->IoStatus.Information = sizeof(*Out);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    return Status;
+}
+
+VOID
+MpChecksumCleanup(
+    _In_ MP_CHECKSUM *Checksum
+    )
+{
+    if (Checksum->Processors != NULL) {
+        ExFreePoolWithTag(Checksum->Processors, POOLTAG_MP_CHECKSUM);
+    }
+
+    ExFreePoolWithTag(Checksum, POOLTAG_MP_CHECKSUM);
+}
+
+MP_CHECKSUM *
+MpChecksumCreate(
+    VOID
+    )
+{
+    MP_CHECKSUM *Checksum;
+    NTSTATUS Status;
+
+    Checksum = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Checksum), POOLTAG_MP_CHECKSUM);
+    if (Checksum == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    Checksum->ProcessorCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    Checksum->Processors =
+        ExAllocatePoolZero(
+            NonPagedPoolNxCacheAligned,
+            (SIZE_T)Checksum->ProcessorCount * sizeof(*Checksum->Processors),
+            POOLTAG_MP_CHECKSUM);
+    if (Checksum->Processors == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        if (Checksum != NULL) {
+            MpChecksumCleanup(Checksum);
+            Checksum = NULL;
+        }
+    }
+
+    return Checksum;
+}
@@ -0,0 +1,58 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+typedef struct _MP_CHECKSUM MP_CHECKSUM;
+typedef struct _SHARED_CONTEXT SHARED_CONTEXT;
+
+MP_CHECKSUM *
+MpChecksumCreate(
+    VOID
+    );
+
+VOID
+MpChecksumCleanup(
+    _In_ MP_CHECKSUM *Checksum
+    );
+
+//
+// Returns the folded, non-complemented ones' complement sum of the buffer.
+//
+UINT16
+MpChecksumPartial(
+    _In_reads_bytes_(Length) CONST VOID *Buffer,
+    _In_ UINT32 Length
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpChecksumTransmitNbls(
+    _In_ ADAPTER_CONTEXT *Adapter,
+    _In_ NET_BUFFER_LIST *NblChain
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpChecksumReceiveNbl(
+    _In_ ADAPTER_CONTEXT *Adapter,
+    _In_ NET_BUFFER_LIST *Nbl
+    );
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+SharedIrpSetChecksumEmulation(
+    _In_ SHARED_CONTEXT *Shared,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    );
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+SharedIrpGetChecksumCounters(
+    _In_ SHARED_CONTEXT *Shared,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    );
@@ -0,0 +1,253 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#include "precomp.h"
+#include "latency.tmh"
+
+#define MP_LATENCY_SUB_BUCKET_COUNT (1ui32 << MINIPORT_LATENCY_SUB_BUCKET_BITS)
+
+//
+// The send or indication timestamp is stored in the second miniport reserved
+// field; the first is used to validate low resource receive indications.
+//
+#define MP_LATENCY_NBL_TIMESTAMP(Nbl) NET_BUFFER_LIST_MINIPORT_RESERVED(Nbl)[1]
+
+C_ASSERT(sizeof(VOID *) >= sizeof(UINT64));
+
+typedef struct DECLSPEC_CACHEALIGN _MP_LATENCY_PROCESSOR {
+    MINIPORT_LATENCY_HISTOGRAM Histogram;
+} MP_LATENCY_PROCESSOR;
+
+typedef struct _MP_LATENCY {
+    UINT64 Frequency;
+    UINT32 ProcessorCount;
+    MP_LATENCY_PROCESSOR *Processors;
+} MP_LATENCY;
+
+static
+UINT32
+MpLatencyGetBucket(
+    _In_ UINT64 Nanoseconds
+    )
+{
+    ULONG MostSignificantBit;
+    UINT32 Bucket;
+
+    if (Nanoseconds < MP_LATENCY_SUB_BUCKET_COUNT) {
+        return (UINT32)Nanoseconds;
+    }
+
+    _BitScanReverse64(&MostSignificantBit, Nanoseconds);
+
+    //
+    // Each power of two at or above the sub-bucket count gets its own group
+    // of linear sub-buckets, indexed by the bits below the most significant.
+    //
+    Bucket =
+        ((MostSignificantBit - MINIPORT_LATENCY_SUB_BUCKET_BITS + 1) <<
+            MINIPORT_LATENCY_SUB_BUCKET_BITS) +
+        (UINT32)((Nanoseconds >> (MostSignificantBit - MINIPORT_LATENCY_SUB_BUCKET_BITS)) &
+            (MP_LATENCY_SUB_BUCKET_COUNT - 1));
+
+    return min(Bucket, MINIPORT_LATENCY_BUCKET_COUNT - 1);
+}
+
+static
+UINT64
+MpLatencyTicksToNanoseconds(
+    _In_ CONST MP_LATENCY *Latency,
+    _In_ UINT64 Ticks
+    )
+{
+    //
+    // Split the conversion to avoid overflowing the multiplication.
+    //
+    return
+        (Ticks / Latency->Frequency) * RTL_SEC_TO_NANOSEC(1) +
+        (Ticks % Latency->Frequency) * RTL_SEC_TO_NANOSEC(1) / Latency->Frequency;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpLatencyStampNbls(
+    _In_ NET_BUFFER_LIST *NblChain
+    )
+{
+    CONST UINT64 Now = KeQueryPerformanceCounter(NULL).QuadPart;
+
+    for (NET_BUFFER_LIST *Nbl = NblChain; Nbl != NULL; Nbl = Nbl->Next) {
+        MP_LATENCY_NBL_TIMESTAMP(Nbl) = (VOID *)(ULONG_PTR)Now;
+    }
+}
+
+static
+VOID
+MpLatencyRecordNbls(
+    _In_ MP_LATENCY *Latency,
+    _Inout_ MINIPORT_LATENCY_HISTOGRAM_DIRECTION *Histogram,
+    _In_ NET_BUFFER_LIST *NblChain
+    )
+{
+    CONST UINT64 Now = KeQueryPerformanceCounter(NULL).QuadPart;
+    UINT64 Count = 0;
+    UINT64 TotalNanoseconds = 0;
+
+    //
+    // Histograms are per-processor, so the interlocked operations never
+    // contend; they only guard against preemption at passive level.
+    //
+    for (NET_BUFFER_LIST *Nbl = NblChain; Nbl != NULL; Nbl = Nbl->Next) {
+        CONST UINT64 Timestamp = (UINT64)(ULONG_PTR)MP_LATENCY_NBL_TIMESTAMP(Nbl);
+        UINT64 Nanoseconds;
+
+        Nanoseconds = MpLatencyTicksToNanoseconds(Latency, Now > Timestamp ? Now - Timestamp : 0);
+        InterlockedIncrementNoFence64((LONG64 *)&Histogram->Buckets[MpLatencyGetBucket(Nanoseconds)]);
+
+        TotalNanoseconds += Nanoseconds;
+        Count++;
+    }
+
+    InterlockedAddNoFence64((LONG64 *)&Histogram->Count, (LONG64)Count);
+    InterlockedAddNoFence64((LONG64 *)&Histogram->TotalNanoseconds, (LONG64)TotalNanoseconds);
+}
+
+static
+MINIPORT_LATENCY_HISTOGRAM *
+MpLatencyGetProcessorHistogram(
+    _In_ MP_LATENCY *Latency
+    )
+{
+    UINT32 Index = KeGetCurrentProcessorIndex();
+
+    if (Index >= Latency->ProcessorCount) {
+        Index = 0;
+    }
+
+    return &Latency->Processors[Index].Histogram;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpLatencyRecordReceiveNbls(
+    _In_ MP_LATENCY *Latency,
+    _In_ NET_BUFFER_LIST *NblChain
+    )
+{
+    MpLatencyRecordNbls(Latency, &MpLatencyGetProcessorHistogram(Latency)->Receive, NblChain);
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpLatencyRecordTransmitNbls(
+    _In_ MP_LATENCY *Latency,
+    _In_ NET_BUFFER_LIST *NblChain
+    )
+{
+    MpLatencyRecordNbls(Latency, &MpLatencyGetProcessorHistogram(Latency)->Transmit, NblChain);
+}
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+SharedIrpGetLatencyHistogram(
+    _In_ SHARED_CONTEXT *Shared,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    MINIPORT_GET_LATENCY_HISTOGRAM_IN In = {0};
+    MINIPORT_LATENCY_HISTOGRAM *Out = Irp->AssociatedIrp.SystemBuffer;
+    MP_LATENCY *Latency = Shared->Adapter->Latency;
+    CONST UINT32 CounterCount = sizeof(*Out) / sizeof(UINT64);
+    NTSTATUS Status;
+
+    C_ASSERT(sizeof(MINIPORT_LATENCY_HISTOGRAM) % sizeof(UINT64) == 0);
+
+    if (IrpSp->Parameters.DeviceIoControl.InputBufferLength >= sizeof(In)) {
+        In = *(CONST MINIPORT_GET_LATENCY_HISTOGRAM_IN *)Irp->AssociatedIrp.SystemBuffer;
+    }
+
+    if (IrpSp->Parameters.DeviceIoControl.OutputBufferLength < sizeof(*Out)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    RtlZeroMemory(Out, sizeof(*Out));
+
+    for (UINT32 Index = 0; Index < Latency->ProcessorCount; Index++) {
+        UINT64 *Source = (UINT64 *)&Latency->Processors[Index].Histogram;
+        UINT64 *Destination = (UINT64 *)Out;
+
+        for (UINT32 Counter = 0; Counter < CounterCount; Counter++) {
+            if (In.Flags.Reset) {
+                Destination[Counter] +=
+                    (UINT64)InterlockedExchangeNoFence64((LONG64 *)&Source[Counter], 0);
+            } else {
+                Destination[Counter] += ReadULong64NoFence(&Source[Counter]);
+            }
+        }
+    }
+
+    Irp->IoStatus.Information = sizeof(*Out);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    return Status;
+}
+
+VOID
+MpLatencyCleanup(
+    _In_ MP_LATENCY *Latency
+    )
+{
+    if (Latency->Processors != NULL) {
+        ExFreePoolWithTag(Latency->Processors, POOLTAG_MP_LATENCY);
+    }
+
+    ExFreePoolWithTag(Latency, POOLTAG_MP_LATENCY);
+}
+
+MP_LATENCY *
+MpLatencyCreate(
+    VOID
+    )
+{
+    MP_LATENCY *Latency;
+    LARGE_INTEGER Frequency;
+    NTSTATUS Status;
+
+    Latency = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Latency), POOLTAG_MP_LATENCY);
+    if (Latency == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    KeQueryPerformanceCounter(&Frequency);
+    Latency->Frequency = Frequency.QuadPart;
+
+    Latency->ProcessorCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    Latency->Processors =
+        ExAllocatePoolZero(
+            NonPagedPoolNxCacheAligned,
+            (SIZE_T)Latency->ProcessorCount * sizeof(*Latency->Processors),
+            POOLTAG_MP_LATENCY);
+    if (Latency->Processors == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        if (Latency != NULL) {
+            MpLatencyCleanup(Latency);
+            Latency = NULL;
+        }
+    }
+
+    return Latency;
+}
@@ -0,0 +1,52 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+typedef struct _MP_LATENCY MP_LATENCY;
+typedef struct _SHARED_CONTEXT SHARED_CONTEXT;
+
+MP_LATENCY *
+MpLatencyCreate(
+    VOID
+    );
+
+VOID
+MpLatencyCleanup(
+    _In_ MP_LATENCY *Latency
+    );
+
+//
+// Records the current time in each NBL's miniport reserved area. The NBLs
+// must be owned by the miniport until they are passed to one of the
+// MpLatencyRecord* routines.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpLatencyStampNbls(
+    _In_ NET_BUFFER_LIST *NblChain
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpLatencyRecordReceiveNbls(
+    _In_ MP_LATENCY *Latency,
+    _In_ NET_BUFFER_LIST *NblChain
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpLatencyRecordTransmitNbls(
+    _In_ MP_LATENCY *Latency,
+    _In_ NET_BUFFER_LIST *NblChain
+    );
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+SharedIrpGetLatencyHistogram(
+    _In_ SHARED_CONTEXT *Shared,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    );
@@ -92,6 +92,14 @@ MpCleanupAdapter(
         SharedAdapterCleanup(Adapter->Shared);
     }
 
+    if (Adapter->Statistics != NULL) {
+        MpStatisticsCleanup(Adapter->Statistics);
+    }
+
+    if (Adapter->Latency != NULL) {
+        MpLatencyCleanup(Adapter->Latency);
+    }
+
     ASSERT(IsListEmpty(&Adapter->PortList));
 
     MpIoctlDereference();
@@ -138,8 +146,22 @@ MpCreateAdapter(
         goto Exit;
     }
 
+    Adapter->Statistics = MpStatisticsCreate();
+    if (Adapter->Statistics == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    Adapter->Latency = MpLatencyCreate();
+    if (Adapter->Latency == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
     Status =
-        FnTimerCreate(&Adapter->WatchdogTimer, MpWatchdogTimeout, Adapter, RTL_SEC_TO_MILLISEC(1));
+        FnTimerCreate(
+            MpGlobalContext.TimerWheel, &Adapter->WatchdogTimer, MpWatchdogTimeout, Adapter,
+            RTL_SEC_TO_MILLISEC(1));
     if (!NT_SUCCESS(Status)) {
         goto Exit;
     }
@@ -922,6 +944,11 @@ MiniportUnloadHandler(
 
     MpIoctlCleanup();
 
+    if (MpGlobalContext.TimerWheel != NULL) {
+        FnTimerWheelClose(MpGlobalContext.TimerWheel);
+        MpGlobalContext.TimerWheel = NULL;
+    }
+
     TraceExitSuccess(TRACE_CONTROL);
 
     WPP_CLEANUP(DriverObject);
@@ -1005,6 +1032,11 @@ DriverEntry(
         goto Cleanup;
     }
 
+    Status = FnConvertNtStatusToNdisStatus(FnTimerWheelCreate(&MpGlobalContext.TimerWheel));
+    if (Status != NDIS_STATUS_SUCCESS) {
+        goto Cleanup;
+    }
+
     MChars.InitializeHandlerEx = MiniportInitializeHandler;
     MChars.HaltHandlerEx = MiniportHaltHandler;
     MChars.UnloadHandler = MiniportUnloadHandler;
@@ -24,6 +24,8 @@
 
 typedef struct _ADAPTER_SHARED ADAPTER_SHARED;
 typedef struct _EXCLUSIVE_USER_CONTEXT EXCLUSIVE_USER_CONTEXT;
+typedef struct _MP_LATENCY MP_LATENCY;
+typedef struct _MP_STATISTICS MP_STATISTICS;
 
 typedef struct DECLSPEC_CACHEALIGN {
     UINT32 QueueId;
@@ -95,6 +97,8 @@ typedef struct _ADAPTER_CONTEXT {
     EXCLUSIVE_USER_CONTEXT *UserContext;
 
     ADAPTER_SHARED *Shared;
+    MP_STATISTICS *Statistics;
+    MP_LATENCY *Latency;
 } ADAPTER_CONTEXT;
 
 typedef struct _GLOBAL_CONTEXT {
@@ -102,6 +106,7 @@ typedef struct _GLOBAL_CONTEXT {
     LIST_ENTRY AdapterList;
     HANDLE NdisMiniportDriverHandle;
     UINT32 NdisVersion;
+    FN_TIMER_WHEEL_HANDLE TimerWheel;
 
     NDIS_MEDIUM Medium;
     ULONG PacketFilter;
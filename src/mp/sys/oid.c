@@ -324,29 +324,7 @@ MpProcessQueryOid(
             break;
 
         case OID_GEN_STATISTICS:
-            RtlZeroMemory(&StatisticsInfo, sizeof(StatisticsInfo));
-            StatisticsInfo.Header.Revision = NDIS_OBJECT_REVISION_1;
-            StatisticsInfo.Header.Type = NDIS_OBJECT_TYPE_DEFAULT;
-            StatisticsInfo.Header.Size = sizeof(NDIS_STATISTICS_INFO);
-            StatisticsInfo.SupportedStatistics =
-                            NDIS_STATISTICS_FLAGS_VALID_RCV_DISCARDS |
-                            NDIS_STATISTICS_FLAGS_VALID_BYTES_RCV |
-                            NDIS_STATISTICS_FLAGS_VALID_XMIT_DISCARDS |
-                            NDIS_STATISTICS_FLAGS_VALID_BYTES_XMIT |
-                            NDIS_STATISTICS_FLAGS_VALID_DIRECTED_FRAMES_RCV |
-                            NDIS_STATISTICS_FLAGS_VALID_DIRECTED_FRAMES_XMIT |
-                            NDIS_STATISTICS_FLAGS_VALID_BROADCAST_FRAMES_RCV |
-                            NDIS_STATISTICS_FLAGS_VALID_BROADCAST_FRAMES_XMIT;
-#if 0
-            StatisticsInfo.ifInDiscards = enlStats.RxDrops;
-            StatisticsInfo.ifHCInOctets = enlStats.RxBytes;
-            StatisticsInfo.ifHCInUcastPkts = enlStats.RxPkts;
-            StatisticsInfo.ifHCInBroadcastPkts = enlStats.EmptyTicks;
-            StatisticsInfo.ifHCOutOctets = enlStats.TxBytes;
-            StatisticsInfo.ifHCOutUcastPkts = enlStats.TxPkts;
-            StatisticsInfo.ifHCOutBroadcastPkts = enlStats.BusyTicks;
-            StatisticsInfo.ifOutDiscards = enlStats.TxDrops + pAdapter->EnlTxDrops;
-#endif // TODO
+            MpStatisticsQuery(Adapter->Statistics, &StatisticsInfo);
 
             Data = &StatisticsInfo;
             DataLength = sizeof(NDIS_STATISTICS_INFO);
@@ -8,6 +8,7 @@
 #include <ntddk.h>
 #include <ndis.h>
 #include <ntintsafe.h>
+#include <netiodef.h>
 #include <ndis/ndl/nblqueue.h>
 #include <qeo_ndis.h>
 #include <fnassert.h>
@@ -24,13 +25,16 @@
 #include "miniport.h"
 
 #include "bounce.h"
+#include "checksum.h"
 #include "exclusive.h"
+#include "latency.h"
 #include "pooltag.h"
 #include "oid.h"
 #include "port.h"
 #include "rss.h"
 #include "rx.h"
 #include "shared.h"
+#include "stats.h"
 #include "trace.h"
 #include "tx.h"
 
@@ -105,6 +105,7 @@ SharedIrpRxEnqueue(
 
     NET_BUFFER_LIST_INFO(Nbl, TcpIpChecksumNetBufferListInfo) =
         EnqueueIn.Frame.Input.Checksum.Value;
+    MpChecksumReceiveNbl(Adapter, Nbl);
 
     if (EnqueueIn.Frame.Input.Rsc.Value != 0) {
         if (EnqueueIn.Frame.Input.Rsc.Info.CoalescedSegCount < 1) {
@@ -154,6 +155,7 @@ MpReturnNetBufferLists(
     TraceEnter(TRACE_DATAPATH, "Adapter=%p", Adapter);
 
     TraceNbls(NetBufferLists);
+    MpLatencyRecordReceiveNbls(Adapter->Latency, NetBufferLists);
     Count = SharedRxCleanupNblChain(NetBufferLists);
 
     ExReleaseRundownProtectionEx(&Adapter->Shared->NblRundown, Count);
@@ -215,6 +217,7 @@ SharedIrpRxFlush(
     }
 
     if (!ExAcquireRundownProtectionEx(&Adapter->Shared->NblRundown, (UINT32)Nbls.NblCount)) {
+        MpStatisticsReceiveDiscards(Adapter->Statistics, NdisGetNblChainFromNblCountedQueue(&Nbls));
         SharedRxCleanupNblChain(NdisGetNblChainFromNblCountedQueue(&Nbls));
         Status = STATUS_DEVICE_NOT_READY;
         goto Exit;
@@ -239,7 +242,14 @@ SharedIrpRxFlush(
         KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
     }
 
+    //
+    // Count the NBLs before indicating them: without the resources flag, the
+    // stack may return them before the indication call returns.
+    //
+    MpStatisticsReceiveNbls(Adapter->Statistics, NdisGetNblChainFromNblCountedQueue(&Nbls));
+
     TraceNbls(NdisGetNblChainFromNblCountedQueue(&Nbls));
+    MpLatencyStampNbls(NdisGetNblChainFromNblCountedQueue(&Nbls));
     NdisMIndicateReceiveNetBufferLists(
         Adapter->MiniportHandle, NdisGetNblChainFromNblCountedQueue(&Nbls),
         NDIS_DEFAULT_PORT_NUMBER, (UINT32)Nbls.NblCount, NdisFlags);
@@ -254,6 +264,7 @@ SharedIrpRxFlush(
         NET_BUFFER_LIST *Nbl = NdisGetNblChainFromNblCountedQueue(&Nbls);
         UINT32 Count = 0;
 
+        MpLatencyRecordReceiveNbls(Adapter->Latency, NdisGetNblChainFromNblCountedQueue(&Nbls));
         ExReleaseRundownProtectionEx(&Adapter->Shared->NblRundown, (UINT32)Nbls.NblCount);
 
         //
@@ -255,6 +255,10 @@ SharedAdapterCleanup(
     _In_ ADAPTER_SHARED *AdapterShared
     )
 {
+    if (AdapterShared->Checksum != NULL) {
+        MpChecksumCleanup(AdapterShared->Checksum);
+    }
+
     if (AdapterShared->NblPool != NULL) {
         NdisFreeNetBufferListPool(AdapterShared->NblPool);
     }
@@ -296,6 +300,12 @@ SharedAdapterCreate(
         goto Exit;
     }
 
+    AdapterShared->Checksum = MpChecksumCreate();
+    if (AdapterShared->Checksum == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
     Status = STATUS_SUCCESS;
 
 Exit:
@@ -363,6 +373,18 @@ SharedIrpDeviceIoControl(
         Status = SharedIrpUpdateTaskOffload(Shared, Irp, IrpSp);
         break;
 
+    case FNMP_IOCTL_MINIPORT_SET_CHECKSUM_EMULATION:
+        Status = SharedIrpSetChecksumEmulation(Shared, Irp, IrpSp);
+        break;
+
+    case FNMP_IOCTL_MINIPORT_GET_CHECKSUM_COUNTERS:
+        Status = SharedIrpGetChecksumCounters(Shared, Irp, IrpSp);
+        break;
+
+    case FNMP_IOCTL_MINIPORT_GET_LATENCY_HISTOGRAM:
+        Status = SharedIrpGetLatencyHistogram(Shared, Irp, IrpSp);
+        break;
+
     default:
         Status = STATUS_NOT_SUPPORTED;
         goto Exit;
@@ -23,6 +23,8 @@ typedef struct _ADAPTER_SHARED {
 
     KSPIN_LOCK Lock;
     LIST_ENTRY TxFilterList;
+
+    MP_CHECKSUM *Checksum;
 } ADAPTER_SHARED;
 
 typedef struct _SHARED_CONTEXT {
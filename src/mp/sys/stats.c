@@ -0,0 +1,322 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#include "precomp.h"
+#include "stats.tmh"
+
+typedef enum _MP_STATISTICS_CAST {
+    MpStatisticsUnicast,
+    MpStatisticsMulticast,
+    MpStatisticsBroadcast,
+    MpStatisticsCastMax,
+} MP_STATISTICS_CAST;
+
+typedef struct _MP_STATISTICS_DIRECTION {
+    UINT64 Packets[MpStatisticsCastMax];
+    UINT64 Bytes[MpStatisticsCastMax];
+    UINT64 Discards;
+} MP_STATISTICS_DIRECTION;
+
+typedef struct DECLSPEC_CACHEALIGN _MP_STATISTICS_PROCESSOR {
+    MP_STATISTICS_DIRECTION Receive;
+    MP_STATISTICS_DIRECTION Transmit;
+} MP_STATISTICS_PROCESSOR;
+
+typedef struct _MP_STATISTICS {
+    UINT32 ProcessorCount;
+    MP_STATISTICS_PROCESSOR *Processors;
+} MP_STATISTICS;
+
+static
+MP_STATISTICS_CAST
+MpStatisticsGetCast(
+    _In_ NET_BUFFER *NetBuffer
+    )
+{
+    DECLSPEC_ALIGN(2) UCHAR Storage[MAC_ADDR_LEN];
+    CONST UCHAR *Destination;
+
+    if (NET_BUFFER_DATA_LENGTH(NetBuffer) < sizeof(Storage)) {
+        return MpStatisticsUnicast;
+    }
+
+    Destination = NdisGetDataBuffer(NetBuffer, sizeof(Storage), Storage, 1, 0);
+    if (Destination == NULL || !(Destination[0] & 0x01)) {
+        return MpStatisticsUnicast;
+    }
+
+    for (UINT32 Index = 0; Index < MAC_ADDR_LEN; Index++) {
+        if (Destination[Index] != 0xFF) {
+            return MpStatisticsMulticast;
+        }
+    }
+
+    return MpStatisticsBroadcast;
+}
+
+static
+VOID
+MpStatisticsCountNbls(
+    _In_ NET_BUFFER_LIST *NblChain,
+    _Out_ MP_STATISTICS_DIRECTION *Counters
+    )
+{
+    RtlZeroMemory(Counters, sizeof(*Counters));
+
+    for (NET_BUFFER_LIST *Nbl = NblChain; Nbl != NULL; Nbl = Nbl->Next) {
+        for (NET_BUFFER *Nb = NET_BUFFER_LIST_FIRST_NB(Nbl); Nb != NULL;
+                Nb = NET_BUFFER_NEXT_NB(Nb)) {
+            MP_STATISTICS_CAST Cast = MpStatisticsGetCast(Nb);
+
+            Counters->Packets[Cast]++;
+            Counters->Bytes[Cast] += NET_BUFFER_DATA_LENGTH(Nb);
+        }
+    }
+}
+
+static
+UINT64
+MpStatisticsCountPackets(
+    _In_ NET_BUFFER_LIST *NblChain
+    )
+{
+    UINT64 Count = 0;
+
+    for (NET_BUFFER_LIST *Nbl = NblChain; Nbl != NULL; Nbl = Nbl->Next) {
+        for (NET_BUFFER *Nb = NET_BUFFER_LIST_FIRST_NB(Nbl); Nb != NULL;
+                Nb = NET_BUFFER_NEXT_NB(Nb)) {
+            Count++;
+        }
+    }
+
+    return Count;
+}
+
+static
+MP_STATISTICS_PROCESSOR *
+MpStatisticsGetProcessor(
+    _In_ MP_STATISTICS *Statistics
+    )
+{
+    UINT32 Index = KeGetCurrentProcessorIndex();
+
+    if (Index >= Statistics->ProcessorCount) {
+        Index = 0;
+    }
+
+    return &Statistics->Processors[Index];
+}
+
+static
+VOID
+MpStatisticsAdd(
+    _Inout_ MP_STATISTICS_DIRECTION *Slot,
+    _In_ CONST MP_STATISTICS_DIRECTION *Counters
+    )
+{
+    //
+    // Each slot is only written from its own processor, so the interlocked
+    // operations never contend; they only guard against preemption and
+    // migration at passive level.
+    //
+    for (UINT32 Cast = 0; Cast < MpStatisticsCastMax; Cast++) {
+        if (Counters->Packets[Cast] > 0) {
+            InterlockedAddNoFence64(
+                (LONG64 *)&Slot->Packets[Cast], (LONG64)Counters->Packets[Cast]);
+            InterlockedAddNoFence64(
+                (LONG64 *)&Slot->Bytes[Cast], (LONG64)Counters->Bytes[Cast]);
+        }
+    }
+
+    if (Counters->Discards > 0) {
+        InterlockedAddNoFence64((LONG64 *)&Slot->Discards, (LONG64)Counters->Discards);
+    }
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpStatisticsReceiveNbls(
+    _In_ MP_STATISTICS *Statistics,
+    _In_ NET_BUFFER_LIST *NblChain
+    )
+{
+    MP_STATISTICS_DIRECTION Counters;
+
+    MpStatisticsCountNbls(NblChain, &Counters);
+    MpStatisticsAdd(&MpStatisticsGetProcessor(Statistics)->Receive, &Counters);
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpStatisticsReceiveDiscards(
+    _In_ MP_STATISTICS *Statistics,
+    _In_ NET_BUFFER_LIST *NblChain
+    )
+{
+    MP_STATISTICS_DIRECTION Counters = {0};
+
+    Counters.Discards = MpStatisticsCountPackets(NblChain);
+    MpStatisticsAdd(&MpStatisticsGetProcessor(Statistics)->Receive, &Counters);
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpStatisticsTransmitNbls(
+    _In_ MP_STATISTICS *Statistics,
+    _In_ NET_BUFFER_LIST *NblChain
+    )
+{
+    MP_STATISTICS_DIRECTION Counters;
+
+    MpStatisticsCountNbls(NblChain, &Counters);
+    MpStatisticsAdd(&MpStatisticsGetProcessor(Statistics)->Transmit, &Counters);
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpStatisticsTransmitDiscards(
+    _In_ MP_STATISTICS *Statistics,
+    _In_ NET_BUFFER_LIST *NblChain
+    )
+{
+    MP_STATISTICS_DIRECTION Counters = {0};
+
+    Counters.Discards = MpStatisticsCountPackets(NblChain);
+    MpStatisticsAdd(&MpStatisticsGetProcessor(Statistics)->Transmit, &Counters);
+}
+
+static
+VOID
+MpStatisticsSum(
+    _In_ MP_STATISTICS *Statistics,
+    _Out_ MP_STATISTICS_DIRECTION *Receive,
+    _Out_ MP_STATISTICS_DIRECTION *Transmit
+    )
+{
+    CONST UINT32 CounterCount = sizeof(MP_STATISTICS_DIRECTION) / sizeof(UINT64);
+
+    C_ASSERT(sizeof(MP_STATISTICS_DIRECTION) % sizeof(UINT64) == 0);
+
+    RtlZeroMemory(Receive, sizeof(*Receive));
+    RtlZeroMemory(Transmit, sizeof(*Transmit));
+
+    for (UINT32 Index = 0; Index < Statistics->ProcessorCount; Index++) {
+        CONST UINT64 *RxSource = (CONST UINT64 *)&Statistics->Processors[Index].Receive;
+        CONST UINT64 *TxSource = (CONST UINT64 *)&Statistics->Processors[Index].Transmit;
+
+        for (UINT32 Counter = 0; Counter < CounterCount; Counter++) {
+            ((UINT64 *)Receive)[Counter] += ReadULong64NoFence(&RxSource[Counter]);
+            ((UINT64 *)Transmit)[Counter] += ReadULong64NoFence(&TxSource[Counter]);
+        }
+    }
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpStatisticsQuery(
+    _In_ MP_STATISTICS *Statistics,
+    _Out_ NDIS_STATISTICS_INFO *StatisticsInfo
+    )
+{
+    MP_STATISTICS_DIRECTION Rx;
+    MP_STATISTICS_DIRECTION Tx;
+
+    MpStatisticsSum(Statistics, &Rx, &Tx);
+
+    RtlZeroMemory(StatisticsInfo, sizeof(*StatisticsInfo));
+    StatisticsInfo->Header.Revision = NDIS_STATISTICS_INFO_REVISION_1;
+    StatisticsInfo->Header.Type = NDIS_OBJECT_TYPE_DEFAULT;
+    StatisticsInfo->Header.Size = NDIS_SIZEOF_STATISTICS_INFO_REVISION_1;
+    StatisticsInfo->SupportedStatistics =
+        NDIS_STATISTICS_FLAGS_VALID_DIRECTED_FRAMES_RCV |
+        NDIS_STATISTICS_FLAGS_VALID_MULTICAST_FRAMES_RCV |
+        NDIS_STATISTICS_FLAGS_VALID_BROADCAST_FRAMES_RCV |
+        NDIS_STATISTICS_FLAGS_VALID_BYTES_RCV |
+        NDIS_STATISTICS_FLAGS_VALID_RCV_DISCARDS |
+        NDIS_STATISTICS_FLAGS_VALID_DIRECTED_FRAMES_XMIT |
+        NDIS_STATISTICS_FLAGS_VALID_MULTICAST_FRAMES_XMIT |
+        NDIS_STATISTICS_FLAGS_VALID_BROADCAST_FRAMES_XMIT |
+        NDIS_STATISTICS_FLAGS_VALID_BYTES_XMIT |
+        NDIS_STATISTICS_FLAGS_VALID_XMIT_DISCARDS |
+        NDIS_STATISTICS_FLAGS_VALID_DIRECTED_BYTES_RCV |
+        NDIS_STATISTICS_FLAGS_VALID_MULTICAST_BYTES_RCV |
+        NDIS_STATISTICS_FLAGS_VALID_BROADCAST_BYTES_RCV |
+        NDIS_STATISTICS_FLAGS_VALID_DIRECTED_BYTES_XMIT |
+        NDIS_STATISTICS_FLAGS_VALID_MULTICAST_BYTES_XMIT |
+        NDIS_STATISTICS_FLAGS_VALID_BROADCAST_BYTES_XMIT;
+
+    StatisticsInfo->ifInDiscards = Rx.Discards;
+    StatisticsInfo->ifHCInUcastPkts = Rx.Packets[MpStatisticsUnicast];
+    StatisticsInfo->ifHCInMulticastPkts = Rx.Packets[MpStatisticsMulticast];
+    StatisticsInfo->ifHCInBroadcastPkts = Rx.Packets[MpStatisticsBroadcast];
+    StatisticsInfo->ifHCInUcastOctets = Rx.Bytes[MpStatisticsUnicast];
+    StatisticsInfo->ifHCInMulticastOctets = Rx.Bytes[MpStatisticsMulticast];
+    StatisticsInfo->ifHCInBroadcastOctets = Rx.Bytes[MpStatisticsBroadcast];
+    StatisticsInfo->ifHCInOctets =
+        Rx.Bytes[MpStatisticsUnicast] + Rx.Bytes[MpStatisticsMulticast] +
+        Rx.Bytes[MpStatisticsBroadcast];
+
+    StatisticsInfo->ifOutDiscards = Tx.Discards;
+    StatisticsInfo->ifHCOutUcastPkts = Tx.Packets[MpStatisticsUnicast];
+    StatisticsInfo->ifHCOutMulticastPkts = Tx.Packets[MpStatisticsMulticast];
+    StatisticsInfo->ifHCOutBroadcastPkts = Tx.Packets[MpStatisticsBroadcast];
+    StatisticsInfo->ifHCOutUcastOctets = Tx.Bytes[MpStatisticsUnicast];
+    StatisticsInfo->ifHCOutMulticastOctets = Tx.Bytes[MpStatisticsMulticast];
+    StatisticsInfo->ifHCOutBroadcastOctets = Tx.Bytes[MpStatisticsBroadcast];
+    StatisticsInfo->ifHCOutOctets =
+        Tx.Bytes[MpStatisticsUnicast] + Tx.Bytes[MpStatisticsMulticast] +
+        Tx.Bytes[MpStatisticsBroadcast];
+}
+
+VOID
+MpStatisticsCleanup(
+    _In_ MP_STATISTICS *Statistics
+    )
+{
+    if (Statistics->Processors != NULL) {
+        ExFreePoolWithTag(Statistics->Processors, POOLTAG_MP_STATISTICS);
+    }
+
+    ExFreePoolWithTag(Statistics, POOLTAG_MP_STATISTICS);
+}
+
+MP_STATISTICS *
+MpStatisticsCreate(
+    VOID
+    )
+{
+    MP_STATISTICS *Statistics;
+    NTSTATUS Status;
+
+    Statistics = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Statistics), POOLTAG_MP_STATISTICS);
+    if (Statistics == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    Statistics->ProcessorCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    Statistics->Processors =
+        ExAllocatePoolZero(
+            NonPagedPoolNxCacheAligned,
+            (SIZE_T)Statistics->ProcessorCount * sizeof(*Statistics->Processors),
+            POOLTAG_MP_STATISTICS);
+    if (Statistics->Processors == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        if (Statistics != NULL) {
+            MpStatisticsCleanup(Statistics);
+            Statistics = NULL;
+        }
+    }
+
+    return Statistics;
+}
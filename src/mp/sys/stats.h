@@ -0,0 +1,53 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+typedef struct _MP_STATISTICS MP_STATISTICS;
+
+MP_STATISTICS *
+MpStatisticsCreate(
+    VOID
+    );
+
+VOID
+MpStatisticsCleanup(
+    _In_ MP_STATISTICS *Statistics
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpStatisticsReceiveNbls(
+    _In_ MP_STATISTICS *Statistics,
+    _In_ NET_BUFFER_LIST *NblChain
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpStatisticsReceiveDiscards(
+    _In_ MP_STATISTICS *Statistics,
+    _In_ NET_BUFFER_LIST *NblChain
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpStatisticsTransmitNbls(
+    _In_ MP_STATISTICS *Statistics,
+    _In_ NET_BUFFER_LIST *NblChain
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpStatisticsTransmitDiscards(
+    _In_ MP_STATISTICS *Statistics,
+    _In_ NET_BUFFER_LIST *NblChain
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+MpStatisticsQuery(
+    _In_ MP_STATISTICS *Statistics,
+    _Out_ NDIS_STATISTICS_INFO *StatisticsInfo
+    );
@@ -40,6 +40,8 @@ SharedTxCompleteNbls(
     )
 {
     ASSERT(Count <= MAXULONG);
+    MpStatisticsTransmitNbls(Shared->Adapter->Statistics, NblChain);
+    MpLatencyRecordTransmitNbls(Shared->Adapter->Latency, NblChain);
     NdisMSendNetBufferListsComplete(Shared->Adapter->MiniportHandle, NblChain, 0);
     ExReleaseRundownProtectionEx(&Shared->NblRundown, (ULONG)Count);
 }
@@ -154,10 +156,14 @@ MpSendNetBufferLists(
     NdisAppendNblChainToNblCountedQueue(&NblChain, NetBufferLists);
 
     if (!ExAcquireRundownProtectionEx(&Adapter->Shared->NblRundown, (ULONG)NblChain.NblCount)) {
+        MpStatisticsTransmitDiscards(Adapter->Statistics, NetBufferLists);
         NdisMSendNetBufferListsComplete(Adapter->MiniportHandle, NetBufferLists, 0);
         return;
     }
 
+    MpLatencyStampNbls(NetBufferLists);
+    MpChecksumTransmitNbls(Adapter, NetBufferLists);
+
     KeAcquireSpinLock(&Adapter->Shared->Lock, &OldIrql);
 
     while (!NdisIsNblCountedQueueEmpty(&NblChain)) {
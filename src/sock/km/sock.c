@@ -16,11 +16,13 @@
 
 #include <ntddk.h>
 #include <wsk.h>
+#include <ws2ipdef.h>
 
 #define FNSOCKAPI __declspec(dllexport)
 
 #include "fnsock.h"
 #include "pooltag.h"
+#include "sockcmsg.h"
 #include "trace.h"
 #include "wskclient.h"
 
@@ -30,26 +32,114 @@ typedef struct _WSK_DATAGRAM_SOCKET {
     const WSK_PROVIDER_DATAGRAM_DISPATCH* Dispatch;
 } WSK_DATAGRAM_SOCKET, * PWSK_DATAGRAM_SOCKET;
 
+typedef struct FNSOCK_COMPLETION_QUEUE_OBJECT FNSOCK_COMPLETION_QUEUE_OBJECT;
+
 typedef struct FNSOCK_SOCKET_BINDING {
     PWSK_SOCKET Socket;
 
     ADDRESS_FAMILY AddressFamily;
     ULONG SockType;
     BOOLEAN IsBound;
+    BOOLEAN IsListening;
     UINT32 ReceiveTimeout;
 
-    KSPIN_LOCK SendContextLock;
-    LIST_ENTRY SendContextList;
+    //
+    // Fire and forget sends still in flight. SendCompleteEvent is set whenever
+    // one of them completes. Protected by SendLock.
+    //
+    KSPIN_LOCK SendLock;
+    KEVENT SendCompleteEvent;
+    UINT32 OutstandingSendCount;
+    UINT32 PeakOutstandingSendCount;
 
     KSPIN_LOCK RecvDataLock;
     LIST_ENTRY RecvDataList;
     KEVENT RecvEvent;
+    ULONG RecvDataBytes;
+    ULONG ReceiveBufferSize;
+    UINT64 RecvDroppedPackets;
+    UINT64 RecvDroppedBytes;
+    BOOLEAN RetainIndications;
+    UINT32 RetainedIndicationCount;
+
+    //
+    // Stream sockets treat RecvDataList as a byte stream: RecvDataOffset is
+    // the read cursor into the head chunk and RecvShutdown is set once the
+    // peer has disconnected. Readers are serialized by StreamRecvLock.
+    //
+    FAST_MUTEX StreamRecvLock;
+    ULONG RecvDataOffset;
+    BOOLEAN RecvShutdown;
+
+    //
+    // Connected stream sockets keep FNSOCK_STREAM_RECV_COUNT receives posted
+    // through a wskclient receive pipeline, which feeds RecvDataList.
+    //
+    VOID* RecvPipeline;
+    CHAR* RecvPipelineBuffers;
 
     KSPIN_LOCK AcceptLock;
     LIST_ENTRY AcceptList;
     KEVENT AcceptEvent;
+
+    //
+    // Asynchronous receives and accepts are pended on the binding until data
+    // or a connection is available. The binding is then queued to its
+    // completion queue, which completes the operations when it is drained.
+    // AsyncRecvList is protected by RecvDataLock, AsyncAcceptList by
+    // AcceptLock, and ReadyLink by the completion queue lock.
+    //
+    FNSOCK_COMPLETION_QUEUE_OBJECT* CompletionQueue;
+    LIST_ENTRY AsyncRecvList;
+    LIST_ENTRY AsyncAcceptList;
+    LIST_ENTRY ReadyLink;
+    BOOLEAN IsReadyQueued;
+
+    //
+    // FnSockPoll waiters registered on the binding, signaled whenever data, a
+    // disconnect or a connection arrives.
+    //
+    KSPIN_LOCK PollLock;
+    LIST_ENTRY PollWaiterList;
 } FNSOCK_SOCKET_BINDING;
 
+struct FNSOCK_COMPLETION_QUEUE_OBJECT {
+    KSPIN_LOCK Lock;
+    KEVENT ReadyEvent;
+    LIST_ENTRY ReadyBindingList;
+    LIST_ENTRY CompletedList;
+
+    //
+    // Connects are completed by wskclient at DISPATCH_LEVEL, and then
+    // finished at PASSIVE_LEVEL when the queue is drained.
+    //
+    LIST_ENTRY ConnectList;
+
+    //
+    // Serializes completing the operations of ready bindings with closing
+    // those bindings.
+    //
+    FAST_MUTEX ProcessLock;
+};
+
+typedef struct FNSOCK_POLL_REGISTRATION {
+    LIST_ENTRY Link;
+    FNSOCK_SOCKET_BINDING* Binding;
+    KEVENT* Event;
+} FNSOCK_POLL_REGISTRATION;
+
+typedef struct FNSOCK_ASYNC_OPERATION {
+    LIST_ENTRY Link;
+    FNSOCK_SOCKET_BINDING* Binding;
+    FNSOCK_OPERATION Operation;
+    VOID* Context;
+    CHAR* Buffer;
+    INT BufferLength;
+    INT Flags;
+    NTSTATUS Status;
+    INT BytesTransferred;
+} FNSOCK_ASYNC_OPERATION;
+
 typedef struct FNSOCK_SOCKET_ACCEPT_CONTEXT {
     LIST_ENTRY Link;
     FNSOCK_SOCKET_BINDING* AcceptedSocket;
@@ -58,16 +148,46 @@ typedef struct FNSOCK_SOCKET_ACCEPT_CONTEXT {
 typedef struct FNSOCK_SOCKET_RECV_DATA {
     LIST_ENTRY Link;
     INT Flags;
+    //
+    // If non-NULL, the datagram is retained in its WSK indication and the
+    // control data and data buffers below are unused.
+    //
+    PWSK_DATAGRAM_INDICATION Indication;
     ULONG ControlDataLength;
     DECLSPEC_ALIGN(MEMORY_ALLOCATION_ALIGNMENT) UCHAR ControlData[128];
     ULONG DataLength;
     UCHAR Data[0];
 } FNSOCK_SOCKET_RECV_DATA;
 
-typedef struct FNSOCK_SOCKET_SEND_CONTEXT {
-    LIST_ENTRY Link;
-    VOID* WskClientSendContext;
-} FNSOCK_SOCKET_SEND_CONTEXT;
+//
+// The maximum number of fire and forget sends outstanding on a socket. Once
+// the window is full, new sends block until one of them completes.
+//
+#define FNSOCK_MAX_OUTSTANDING_SENDS 128
+
+//
+// The maximum number of datagram indications retained from WSK on a socket.
+// Once the budget is exhausted, indicated datagrams are copied instead.
+//
+#define FNSOCK_MAX_RETAINED_INDICATIONS 64
+
+//
+// The default SO_RCVBUF of datagram sockets, matching user mode WinSock.
+//
+#define FNSOCK_DEFAULT_RECEIVE_BUFFER_SIZE 65536
+
+//
+// The maximum number of datagrams to the same destination that a batched
+// send submits to WSK as a single request.
+//
+#define FNSOCK_MAX_SEND_MESSAGES 32
+
+//
+// The number and size of the receives each connected stream socket keeps
+// posted.
+//
+#define FNSOCK_STREAM_RECV_COUNT 4
+#define FNSOCK_STREAM_RECV_SIZE 4096
 
 static WSK_CLIENT_DATAGRAM_DISPATCH WskDatagramDispatch;
 
@@ -102,16 +222,11 @@ FnSockStreamSocketAccept(
     _Outptr_result_maybenull_ CONST WSK_CLIENT_CONNECTION_DISPATCH** AcceptSocketDispatch
     );
 
-_IRQL_requires_max_(DISPATCH_LEVEL)
-_Must_inspect_result_
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS
-NTAPI
-FnSockStreamSocketReceive(
-    _In_opt_ void* SocketContext,
-    _In_ ULONG Flags,
-    _In_opt_ PWSK_DATA_INDICATION DataIndicationHead,
-    _In_ SIZE_T BytesIndicated,
-    _Inout_ SIZE_T* BytesAccepted
+StartStreamReceives(
+    _In_ FNSOCK_SOCKET_BINDING* Binding
     );
 
 _Function_class_(DRIVER_INITIALIZE)
@@ -165,8 +280,6 @@ FnSockInitialize(
 
     WskListenDispatch.WskAcceptEvent = FnSockStreamSocketAccept;
 
-    WskConnectionDispatch.WskReceiveEvent = FnSockStreamSocketReceive;
-
     WskStreamDispatch.Listen = &WskListenDispatch;
     WskStreamDispatch.Connect = &WskConnectionDispatch;
 
@@ -208,378 +321,485 @@ InitializeBinding(
     KeInitializeSpinLock(&Binding->RecvDataLock);
     InitializeListHead(&Binding->RecvDataList);
     KeInitializeEvent(&Binding->RecvEvent, NotificationEvent, FALSE);
+    Binding->ReceiveBufferSize = FNSOCK_DEFAULT_RECEIVE_BUFFER_SIZE;
+    Binding->RetainIndications = (WskSockType == WSK_FLAG_DATAGRAM_SOCKET);
+    ExInitializeFastMutex(&Binding->StreamRecvLock);
+
+    KeInitializeSpinLock(&Binding->SendLock);
+    KeInitializeEvent(&Binding->SendCompleteEvent, NotificationEvent, FALSE);
 
-    KeInitializeSpinLock(&Binding->SendContextLock);
-    InitializeListHead(&Binding->SendContextList);
+    InitializeListHead(&Binding->AsyncRecvList);
+    InitializeListHead(&Binding->AsyncAcceptList);
+
+    KeInitializeSpinLock(&Binding->PollLock);
+    InitializeListHead(&Binding->PollWaiterList);
 }
 
-FNSOCKAPI
+static
 _IRQL_requires_max_(PASSIVE_LEVEL)
-FNSOCK_STATUS
-FnSockCreate(
-    _In_ INT AddressFamily,
-    _In_ INT SocketType,
-    _In_ INT Protocol,
-    _Out_ FNSOCK_HANDLE* Socket
+NTSTATUS
+ValidateAddress(
+    _In_ FNSOCK_SOCKET_BINDING* Binding,
+    _In_reads_bytes_(AddressLength) const struct sockaddr* Address,
+    _In_ INT AddressLength
     )
 {
-    NTSTATUS Status;
-    FNSOCK_SOCKET_BINDING* Binding = NULL;
-    INT WskSockType;
-    VOID* Dispatch = NULL;
+    INT MinAddressLength;
 
-    *Socket = NULL;
+    //
+    // WSK takes addresses without a length, so make sure the caller's buffer
+    // holds a whole address of the family it claims.
+    //
+    if (AddressLength < (INT)sizeof(Address->sa_family)) {
+        MinAddressLength = MAXINT;
+    } else if (Address->sa_family == AF_INET) {
+        MinAddressLength = sizeof(SOCKADDR_IN);
+    } else if (Address->sa_family == AF_INET6) {
+        MinAddressLength = sizeof(SOCKADDR_IN6);
+    } else {
+        MinAddressLength = MAXINT;
+    }
 
-    Binding =
-#pragma warning( suppress : 4996 )
-        (FNSOCK_SOCKET_BINDING*)ExAllocatePoolWithTag(
-            NonPagedPoolNx, sizeof(*Binding), POOLTAG_FNSOCK_SOCKET);
-    if (Binding == NULL) {
+    if (AddressLength < MinAddressLength) {
         TraceError(
-            "[data] ERROR, %s.",
-            "Could not allocate memory for socket");
-        Status = STATUS_UNSUCCESSFUL;
-        goto Exit;
+            "[data][%p] ERROR, %s.",
+            Binding,
+            "Invalid address");
+        return STATUS_INVALID_PARAMETER;
     }
-    RtlZeroMemory(Binding, sizeof(*Binding));
 
-    switch (SocketType) {
-    case SOCK_DGRAM:
-    case SOCK_RAW:
-        WskSockType = WSK_FLAG_DATAGRAM_SOCKET;
-        Dispatch = &WskDatagramDispatch;
-        break;
-    case SOCK_STREAM:
-        WskSockType = WSK_FLAG_STREAM_SOCKET;
-        Dispatch = &WskStreamDispatch;
-        break;
-    default:
-        return STATUS_NOT_SUPPORTED;
-    }
+    return STATUS_SUCCESS;
+}
 
-    InitializeBinding(Binding, (ADDRESS_FAMILY)AddressFamily, WskSockType);
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+QueueReadyBinding(
+    _In_ FNSOCK_SOCKET_BINDING* Binding
+    )
+{
+    FNSOCK_COMPLETION_QUEUE_OBJECT* QueueObject = Binding->CompletionQueue;
+    KIRQL PrevIrql;
 
-    Status =
-        WskSocketSync(
-            WskSockType,
-            (ADDRESS_FAMILY)AddressFamily,
-            (USHORT)SocketType,
-            Protocol,
-            &Binding->Socket,
-            Binding,
-            Dispatch
-            );
-    if (!NT_SUCCESS(Status)) {
-        TraceError(
-            "[data][%p] ERROR, %u, %s.",
-            Binding,
-            Status,
-            "WskSocketSync");
-        goto Exit;
+    KeAcquireSpinLock(&QueueObject->Lock, &PrevIrql);
+    if (!Binding->IsReadyQueued) {
+        InsertTailList(&QueueObject->ReadyBindingList, &Binding->ReadyLink);
+        Binding->IsReadyQueued = TRUE;
+        KeSetEvent(&QueueObject->ReadyEvent, EVENT_INCREMENT, FALSE);
     }
+    KeReleaseSpinLock(&QueueObject->Lock, PrevIrql);
+}
 
-    *Socket = (FNSOCK_HANDLE)Binding;
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+SignalPollWaiters(
+    _In_ FNSOCK_SOCKET_BINDING* Binding
+    )
+{
+    KIRQL PrevIrql;
 
-Exit:
+    KeAcquireSpinLock(&Binding->PollLock, &PrevIrql);
+    for (LIST_ENTRY* Entry = Binding->PollWaiterList.Flink;
+            Entry != &Binding->PollWaiterList;
+            Entry = Entry->Flink) {
+        FNSOCK_POLL_REGISTRATION* Registration =
+            CONTAINING_RECORD(Entry, FNSOCK_POLL_REGISTRATION, Link);
 
-    if (!NT_SUCCESS(Status)) {
-        FnSockSocketLastError = Status;
+        KeSetEvent(Registration->Event, EVENT_INCREMENT, FALSE);
+    }
+    KeReleaseSpinLock(&Binding->PollLock, PrevIrql);
+}
 
-        if (Binding != NULL) {
-            ExFreePoolWithTag(Binding, POOLTAG_FNSOCK_SOCKET);
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+WaitForSendWindow(
+    _In_ FNSOCK_SOCKET_BINDING* Binding,
+    _In_ UINT32 MaxOutstandingSends,
+    _In_ BOOLEAN StartSend
+    )
+{
+    //
+    // Wait until no more than MaxOutstandingSends sends are in flight and, if
+    // StartSend is set, account for a new send under the same lock.
+    //
+    for (;;) {
+        KIRQL PrevIrql;
+
+        KeAcquireSpinLock(&Binding->SendLock, &PrevIrql);
+
+        if (Binding->OutstandingSendCount <= MaxOutstandingSends) {
+            if (StartSend) {
+                Binding->OutstandingSendCount++;
+                Binding->PeakOutstandingSendCount =
+                    max(Binding->PeakOutstandingSendCount, Binding->OutstandingSendCount);
+            }
+            KeReleaseSpinLock(&Binding->SendLock, PrevIrql);
+            break;
         }
-    }
 
-    return Status;
+        KeClearEvent(&Binding->SendCompleteEvent);
+        KeReleaseSpinLock(&Binding->SendLock, PrevIrql);
+
+        KeWaitForSingleObject(&Binding->SendCompleteEvent, Executive, KernelMode, FALSE, NULL);
+    }
 }
 
-FNSOCKAPI
-_IRQL_requires_max_(PASSIVE_LEVEL)
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
 VOID
-FnSockClose(
-    _In_ FNSOCK_HANDLE Socket
+FinishSend(
+    _In_ FNSOCK_SOCKET_BINDING* Binding
     )
 {
-    NTSTATUS Status;
-    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
+    KIRQL PrevIrql;
 
-    while (!IsListEmpty(&Binding->SendContextList)) {
-        LIST_ENTRY* Entry;
-        FNSOCK_SOCKET_SEND_CONTEXT* SendContext;
-        ULONG BytesSent;
+    //
+    // A closing socket waits for its sends to finish before freeing the
+    // binding, so the binding must not be touched once the lock is released.
+    //
+    KeAcquireSpinLock(&Binding->SendLock, &PrevIrql);
+    Binding->OutstandingSendCount--;
+    KeSetEvent(&Binding->SendCompleteEvent, EVENT_INCREMENT, FALSE);
+    SignalPollWaiters(Binding);
+    KeReleaseSpinLock(&Binding->SendLock, PrevIrql);
+}
 
-        Entry = RemoveHeadList(&Binding->SendContextList);
-        SendContext = CONTAINING_RECORD(Entry, FNSOCK_SOCKET_SEND_CONTEXT, Link);
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+SendComplete(
+    _In_opt_ PVOID Context,
+    _In_ NTSTATUS Status,
+    _In_ ULONG_PTR Information
+    )
+{
+    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Context;
 
-        Status =
-            WskSendToAwait(
-                SendContext->WskClientSendContext,
-                WSKCLIENT_INFINITE,
-                WSKCLIENT_UNKNOWN_BYTES,
-                &BytesSent);
-        if (!NT_SUCCESS(Status)) {
-            TraceError(
-                "[data][%p] ERROR, %u, %s.",
-                Binding,
-                Status,
-                "WskSendToAwait");
-        }
+    UNREFERENCED_PARAMETER(Information);
 
-        ExFreePoolWithTag(SendContext, POOLTAG_FNSOCK_SEND);
-    }
+    NT_ASSERT(Binding != NULL);
 
-    Status =
-        WskCloseSocketSync(
-            Binding->Socket);
     if (!NT_SUCCESS(Status)) {
         TraceError(
             "[data][%p] ERROR, %u, %s.",
             Binding,
             Status,
-            "WskCloseSocketSync");
+            "Fire and forget send");
     }
 
-    while (!IsListEmpty(&Binding->RecvDataList)) {
-        LIST_ENTRY* Entry;
-        FNSOCK_SOCKET_RECV_DATA* RecvData;
+    FinishSend(Binding);
+}
 
-        Entry = RemoveHeadList(&Binding->RecvDataList);
-        RecvData = CONTAINING_RECORD(Entry, FNSOCK_SOCKET_RECV_DATA, Link);
-        ExFreePoolWithTag(RecvData, POOLTAG_FNSOCK_RECV);
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+SignalRecvReadyLocked(
+    _In_ FNSOCK_SOCKET_BINDING* Binding
+    )
+{
+    //
+    // The caller holds RecvDataLock.
+    //
+    if (!IsListEmpty(&Binding->AsyncRecvList) &&
+        (!IsListEmpty(&Binding->RecvDataList) || Binding->RecvShutdown)) {
+        QueueReadyBinding(Binding);
     }
+}
 
-    while (!IsListEmpty(&Binding->AcceptList)) {
-        LIST_ENTRY* Entry;
-        FNSOCK_SOCKET_ACCEPT_CONTEXT* AcceptContext;
-
-        Entry = RemoveHeadList(&Binding->AcceptList);
-        AcceptContext = CONTAINING_RECORD(Entry, FNSOCK_SOCKET_ACCEPT_CONTEXT, Link);
-        Status =
-            WskCloseSocketSync(
-                AcceptContext->AcceptedSocket->Socket);
-        if (!NT_SUCCESS(Status)) {
-            TraceError(
-                "[data][%p] ERROR, %u, %s.",
-                Binding,
-                Status,
-                "WskCloseSocketSync(accepted)");
-        }
-        ExFreePoolWithTag(AcceptContext->AcceptedSocket, POOLTAG_FNSOCK_SOCKET);
-        ExFreePoolWithTag(AcceptContext, POOLTAG_FNSOCK_ACCEPT);
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+SignalAcceptReadyLocked(
+    _In_ FNSOCK_SOCKET_BINDING* Binding
+    )
+{
+    //
+    // The caller holds AcceptLock.
+    //
+    if (!IsListEmpty(&Binding->AsyncAcceptList) && !IsListEmpty(&Binding->AcceptList)) {
+        QueueReadyBinding(Binding);
     }
-
-    ExFreePoolWithTag(Binding, POOLTAG_FNSOCK_SOCKET);
 }
 
-FNSOCKAPI
+static
 _IRQL_requires_max_(PASSIVE_LEVEL)
-FNSOCK_STATUS
-FnSockBind(
-    _In_ FNSOCK_HANDLE Socket,
-    _In_reads_bytes_(AddressLength) const struct sockaddr* Address,
-    _In_ INT AddressLength
+VOID
+CancelAsyncOperations(
+    _In_ FNSOCK_SOCKET_BINDING* Binding
     )
 {
-    NTSTATUS Status;
-    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
+    FNSOCK_COMPLETION_QUEUE_OBJECT* QueueObject = Binding->CompletionQueue;
+    LIST_ENTRY CancelList;
+    KIRQL PrevIrql;
 
-    UNREFERENCED_PARAMETER(AddressLength);
+    InitializeListHead(&CancelList);
 
-    Status =
-        WskBindSync(
-            Binding->Socket,
-            Binding->SockType,
-            (PSOCKADDR)Address
-            );
-    if (!NT_SUCCESS(Status)) {
-        TraceError(
-            "[data][%p] ERROR, %u, %s.",
-            Binding,
-            Status,
-            "WskBindSync");
-        goto Exit;
+    ExAcquireFastMutex(&QueueObject->ProcessLock);
+
+    KeAcquireSpinLock(&Binding->RecvDataLock, &PrevIrql);
+    while (!IsListEmpty(&Binding->AsyncRecvList)) {
+        InsertTailList(&CancelList, RemoveHeadList(&Binding->AsyncRecvList));
     }
+    KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
 
-    if (Binding->SockType == WSK_FLAG_DATAGRAM_SOCKET) {
-        Status =
-            WskEnableCallbacks(
-                Binding->Socket,
-                Binding->SockType,
-                WSK_EVENT_RECEIVE_FROM);
-        if (!NT_SUCCESS(Status)) {
-            TraceError(
-                "[data][%p] ERROR, %u, %s.",
-                Binding,
-                Status,
-                "WskEnableCallbacks");
-            goto Exit;
-        }
+    KeAcquireSpinLock(&Binding->AcceptLock, &PrevIrql);
+    while (!IsListEmpty(&Binding->AsyncAcceptList)) {
+        InsertTailList(&CancelList, RemoveHeadList(&Binding->AsyncAcceptList));
     }
+    KeReleaseSpinLock(&Binding->AcceptLock, PrevIrql);
 
-    Binding->IsBound = TRUE;
-
-Exit:
+    //
+    // Pending operations complete with an error, like user mode operations
+    // that are aborted by closing their socket. Outstanding sends complete
+    // once WSK completes their IRPs.
+    //
+    KeAcquireSpinLock(&QueueObject->Lock, &PrevIrql);
+    if (Binding->IsReadyQueued) {
+        RemoveEntryList(&Binding->ReadyLink);
+        Binding->IsReadyQueued = FALSE;
+    }
+    while (!IsListEmpty(&CancelList)) {
+        FNSOCK_ASYNC_OPERATION* Operation =
+            CONTAINING_RECORD(RemoveHeadList(&CancelList), FNSOCK_ASYNC_OPERATION, Link);
 
-    if (!NT_SUCCESS(Status)) {
-        FnSockSocketLastError = Status;
+        Operation->Status = STATUS_CANCELLED;
+        InsertTailList(&QueueObject->CompletedList, &Operation->Link);
+        KeSetEvent(&QueueObject->ReadyEvent, EVENT_INCREMENT, FALSE);
     }
+    KeReleaseSpinLock(&QueueObject->Lock, PrevIrql);
 
-    return Status;
+    ExReleaseFastMutex(&QueueObject->ProcessLock);
 }
 
-FNSOCKAPI
+static
 _IRQL_requires_max_(PASSIVE_LEVEL)
-FNSOCK_STATUS
-FnSockGetSockName(
-    _In_ FNSOCK_HANDLE Socket,
-    _Out_writes_bytes_(*AddressLength) struct sockaddr* Address,
-    _Inout_ INT* AddressLength
+VOID
+CancelCompletedConnects(
+    _In_ FNSOCK_SOCKET_BINDING* Binding
     )
 {
-    NTSTATUS Status;
-    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
+    FNSOCK_COMPLETION_QUEUE_OBJECT* QueueObject = Binding->CompletionQueue;
+    LIST_ENTRY* Entry;
+    KIRQL PrevIrql;
 
-    UNREFERENCED_PARAMETER(AddressLength);
+    //
+    // Closing the WSK socket completes its outstanding connect, but the
+    // binding must not be used to finish it once closed.
+    //
+    ExAcquireFastMutex(&QueueObject->ProcessLock);
 
-    Status =
-        WskGetLocalAddrSync(
-            Binding->Socket,
-            Binding->SockType,
-            Address);
-    if (!NT_SUCCESS(Status)) {
-        TraceError(
-            "[data][%p] ERROR, %u, %s.",
-            Binding,
-            Status,
-            "WskGetLocalAddrSync");
-        goto Exit;
-    }
+    KeAcquireSpinLock(&QueueObject->Lock, &PrevIrql);
+    Entry = QueueObject->ConnectList.Flink;
+    while (Entry != &QueueObject->ConnectList) {
+        FNSOCK_ASYNC_OPERATION* Operation =
+            CONTAINING_RECORD(Entry, FNSOCK_ASYNC_OPERATION, Link);
 
-Exit:
+        Entry = Entry->Flink;
 
-    if (!NT_SUCCESS(Status)) {
-        FnSockSocketLastError = Status;
+        if (Operation->Binding == Binding) {
+            RemoveEntryList(&Operation->Link);
+            Operation->Status = STATUS_CANCELLED;
+            InsertTailList(&QueueObject->CompletedList, &Operation->Link);
+            KeSetEvent(&QueueObject->ReadyEvent, EVENT_INCREMENT, FALSE);
+        }
     }
+    KeReleaseSpinLock(&QueueObject->Lock, PrevIrql);
 
-    return Status;
+    ExReleaseFastMutex(&QueueObject->ProcessLock);
 }
 
-FNSOCKAPI
-_IRQL_requires_max_(PASSIVE_LEVEL)
-FNSOCK_STATUS
-FnSockSetSockOpt(
-    _In_ FNSOCK_HANDLE Socket,
-    _In_ ULONG Level,
-    _In_ ULONG OptionName,
-    _In_reads_bytes_opt_(OptionLength) VOID* OptionValue,
-    _In_ SIZE_T OptionLength
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+CopyFromWskBuf(
+    _Out_writes_bytes_(Length) UCHAR* Destination,
+    _In_ const WSK_BUF* Buffer,
+    _In_ SIZE_T Length
     )
 {
-    NTSTATUS Status;
-    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
+    PMDL Mdl = Buffer->Mdl;
+    ULONG MdlOffset = Buffer->Offset;
+    SIZE_T CopiedLength = 0;
 
-    if (Level == SOL_SOCKET && OptionName == SO_RCVTIMEO) {
-        if (OptionLength < sizeof(UINT32) ||
-            OptionValue == NULL ||
-            *(UINT32*)OptionValue == MAXUINT32) {
-            TraceError(
-                "[data] ERROR, %s.",
-                "SO_RCVTIMEO invalid parameter");
-            Status = STATUS_INVALID_PARAMETER;
-            goto Exit;
+    while (CopiedLength < Length && Mdl != NULL) {
+        UCHAR* Va;
+        SIZE_T CopySize;
+
+        Va = MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority | MdlMappingNoExecute);
+        if (Va == NULL) {
+            return FALSE;
         }
-        Binding->ReceiveTimeout = *(UINT32*)OptionValue;
-        Status = STATUS_SUCCESS;
-        goto Exit;
+
+        CopySize = min(MmGetMdlByteCount(Mdl) - MdlOffset, Length - CopiedLength);
+        RtlCopyMemory(Destination + CopiedLength, Va + MdlOffset, CopySize);
+        CopiedLength += CopySize;
+
+        Mdl = Mdl->Next;
+        MdlOffset = 0;
     }
 
+    return CopiedLength == Length;
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+ReleaseIndications(
+    _In_ FNSOCK_SOCKET_BINDING* Binding,
+    _In_ PWSK_DATAGRAM_INDICATION DataIndication
+    )
+{
+    NTSTATUS Status;
+
     Status =
-        WskControlSocketSync(
-            Binding->Socket,
-            Binding->SockType,
-            WskSetOption,
-            OptionName,
-            Level,
-            OptionLength,
-            OptionValue,
-            0,
-            NULL,
-            NULL);
+        ((PWSK_DATAGRAM_SOCKET)Binding->Socket)->Dispatch->WskRelease(
+            Binding->Socket, DataIndication);
     if (!NT_SUCCESS(Status)) {
         TraceError(
             "[data][%p] ERROR, %u, %s.",
             Binding,
             Status,
-            "WskControlSocketSync");
-        goto Exit;
+            "WskRelease");
     }
+}
 
-Exit:
+static
+ULONG
+GetRecvDataLength(
+    _In_ const FNSOCK_SOCKET_RECV_DATA* RecvData
+    )
+{
+    if (RecvData->Indication != NULL) {
+        return (ULONG)RecvData->Indication->Buffer.Length;
+    }
 
-    if (!NT_SUCCESS(Status)) {
-        FnSockSocketLastError = Status;
+    return RecvData->DataLength;
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+FreeRecvData(
+    _In_ FNSOCK_SOCKET_BINDING* Binding,
+    _In_ FNSOCK_SOCKET_RECV_DATA* RecvData
+    )
+{
+    if (RecvData->Indication != NULL) {
+        KIRQL PrevIrql;
+
+        ReleaseIndications(Binding, RecvData->Indication);
+
+        KeAcquireSpinLock(&Binding->RecvDataLock, &PrevIrql);
+        Binding->RetainedIndicationCount--;
+        KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
     }
 
-    return Status;
+    ExFreePoolWithTag(RecvData, POOLTAG_FNSOCK_RECV);
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+FlushRecvData(
+    _In_ FNSOCK_SOCKET_BINDING* Binding
+    )
+{
+    for (;;) {
+        LIST_ENTRY* Entry;
+        KIRQL PrevIrql;
+
+        KeAcquireSpinLock(&Binding->RecvDataLock, &PrevIrql);
+
+        if (IsListEmpty(&Binding->RecvDataList)) {
+            KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
+            break;
+        }
+
+        Entry = RemoveHeadList(&Binding->RecvDataList);
+
+        KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
+
+        FreeRecvData(Binding, CONTAINING_RECORD(Entry, FNSOCK_SOCKET_RECV_DATA, Link));
+    }
 }
 
 FNSOCKAPI
 _IRQL_requires_max_(PASSIVE_LEVEL)
 FNSOCK_STATUS
-FnSockGetSockOpt(
-    _In_ FNSOCK_HANDLE Socket,
-    _In_ ULONG Level,
-    _In_ ULONG OptionName,
-    _Out_writes_bytes_(*OptionLength) VOID* OptionValue,
-    _Inout_ SIZE_T* OptionLength
+FnSockCreate(
+    _In_ INT AddressFamily,
+    _In_ INT SocketType,
+    _In_ INT Protocol,
+    _Out_ FNSOCK_HANDLE* Socket
     )
 {
     NTSTATUS Status;
-    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
-    SIZE_T OutputSizeReturned;
+    FNSOCK_SOCKET_BINDING* Binding = NULL;
+    INT WskSockType;
+    VOID* Dispatch = NULL;
 
-    if (Level == SOL_SOCKET && OptionName == SO_RCVTIMEO) {
-        if (*OptionLength < sizeof(UINT32) ||
-            OptionValue == NULL) {
-            TraceError(
-                "[data] ERROR, %s.",
-                "SO_RCVTIMEO invalid parameter");
-            Status = STATUS_INVALID_PARAMETER;
-            goto Exit;
-        }
-        *(UINT32*)OptionValue = Binding->ReceiveTimeout;
-        *OptionLength = sizeof(UINT32);
-        Status = STATUS_SUCCESS;
+    *Socket = NULL;
+
+    Binding =
+#pragma warning( suppress : 4996 )
+        (FNSOCK_SOCKET_BINDING*)ExAllocatePoolWithTag(
+            NonPagedPoolNx, sizeof(*Binding), POOLTAG_FNSOCK_SOCKET);
+    if (Binding == NULL) {
+        TraceError(
+            "[data] ERROR, %s.",
+            "Could not allocate memory for socket");
+        Status = STATUS_UNSUCCESSFUL;
         goto Exit;
     }
+    RtlZeroMemory(Binding, sizeof(*Binding));
+
+    switch (SocketType) {
+    case SOCK_DGRAM:
+    case SOCK_RAW:
+        WskSockType = WSK_FLAG_DATAGRAM_SOCKET;
+        Dispatch = &WskDatagramDispatch;
+        break;
+    case SOCK_STREAM:
+        WskSockType = WSK_FLAG_STREAM_SOCKET;
+        Dispatch = &WskStreamDispatch;
+        break;
+    default:
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    InitializeBinding(Binding, (ADDRESS_FAMILY)AddressFamily, WskSockType);
 
     Status =
-        WskControlSocketSync(
-            Binding->Socket,
-            Binding->SockType,
-            WskGetOption,
-            OptionName,
-            Level,
-            0,
-            NULL,
-            *OptionLength,
-            OptionValue,
-            &OutputSizeReturned);
+        WskSocketSync(
+            WskSockType,
+            (ADDRESS_FAMILY)AddressFamily,
+            (USHORT)SocketType,
+            Protocol,
+            &Binding->Socket,
+            Binding,
+            Dispatch
+            );
     if (!NT_SUCCESS(Status)) {
         TraceError(
             "[data][%p] ERROR, %u, %s.",
             Binding,
             Status,
-            "WskControlSocketSync");
+            "WskSocketSync");
         goto Exit;
     }
 
-    *OptionLength = OutputSizeReturned;
+    *Socket = (FNSOCK_HANDLE)Binding;
 
 Exit:
 
     if (!NT_SUCCESS(Status)) {
         FnSockSocketLastError = Status;
+
+        if (Binding != NULL) {
+            ExFreePoolWithTag(Binding, POOLTAG_FNSOCK_SOCKET);
+        }
     }
 
     return Status;
@@ -587,93 +807,131 @@ Exit:
 
 FNSOCKAPI
 _IRQL_requires_max_(PASSIVE_LEVEL)
-FNSOCK_STATUS
-FnSockIoctl(
-    _In_ FNSOCK_HANDLE Socket,
-    _In_ ULONG ControlCode,
-    _In_reads_bytes_opt_(InputLength) VOID* Input,
-    _In_ ULONG InputLength,
-    _Out_writes_bytes_opt_(OutputLength) VOID* Output,
-    _In_ ULONG OutputLength,
-    _Out_ ULONG* BytesReturned
+VOID
+FnSockClose(
+    _In_ FNSOCK_HANDLE Socket
     )
 {
     NTSTATUS Status;
     FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
-    SIZE_T OutputSizeReturned = 0;
+    KIRQL PrevIrql;
 
-    Status =
-        WskControlSocketSync(
-            Binding->Socket,
-            Binding->SockType,
-            WskIoctl,
-            ControlCode,
-            0,
-            InputLength,
-            Input,
-            OutputLength,
-            Output,
-            &OutputSizeReturned);
+    if (Binding->CompletionQueue != NULL) {
+        CancelAsyncOperations(Binding);
+    }
+
+    WaitForSendWindow(Binding, 0, FALSE);
+
+    //
+    // Retained indications must be released back to WSK before the socket is
+    // closed, so stop retaining new indications and release the queued ones.
+    //
+    KeAcquireSpinLock(&Binding->RecvDataLock, &PrevIrql);
+    Binding->RetainIndications = FALSE;
+    KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
+
+    FlushRecvData(Binding);
+    NT_ASSERT(Binding->RetainedIndicationCount == 0);
+
+    //
+    // The pipeline cancels its posted receives and stops reposting them, so
+    // it must be destroyed before the socket it receives on is closed.
+    //
+    if (Binding->RecvPipeline != NULL) {
+        WskReceivePipelineDestroy(Binding->RecvPipeline);
+        ExFreePoolWithTag(Binding->RecvPipelineBuffers, POOLTAG_FNSOCK_RECV);
+    }
+
+    Status =
+        WskCloseSocketSync(
+            Binding->Socket);
     if (!NT_SUCCESS(Status)) {
         TraceError(
             "[data][%p] ERROR, %u, %s.",
             Binding,
             Status,
-            "WskControlSocketSync");
-        goto Exit;
+            "WskCloseSocketSync");
     }
 
-Exit:
+    if (Binding->CompletionQueue != NULL) {
+        CancelCompletedConnects(Binding);
+    }
 
-    *BytesReturned = (ULONG)OutputSizeReturned;
+    FlushRecvData(Binding);
 
-    if (!NT_SUCCESS(Status)) {
-        FnSockSocketLastError = Status;
+    while (!IsListEmpty(&Binding->AcceptList)) {
+        LIST_ENTRY* Entry;
+        FNSOCK_SOCKET_ACCEPT_CONTEXT* AcceptContext;
+
+        Entry = RemoveHeadList(&Binding->AcceptList);
+        AcceptContext = CONTAINING_RECORD(Entry, FNSOCK_SOCKET_ACCEPT_CONTEXT, Link);
+        Status =
+            WskCloseSocketSync(
+                AcceptContext->AcceptedSocket->Socket);
+        if (!NT_SUCCESS(Status)) {
+            TraceError(
+                "[data][%p] ERROR, %u, %s.",
+                Binding,
+                Status,
+                "WskCloseSocketSync(accepted)");
+        }
+        ExFreePoolWithTag(AcceptContext->AcceptedSocket, POOLTAG_FNSOCK_SOCKET);
+        ExFreePoolWithTag(AcceptContext, POOLTAG_FNSOCK_ACCEPT);
     }
 
-    return Status;
+    ExFreePoolWithTag(Binding, POOLTAG_FNSOCK_SOCKET);
 }
 
 FNSOCKAPI
 _IRQL_requires_max_(PASSIVE_LEVEL)
 FNSOCK_STATUS
-FnSockListen(
+FnSockBind(
     _In_ FNSOCK_HANDLE Socket,
-    _In_ ULONG Backlog
+    _In_reads_bytes_(AddressLength) const struct sockaddr* Address,
+    _In_ INT AddressLength
     )
 {
     NTSTATUS Status;
     FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
 
-    UNREFERENCED_PARAMETER(Backlog);
-
-    Status =
-        WskListenSync(
-            Binding->Socket,
-            Binding->SockType);
+    Status = ValidateAddress(Binding, Address, AddressLength);
     if (!NT_SUCCESS(Status)) {
-        TraceError(
-            "[data][%p] ERROR, %u, %s.",
-            Binding,
-            Status,
-            "WskListenSync");
         goto Exit;
     }
 
     Status =
-        WskEnableCallbacks(
+        WskBindSync(
             Binding->Socket,
             Binding->SockType,
-            WSK_EVENT_ACCEPT);
+            (PSOCKADDR)Address
+            );
     if (!NT_SUCCESS(Status)) {
         TraceError(
             "[data][%p] ERROR, %u, %s.",
             Binding,
             Status,
-            "WskEnableCallbacks");
+            "WskBindSync");
         goto Exit;
     }
 
+    if (Binding->SockType == WSK_FLAG_DATAGRAM_SOCKET) {
+        Status =
+            WskEnableCallbacks(
+                Binding->Socket,
+                Binding->SockType,
+                WSK_EVENT_RECEIVE_FROM);
+        if (!NT_SUCCESS(Status)) {
+            TraceError(
+                "[data][%p] ERROR, %u, %s.",
+                Binding,
+                Status,
+                "WskEnableCallbacks");
+            goto Exit;
+        }
+    }
+
+    Binding->IsBound = TRUE;
+
 Exit:
 
     if (!NT_SUCCESS(Status)) {
@@ -685,8 +943,8 @@ Exit:
 
 FNSOCKAPI
 _IRQL_requires_max_(PASSIVE_LEVEL)
-FNSOCK_HANDLE
-FnSockAccept(
+FNSOCK_STATUS
+FnSockGetSockName(
     _In_ FNSOCK_HANDLE Socket,
     _Out_writes_bytes_(*AddressLength) struct sockaddr* Address,
     _Inout_ INT* AddressLength
@@ -694,151 +952,102 @@ FnSockAccept(
 {
     NTSTATUS Status;
     FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
-    FNSOCK_SOCKET_BINDING* NewBinding = NULL;
-    LIST_ENTRY* Entry;
-    FNSOCK_SOCKET_ACCEPT_CONTEXT* AcceptContext = NULL;
-    KIRQL PrevIrql;
 
-    UNREFERENCED_PARAMETER(Address);
     UNREFERENCED_PARAMETER(AddressLength);
 
-    KeAcquireSpinLock(&Binding->AcceptLock, &PrevIrql);
-
-    if (IsListEmpty(&Binding->AcceptList)) {
-        LARGE_INTEGER Timeout;
-        LARGE_INTEGER* TimeoutPtr;
-
-        KeReleaseSpinLock(&Binding->AcceptLock, PrevIrql);
-
-        if (Binding->ReceiveTimeout == WSKCLIENT_INFINITE) {
-            TimeoutPtr = NULL;
-        } else {
-            Timeout.QuadPart = UInt32x32To64(Binding->ReceiveTimeout, 10000);
-            Timeout.QuadPart = -Timeout.QuadPart;
-            TimeoutPtr = &Timeout;
-        }
-
-        Status = KeWaitForSingleObject(&Binding->AcceptEvent, Executive, KernelMode, FALSE, TimeoutPtr);
-        if (!NT_SUCCESS(Status)) {
-            TraceError(
-                "[data][%p] ERROR, %u, %s.",
-                Binding,
-                Status,
-                "KeWaitForSingleObject");
-            goto Exit;
-        }
-
-        KeAcquireSpinLock(&Binding->AcceptLock, &PrevIrql);
-
-        if (IsListEmpty(&Binding->AcceptList)) {
-            KeReleaseSpinLock(&Binding->AcceptLock, PrevIrql);
-            Status = STATUS_UNSUCCESSFUL;
-            goto Exit;
-        }
-    }
-
-    Entry = RemoveHeadList(&Binding->AcceptList);
-
-    KeReleaseSpinLock(&Binding->AcceptLock, PrevIrql);
-
-    AcceptContext = CONTAINING_RECORD(Entry, FNSOCK_SOCKET_ACCEPT_CONTEXT, Link);
-
-    NewBinding = AcceptContext->AcceptedSocket;
-
     Status =
-        WskEnableCallbacks(
-            NewBinding->Socket,
-            NewBinding->SockType,
-            WSK_EVENT_RECEIVE);
+        WskGetLocalAddrSync(
+            Binding->Socket,
+            Binding->SockType,
+            Address);
     if (!NT_SUCCESS(Status)) {
         TraceError(
             "[data][%p] ERROR, %u, %s.",
-            NewBinding,
+            Binding,
             Status,
-            "WskEnableCallbacks");
+            "WskGetLocalAddrSync");
         goto Exit;
     }
 
-    Status = STATUS_SUCCESS;
-
 Exit:
 
-    if (AcceptContext != NULL) {
-        ExFreePoolWithTag(AcceptContext, POOLTAG_FNSOCK_ACCEPT);
-    }
-
     if (!NT_SUCCESS(Status)) {
         FnSockSocketLastError = Status;
-
-        if (NewBinding != NULL) {
-            FnSockClose((FNSOCK_HANDLE)NewBinding);
-            NewBinding = NULL;
-        }
     }
 
-    return (FNSOCK_HANDLE)NewBinding;
+    return Status;
 }
 
 FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
 FNSOCK_STATUS
-FnSockConnect(
+FnSockSetSockOpt(
     _In_ FNSOCK_HANDLE Socket,
-    _In_reads_bytes_(AddressLength) struct sockaddr* Address,
-    _In_ INT AddressLength
+    _In_ ULONG Level,
+    _In_ ULONG OptionName,
+    _In_reads_bytes_opt_(OptionLength) VOID* OptionValue,
+    _In_ SIZE_T OptionLength
     )
 {
     NTSTATUS Status;
     FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
 
-    UNREFERENCED_PARAMETER(AddressLength);
+    if (Level == SOL_SOCKET && OptionName == SO_RCVTIMEO) {
+        if (OptionLength < sizeof(UINT32) ||
+            OptionValue == NULL ||
+            *(UINT32*)OptionValue == MAXUINT32) {
+            TraceError(
+                "[data] ERROR, %s.",
+                "SO_RCVTIMEO invalid parameter");
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+        Binding->ReceiveTimeout = *(UINT32*)OptionValue;
+        Status = STATUS_SUCCESS;
+        goto Exit;
+    }
 
     //
-    // Bind to wildcard address if not bound already.
+    // Datagrams are buffered by FnSock rather than WSK, so emulate the
+    // receive buffer limit here. Stream sockets leave it to the WSK provider.
     //
-    if (!Binding->IsBound) {
-        SOCKADDR_INET WildcardAddress = {0};
-        WildcardAddress.si_family = Binding->AddressFamily;
-
-        Status =
-            FnSockBind(
-                Socket,
-                (struct sockaddr*)&WildcardAddress,
-                sizeof(WildcardAddress));
-        if (!NT_SUCCESS(Status)) {
+    if (Level == SOL_SOCKET && OptionName == SO_RCVBUF &&
+        Binding->SockType == WSK_FLAG_DATAGRAM_SOCKET) {
+        if (OptionLength < sizeof(INT) ||
+            OptionValue == NULL ||
+            *(INT*)OptionValue < 0) {
+            TraceError(
+                "[data] ERROR, %s.",
+                "SO_RCVBUF invalid parameter");
+            Status = STATUS_INVALID_PARAMETER;
             goto Exit;
         }
+        WriteULongNoFence(&Binding->ReceiveBufferSize, *(ULONG*)OptionValue);
+        Status = STATUS_SUCCESS;
+        goto Exit;
     }
 
     Status =
-        WskConnectSync(
+        WskControlSocketSync(
             Binding->Socket,
             Binding->SockType,
-            Address);
+            WskSetOption,
+            OptionName,
+            Level,
+            OptionLength,
+            OptionValue,
+            0,
+            NULL,
+            NULL);
     if (!NT_SUCCESS(Status)) {
         TraceError(
             "[data][%p] ERROR, %u, %s.",
             Binding,
             Status,
-            "WskConnectSync");
+            "WskControlSocketSync");
         goto Exit;
     }
 
-    if (Binding->SockType == WSK_FLAG_STREAM_SOCKET) {
-        Status =
-            WskEnableCallbacks(
-                Binding->Socket,
-                Binding->SockType,
-                WSK_EVENT_RECEIVE);
-        if (!NT_SUCCESS(Status)) {
-            TraceError(
-                "[data][%p] ERROR, %u, %s.",
-                Binding,
-                Status,
-                "WskEnableCallbacks");
-            goto Exit;
-        }
-    }
-
 Exit:
 
     if (!NT_SUCCESS(Status)) {
@@ -850,234 +1059,280 @@ Exit:
 
 FNSOCKAPI
 _IRQL_requires_max_(PASSIVE_LEVEL)
-INT
-FnSockSend(
+FNSOCK_STATUS
+FnSockGetSockOpt(
     _In_ FNSOCK_HANDLE Socket,
-    _In_reads_bytes_(BufferLength) const CHAR* Buffer,
-    _In_ INT BufferLength,
-    _In_ BOOLEAN BufferIsNonPagedPool,
-    _In_ INT Flags
+    _In_ ULONG Level,
+    _In_ ULONG OptionName,
+    _Out_writes_bytes_(*OptionLength) VOID* OptionValue,
+    _Inout_ SIZE_T* OptionLength
     )
 {
     NTSTATUS Status;
     FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
-    FNSOCK_SOCKET_SEND_CONTEXT* SendContext;
-    INT BytesSent = 0;
-    KIRQL PrevIrql;
-
-    UNREFERENCED_PARAMETER(Flags);
-
-    SendContext =
-#pragma warning( suppress : 4996 )
-        (FNSOCK_SOCKET_SEND_CONTEXT*)ExAllocatePoolWithTag(
-            NonPagedPoolNx, sizeof(*SendContext), POOLTAG_FNSOCK_SEND);
-    if (SendContext == NULL) {
-        TraceError(
-            "[data] ERROR, %s.",
-            "Could not allocate memory for socket send");
-        Status = STATUS_NO_MEMORY;
-        goto Exit;
-    }
-    RtlZeroMemory(SendContext, sizeof(*SendContext));
+    SIZE_T OutputSizeReturned;
+
+    if (Level == SOL_SOCKET && OptionName == SO_RCVTIMEO) {
+        if (*OptionLength < sizeof(UINT32) ||
+            OptionValue == NULL) {
+            TraceError(
+                "[data] ERROR, %s.",
+                "SO_RCVTIMEO invalid parameter");
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+        *(UINT32*)OptionValue = Binding->ReceiveTimeout;
+        *OptionLength = sizeof(UINT32);
+        Status = STATUS_SUCCESS;
+        goto Exit;
+    }
+
+    if (Level == SOL_SOCKET && OptionName == SO_RCVBUF &&
+        Binding->SockType == WSK_FLAG_DATAGRAM_SOCKET) {
+        if (*OptionLength < sizeof(INT) ||
+            OptionValue == NULL) {
+            TraceError(
+                "[data] ERROR, %s.",
+                "SO_RCVBUF invalid parameter");
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+        *(INT*)OptionValue = (INT)ReadULongNoFence(&Binding->ReceiveBufferSize);
+        *OptionLength = sizeof(INT);
+        Status = STATUS_SUCCESS;
+        goto Exit;
+    }
+
+    if (Level == FNSOCK_SOL_FNSOCK && OptionName == FNSOCK_SO_RECV_STATISTICS) {
+        FNSOCK_RECV_STATISTICS* Statistics = (FNSOCK_RECV_STATISTICS*)OptionValue;
+
+        if (*OptionLength < sizeof(*Statistics) ||
+            OptionValue == NULL) {
+            TraceError(
+                "[data] ERROR, %s.",
+                "FNSOCK_SO_RECV_STATISTICS invalid parameter");
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+        RtlZeroMemory(Statistics, sizeof(*Statistics));
+        Statistics->QueuedBytes = ReadULongNoFence(&Binding->RecvDataBytes);
+        Statistics->DroppedPackets = ReadULong64NoFence(&Binding->RecvDroppedPackets);
+        Statistics->DroppedBytes = ReadULong64NoFence(&Binding->RecvDroppedBytes);
+        Statistics->RetainedPackets =
+            ReadULongNoFence((ULONG*)&Binding->RetainedIndicationCount);
+        *OptionLength = sizeof(*Statistics);
+        Status = STATUS_SUCCESS;
+        goto Exit;
+    }
+
+    if (Level == FNSOCK_SOL_FNSOCK && OptionName == FNSOCK_SO_SEND_STATISTICS) {
+        FNSOCK_SEND_STATISTICS* Statistics = (FNSOCK_SEND_STATISTICS*)OptionValue;
+        KIRQL PrevIrql;
+
+        if (*OptionLength < sizeof(*Statistics) ||
+            OptionValue == NULL) {
+            TraceError(
+                "[data] ERROR, %s.",
+                "FNSOCK_SO_SEND_STATISTICS invalid parameter");
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+        RtlZeroMemory(Statistics, sizeof(*Statistics));
+        KeAcquireSpinLock(&Binding->SendLock, &PrevIrql);
+        Statistics->OutstandingSends = Binding->OutstandingSendCount;
+        Statistics->PeakOutstandingSends = Binding->PeakOutstandingSendCount;
+        KeReleaseSpinLock(&Binding->SendLock, PrevIrql);
+        Statistics->MaxOutstandingSends = FNSOCK_MAX_OUTSTANDING_SENDS;
+        *OptionLength = sizeof(*Statistics);
+        Status = STATUS_SUCCESS;
+        goto Exit;
+    }
 
-    //
-    // To emulate the fire and forget behavior of user mode WinSock with WSK,
-    // allocate a send context, initiate a send and clean up the send context
-    // later when the socket is closed. Accumulating send contexts throughout
-    // the lifetime of the socket is not ideal and this emulation can be
-    // improved upon if needed.
-    //
     Status =
-        WskSendAsync(
+        WskControlSocketSync(
             Binding->Socket,
             Binding->SockType,
-            (char *)Buffer,
-            BufferLength,
-            BufferIsNonPagedPool,
+            WskGetOption,
+            OptionName,
+            Level,
             0,
-            &SendContext->WskClientSendContext);
+            NULL,
+            *OptionLength,
+            OptionValue,
+            &OutputSizeReturned);
     if (!NT_SUCCESS(Status)) {
         TraceError(
             "[data][%p] ERROR, %u, %s.",
             Binding,
             Status,
-            "WskSendSync");
+            "WskControlSocketSync");
         goto Exit;
     }
 
-    KeAcquireSpinLock(&Binding->SendContextLock, &PrevIrql);
-    InsertTailList(&Binding->SendContextList, &SendContext->Link);
-    KeReleaseSpinLock(&Binding->SendContextLock, PrevIrql);
-
-    Status = STATUS_SUCCESS;
-    BytesSent = BufferLength;
+    *OptionLength = OutputSizeReturned;
 
 Exit:
 
     if (!NT_SUCCESS(Status)) {
         FnSockSocketLastError = Status;
-
-        BytesSent = -1;
-
-        if (SendContext != NULL) {
-            ExFreePoolWithTag(SendContext, POOLTAG_FNSOCK_SEND);
-        }
     }
 
-    return BytesSent;
+    return Status;
 }
 
 FNSOCKAPI
 _IRQL_requires_max_(PASSIVE_LEVEL)
-INT
-FnSockSendto(
+FNSOCK_STATUS
+FnSockIoctl(
     _In_ FNSOCK_HANDLE Socket,
-    _In_reads_bytes_(BufferLength) const CHAR* Buffer,
-    _In_ INT BufferLength,
-    _In_ BOOLEAN BufferIsNonPagedPool,
-    _In_ INT Flags,
-    _In_reads_bytes_(AddressLength) const struct sockaddr* Address,
-    _In_ INT AddressLength
+    _In_ ULONG ControlCode,
+    _In_reads_bytes_opt_(InputLength) VOID* Input,
+    _In_ ULONG InputLength,
+    _Out_writes_bytes_opt_(OutputLength) VOID* Output,
+    _In_ ULONG OutputLength,
+    _Out_ ULONG* BytesReturned
     )
 {
-    return
-        FnSockSendMsg(
-            Socket, Buffer, BufferLength, BufferIsNonPagedPool, Flags, Address, AddressLength,
-            NULL, 0);
+    NTSTATUS Status;
+    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
+    SIZE_T OutputSizeReturned = 0;
+
+    Status =
+        WskControlSocketSync(
+            Binding->Socket,
+            Binding->SockType,
+            WskIoctl,
+            ControlCode,
+            0,
+            InputLength,
+            Input,
+            OutputLength,
+            Output,
+            &OutputSizeReturned);
+    if (!NT_SUCCESS(Status)) {
+        TraceError(
+            "[data][%p] ERROR, %u, %s.",
+            Binding,
+            Status,
+            "WskControlSocketSync");
+        goto Exit;
+    }
+
+Exit:
+
+    *BytesReturned = (ULONG)OutputSizeReturned;
+
+    if (!NT_SUCCESS(Status)) {
+        FnSockSocketLastError = Status;
+    }
+
+    return Status;
 }
 
 FNSOCKAPI
 _IRQL_requires_max_(PASSIVE_LEVEL)
-INT
-FnSockSendMsg(
+FNSOCK_STATUS
+FnSockListen(
     _In_ FNSOCK_HANDLE Socket,
-    _In_reads_bytes_(BufferLength) const CHAR* Buffer,
-    _In_ INT BufferLength,
-    _In_ BOOLEAN BufferIsNonPagedPool,
-    _In_ INT Flags,
-    _In_reads_bytes_(AddressLength) const struct sockaddr* Address,
-    _In_ INT AddressLength,
-    _In_reads_bytes_(ControlBufferLength) const CMSGHDR* ControlBuffer,
-    _In_ INT ControlBufferLength
+    _In_ ULONG Backlog
     )
 {
     NTSTATUS Status;
     FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
-    FNSOCK_SOCKET_SEND_CONTEXT* SendContext;
-    INT BytesSent = 0;
-    KIRQL PrevIrql;
 
-    UNREFERENCED_PARAMETER(Flags);
-    UNREFERENCED_PARAMETER(AddressLength);
+    UNREFERENCED_PARAMETER(Backlog);
 
-    SendContext =
-#pragma warning( suppress : 4996 )
-        (FNSOCK_SOCKET_SEND_CONTEXT*)ExAllocatePoolWithTag(
-            NonPagedPoolNx, sizeof(*SendContext), POOLTAG_FNSOCK_SEND);
-    if (SendContext == NULL) {
+    Status =
+        WskListenSync(
+            Binding->Socket,
+            Binding->SockType);
+    if (!NT_SUCCESS(Status)) {
         TraceError(
-            "[data] ERROR, %s.",
-            "Could not allocate memory for socket send");
-        Status = STATUS_NO_MEMORY;
+            "[data][%p] ERROR, %u, %s.",
+            Binding,
+            Status,
+            "WskListenSync");
         goto Exit;
     }
-    RtlZeroMemory(SendContext, sizeof(*SendContext));
 
-    //
-    // To emulate the fire and forget behavior of user mode WinSock with WSK,
-    // allocate a send context, initiate a send and clean up the send context
-    // later when the socket is closed. Accumulating send contexts throughout
-    // the lifetime of the socket is not ideal and this emulation can be
-    // improved upon if needed.
-    //
     Status =
-        WskSendToAsync(
+        WskEnableCallbacks(
             Binding->Socket,
-            (char *)Buffer,
-            BufferLength,
-            BufferIsNonPagedPool,
-            (PSOCKADDR)Address,
-            ControlBufferLength,
-            ControlBuffer,
-            &SendContext->WskClientSendContext);
+            Binding->SockType,
+            WSK_EVENT_ACCEPT);
     if (!NT_SUCCESS(Status)) {
         TraceError(
             "[data][%p] ERROR, %u, %s.",
             Binding,
             Status,
-            "WskSendToSync");
+            "WskEnableCallbacks");
         goto Exit;
     }
 
-    KeAcquireSpinLock(&Binding->SendContextLock, &PrevIrql);
-    InsertTailList(&Binding->SendContextList, &SendContext->Link);
-    KeReleaseSpinLock(&Binding->SendContextLock, PrevIrql);
-
-    Status = STATUS_SUCCESS;
-    BytesSent = BufferLength;
+    Binding->IsListening = TRUE;
 
 Exit:
 
     if (!NT_SUCCESS(Status)) {
         FnSockSocketLastError = Status;
-
-        BytesSent = -1;
-
-        if (SendContext != NULL) {
-            ExFreePoolWithTag(SendContext, POOLTAG_FNSOCK_SEND);
-        }
     }
 
-    return BytesSent;
+    return Status;
 }
 
-FNSOCKAPI
+static
 _IRQL_requires_max_(PASSIVE_LEVEL)
-INT
-FnSockRecv(
-    _In_ FNSOCK_HANDLE Socket,
-    _Out_writes_bytes_to_(BufferLength, return) CHAR* Buffer,
-    _In_ INT BufferLength,
-    _In_ BOOLEAN BufferIsNonPagedPool,
-    _In_ INT Flags
+NTSTATUS
+CompleteAccept(
+    _In_ FNSOCK_SOCKET_ACCEPT_CONTEXT* AcceptContext,
+    _Out_ FNSOCK_SOCKET_BINDING** AcceptedBinding
     )
 {
-    INT ControlBufferLength = 0;
+    NTSTATUS Status;
+    FNSOCK_SOCKET_BINDING* NewBinding = AcceptContext->AcceptedSocket;
 
-    return
-        FnSockRecvMsg(
-            Socket, Buffer, BufferLength, BufferIsNonPagedPool, NULL, &ControlBufferLength, &Flags);
+    *AcceptedBinding = NULL;
+
+    ExFreePoolWithTag(AcceptContext, POOLTAG_FNSOCK_ACCEPT);
+
+    Status = StartStreamReceives(NewBinding);
+    if (!NT_SUCCESS(Status)) {
+        FnSockClose((FNSOCK_HANDLE)NewBinding);
+        goto Exit;
+    }
+
+    *AcceptedBinding = NewBinding;
+
+Exit:
+
+    return Status;
 }
 
 FNSOCKAPI
 _IRQL_requires_max_(PASSIVE_LEVEL)
-INT
-FnSockRecvMsg(
+FNSOCK_HANDLE
+FnSockAccept(
     _In_ FNSOCK_HANDLE Socket,
-    _Out_writes_bytes_to_(BufferLength, return) CHAR* Buffer,
-    _In_ INT BufferLength,
-    _In_ BOOLEAN BufferIsNonPagedPool,
-    _Out_writes_bytes_to_(*ControlBufferLength, *ControlBufferLength) CMSGHDR *ControlBuffer,
-    _Inout_ INT *ControlBufferLength,
-    _In_ INT *Flags
+    _Out_writes_bytes_(*AddressLength) struct sockaddr* Address,
+    _Inout_ INT* AddressLength
     )
 {
+    NTSTATUS Status;
     FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
+    FNSOCK_SOCKET_BINDING* NewBinding = NULL;
     LIST_ENTRY* Entry;
-    FNSOCK_SOCKET_RECV_DATA* RecvData;
     KIRQL PrevIrql;
-    INT BytesReceived = 0;
-    NTSTATUS Status;
 
-    UNREFERENCED_PARAMETER(BufferIsNonPagedPool);
+    UNREFERENCED_PARAMETER(Address);
+    UNREFERENCED_PARAMETER(AddressLength);
 
-    KeAcquireSpinLock(&Binding->RecvDataLock, &PrevIrql);
+    KeAcquireSpinLock(&Binding->AcceptLock, &PrevIrql);
 
-    if (IsListEmpty(&Binding->RecvDataList)) {
+    if (IsListEmpty(&Binding->AcceptList)) {
         LARGE_INTEGER Timeout;
         LARGE_INTEGER* TimeoutPtr;
 
-        KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
+        KeReleaseSpinLock(&Binding->AcceptLock, PrevIrql);
 
         if (Binding->ReceiveTimeout == WSKCLIENT_INFINITE) {
             TimeoutPtr = NULL;
@@ -1087,7 +1342,7 @@ FnSockRecvMsg(
             TimeoutPtr = &Timeout;
         }
 
-        Status = KeWaitForSingleObject(&Binding->RecvEvent, Executive, KernelMode, FALSE, TimeoutPtr);
+        Status = KeWaitForSingleObject(&Binding->AcceptEvent, Executive, KernelMode, FALSE, TimeoutPtr);
         if (!NT_SUCCESS(Status)) {
             TraceError(
                 "[data][%p] ERROR, %u, %s.",
@@ -1097,411 +1352,1384 @@ FnSockRecvMsg(
             goto Exit;
         }
 
-        KeAcquireSpinLock(&Binding->RecvDataLock, &PrevIrql);
+        KeAcquireSpinLock(&Binding->AcceptLock, &PrevIrql);
 
-        if (IsListEmpty(&Binding->RecvDataList)) {
-            KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
+        if (IsListEmpty(&Binding->AcceptList)) {
+            KeReleaseSpinLock(&Binding->AcceptLock, PrevIrql);
             Status = STATUS_UNSUCCESSFUL;
             goto Exit;
         }
     }
 
-    Entry = RemoveHeadList(&Binding->RecvDataList);
-
-    KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
-
+    Entry = RemoveHeadList(&Binding->AcceptList);
 
-    RecvData = CONTAINING_RECORD(Entry, FNSOCK_SOCKET_RECV_DATA, Link);
+    KeReleaseSpinLock(&Binding->AcceptLock, PrevIrql);
 
-    *Flags = RecvData->Flags;
+    Status =
+        CompleteAccept(
+            CONTAINING_RECORD(Entry, FNSOCK_SOCKET_ACCEPT_CONTEXT, Link), &NewBinding);
 
-    // TODO: Iterate through the received data list to fill buffers for stream sockets.
-    if (RecvData->DataLength <= (ULONG)BufferLength) {
-        BytesReceived = RecvData->DataLength;
-        Status = STATUS_SUCCESS;
-    } else {
-        Status = STATUS_BUFFER_OVERFLOW;
-    }
-    RtlCopyMemory(Buffer, RecvData->Data, min(RecvData->DataLength, (ULONG)BufferLength));
+Exit:
 
-    if ((ULONG)*ControlBufferLength >= RecvData->ControlDataLength) {
-        *ControlBufferLength = RecvData->ControlDataLength;
-    } else {
-        *Flags |= MSG_CTRUNC;
+    if (!NT_SUCCESS(Status)) {
+        FnSockSocketLastError = Status;
     }
 
-    RtlCopyMemory(ControlBuffer, RecvData->ControlData, *ControlBufferLength);
+    return (FNSOCK_HANDLE)NewBinding;
+}
 
-    ExFreePoolWithTag(RecvData, POOLTAG_FNSOCK_RECV);
-
-Exit:
-
-    if (!NT_SUCCESS(Status)) {
-        FnSockSocketLastError = Status;
-
-        BytesReceived = -1;
-    }
-
-    return BytesReceived;
-}
-
-static
-_IRQL_requires_max_(DISPATCH_LEVEL)
-VOID
-QueueRecvData(
-    _In_ FNSOCK_SOCKET_BINDING* Binding,
-    _In_ WSK_BUF* Buffer,
-    _When_(ControlBufferLength > 0, _In_) _When_(ControlBufferLength == 0, _In_opt_) CMSGHDR* ControlBuffer,
-    _In_ ULONG ControlBufferLength
+FNSOCKAPI
+FNSOCK_STATUS
+FnSockConnect(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_reads_bytes_(AddressLength) struct sockaddr* Address,
+    _In_ INT AddressLength
     )
 {
-    PMDL Mdl = Buffer->Mdl;
-    ULONG MdlOffset = Buffer->Offset;
-    SIZE_T DataLength = Buffer->Length;
-    SIZE_T CopiedLength;
+    NTSTATUS Status;
+    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
 
-    if (Mdl == NULL || DataLength == 0) {
-        TraceWarn(
-            "[%p] Dropping data with empty mdl.",
-            Binding);
-        return;
+    Status = ValidateAddress(Binding, Address, AddressLength);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
     }
 
     //
-    // We require contiguous buffers.
+    // Bind to wildcard address if not bound already.
     //
-    if ((SIZE_T)DataLength > Mdl->ByteCount - MdlOffset) {
-        TraceWarn(
-            "[%p] Dropping data with fragmented MDL.",
-            Binding);
-        NT_ASSERT(FALSE);
-        return;
-    }
+    if (!Binding->IsBound) {
+        SOCKADDR_INET WildcardAddress = {0};
+        WildcardAddress.si_family = Binding->AddressFamily;
 
-    UCHAR* Va = MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority | MdlMappingNoExecute);
-    if (Va == NULL) {
-        TraceError(
-            "[%p] Dropping data due to failed mapping.",
-            Binding);
-        return;
+        Status =
+            FnSockBind(
+                Socket,
+                (struct sockaddr*)&WildcardAddress,
+                sizeof(WildcardAddress));
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
     }
 
-    FNSOCK_SOCKET_RECV_DATA* RecvData = NULL;
-    SIZE_T AllocSize = sizeof(*RecvData) + DataLength;
-    RecvData =
-#pragma warning( suppress : 4996 )
-        (FNSOCK_SOCKET_RECV_DATA*)ExAllocatePoolWithTag(
-            NonPagedPoolNx, AllocSize, POOLTAG_FNSOCK_RECV);
-    if (RecvData == NULL) {
+    Status =
+        WskConnectSync(
+            Binding->Socket,
+            Binding->SockType,
+            Address);
+    if (!NT_SUCCESS(Status)) {
         TraceError(
-            "[%p] Dropping data due to insufficient memory.",
-            Binding);
-        return;
+            "[data][%p] ERROR, %u, %s.",
+            Binding,
+            Status,
+            "WskConnectSync");
+        goto Exit;
     }
-    RtlZeroMemory(RecvData, AllocSize);
 
-    if (ControlBufferLength > 0) {
-        if (ControlBufferLength > sizeof(RecvData->ControlData)) {
-            ControlBufferLength = sizeof(RecvData->ControlData);
-            RecvData->Flags |= MSG_CTRUNC;
+    if (Binding->SockType == WSK_FLAG_STREAM_SOCKET) {
+        Status = StartStreamReceives(Binding);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
         }
-        RtlCopyMemory(RecvData->ControlData, ControlBuffer, ControlBufferLength);
-        RecvData->ControlDataLength = ControlBufferLength;
     }
 
-    RecvData->DataLength = (ULONG)DataLength;
-    CopiedLength = 0;
-    while (CopiedLength < DataLength && Mdl != NULL) {
-        SIZE_T CopySize = min(MmGetMdlByteCount(Mdl) - MdlOffset, DataLength - CopiedLength);
-        RtlCopyMemory(
-            RecvData->Data + CopiedLength,
-            Va + MdlOffset,
-            CopySize);
-        CopiedLength += CopySize;
+Exit:
 
-        Mdl = Mdl->Next;
-        MdlOffset = 0;
+    if (!NT_SUCCESS(Status)) {
+        FnSockSocketLastError = Status;
     }
 
-    KIRQL PrevIrql;
-    KeAcquireSpinLock(&Binding->RecvDataLock, &PrevIrql);
-    InsertTailList(&Binding->RecvDataList, &RecvData->Link);
-    KeSetEvent(&Binding->RecvEvent, EVENT_INCREMENT, FALSE);
-    KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
+    return Status;
 }
 
-_IRQL_requires_max_(DISPATCH_LEVEL)
-_Must_inspect_result_
-NTSTATUS
-NTAPI
-FnSockDatagramSocketReceive(
-    _In_opt_ void* SocketContext,
-    _In_ ULONG Flags,
-    _In_opt_ PWSK_DATAGRAM_INDICATION DataIndicationHead
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockSend(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_reads_bytes_(BufferLength) const CHAR* Buffer,
+    _In_ INT BufferLength,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _In_ INT Flags
     )
 {
-    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)SocketContext;
+    NTSTATUS Status;
+    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
+    VOID* SendCompletion;
+    INT BytesSent = 0;
 
     UNREFERENCED_PARAMETER(Flags);
 
-    NT_ASSERT(Binding != NULL);
-    if (Binding == NULL) {
-        TraceError(
-            "[%p] Unexpected context in WSK callback.",
-            Binding);
-        return STATUS_SUCCESS;
-    }
-
     //
-    // Check to see if the DataIndicate is NULL, which indicates that the
-    // socket has been closed
+    // If the socket already has the maximum number of sends in flight, wait
+    // for one of them to complete.
     //
-    if (DataIndicationHead == NULL) {
-        TraceWarn(
-            "[%p] Unexpected socket state in WSK callback.",
-            Binding);
-        return STATUS_SUCCESS;
-    }
+    WaitForSendWindow(Binding, FNSOCK_MAX_OUTSTANDING_SENDS - 1, TRUE);
 
     //
-    // Process all the data indicated by the callback.
+    // To emulate the fire and forget behavior of user mode WinSock with WSK,
+    // initiate a send and account for its completion in a callback.
     //
-    while (DataIndicationHead != NULL) {
-        PWSK_DATAGRAM_INDICATION DataIndication = DataIndicationHead;
+    Status =
+        WskSendAsync(
+            Binding->Socket,
+            Binding->SockType,
+            (char *)Buffer,
+            BufferLength,
+            BufferIsNonPagedPool,
+            0,
+            &SendCompletion);
+    if (!NT_SUCCESS(Status)) {
+        TraceError(
+            "[data][%p] ERROR, %u, %s.",
+            Binding,
+            Status,
+            "WskSendSync");
+        FinishSend(Binding);
+        goto Exit;
+    }
 
-        DataIndicationHead = DataIndicationHead->Next;
-        DataIndication->Next = NULL;
+    WskSetCompletionCallback(SendCompletion, WSKCLIENT_INFINITE, SendComplete, Binding);
 
-        TraceInfo(
-            "[data][%p] Recv %u bytes",
-            Binding,
-            (ULONG)DataIndication->Buffer.Length);
+    Status = STATUS_SUCCESS;
+    BytesSent = BufferLength;
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        FnSockSocketLastError = Status;
 
-        QueueRecvData(
-            Binding, &DataIndication->Buffer, DataIndication->ControlInfo,
-            DataIndication->ControlInfoLength);
+        BytesSent = -1;
     }
 
-    return STATUS_SUCCESS;
+    return BytesSent;
 }
 
-_IRQL_requires_max_(DISPATCH_LEVEL)
-_Must_inspect_result_
-_At_(AcceptSocket, __drv_aliasesMem)
-NTSTATUS
-NTAPI
-FnSockStreamSocketAccept(
-    _In_opt_ void* SocketContext,
-    _In_ ULONG Flags,
-    _In_ PSOCKADDR LocalAddress,
-    _In_ PSOCKADDR RemoteAddress,
-    _In_opt_ PWSK_SOCKET AcceptSocket,
-    _Outptr_result_maybenull_ void** AcceptSocketContext,
-    _Outptr_result_maybenull_ CONST WSK_CLIENT_CONNECTION_DISPATCH** AcceptSocketDispatch
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockSendto(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_reads_bytes_(BufferLength) const CHAR* Buffer,
+    _In_ INT BufferLength,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _In_ INT Flags,
+    _In_reads_bytes_(AddressLength) const struct sockaddr* Address,
+    _In_ INT AddressLength
+    )
+{
+    return
+        FnSockSendMsg(
+            Socket, Buffer, BufferLength, BufferIsNonPagedPool, Flags, Address, AddressLength,
+            NULL, 0);
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockSendMsg(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_reads_bytes_(BufferLength) const CHAR* Buffer,
+    _In_ INT BufferLength,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _In_ INT Flags,
+    _In_reads_bytes_(AddressLength) const struct sockaddr* Address,
+    _In_ INT AddressLength,
+    _In_reads_bytes_(ControlBufferLength) const CMSGHDR* ControlBuffer,
+    _In_ INT ControlBufferLength
     )
 {
     NTSTATUS Status;
-    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)SocketContext;
-    FNSOCK_SOCKET_BINDING* NewBinding = NULL;
-    FNSOCK_SOCKET_ACCEPT_CONTEXT* AcceptContext = NULL;
-    KIRQL PrevIrql;
+    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
+    VOID* SendCompletion;
+    INT BytesSent = 0;
 
     UNREFERENCED_PARAMETER(Flags);
-    UNREFERENCED_PARAMETER(LocalAddress);
-    UNREFERENCED_PARAMETER(RemoteAddress);
+    UNREFERENCED_PARAMETER(AddressLength);
 
-    *AcceptSocketContext = NULL;
-    *AcceptSocketDispatch = NULL;
+    WaitForSendWindow(Binding, FNSOCK_MAX_OUTSTANDING_SENDS - 1, TRUE);
 
-    NT_ASSERT(Binding != NULL);
-    if (Binding == NULL) {
+    //
+    // To emulate the fire and forget behavior of user mode WinSock with WSK,
+    // initiate a send and account for its completion in a callback.
+    //
+    Status =
+        WskSendToAsync(
+            Binding->Socket,
+            (char *)Buffer,
+            BufferLength,
+            BufferIsNonPagedPool,
+            (PSOCKADDR)Address,
+            ControlBufferLength,
+            ControlBuffer,
+            &SendCompletion);
+    if (!NT_SUCCESS(Status)) {
         TraceError(
-            "[%p] Unexpected context in WSK callback.",
-            Binding);
-        return STATUS_SUCCESS;
+            "[data][%p] ERROR, %u, %s.",
+            Binding,
+            Status,
+            "WskSendToSync");
+        FinishSend(Binding);
+        goto Exit;
     }
 
-    //
-    // If AcceptSocket is NULL, we are supposed to close the listening socket.
-    //
-    NT_ASSERT(AcceptSocket != NULL);
+    WskSetCompletionCallback(SendCompletion, WSKCLIENT_INFINITE, SendComplete, Binding);
 
-    NewBinding =
-#pragma warning( suppress : 4996 )
-        (FNSOCK_SOCKET_BINDING*)ExAllocatePoolWithTag(
-            NonPagedPoolNx, sizeof(*NewBinding), POOLTAG_FNSOCK_SOCKET);
-    if (NewBinding == NULL) {
-        TraceError(
-            "[data] ERROR, %s.",
-            "Could not allocate memory for socket");
-        Status = STATUS_UNSUCCESSFUL;
-        goto Exit;
-    }
-    RtlZeroMemory(NewBinding, sizeof(*NewBinding));
+    Status = STATUS_SUCCESS;
+    BytesSent = BufferLength;
 
-    AcceptContext =
-#pragma warning( suppress : 4996 )
-        (FNSOCK_SOCKET_ACCEPT_CONTEXT*)ExAllocatePoolWithTag(
-            NonPagedPoolNx, sizeof(*AcceptContext), POOLTAG_FNSOCK_ACCEPT);
-    if (AcceptContext == NULL) {
-        TraceError(
-            "[data] ERROR, %s.",
-            "Could not allocate memory for accept context");
-        Status = STATUS_UNSUCCESSFUL;
-        goto Exit;
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        FnSockSocketLastError = Status;
+
+        BytesSent = -1;
     }
-    RtlZeroMemory(AcceptContext, sizeof(*AcceptContext));
 
-    InitializeBinding(NewBinding, Binding->AddressFamily, WSK_FLAG_CONNECTION_SOCKET);
-    NewBinding->Socket = AcceptSocket;
-    NewBinding->IsBound = TRUE;
+    return BytesSent;
+}
 
-    AcceptContext->AcceptedSocket = NewBinding;
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockRecv(
+    _In_ FNSOCK_HANDLE Socket,
+    _Out_writes_bytes_to_(BufferLength, return) CHAR* Buffer,
+    _In_ INT BufferLength,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _In_ INT Flags
+    )
+{
+    INT ControlBufferLength = 0;
 
-    KeAcquireSpinLock(&Binding->AcceptLock, &PrevIrql);
-    InsertTailList(&Binding->AcceptList, &AcceptContext->Link);
-    KeSetEvent(&Binding->AcceptEvent, EVENT_INCREMENT, FALSE);
-    KeReleaseSpinLock(&Binding->AcceptLock, PrevIrql);
+    return
+        FnSockRecvMsg(
+            Socket, Buffer, BufferLength, BufferIsNonPagedPool, NULL, &ControlBufferLength, &Flags);
+}
 
-    *AcceptSocketContext = NewBinding;
-    *AcceptSocketDispatch = &WskConnectionDispatch;
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+ReceiveStreamData(
+    _In_ FNSOCK_SOCKET_BINDING* Binding,
+    _Out_writes_bytes_to_(BufferLength, *BytesReceived) CHAR* Buffer,
+    _In_ ULONG BufferLength,
+    _In_ INT Flags,
+    _In_ UINT32 TimeoutMs,
+    _Out_ ULONG* BytesReceived
+    )
+{
+    const BOOLEAN Peek = !!(Flags & MSG_PEEK);
+    const BOOLEAN WaitAll = !!(Flags & MSG_WAITALL) && !Peek;
+    LARGE_INTEGER Timeout;
+    LARGE_INTEGER* TimeoutPtr;
+    ULONG Copied = 0;
+    NTSTATUS Status;
 
-    Status = STATUS_SUCCESS;
+    if (TimeoutMs == WSKCLIENT_INFINITE) {
+        TimeoutPtr = NULL;
+    } else {
+        Timeout.QuadPart = UInt32x32To64(TimeoutMs, 10000);
+        Timeout.QuadPart = -Timeout.QuadPart;
+        TimeoutPtr = &Timeout;
+    }
 
-Exit:
+    ExAcquireFastMutex(&Binding->StreamRecvLock);
 
-    if (!NT_SUCCESS(Status)) {
-        if (AcceptContext != NULL) {
-            ExFreePoolWithTag(AcceptContext, POOLTAG_FNSOCK_ACCEPT);
+    for (;;) {
+        LIST_ENTRY* Entry;
+        ULONG Offset;
+        ULONG Available;
+        BOOLEAN Shutdown;
+        KIRQL PrevIrql;
+
+        KeAcquireSpinLock(&Binding->RecvDataLock, &PrevIrql);
+        Available = Binding->RecvDataBytes;
+        Shutdown = Binding->RecvShutdown;
+        if (Available == 0 && !Shutdown) {
+            KeClearEvent(&Binding->RecvEvent);
         }
-        if (NewBinding != NULL) {
-            ExFreePoolWithTag(NewBinding, POOLTAG_FNSOCK_SOCKET);
+        Entry = Binding->RecvDataList.Flink;
+        Offset = Binding->RecvDataOffset;
+        KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
+
+        //
+        // The receive callback only appends chunks and readers are
+        // serialized, so the chunks counted in Available can be read without
+        // holding the spin lock.
+        //
+        while (Copied < BufferLength && Available > 0) {
+            FNSOCK_SOCKET_RECV_DATA* RecvData =
+                CONTAINING_RECORD(Entry, FNSOCK_SOCKET_RECV_DATA, Link);
+            ULONG CopySize = min(RecvData->DataLength - Offset, BufferLength - Copied);
+
+            RtlCopyMemory(Buffer + Copied, RecvData->Data + Offset, CopySize);
+            Copied += CopySize;
+            Offset += CopySize;
+            Available -= CopySize;
+
+            if (Peek) {
+                if (Offset == RecvData->DataLength && Available > 0) {
+                    Entry = Entry->Flink;
+                    Offset = 0;
+                }
+                continue;
+            }
+
+            KeAcquireSpinLock(&Binding->RecvDataLock, &PrevIrql);
+            Binding->RecvDataBytes -= CopySize;
+            if (Offset == RecvData->DataLength) {
+                RemoveEntryList(&RecvData->Link);
+                Binding->RecvDataOffset = 0;
+            } else {
+                Binding->RecvDataOffset = Offset;
+                RecvData = NULL;
+            }
+            Entry = Binding->RecvDataList.Flink;
+            KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
+
+            if (RecvData != NULL) {
+                ExFreePoolWithTag(RecvData, POOLTAG_FNSOCK_RECV);
+                Offset = 0;
+            }
+        }
+
+        if (Copied == BufferLength || (Copied > 0 && !WaitAll) || Shutdown) {
+            Status = STATUS_SUCCESS;
+            break;
+        }
+
+        Status = KeWaitForSingleObject(&Binding->RecvEvent, Executive, KernelMode, FALSE, TimeoutPtr);
+        if (Status != STATUS_SUCCESS) {
+            if (Copied > 0) {
+                //
+                // The copied bytes have already been consumed from the stream,
+                // so return them rather than failing a MSG_WAITALL receive.
+                //
+                Status = STATUS_SUCCESS;
+                break;
+            }
+            if (NT_SUCCESS(Status)) {
+                Status = STATUS_IO_TIMEOUT;
+            }
+            TraceError(
+                "[data][%p] ERROR, %u, %s.",
+                Binding,
+                Status,
+                "KeWaitForSingleObject");
+            break;
         }
     }
 
+    ExReleaseFastMutex(&Binding->StreamRecvLock);
+
+    *BytesReceived = Copied;
+
     return Status;
 }
 
+static
 _IRQL_requires_max_(DISPATCH_LEVEL)
-_Must_inspect_result_
+FNSOCK_SOCKET_RECV_DATA*
+RemoveRecvDataLocked(
+    _In_ FNSOCK_SOCKET_BINDING* Binding
+    )
+{
+    FNSOCK_SOCKET_RECV_DATA* RecvData;
+
+    //
+    // The caller holds RecvDataLock and has checked the list is not empty.
+    //
+    RecvData =
+        CONTAINING_RECORD(RemoveHeadList(&Binding->RecvDataList), FNSOCK_SOCKET_RECV_DATA, Link);
+    Binding->RecvDataBytes -= GetRecvDataLength(RecvData);
+
+    return RecvData;
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS
-NTAPI
-FnSockStreamSocketReceive(
-    _In_opt_ void* SocketContext,
-    _In_ ULONG Flags,
-    _In_opt_ PWSK_DATA_INDICATION DataIndicationHead,
-    _In_ SIZE_T BytesIndicated,
-    _Inout_ SIZE_T* BytesAccepted
+DequeueRecvData(
+    _In_ FNSOCK_SOCKET_BINDING* Binding,
+    _Inout_ LIST_ENTRY* RecvDataList,
+    _In_ UINT32 MaxCount,
+    _Out_ UINT32* Count
     )
 {
-    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)SocketContext;
+    KIRQL PrevIrql;
+    NTSTATUS Status;
 
-    UNREFERENCED_PARAMETER(Flags);
+    *Count = 0;
 
-    NT_ASSERT(Binding != NULL);
-    if (Binding == NULL) {
-        TraceError(
-            "[%p] Unexpected context in WSK callback.",
-            Binding);
-        return STATUS_SUCCESS;
-    }
+    KeAcquireSpinLock(&Binding->RecvDataLock, &PrevIrql);
 
-    //
-    // Check to see if the DataIndicate is NULL, which indicates that the
-    // socket has been closed
-    //
-    if (DataIndicationHead == NULL) {
-        return STATUS_SUCCESS;
-    }
+    if (IsListEmpty(&Binding->RecvDataList)) {
+        LARGE_INTEGER Timeout;
+        LARGE_INTEGER* TimeoutPtr;
 
-    //
-    // Process all the data indicated by the callback.
-    //
-    while (DataIndicationHead != NULL) {
-        PWSK_DATA_INDICATION DataIndication = DataIndicationHead;
+        KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
+
+        if (Binding->ReceiveTimeout == WSKCLIENT_INFINITE) {
+            TimeoutPtr = NULL;
+        } else {
+            Timeout.QuadPart = UInt32x32To64(Binding->ReceiveTimeout, 10000);
+            Timeout.QuadPart = -Timeout.QuadPart;
+            TimeoutPtr = &Timeout;
+        }
 
-        DataIndicationHead = DataIndicationHead->Next;
-        DataIndication->Next = NULL;
+        Status = KeWaitForSingleObject(&Binding->RecvEvent, Executive, KernelMode, FALSE, TimeoutPtr);
+        if (!NT_SUCCESS(Status)) {
+            TraceError(
+                "[data][%p] ERROR, %u, %s.",
+                Binding,
+                Status,
+                "KeWaitForSingleObject");
+            goto Exit;
+        }
 
-        TraceInfo(
-            "[data][%p] Recv %u bytes",
-            Binding,
-            (ULONG)DataIndication->Buffer.Length);
+        KeAcquireSpinLock(&Binding->RecvDataLock, &PrevIrql);
 
-        QueueRecvData(Binding, &DataIndication->Buffer, NULL, 0);
+        if (IsListEmpty(&Binding->RecvDataList)) {
+            KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
+            Status = STATUS_UNSUCCESSFUL;
+            goto Exit;
+        }
     }
 
-    *BytesAccepted = BytesIndicated;
+    //
+    // Drain as many datagrams as requested under a single lock acquisition.
+    //
+    while (*Count < MaxCount && !IsListEmpty(&Binding->RecvDataList)) {
+        InsertTailList(RecvDataList, &RemoveRecvDataLocked(Binding)->Link);
+        (*Count)++;
+    }
 
-    return STATUS_SUCCESS;
-}
+    KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
 
-#ifndef NO_ERROR
-#define NO_ERROR 0
-#endif
+    Status = STATUS_SUCCESS;
 
-#ifndef ERROR_IO_PENDING
-#define ERROR_IO_PENDING 997L
-#endif
+Exit:
+
+    return Status;
+}
 
 static
-INT
-NtStatusToSocketError(
-    _In_ NTSTATUS Status
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+CompleteRecvData(
+    _In_ FNSOCK_SOCKET_BINDING* Binding,
+    _In_ FNSOCK_SOCKET_RECV_DATA* RecvData,
+    _Out_writes_bytes_to_(BufferLength, *BytesReceived) CHAR* Buffer,
+    _In_ INT BufferLength,
+    _Out_writes_bytes_to_(*ControlBufferLength, *ControlBufferLength) CMSGHDR *ControlBuffer,
+    _Inout_ INT *ControlBufferLength,
+    _Out_ INT *Flags,
+    _Out_ INT *BytesReceived
     )
 {
-    INT err;
-
-    switch (Status) {
+    ULONG DataLength = GetRecvDataLength(RecvData);
+    const VOID* ControlData;
+    ULONG ControlDataLength;
+    NTSTATUS Status;
 
-    case STATUS_PENDING:
-        err = ERROR_IO_PENDING;
-        break;
+    *Flags = RecvData->Flags;
+    *BytesReceived = 0;
 
-    case STATUS_INVALID_HANDLE:
-    case STATUS_OBJECT_TYPE_MISMATCH:
-        err = WSAENOTSOCK;
-        break;
+    if (RecvData->Indication != NULL) {
+        ControlData = RecvData->Indication->ControlInfo;
+        ControlDataLength = RecvData->Indication->ControlInfoLength;
+    } else {
+        ControlData = RecvData->ControlData;
+        ControlDataLength = RecvData->ControlDataLength;
+    }
 
-    case STATUS_INSUFFICIENT_RESOURCES:
-    case STATUS_PAGEFILE_QUOTA:
-    case STATUS_COMMITMENT_LIMIT:
-    case STATUS_WORKING_SET_QUOTA:
-    case STATUS_NO_MEMORY:
-    case STATUS_CONFLICTING_ADDRESSES:
-    case STATUS_QUOTA_EXCEEDED:
-    case STATUS_TOO_MANY_PAGING_FILES:
-    case STATUS_REMOTE_RESOURCES:
-    case STATUS_TOO_MANY_ADDRESSES:
-        err = WSAENOBUFS;
-        break;
+    if (DataLength <= (ULONG)BufferLength) {
+        *BytesReceived = DataLength;
+        Status = STATUS_SUCCESS;
+    } else {
+        Status = STATUS_BUFFER_OVERFLOW;
+    }
 
-    case STATUS_SHARING_VIOLATION:
-    case STATUS_ADDRESS_ALREADY_EXISTS:
-        err = WSAEADDRINUSE;
-        break;
+    if (RecvData->Indication != NULL) {
+        //
+        // Copy straight from the retained indication's MDL chain.
+        //
+        if (!CopyFromWskBuf(
+                (UCHAR*)Buffer, &RecvData->Indication->Buffer,
+                min(DataLength, (ULONG)BufferLength))) {
+            TraceError(
+                "[data][%p] ERROR, %s.",
+                Binding,
+                "Could not map retained indication");
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+        }
+    } else {
+        RtlCopyMemory(Buffer, RecvData->Data, min(DataLength, (ULONG)BufferLength));
+    }
 
-    case STATUS_LINK_TIMEOUT:
-    case STATUS_IO_TIMEOUT:
-    case STATUS_TIMEOUT:
-        err = WSAETIMEDOUT;
-        break;
+    if ((ULONG)*ControlBufferLength >= ControlDataLength) {
+        *ControlBufferLength = ControlDataLength;
+    } else {
+        *Flags |= MSG_CTRUNC;
+    }
 
-    case STATUS_GRACEFUL_DISCONNECT:
-        err = WSAEDISCON;
-        break;
+    RtlCopyMemory(ControlBuffer, ControlData, *ControlBufferLength);
 
-    case STATUS_REMOTE_DISCONNECT:
-    case STATUS_CONNECTION_RESET:
-    case STATUS_LINK_FAILED:
-    case STATUS_CONNECTION_DISCONNECTED:
-    case STATUS_PORT_UNREACHABLE:
-        err = WSAECONNRESET;
-        break;
+    FreeRecvData(Binding, RecvData);
 
-    case STATUS_HOPLIMIT_EXCEEDED:
-        err = WSAENETRESET;
-        break;
+    return Status;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockRecvMsg(
+    _In_ FNSOCK_HANDLE Socket,
+    _Out_writes_bytes_to_(BufferLength, return) CHAR* Buffer,
+    _In_ INT BufferLength,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _Out_writes_bytes_to_(*ControlBufferLength, *ControlBufferLength) CMSGHDR *ControlBuffer,
+    _Inout_ INT *ControlBufferLength,
+    _In_ INT *Flags
+    )
+{
+    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
+    LIST_ENTRY RecvDataList;
+    UINT32 Count;
+    INT BytesReceived = 0;
+    NTSTATUS Status;
+
+    UNREFERENCED_PARAMETER(BufferIsNonPagedPool);
+
+    if (Binding->SockType != WSK_FLAG_DATAGRAM_SOCKET) {
+        ULONG StreamBytesReceived;
+
+        //
+        // Stream data is gathered across indicated chunks and never carries
+        // control data.
+        //
+        Status =
+            ReceiveStreamData(
+                Binding, Buffer, (ULONG)BufferLength, *Flags, Binding->ReceiveTimeout,
+                &StreamBytesReceived);
+        if (NT_SUCCESS(Status)) {
+            BytesReceived = (INT)StreamBytesReceived;
+        }
+        *ControlBufferLength = 0;
+        *Flags = 0;
+        goto Exit;
+    }
+
+    InitializeListHead(&RecvDataList);
+
+    Status = DequeueRecvData(Binding, &RecvDataList, 1, &Count);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status =
+        CompleteRecvData(
+            Binding,
+            CONTAINING_RECORD(RemoveHeadList(&RecvDataList), FNSOCK_SOCKET_RECV_DATA, Link),
+            Buffer, BufferLength, ControlBuffer, ControlBufferLength, Flags, &BytesReceived);
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        FnSockSocketLastError = Status;
+
+        BytesReceived = -1;
+    }
+
+    return BytesReceived;
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+GetSendMessagesCount(
+    _In_reads_(MessageCount) const FNSOCK_MSG* Messages,
+    _In_ INT MessageCount
+    )
+{
+    INT Count;
+
+    //
+    // Consecutive datagrams without control data to the same destination can
+    // be sent as one WSK request.
+    //
+    for (Count = 0; Count < min(MessageCount, FNSOCK_MAX_SEND_MESSAGES); Count++) {
+        const FNSOCK_MSG* Message = &Messages[Count];
+
+        if (Message->BufferLength <= 0 || Message->ControlBufferLength != 0 ||
+            Message->Address == NULL || Message->AddressLength != Messages[0].AddressLength ||
+            !RtlEqualMemory(Message->Address, Messages[0].Address, Message->AddressLength)) {
+            break;
+        }
+    }
+
+    return Count;
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+SendMessages(
+    _In_ FNSOCK_SOCKET_BINDING* Binding,
+    _Inout_updates_(MessageCount) FNSOCK_MSG* Messages,
+    _In_ INT MessageCount,
+    _In_ BOOLEAN BufferIsNonPagedPool
+    )
+{
+    WSKCLIENT_MESSAGE WskMessages[FNSOCK_MAX_SEND_MESSAGES];
+    VOID* SendCompletion;
+    NTSTATUS Status;
+
+    ASSERT(MessageCount <= FNSOCK_MAX_SEND_MESSAGES);
+
+    WaitForSendWindow(Binding, FNSOCK_MAX_OUTSTANDING_SENDS - 1, TRUE);
+
+    for (INT Index = 0; Index < MessageCount; Index++) {
+        WskMessages[Index].Buf = Messages[Index].Buffer;
+        WskMessages[Index].BufLen = Messages[Index].BufferLength;
+    }
+
+    //
+    // Like single datagram sends, the batch is fire and forget and counts as
+    // one send in flight until its completion callback runs.
+    //
+    Status =
+        WskSendMessagesAsync(
+            Binding->Socket, WskMessages, MessageCount, BufferIsNonPagedPool,
+            (PSOCKADDR)Messages[0].Address, 0, NULL, &SendCompletion);
+    if (!NT_SUCCESS(Status)) {
+        if (Status != STATUS_NOT_SUPPORTED) {
+            TraceError(
+                "[data][%p] ERROR, %u, %s.",
+                Binding,
+                Status,
+                "WskSendMessagesAsync");
+        }
+        FinishSend(Binding);
+        return Status;
+    }
+
+    WskSetCompletionCallback(SendCompletion, WSKCLIENT_INFINITE, SendComplete, Binding);
+
+    for (INT Index = 0; Index < MessageCount; Index++) {
+        Messages[Index].BytesTransferred = Messages[Index].BufferLength;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockSendMsgBatch(
+    _In_ FNSOCK_HANDLE Socket,
+    _Inout_updates_(MessageCount) FNSOCK_MSG* Messages,
+    _In_ INT MessageCount,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _In_ INT Flags
+    )
+{
+    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
+    INT Index = 0;
+
+    //
+    // Neither WskSendMessages nor WskSendTo accepts send flags, so fail
+    // rather than silently sending without them.
+    //
+    if (Flags != 0) {
+        TraceError(
+            "[data][%p] ERROR, %s.",
+            Binding,
+            "Unsupported send flags");
+        FnSockSocketLastError = STATUS_NOT_SUPPORTED;
+        return -1;
+    }
+
+    while (Index < MessageCount) {
+        FNSOCK_MSG* Message = &Messages[Index];
+        INT Count = 0;
+
+        if (Binding->SockType == WSK_FLAG_DATAGRAM_SOCKET) {
+            Count = GetSendMessagesCount(Message, MessageCount - Index);
+        }
+
+        if (Count > 1) {
+            NTSTATUS Status = SendMessages(Binding, Message, Count, BufferIsNonPagedPool);
+
+            if (NT_SUCCESS(Status)) {
+                Index += Count;
+                continue;
+            }
+
+            if (Status != STATUS_NOT_SUPPORTED) {
+                FnSockSocketLastError = Status;
+                Message->BytesTransferred = -1;
+                break;
+            }
+
+            //
+            // Fall back to sending the datagrams individually.
+            //
+        }
+
+        Message->BytesTransferred =
+            FnSockSendMsg(
+                Socket, Message->Buffer, Message->BufferLength, BufferIsNonPagedPool, Flags,
+                Message->Address, Message->AddressLength, Message->ControlBuffer,
+                Message->ControlBufferLength);
+        if (Message->BytesTransferred < 0) {
+            break;
+        }
+
+        Index++;
+    }
+
+    return (Index > 0 || MessageCount == 0) ? Index : -1;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockRecvMsgBatch(
+    _In_ FNSOCK_HANDLE Socket,
+    _Inout_updates_(MessageCount) FNSOCK_MSG* Messages,
+    _In_ INT MessageCount,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _In_ INT Flags
+    )
+{
+    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
+    LIST_ENTRY RecvDataList;
+    UINT32 Count;
+    INT Index;
+    NTSTATUS Status;
+
+    if (MessageCount <= 0) {
+        return 0;
+    }
+
+    if (Binding->SockType != WSK_FLAG_DATAGRAM_SOCKET) {
+        //
+        // Stream data has no message boundaries, so fill only one buffer.
+        //
+        Messages[0].Flags = Flags;
+        Messages[0].BytesTransferred =
+            FnSockRecvMsg(
+                Socket, Messages[0].Buffer, Messages[0].BufferLength, BufferIsNonPagedPool,
+                Messages[0].ControlBuffer, &Messages[0].ControlBufferLength,
+                &Messages[0].Flags);
+        return (Messages[0].BytesTransferred < 0) ? -1 : 1;
+    }
+
+    InitializeListHead(&RecvDataList);
+
+    Status = DequeueRecvData(Binding, &RecvDataList, (UINT32)MessageCount, &Count);
+    if (!NT_SUCCESS(Status)) {
+        FnSockSocketLastError = Status;
+        return -1;
+    }
+
+    //
+    // Every dequeued datagram is consumed; failures such as a buffer that is
+    // too small are reported per message.
+    //
+    for (Index = 0; Index < (INT)Count; Index++) {
+        FNSOCK_MSG* Message = &Messages[Index];
+
+        Status =
+            CompleteRecvData(
+                Binding,
+                CONTAINING_RECORD(RemoveHeadList(&RecvDataList), FNSOCK_SOCKET_RECV_DATA, Link),
+                Message->Buffer, Message->BufferLength, Message->ControlBuffer,
+                &Message->ControlBufferLength, &Message->Flags, &Message->BytesTransferred);
+        if (!NT_SUCCESS(Status)) {
+            FnSockSocketLastError = Status;
+            Message->BytesTransferred = -1;
+        }
+    }
+
+    return (INT)Count;
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+IsRecvBufferFull(
+    _In_ FNSOCK_SOCKET_BINDING* Binding
+    )
+{
+    //
+    // Like WinSock, accept a datagram as long as the buffered bytes are below
+    // the receive buffer size, even if the datagram itself exceeds it.
+    //
+    return
+        Binding->SockType == WSK_FLAG_DATAGRAM_SOCKET &&
+        ReadULongNoFence(&Binding->RecvDataBytes) >=
+            ReadULongNoFence(&Binding->ReceiveBufferSize);
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+CountRecvDrop(
+    _In_ FNSOCK_SOCKET_BINDING* Binding,
+    _In_ SIZE_T DataLength
+    )
+{
+    InterlockedIncrementNoFence64((LONG64*)&Binding->RecvDroppedPackets);
+    InterlockedAddNoFence64((LONG64*)&Binding->RecvDroppedBytes, (LONG64)DataLength);
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+InsertRecvData(
+    _In_ FNSOCK_SOCKET_BINDING* Binding,
+    _In_ FNSOCK_SOCKET_RECV_DATA* RecvData
+    )
+{
+    BOOLEAN Inserted = FALSE;
+    KIRQL PrevIrql;
+    KeAcquireSpinLock(&Binding->RecvDataLock, &PrevIrql);
+    if (!IsRecvBufferFull(Binding)) {
+        InsertTailList(&Binding->RecvDataList, &RecvData->Link);
+        Binding->RecvDataBytes += RecvData->DataLength;
+        KeSetEvent(&Binding->RecvEvent, EVENT_INCREMENT, FALSE);
+        SignalRecvReadyLocked(Binding);
+        SignalPollWaiters(Binding);
+        Inserted = TRUE;
+    }
+    KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
+    return Inserted;
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+FNSOCK_SOCKET_RECV_DATA*
+AllocateRecvData(
+    _In_ FNSOCK_SOCKET_BINDING* Binding,
+    _In_ SIZE_T DataLength
+    )
+{
+    FNSOCK_SOCKET_RECV_DATA* RecvData = NULL;
+    SIZE_T AllocSize = sizeof(*RecvData) + DataLength;
+    RecvData =
+#pragma warning( suppress : 4996 )
+        (FNSOCK_SOCKET_RECV_DATA*)ExAllocatePoolWithTag(
+            NonPagedPoolNx, AllocSize, POOLTAG_FNSOCK_RECV);
+    if (RecvData == NULL) {
+        TraceError(
+            "[%p] Dropping data due to insufficient memory.",
+            Binding);
+        return NULL;
+    }
+
+    //
+    // The caller fully overwrites the data buffer, so only zero the header.
+    //
+    RtlZeroMemory(RecvData, sizeof(*RecvData));
+    RecvData->DataLength = (ULONG)DataLength;
+
+    return RecvData;
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+QueueAllocatedRecvData(
+    _In_ FNSOCK_SOCKET_BINDING* Binding,
+    _In_ FNSOCK_SOCKET_RECV_DATA* RecvData
+    )
+{
+    if (!InsertRecvData(Binding, RecvData)) {
+        TraceWarn(
+            "[%p] Dropping data due to full receive buffer.",
+            Binding);
+        CountRecvDrop(Binding, RecvData->DataLength);
+        ExFreePoolWithTag(RecvData, POOLTAG_FNSOCK_RECV);
+    }
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+QueueRecvData(
+    _In_ FNSOCK_SOCKET_BINDING* Binding,
+    _In_ WSK_BUF* Buffer,
+    _When_(ControlBufferLength > 0, _In_) _When_(ControlBufferLength == 0, _In_opt_) CMSGHDR* ControlBuffer,
+    _In_ ULONG ControlBufferLength
+    )
+{
+    SIZE_T DataLength = Buffer->Length;
+
+    if (Buffer->Mdl == NULL || DataLength == 0) {
+        TraceWarn(
+            "[%p] Dropping data with empty mdl.",
+            Binding);
+        return;
+    }
+
+    FNSOCK_SOCKET_RECV_DATA* RecvData = AllocateRecvData(Binding, DataLength);
+    if (RecvData == NULL) {
+        return;
+    }
+
+    if (ControlBufferLength > 0) {
+        if (ControlBufferLength > sizeof(RecvData->ControlData)) {
+            ControlBufferLength = sizeof(RecvData->ControlData);
+            RecvData->Flags |= MSG_CTRUNC;
+        }
+        RtlCopyMemory(RecvData->ControlData, ControlBuffer, ControlBufferLength);
+        RecvData->ControlDataLength = ControlBufferLength;
+    }
+
+    if (!CopyFromWskBuf(RecvData->Data, Buffer, DataLength)) {
+        TraceError(
+            "[%p] Dropping data due to failed mapping.",
+            Binding);
+        ExFreePoolWithTag(RecvData, POOLTAG_FNSOCK_RECV);
+        return;
+    }
+
+    QueueAllocatedRecvData(Binding, RecvData);
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+SignalRecvShutdown(
+    _In_ FNSOCK_SOCKET_BINDING* Binding
+    )
+{
+    KIRQL PrevIrql;
+
+    //
+    // Wake up any readers waiting for more stream data.
+    //
+    KeAcquireSpinLock(&Binding->RecvDataLock, &PrevIrql);
+    Binding->RecvShutdown = TRUE;
+    KeSetEvent(&Binding->RecvEvent, EVENT_INCREMENT, FALSE);
+    SignalRecvReadyLocked(Binding);
+    SignalPollWaiters(Binding);
+    KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+StreamReceiveComplete(
+    _In_opt_ PVOID Context,
+    _In_ NTSTATUS Status,
+    _In_ char *Buf,
+    _In_ ULONG BytesReceived
+    )
+{
+    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Context;
+    FNSOCK_SOCKET_RECV_DATA* RecvData;
+
+    NT_ASSERT(Binding != NULL);
+
+    //
+    // A failed or empty receive means the peer disconnected or the socket is
+    // closing, and the pipeline stops posting receives.
+    //
+    if (!NT_SUCCESS(Status) || BytesReceived == 0) {
+        SignalRecvShutdown(Binding);
+        return;
+    }
+
+    TraceInfo(
+        "[data][%p] Recv %u bytes",
+        Binding,
+        BytesReceived);
+
+    //
+    // The pipeline reposts the buffer once this returns, so copy the data out.
+    //
+    RecvData = AllocateRecvData(Binding, BytesReceived);
+    if (RecvData == NULL) {
+        return;
+    }
+
+    RtlCopyMemory(RecvData->Data, Buf, BytesReceived);
+    QueueAllocatedRecvData(Binding, RecvData);
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+StartStreamReceives(
+    _In_ FNSOCK_SOCKET_BINDING* Binding
+    )
+{
+    NTSTATUS Status;
+
+    NT_ASSERT(Binding->RecvPipeline == NULL);
+
+    Binding->RecvPipelineBuffers =
+#pragma warning( suppress : 4996 )
+        (CHAR*)ExAllocatePoolWithTag(
+            NonPagedPoolNx, FNSOCK_STREAM_RECV_COUNT * FNSOCK_STREAM_RECV_SIZE,
+            POOLTAG_FNSOCK_RECV);
+    if (Binding->RecvPipelineBuffers == NULL) {
+        TraceError(
+            "[data] ERROR, %s.",
+            "Could not allocate memory for stream receives");
+        return STATUS_NO_MEMORY;
+    }
+
+    Status =
+        WskReceivePipelineCreate(
+            Binding->Socket, Binding->SockType, Binding->RecvPipelineBuffers,
+            FNSOCK_STREAM_RECV_SIZE, FNSOCK_STREAM_RECV_COUNT, TRUE, StreamReceiveComplete,
+            Binding, &Binding->RecvPipeline);
+    if (!NT_SUCCESS(Status)) {
+        TraceError(
+            "[data][%p] ERROR, %u, %s.",
+            Binding,
+            Status,
+            "WskReceivePipelineCreate");
+        Binding->RecvPipeline = NULL;
+        ExFreePoolWithTag(Binding->RecvPipelineBuffers, POOLTAG_FNSOCK_RECV);
+        Binding->RecvPipelineBuffers = NULL;
+    }
+
+    return Status;
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+RetainRecvIndications(
+    _In_ FNSOCK_SOCKET_BINDING* Binding,
+    _In_ PWSK_DATAGRAM_INDICATION DataIndicationHead
+    )
+{
+    PWSK_DATAGRAM_INDICATION DataIndication;
+    LIST_ENTRY RecvDataList;
+    UINT32 IndicationCount = 0;
+    SIZE_T LeadingBytes = 0;
+    SIZE_T LastLength = 0;
+    BOOLEAN Retained = FALSE;
+    KIRQL PrevIrql;
+
+    //
+    // Pending the indication list transfers ownership of every indication in
+    // it, and indications must not be released before the callback returns.
+    // Therefore the list is either retained in full or not at all.
+    //
+    for (DataIndication = DataIndicationHead;
+            DataIndication != NULL;
+            DataIndication = DataIndication->Next) {
+        if (DataIndication->Buffer.Mdl == NULL || DataIndication->Buffer.Length == 0) {
+            return FALSE;
+        }
+        LeadingBytes += LastLength;
+        LastLength = DataIndication->Buffer.Length;
+        IndicationCount++;
+    }
+
+    if (!ReadBooleanNoFence(&Binding->RetainIndications) ||
+        ReadULongNoFence((ULONG*)&Binding->RetainedIndicationCount) + IndicationCount >
+            FNSOCK_MAX_RETAINED_INDICATIONS) {
+        return FALSE;
+    }
+
+    //
+    // Only the headers are needed: the data and control info stay in the
+    // indications until the application receives the datagrams.
+    //
+    InitializeListHead(&RecvDataList);
+    for (DataIndication = DataIndicationHead;
+            DataIndication != NULL;
+            DataIndication = DataIndication->Next) {
+        FNSOCK_SOCKET_RECV_DATA* RecvData =
+#pragma warning( suppress : 4996 )
+            (FNSOCK_SOCKET_RECV_DATA*)ExAllocatePoolWithTag(
+                NonPagedPoolNx, sizeof(*RecvData), POOLTAG_FNSOCK_RECV);
+        if (RecvData == NULL) {
+            goto Exit;
+        }
+        RtlZeroMemory(RecvData, sizeof(*RecvData));
+        RecvData->Indication = DataIndication;
+        InsertTailList(&RecvDataList, &RecvData->Link);
+    }
+
+    //
+    // Like WinSock, a datagram is accepted as long as the bytes buffered ahead
+    // of it are below the receive buffer size, so the list is retained only if
+    // none of its datagrams would be dropped.
+    //
+    KeAcquireSpinLock(&Binding->RecvDataLock, &PrevIrql);
+    if (Binding->RetainIndications &&
+        Binding->RetainedIndicationCount + IndicationCount <= FNSOCK_MAX_RETAINED_INDICATIONS &&
+        Binding->RecvDataBytes + LeadingBytes < Binding->ReceiveBufferSize) {
+        Binding->RetainedIndicationCount += IndicationCount;
+        Binding->RecvDataBytes += (ULONG)(LeadingBytes + LastLength);
+        while (!IsListEmpty(&RecvDataList)) {
+            InsertTailList(&Binding->RecvDataList, RemoveHeadList(&RecvDataList));
+        }
+        KeSetEvent(&Binding->RecvEvent, EVENT_INCREMENT, FALSE);
+        SignalRecvReadyLocked(Binding);
+        SignalPollWaiters(Binding);
+        Retained = TRUE;
+    }
+    KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
+
+Exit:
+
+    while (!IsListEmpty(&RecvDataList)) {
+        ExFreePoolWithTag(
+            CONTAINING_RECORD(RemoveHeadList(&RecvDataList), FNSOCK_SOCKET_RECV_DATA, Link),
+            POOLTAG_FNSOCK_RECV);
+    }
+
+    return Retained;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+_Must_inspect_result_
+NTSTATUS
+NTAPI
+FnSockDatagramSocketReceive(
+    _In_opt_ void* SocketContext,
+    _In_ ULONG Flags,
+    _In_opt_ PWSK_DATAGRAM_INDICATION DataIndicationHead
+    )
+{
+    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)SocketContext;
+
+    UNREFERENCED_PARAMETER(Flags);
+
+    NT_ASSERT(Binding != NULL);
+    if (Binding == NULL) {
+        TraceError(
+            "[%p] Unexpected context in WSK callback.",
+            Binding);
+        return STATUS_SUCCESS;
+    }
+
+    //
+    // Check to see if the DataIndicate is NULL, which indicates that the
+    // socket has been closed
+    //
+    if (DataIndicationHead == NULL) {
+        TraceWarn(
+            "[%p] Unexpected socket state in WSK callback.",
+            Binding);
+        return STATUS_SUCCESS;
+    }
+
+    //
+    // Retain the indications while the budget allows, so each datagram is
+    // copied only once, directly into the application buffer. Returning
+    // STATUS_PENDING hands the whole list to fnsock, which then releases each
+    // indication once the application has received it.
+    //
+    if (RetainRecvIndications(Binding, DataIndicationHead)) {
+        TraceInfo(
+            "[data][%p] Retained indications",
+            Binding);
+        return STATUS_PENDING;
+    }
+
+    //
+    // Otherwise copy the data out and leave the indications with WSK, which
+    // reclaims them when the callback returns.
+    //
+    for (PWSK_DATAGRAM_INDICATION DataIndication = DataIndicationHead;
+            DataIndication != NULL;
+            DataIndication = DataIndication->Next) {
+        TraceInfo(
+            "[data][%p] Recv %u bytes",
+            Binding,
+            (ULONG)DataIndication->Buffer.Length);
+
+        if (IsRecvBufferFull(Binding)) {
+            TraceWarn(
+                "[%p] Dropping data due to full receive buffer.",
+                Binding);
+            CountRecvDrop(Binding, DataIndication->Buffer.Length);
+        } else {
+            QueueRecvData(
+                Binding, &DataIndication->Buffer, DataIndication->ControlInfo,
+                DataIndication->ControlInfoLength);
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+_Must_inspect_result_
+_At_(AcceptSocket, __drv_aliasesMem)
+NTSTATUS
+NTAPI
+FnSockStreamSocketAccept(
+    _In_opt_ void* SocketContext,
+    _In_ ULONG Flags,
+    _In_ PSOCKADDR LocalAddress,
+    _In_ PSOCKADDR RemoteAddress,
+    _In_opt_ PWSK_SOCKET AcceptSocket,
+    _Outptr_result_maybenull_ void** AcceptSocketContext,
+    _Outptr_result_maybenull_ CONST WSK_CLIENT_CONNECTION_DISPATCH** AcceptSocketDispatch
+    )
+{
+    NTSTATUS Status;
+    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)SocketContext;
+    FNSOCK_SOCKET_BINDING* NewBinding = NULL;
+    FNSOCK_SOCKET_ACCEPT_CONTEXT* AcceptContext = NULL;
+    KIRQL PrevIrql;
+
+    UNREFERENCED_PARAMETER(Flags);
+    UNREFERENCED_PARAMETER(LocalAddress);
+    UNREFERENCED_PARAMETER(RemoteAddress);
+
+    *AcceptSocketContext = NULL;
+    *AcceptSocketDispatch = NULL;
+
+    NT_ASSERT(Binding != NULL);
+    if (Binding == NULL) {
+        TraceError(
+            "[%p] Unexpected context in WSK callback.",
+            Binding);
+        return STATUS_SUCCESS;
+    }
+
+    //
+    // If AcceptSocket is NULL, we are supposed to close the listening socket.
+    //
+    NT_ASSERT(AcceptSocket != NULL);
+
+    NewBinding =
+#pragma warning( suppress : 4996 )
+        (FNSOCK_SOCKET_BINDING*)ExAllocatePoolWithTag(
+            NonPagedPoolNx, sizeof(*NewBinding), POOLTAG_FNSOCK_SOCKET);
+    if (NewBinding == NULL) {
+        TraceError(
+            "[data] ERROR, %s.",
+            "Could not allocate memory for socket");
+        Status = STATUS_UNSUCCESSFUL;
+        goto Exit;
+    }
+    RtlZeroMemory(NewBinding, sizeof(*NewBinding));
+
+    AcceptContext =
+#pragma warning( suppress : 4996 )
+        (FNSOCK_SOCKET_ACCEPT_CONTEXT*)ExAllocatePoolWithTag(
+            NonPagedPoolNx, sizeof(*AcceptContext), POOLTAG_FNSOCK_ACCEPT);
+    if (AcceptContext == NULL) {
+        TraceError(
+            "[data] ERROR, %s.",
+            "Could not allocate memory for accept context");
+        Status = STATUS_UNSUCCESSFUL;
+        goto Exit;
+    }
+    RtlZeroMemory(AcceptContext, sizeof(*AcceptContext));
+
+    InitializeBinding(NewBinding, Binding->AddressFamily, WSK_FLAG_CONNECTION_SOCKET);
+    NewBinding->Socket = AcceptSocket;
+    NewBinding->IsBound = TRUE;
+
+    AcceptContext->AcceptedSocket = NewBinding;
+
+    KeAcquireSpinLock(&Binding->AcceptLock, &PrevIrql);
+    InsertTailList(&Binding->AcceptList, &AcceptContext->Link);
+    KeSetEvent(&Binding->AcceptEvent, EVENT_INCREMENT, FALSE);
+    SignalAcceptReadyLocked(Binding);
+    SignalPollWaiters(Binding);
+    KeReleaseSpinLock(&Binding->AcceptLock, PrevIrql);
+
+    *AcceptSocketContext = NewBinding;
+    *AcceptSocketDispatch = &WskConnectionDispatch;
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        if (AcceptContext != NULL) {
+            ExFreePoolWithTag(AcceptContext, POOLTAG_FNSOCK_ACCEPT);
+        }
+        if (NewBinding != NULL) {
+            ExFreePoolWithTag(NewBinding, POOLTAG_FNSOCK_SOCKET);
+        }
+    }
+
+    return Status;
+}
+
+#ifndef NO_ERROR
+#define NO_ERROR 0
+#endif
+
+#ifndef ERROR_IO_PENDING
+#define ERROR_IO_PENDING 997L
+#endif
+
+static
+INT
+NtStatusToSocketError(
+    _In_ NTSTATUS Status
+    )
+{
+    INT err;
+
+    switch (Status) {
+
+    case STATUS_PENDING:
+        err = ERROR_IO_PENDING;
+        break;
+
+    case STATUS_INVALID_HANDLE:
+    case STATUS_OBJECT_TYPE_MISMATCH:
+        err = WSAENOTSOCK;
+        break;
+
+    case STATUS_INSUFFICIENT_RESOURCES:
+    case STATUS_PAGEFILE_QUOTA:
+    case STATUS_COMMITMENT_LIMIT:
+    case STATUS_WORKING_SET_QUOTA:
+    case STATUS_NO_MEMORY:
+    case STATUS_CONFLICTING_ADDRESSES:
+    case STATUS_QUOTA_EXCEEDED:
+    case STATUS_TOO_MANY_PAGING_FILES:
+    case STATUS_REMOTE_RESOURCES:
+    case STATUS_TOO_MANY_ADDRESSES:
+        err = WSAENOBUFS;
+        break;
+
+    case STATUS_SHARING_VIOLATION:
+    case STATUS_ADDRESS_ALREADY_EXISTS:
+        err = WSAEADDRINUSE;
+        break;
+
+    case STATUS_LINK_TIMEOUT:
+    case STATUS_IO_TIMEOUT:
+    case STATUS_TIMEOUT:
+        err = WSAETIMEDOUT;
+        break;
+
+    case STATUS_GRACEFUL_DISCONNECT:
+        err = WSAEDISCON;
+        break;
+
+    case STATUS_REMOTE_DISCONNECT:
+    case STATUS_CONNECTION_RESET:
+    case STATUS_LINK_FAILED:
+    case STATUS_CONNECTION_DISCONNECTED:
+    case STATUS_PORT_UNREACHABLE:
+        err = WSAECONNRESET;
+        break;
+
+    case STATUS_HOPLIMIT_EXCEEDED:
+        err = WSAENETRESET;
+        break;
 
     case STATUS_LOCAL_DISCONNECT:
     case STATUS_TRANSACTION_ABORTED:
@@ -1509,114 +2737,1434 @@ NtStatusToSocketError(
         err = WSAECONNABORTED;
         break;
 
-    case STATUS_BAD_NETWORK_PATH:
-    case STATUS_NETWORK_UNREACHABLE:
-    case STATUS_PROTOCOL_UNREACHABLE:
-        err = WSAENETUNREACH;
-        break;
+    case STATUS_BAD_NETWORK_PATH:
+    case STATUS_NETWORK_UNREACHABLE:
+    case STATUS_PROTOCOL_UNREACHABLE:
+        err = WSAENETUNREACH;
+        break;
+
+    case STATUS_HOST_UNREACHABLE:
+        err = WSAEHOSTUNREACH;
+        break;
+
+    case STATUS_HOST_DOWN:
+        err = WSAEHOSTDOWN;
+        break;
+
+    case STATUS_CANCELLED:
+    case STATUS_REQUEST_ABORTED:
+        err = WSAEINTR;
+        break;
+
+    case STATUS_BUFFER_OVERFLOW:
+    case STATUS_INVALID_BUFFER_SIZE:
+        err = WSAEMSGSIZE;
+        break;
+
+    case STATUS_BUFFER_TOO_SMALL:
+    case STATUS_ACCESS_VIOLATION:
+    case STATUS_DATATYPE_MISALIGNMENT_ERROR:
+        err = WSAEFAULT;
+        break;
+
+    case STATUS_DEVICE_NOT_READY:
+    case STATUS_REQUEST_NOT_ACCEPTED:
+        err = WSAEWOULDBLOCK;
+        break;
+
+    case STATUS_INVALID_NETWORK_RESPONSE:
+    case STATUS_NETWORK_BUSY:
+    case STATUS_NO_SUCH_DEVICE:
+    case STATUS_NO_SUCH_FILE:
+    case STATUS_OBJECT_PATH_NOT_FOUND:
+    case STATUS_OBJECT_NAME_NOT_FOUND:
+    case STATUS_UNEXPECTED_NETWORK_ERROR:
+        err = WSAENETDOWN;
+        break;
+
+    case STATUS_INVALID_CONNECTION:
+        err = WSAENOTCONN;
+        break;
+
+    case STATUS_REMOTE_NOT_LISTENING:
+    case STATUS_CONNECTION_REFUSED:
+        err = WSAECONNREFUSED;
+        break;
+
+    case STATUS_PIPE_DISCONNECTED:
+        err = WSAESHUTDOWN;
+        break;
+
+    case STATUS_INVALID_ADDRESS:
+    case STATUS_INVALID_ADDRESS_COMPONENT:
+        err = WSAEADDRNOTAVAIL;
+        break;
+
+    case STATUS_NOT_SUPPORTED:
+    case STATUS_NOT_IMPLEMENTED:
+        err = WSAEOPNOTSUPP;
+        break;
+
+    case STATUS_ACCESS_DENIED:
+        err = WSAEACCES;
+        break;
+
+    case STATUS_CONNECTION_ACTIVE:
+        err = WSAEISCONN;
+        break;
+
+    case STATUS_PROTOCOL_NOT_SUPPORTED:
+        return WSAEAFNOSUPPORT;
+
+    case STATUS_SUCCESS:
+        return NO_ERROR;
+
+    default:
+
+        if (NT_SUCCESS(Status)) {
+            NT_ASSERT(FALSE);
+
+            err = NO_ERROR;
+            break;
+        }
+
+        //
+        // Fall over to default error code
+        //
+    case STATUS_UNSUCCESSFUL:
+    case STATUS_INVALID_PARAMETER:
+    case STATUS_ADDRESS_CLOSED:
+    case STATUS_CONNECTION_INVALID:
+    case STATUS_ADDRESS_ALREADY_ASSOCIATED:
+    case STATUS_ADDRESS_NOT_ASSOCIATED:
+    case STATUS_INVALID_DEVICE_STATE:
+    case STATUS_INVALID_DEVICE_REQUEST:
+        err = WSAEINVAL;
+        break;
+
+    }
+
+    return err;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockSendSegments(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_reads_bytes_(BufferLength) const CHAR* Buffer,
+    _In_ INT BufferLength,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _In_ INT Flags,
+    _In_reads_bytes_(AddressLength) const struct sockaddr* Address,
+    _In_ INT AddressLength,
+    _In_ UINT32 SegmentSize
+    )
+{
+    DECLSPEC_ALIGN(MEMORY_ALLOCATION_ALIGNMENT)
+        CHAR ControlBuffer[FNSOCK_SEGMENT_SIZE_CONTROL_LENGTH];
+
+    FnSockFormatSegmentSize((CMSGHDR*)ControlBuffer, SegmentSize);
+
+    return
+        FnSockSendMsg(
+            Socket, Buffer, BufferLength, BufferIsNonPagedPool, Flags, Address, AddressLength,
+            (CMSGHDR*)ControlBuffer, sizeof(ControlBuffer));
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+BOOLEAN
+FnSockGetCoalescedInfo(
+    _In_reads_bytes_(ControlBufferLength) const CMSGHDR* ControlBuffer,
+    _In_ INT ControlBufferLength,
+    _Out_ UINT32* SegmentSize
+    )
+{
+    return FnSockParseCoalescedInfo(ControlBuffer, ControlBufferLength, SegmentSize);
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockCreateCompletionQueue(
+    _Out_ FNSOCK_COMPLETION_QUEUE* Queue
+    )
+{
+    NTSTATUS Status;
+    FNSOCK_COMPLETION_QUEUE_OBJECT* QueueObject;
+
+    *Queue = NULL;
+
+    QueueObject =
+#pragma warning( suppress : 4996 )
+        (FNSOCK_COMPLETION_QUEUE_OBJECT*)ExAllocatePoolWithTag(
+            NonPagedPoolNx, sizeof(*QueueObject), POOLTAG_FNSOCK_QUEUE);
+    if (QueueObject == NULL) {
+        TraceError(
+            "[data] ERROR, %s.",
+            "Could not allocate memory for completion queue");
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+    RtlZeroMemory(QueueObject, sizeof(*QueueObject));
+
+    KeInitializeSpinLock(&QueueObject->Lock);
+    KeInitializeEvent(&QueueObject->ReadyEvent, NotificationEvent, FALSE);
+    InitializeListHead(&QueueObject->ReadyBindingList);
+    InitializeListHead(&QueueObject->CompletedList);
+    InitializeListHead(&QueueObject->ConnectList);
+    ExInitializeFastMutex(&QueueObject->ProcessLock);
+
+    *Queue = (FNSOCK_COMPLETION_QUEUE)QueueObject;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        FnSockSocketLastError = Status;
+    }
+
+    return Status;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+FnSockCloseCompletionQueue(
+    _In_ FNSOCK_COMPLETION_QUEUE Queue
+    )
+{
+    FNSOCK_COMPLETION_QUEUE_OBJECT* QueueObject = (FNSOCK_COMPLETION_QUEUE_OBJECT*)Queue;
+
+    NT_ASSERT(IsListEmpty(&QueueObject->ReadyBindingList));
+    NT_ASSERT(IsListEmpty(&QueueObject->CompletedList));
+    NT_ASSERT(IsListEmpty(&QueueObject->ConnectList));
+
+    ExFreePoolWithTag(QueueObject, POOLTAG_FNSOCK_QUEUE);
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockAssociateCompletionQueue(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_ FNSOCK_COMPLETION_QUEUE Queue
+    )
+{
+    NTSTATUS Status;
+    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
+
+    if (Binding->CompletionQueue != NULL) {
+        TraceError(
+            "[data][%p] ERROR, %s.",
+            Binding,
+            "Socket is already associated with a completion queue");
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Binding->CompletionQueue = (FNSOCK_COMPLETION_QUEUE_OBJECT*)Queue;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        FnSockSocketLastError = Status;
+    }
+
+    return Status;
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+AllocateAsyncOperation(
+    _In_ FNSOCK_SOCKET_BINDING* Binding,
+    _In_ FNSOCK_OPERATION OperationType,
+    _In_opt_ VOID* Context,
+    _Out_ FNSOCK_ASYNC_OPERATION** Operation
+    )
+{
+    *Operation = NULL;
+
+    if (Binding->CompletionQueue == NULL) {
+        TraceError(
+            "[data][%p] ERROR, %s.",
+            Binding,
+            "Socket is not associated with a completion queue");
+        return STATUS_INVALID_DEVICE_STATE;
+    }
+
+    *Operation =
+#pragma warning( suppress : 4996 )
+        (FNSOCK_ASYNC_OPERATION*)ExAllocatePoolWithTag(
+            NonPagedPoolNx, sizeof(**Operation), POOLTAG_FNSOCK_ASYNC);
+    if (*Operation == NULL) {
+        TraceError(
+            "[data] ERROR, %s.",
+            "Could not allocate memory for async operation");
+        return STATUS_NO_MEMORY;
+    }
+    RtlZeroMemory(*Operation, sizeof(**Operation));
+
+    (*Operation)->Binding = Binding;
+    (*Operation)->Operation = OperationType;
+    (*Operation)->Context = Context;
+
+    return STATUS_SUCCESS;
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+CompleteAsyncOperation(
+    _In_ FNSOCK_ASYNC_OPERATION* Operation,
+    _In_ NTSTATUS Status,
+    _In_ INT BytesTransferred,
+    _In_opt_ FNSOCK_SOCKET_BINDING* AcceptedBinding,
+    _Out_ FNSOCK_COMPLETION* Completion
+    )
+{
+    RtlZeroMemory(Completion, sizeof(*Completion));
+    Completion->Socket = (FNSOCK_HANDLE)Operation->Binding;
+    Completion->Operation = Operation->Operation;
+    Completion->Context = Operation->Context;
+
+    if (NT_SUCCESS(Status)) {
+        Completion->BytesTransferred = BytesTransferred;
+        Completion->AcceptedSocket = (FNSOCK_HANDLE)AcceptedBinding;
+    } else {
+        Completion->Error = NtStatusToSocketError(Status);
+    }
+
+    ExFreePoolWithTag(Operation, POOLTAG_FNSOCK_ASYNC);
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+SendAsyncComplete(
+    _In_opt_ PVOID Context,
+    _In_ NTSTATUS Status,
+    _In_ ULONG_PTR Information
+    )
+{
+    FNSOCK_ASYNC_OPERATION* Operation = (FNSOCK_ASYNC_OPERATION*)Context;
+    FNSOCK_COMPLETION_QUEUE_OBJECT* QueueObject;
+    KIRQL PrevIrql;
+
+    NT_ASSERT(Operation != NULL);
+    QueueObject = Operation->Binding->CompletionQueue;
+
+    Operation->Status = Status;
+    Operation->BytesTransferred = (INT)Information;
+
+    KeAcquireSpinLock(&QueueObject->Lock, &PrevIrql);
+    InsertTailList(&QueueObject->CompletedList, &Operation->Link);
+    KeSetEvent(&QueueObject->ReadyEvent, EVENT_INCREMENT, FALSE);
+    KeReleaseSpinLock(&QueueObject->Lock, PrevIrql);
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockSendAsync(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_reads_bytes_(BufferLength) const CHAR* Buffer,
+    _In_ INT BufferLength,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _In_ INT Flags,
+    _In_opt_ VOID* Context
+    )
+{
+    NTSTATUS Status;
+    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
+    FNSOCK_ASYNC_OPERATION* Operation;
+    VOID* SendCompletion;
+
+    UNREFERENCED_PARAMETER(Flags);
+
+    Status = AllocateAsyncOperation(Binding, FnSockOperationSend, Context, &Operation);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status =
+        WskSendAsync(
+            Binding->Socket,
+            Binding->SockType,
+            (char *)Buffer,
+            BufferLength,
+            BufferIsNonPagedPool,
+            0,
+            &SendCompletion);
+    if (!NT_SUCCESS(Status)) {
+        TraceError(
+            "[data][%p] ERROR, %u, %s.",
+            Binding,
+            Status,
+            "WskSendAsync");
+        goto Exit;
+    }
+
+    //
+    // The send is queued to the completion queue once WSK completes it.
+    //
+    WskSetCompletionCallback(
+        SendCompletion, WSKCLIENT_INFINITE, SendAsyncComplete, Operation);
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        FnSockSocketLastError = Status;
+
+        if (Operation != NULL) {
+            ExFreePoolWithTag(Operation, POOLTAG_FNSOCK_ASYNC);
+        }
+    }
+
+    return Status;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockRecvAsync(
+    _In_ FNSOCK_HANDLE Socket,
+    _Out_writes_bytes_(BufferLength) CHAR* Buffer,
+    _In_ INT BufferLength,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _In_ INT Flags,
+    _In_opt_ VOID* Context
+    )
+{
+    NTSTATUS Status;
+    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
+    FNSOCK_ASYNC_OPERATION* Operation;
+    KIRQL PrevIrql;
+
+    UNREFERENCED_PARAMETER(BufferIsNonPagedPool);
+
+    Status = AllocateAsyncOperation(Binding, FnSockOperationRecv, Context, &Operation);
+    if (!NT_SUCCESS(Status)) {
+        FnSockSocketLastError = Status;
+        return Status;
+    }
+
+    Operation->Buffer = Buffer;
+    Operation->BufferLength = BufferLength;
+    Operation->Flags = Flags;
+
+    KeAcquireSpinLock(&Binding->RecvDataLock, &PrevIrql);
+    InsertTailList(&Binding->AsyncRecvList, &Operation->Link);
+    SignalRecvReadyLocked(Binding);
+    KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
+
+    return STATUS_SUCCESS;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockAcceptAsync(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_opt_ VOID* Context
+    )
+{
+    NTSTATUS Status;
+    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
+    FNSOCK_ASYNC_OPERATION* Operation;
+    KIRQL PrevIrql;
+
+    Status = AllocateAsyncOperation(Binding, FnSockOperationAccept, Context, &Operation);
+    if (!NT_SUCCESS(Status)) {
+        FnSockSocketLastError = Status;
+        return Status;
+    }
+
+    KeAcquireSpinLock(&Binding->AcceptLock, &PrevIrql);
+    InsertTailList(&Binding->AsyncAcceptList, &Operation->Link);
+    SignalAcceptReadyLocked(Binding);
+    KeReleaseSpinLock(&Binding->AcceptLock, PrevIrql);
+
+    return STATUS_SUCCESS;
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+ConnectAsyncComplete(
+    _In_opt_ PVOID Context,
+    _In_ NTSTATUS Status,
+    _In_ ULONG_PTR Information
+    )
+{
+    FNSOCK_ASYNC_OPERATION* Operation = (FNSOCK_ASYNC_OPERATION*)Context;
+    FNSOCK_COMPLETION_QUEUE_OBJECT* QueueObject;
+    KIRQL PrevIrql;
+
+    UNREFERENCED_PARAMETER(Information);
+
+    NT_ASSERT(Operation != NULL);
+    QueueObject = Operation->Binding->CompletionQueue;
+
+    Operation->Status = Status;
+
+    KeAcquireSpinLock(&QueueObject->Lock, &PrevIrql);
+    InsertTailList(&QueueObject->ConnectList, &Operation->Link);
+    KeSetEvent(&QueueObject->ReadyEvent, EVENT_INCREMENT, FALSE);
+    KeReleaseSpinLock(&QueueObject->Lock, PrevIrql);
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockConnectAsync(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_reads_bytes_(AddressLength) const struct sockaddr* Address,
+    _In_ INT AddressLength,
+    _In_opt_ VOID* Context
+    )
+{
+    NTSTATUS Status;
+    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket;
+    FNSOCK_ASYNC_OPERATION* Operation = NULL;
+    VOID* ConnectCompletion;
+
+    Status = ValidateAddress(Binding, Address, AddressLength);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status = AllocateAsyncOperation(Binding, FnSockOperationConnect, Context, &Operation);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    //
+    // Bind to wildcard address if not bound already.
+    //
+    if (!Binding->IsBound) {
+        SOCKADDR_INET WildcardAddress = {0};
+        WildcardAddress.si_family = Binding->AddressFamily;
+
+        Status =
+            FnSockBind(
+                Socket,
+                (struct sockaddr*)&WildcardAddress,
+                sizeof(WildcardAddress));
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    Status =
+        WskConnectExAsync(
+            Binding->Socket,
+            Binding->SockType,
+            (PSOCKADDR)Address,
+            NULL,
+            0,
+            FALSE,
+            &ConnectCompletion);
+    if (!NT_SUCCESS(Status)) {
+        TraceError(
+            "[data][%p] ERROR, %u, %s.",
+            Binding,
+            Status,
+            "WskConnectExAsync");
+        goto Exit;
+    }
+
+    WskSetCompletionCallback(
+        ConnectCompletion, WSKCLIENT_INFINITE, ConnectAsyncComplete, Operation);
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        FnSockSocketLastError = Status;
+
+        if (Operation != NULL) {
+            ExFreePoolWithTag(Operation, POOLTAG_FNSOCK_ASYNC);
+        }
+    }
+
+    return Status;
+}
+
+static
+_IRQL_requires_max_(APC_LEVEL)
+BOOLEAN
+CompleteAsyncRecv(
+    _In_ FNSOCK_SOCKET_BINDING* Binding,
+    _Out_ FNSOCK_COMPLETION* Completion
+    )
+{
+    FNSOCK_ASYNC_OPERATION* Operation = NULL;
+    FNSOCK_SOCKET_RECV_DATA* RecvData = NULL;
+    INT BytesReceived = 0;
+    NTSTATUS Status;
+    KIRQL PrevIrql;
+
+    KeAcquireSpinLock(&Binding->RecvDataLock, &PrevIrql);
+    if (!IsListEmpty(&Binding->AsyncRecvList) &&
+        (!IsListEmpty(&Binding->RecvDataList) || Binding->RecvShutdown)) {
+        Operation =
+            CONTAINING_RECORD(
+                RemoveHeadList(&Binding->AsyncRecvList), FNSOCK_ASYNC_OPERATION, Link);
+        if (Binding->SockType == WSK_FLAG_DATAGRAM_SOCKET) {
+            RecvData = RemoveRecvDataLocked(Binding);
+        }
+    }
+    KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
+
+    if (Operation == NULL) {
+        return FALSE;
+    }
+
+    if (RecvData != NULL) {
+        INT ControlBufferLength = 0;
+        INT Flags;
+
+        Status =
+            CompleteRecvData(
+                Binding, RecvData, Operation->Buffer, Operation->BufferLength, NULL,
+                &ControlBufferLength, &Flags, &BytesReceived);
+    } else {
+        ULONG StreamBytesReceived;
+
+        //
+        // Like overlapped WinSock receives, complete with whatever stream
+        // data is available rather than waiting for the whole buffer.
+        //
+        Status =
+            ReceiveStreamData(
+                Binding, Operation->Buffer, (ULONG)Operation->BufferLength,
+                Operation->Flags & ~MSG_WAITALL, 0, &StreamBytesReceived);
+        if (Status == STATUS_IO_TIMEOUT) {
+            //
+            // A synchronous receive consumed the data first, so pend the
+            // operation again.
+            //
+            KeAcquireSpinLock(&Binding->RecvDataLock, &PrevIrql);
+            InsertHeadList(&Binding->AsyncRecvList, &Operation->Link);
+            KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
+            return FALSE;
+        }
+        BytesReceived = (INT)StreamBytesReceived;
+    }
+
+    CompleteAsyncOperation(Operation, Status, BytesReceived, NULL, Completion);
+
+    return TRUE;
+}
+
+static
+_IRQL_requires_max_(APC_LEVEL)
+BOOLEAN
+CompleteAsyncAccept(
+    _In_ FNSOCK_SOCKET_BINDING* Binding,
+    _Out_ FNSOCK_COMPLETION* Completion
+    )
+{
+    FNSOCK_ASYNC_OPERATION* Operation = NULL;
+    FNSOCK_SOCKET_ACCEPT_CONTEXT* AcceptContext = NULL;
+    FNSOCK_SOCKET_BINDING* NewBinding;
+    NTSTATUS Status;
+    KIRQL PrevIrql;
+
+    KeAcquireSpinLock(&Binding->AcceptLock, &PrevIrql);
+    if (!IsListEmpty(&Binding->AsyncAcceptList) && !IsListEmpty(&Binding->AcceptList)) {
+        Operation =
+            CONTAINING_RECORD(
+                RemoveHeadList(&Binding->AsyncAcceptList), FNSOCK_ASYNC_OPERATION, Link);
+        AcceptContext =
+            CONTAINING_RECORD(
+                RemoveHeadList(&Binding->AcceptList), FNSOCK_SOCKET_ACCEPT_CONTEXT, Link);
+    }
+    KeReleaseSpinLock(&Binding->AcceptLock, PrevIrql);
+
+    if (Operation == NULL) {
+        return FALSE;
+    }
+
+    Status = CompleteAccept(AcceptContext, &NewBinding);
+
+    CompleteAsyncOperation(Operation, Status, 0, NewBinding, Completion);
+
+    return TRUE;
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+CompleteReadyBindings(
+    _In_ FNSOCK_COMPLETION_QUEUE_OBJECT* QueueObject,
+    _Out_writes_to_(MaxCount, return) FNSOCK_COMPLETION* Completions,
+    _In_ INT MaxCount
+    )
+{
+    INT Count = 0;
+
+    ExAcquireFastMutex(&QueueObject->ProcessLock);
+
+    while (Count < MaxCount) {
+        FNSOCK_SOCKET_BINDING* Binding;
+        KIRQL PrevIrql;
+
+        KeAcquireSpinLock(&QueueObject->Lock, &PrevIrql);
+        if (IsListEmpty(&QueueObject->ReadyBindingList)) {
+            KeReleaseSpinLock(&QueueObject->Lock, PrevIrql);
+            break;
+        }
+        Binding =
+            CONTAINING_RECORD(
+                RemoveHeadList(&QueueObject->ReadyBindingList), FNSOCK_SOCKET_BINDING,
+                ReadyLink);
+        Binding->IsReadyQueued = FALSE;
+        KeReleaseSpinLock(&QueueObject->Lock, PrevIrql);
+
+        while (Count < MaxCount && CompleteAsyncRecv(Binding, &Completions[Count])) {
+            Count++;
+        }
+
+        while (Count < MaxCount && CompleteAsyncAccept(Binding, &Completions[Count])) {
+            Count++;
+        }
+
+        //
+        // Queue the binding again if it is still ready, either because the
+        // completion array filled up or because more data or connections
+        // arrived meanwhile.
+        //
+        KeAcquireSpinLock(&Binding->RecvDataLock, &PrevIrql);
+        SignalRecvReadyLocked(Binding);
+        KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
+
+        KeAcquireSpinLock(&Binding->AcceptLock, &PrevIrql);
+        SignalAcceptReadyLocked(Binding);
+        KeReleaseSpinLock(&Binding->AcceptLock, PrevIrql);
+    }
+
+    ExReleaseFastMutex(&QueueObject->ProcessLock);
+
+    return Count;
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+CompleteAsyncConnects(
+    _In_ FNSOCK_COMPLETION_QUEUE_OBJECT* QueueObject,
+    _Out_writes_to_(MaxCount, return) FNSOCK_COMPLETION* Completions,
+    _In_ INT MaxCount
+    )
+{
+    INT Count = 0;
+
+    ExAcquireFastMutex(&QueueObject->ProcessLock);
+
+    while (Count < MaxCount) {
+        FNSOCK_ASYNC_OPERATION* Operation;
+        FNSOCK_SOCKET_BINDING* Binding;
+        NTSTATUS Status;
+        KIRQL PrevIrql;
+
+        KeAcquireSpinLock(&QueueObject->Lock, &PrevIrql);
+        if (IsListEmpty(&QueueObject->ConnectList)) {
+            KeReleaseSpinLock(&QueueObject->Lock, PrevIrql);
+            break;
+        }
+        Operation =
+            CONTAINING_RECORD(
+                RemoveHeadList(&QueueObject->ConnectList), FNSOCK_ASYNC_OPERATION, Link);
+        KeReleaseSpinLock(&QueueObject->Lock, PrevIrql);
+
+        Binding = Operation->Binding;
+        Status = Operation->Status;
+
+        if (NT_SUCCESS(Status)) {
+            Status = StartStreamReceives(Binding);
+        }
+
+        CompleteAsyncOperation(Operation, Status, 0, NULL, &Completions[Count++]);
+    }
+
+    ExReleaseFastMutex(&QueueObject->ProcessLock);
+
+    return Count;
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+INT
+CompleteFinishedOperations(
+    _In_ FNSOCK_COMPLETION_QUEUE_OBJECT* QueueObject,
+    _Out_writes_to_(MaxCount, return) FNSOCK_COMPLETION* Completions,
+    _In_ INT MaxCount
+    )
+{
+    INT Count = 0;
+    KIRQL PrevIrql;
+
+    KeAcquireSpinLock(&QueueObject->Lock, &PrevIrql);
+    while (Count < MaxCount && !IsListEmpty(&QueueObject->CompletedList)) {
+        FNSOCK_ASYNC_OPERATION* Operation =
+            CONTAINING_RECORD(
+                RemoveHeadList(&QueueObject->CompletedList), FNSOCK_ASYNC_OPERATION, Link);
+
+        CompleteAsyncOperation(
+            Operation, Operation->Status, Operation->BytesTransferred, NULL,
+            &Completions[Count++]);
+    }
+    KeReleaseSpinLock(&QueueObject->Lock, PrevIrql);
+
+    return Count;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockGetCompletions(
+    _In_ FNSOCK_COMPLETION_QUEUE Queue,
+    _Out_writes_to_(MaxCount, return) FNSOCK_COMPLETION* Completions,
+    _In_ INT MaxCount,
+    _In_ UINT32 TimeoutMs
+    )
+{
+    FNSOCK_COMPLETION_QUEUE_OBJECT* QueueObject = (FNSOCK_COMPLETION_QUEUE_OBJECT*)Queue;
+    UINT64 Deadline = 0;
+    INT Count = 0;
+
+    if (MaxCount <= 0) {
+        return 0;
+    }
+
+    if (TimeoutMs != FNSOCK_INFINITE) {
+        Deadline = KeQueryInterruptTime() + UInt32x32To64(TimeoutMs, 10000);
+    }
+
+    for (;;) {
+        LARGE_INTEGER Timeout;
+        LARGE_INTEGER* TimeoutPtr = NULL;
+        NTSTATUS Status;
+        KIRQL PrevIrql;
+
+        Count += CompleteFinishedOperations(QueueObject, Completions + Count, MaxCount - Count);
+        Count += CompleteReadyBindings(QueueObject, Completions + Count, MaxCount - Count);
+        Count += CompleteAsyncConnects(QueueObject, Completions + Count, MaxCount - Count);
+        if (Count > 0) {
+            break;
+        }
+
+        KeAcquireSpinLock(&QueueObject->Lock, &PrevIrql);
+        if (IsListEmpty(&QueueObject->ReadyBindingList) &&
+            IsListEmpty(&QueueObject->CompletedList) &&
+            IsListEmpty(&QueueObject->ConnectList)) {
+            KeClearEvent(&QueueObject->ReadyEvent);
+        }
+        KeReleaseSpinLock(&QueueObject->Lock, PrevIrql);
+
+        if (TimeoutMs != FNSOCK_INFINITE) {
+            UINT64 Now = KeQueryInterruptTime();
+
+            if (Now >= Deadline) {
+                break;
+            }
+
+            Timeout.QuadPart = -(INT64)(Deadline - Now);
+            TimeoutPtr = &Timeout;
+        }
+
+        Status =
+            KeWaitForSingleObject(
+                &QueueObject->ReadyEvent, Executive, KernelMode, FALSE, TimeoutPtr);
+        if (!NT_SUCCESS(Status)) {
+            TraceError(
+                "[data][%p] ERROR, %u, %s.",
+                QueueObject,
+                Status,
+                "KeWaitForSingleObject");
+            FnSockSocketLastError = Status;
+            return -1;
+        }
+    }
+
+    return Count;
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+SHORT
+GetPollEvents(
+    _In_ FNSOCK_SOCKET_BINDING* Binding
+    )
+{
+    SHORT Events = 0;
+    KIRQL PrevIrql;
+
+    KeAcquireSpinLock(&Binding->RecvDataLock, &PrevIrql);
+    if (!IsListEmpty(&Binding->RecvDataList)) {
+        Events |= POLLRDNORM;
+    }
+    if (Binding->RecvShutdown) {
+        Events |= POLLHUP;
+    }
+    KeReleaseSpinLock(&Binding->RecvDataLock, PrevIrql);
+
+    if (Binding->IsListening) {
+        KeAcquireSpinLock(&Binding->AcceptLock, &PrevIrql);
+        if (!IsListEmpty(&Binding->AcceptList)) {
+            Events |= POLLRDNORM;
+        }
+        KeReleaseSpinLock(&Binding->AcceptLock, PrevIrql);
+    } else {
+        //
+        // A send does not block as long as the window of sends in flight has
+        // room. Send completions signal poll waiters as the window opens up.
+        //
+        if (ReadULongNoFence((ULONG*)&Binding->OutstandingSendCount) <
+                FNSOCK_MAX_OUTSTANDING_SENDS) {
+            Events |= POLLWRNORM;
+        }
+    }
+
+    return Events;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockPoll(
+    _Inout_updates_(FdCount) FNSOCK_POLL_FD* Fds,
+    _In_ UINT32 FdCount,
+    _In_ INT TimeoutMs
+    )
+{
+    NTSTATUS Status;
+    FNSOCK_POLL_REGISTRATION* Registrations = NULL;
+    UINT64 Deadline = 0;
+    INT ReadyCount = 0;
+    KEVENT Event;
+
+    //
+    // Like WSAPoll, fail rather than wait forever for no sockets.
+    //
+    if (FdCount == 0 && TimeoutMs < 0) {
+        TraceError(
+            "[data] ERROR, %s.",
+            "Indefinite poll without sockets");
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    for (UINT32 Index = 0; Index < FdCount; Index++) {
+        if (Fds[Index].Socket == NULL) {
+            TraceError(
+                "[data] ERROR, %u, %s.",
+                Index,
+                "Null poll socket");
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+    }
+
+    if (FdCount > 0) {
+        Registrations =
+#pragma warning( suppress : 4996 )
+            (FNSOCK_POLL_REGISTRATION*)ExAllocatePoolWithTag(
+                NonPagedPoolNx, sizeof(*Registrations) * FdCount, POOLTAG_FNSOCK_POLL);
+        if (Registrations == NULL) {
+            TraceError(
+                "[data] ERROR, %s.",
+                "Could not allocate memory for poll");
+            Status = STATUS_NO_MEMORY;
+            goto Exit;
+        }
+    }
+
+    if (TimeoutMs >= 0) {
+        Deadline = KeQueryInterruptTime() + UInt32x32To64(TimeoutMs, 10000);
+    }
+
+    //
+    // Register one shared event with every socket, so that a single wait
+    // covers all of them.
+    //
+    KeInitializeEvent(&Event, NotificationEvent, FALSE);
+
+    for (UINT32 Index = 0; Index < FdCount; Index++) {
+        FNSOCK_POLL_REGISTRATION* Registration = &Registrations[Index];
+        KIRQL PrevIrql;
+
+        Registration->Binding = (FNSOCK_SOCKET_BINDING*)Fds[Index].Socket;
+        Registration->Event = &Event;
+
+        KeAcquireSpinLock(&Registration->Binding->PollLock, &PrevIrql);
+        InsertTailList(&Registration->Binding->PollWaiterList, &Registration->Link);
+        KeReleaseSpinLock(&Registration->Binding->PollLock, PrevIrql);
+    }
+
+    Status = STATUS_SUCCESS;
+
+    for (;;) {
+        LARGE_INTEGER Timeout;
+        LARGE_INTEGER* TimeoutPtr = NULL;
+
+        //
+        // Clear the event before checking readiness, so that readiness
+        // changes after the check are not missed.
+        //
+        KeClearEvent(&Event);
+
+        for (UINT32 Index = 0; Index < FdCount; Index++) {
+            FNSOCK_POLL_FD* Fd = &Fds[Index];
+            SHORT Events;
+
+            Events = GetPollEvents(Registrations[Index].Binding);
+            Fd->ReturnedEvents = Events & (Fd->Events | POLLHUP | POLLERR);
+            if (Fd->ReturnedEvents != 0) {
+                ReadyCount++;
+            }
+        }
+
+        if (ReadyCount > 0) {
+            break;
+        }
+
+        if (TimeoutMs >= 0) {
+            UINT64 Now = KeQueryInterruptTime();
+
+            if (Now >= Deadline) {
+                break;
+            }
+
+            Timeout.QuadPart = -(INT64)(Deadline - Now);
+            TimeoutPtr = &Timeout;
+        }
+
+        Status = KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, TimeoutPtr);
+        if (!NT_SUCCESS(Status)) {
+            TraceError(
+                "[data] ERROR, %u, %s.",
+                Status,
+                "KeWaitForSingleObject");
+            break;
+        }
+    }
+
+    for (UINT32 Index = 0; Index < FdCount; Index++) {
+        FNSOCK_POLL_REGISTRATION* Registration = &Registrations[Index];
+        KIRQL PrevIrql;
+
+        KeAcquireSpinLock(&Registration->Binding->PollLock, &PrevIrql);
+        RemoveEntryList(&Registration->Link);
+        KeReleaseSpinLock(&Registration->Binding->PollLock, PrevIrql);
+    }
+
+Exit:
+
+    if (Registrations != NULL) {
+        ExFreePoolWithTag(Registrations, POOLTAG_FNSOCK_POLL);
+    }
 
-    case STATUS_HOST_UNREACHABLE:
-        err = WSAEHOSTUNREACH;
-        break;
+    if (!NT_SUCCESS(Status)) {
+        FnSockSocketLastError = Status;
+        ReadyCount = -1;
+    }
 
-    case STATUS_HOST_DOWN:
-        err = WSAEHOSTDOWN;
-        break;
+    return ReadyCount;
+}
 
-    case STATUS_CANCELLED:
-    case STATUS_REQUEST_ABORTED:
-        err = WSAEINTR;
-        break;
+//
+// Kernel mode has no registered I/O. A registered I/O socket is a regular
+// socket whose sends copy through a region of send buffers registered with
+// WSK once, so that each send skips building and locking an MDL. Receives use
+// the regular batch path.
+//
+typedef struct FNSOCK_RIO_SOCKET FNSOCK_RIO_SOCKET;
 
-    case STATUS_BUFFER_OVERFLOW:
-    case STATUS_INVALID_BUFFER_SIZE:
-        err = WSAEMSGSIZE;
-        break;
+typedef struct FNSOCK_RIO_SEND_BUFFER {
+    FNSOCK_RIO_SOCKET* Socket;
+    UINT32 Index;
+} FNSOCK_RIO_SEND_BUFFER;
 
-    case STATUS_BUFFER_TOO_SMALL:
-    case STATUS_ACCESS_VIOLATION:
-    case STATUS_DATATYPE_MISALIGNMENT_ERROR:
-        err = WSAEFAULT;
-        break;
+//
+// The region is laid out as the send buffers followed by one remote address
+// per send buffer, which must remain valid until the send completes.
+//
+typedef struct FNSOCK_RIO_SOCKET {
+    FNSOCK_HANDLE Socket;
+    CHAR* Region;
+    VOID* RegisteredRegion;
+    UINT32 BufferSize;
+    UINT32 SendBufferCount;
+    FNSOCK_RIO_SEND_BUFFER* SendBuffers;
 
-    case STATUS_DEVICE_NOT_READY:
-    case STATUS_REQUEST_NOT_ACCEPTED:
-        err = WSAEWOULDBLOCK;
-        break;
+    //
+    // SendBufferEvent is set whenever a send completes and returns its buffer
+    // to the free list. Protected by Lock.
+    //
+    KSPIN_LOCK Lock;
+    KEVENT SendBufferEvent;
+    UINT32 FreeSendBufferCount;
+    UINT32* FreeSendBuffers;
+} FNSOCK_RIO_SOCKET;
 
-    case STATUS_INVALID_NETWORK_RESPONSE:
-    case STATUS_NETWORK_BUSY:
-    case STATUS_NO_SUCH_DEVICE:
-    case STATUS_NO_SUCH_FILE:
-    case STATUS_OBJECT_PATH_NOT_FOUND:
-    case STATUS_OBJECT_NAME_NOT_FOUND:
-    case STATUS_UNEXPECTED_NETWORK_ERROR:
-        err = WSAENETDOWN;
-        break;
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+CleanupRioSocket(
+    _In_ FNSOCK_RIO_SOCKET* Socket
+    )
+{
+    KIRQL PrevIrql;
 
-    case STATUS_INVALID_CONNECTION:
-        err = WSAENOTCONN;
-        break;
+    //
+    // Wait for the outstanding sends to return their buffers before closing
+    // the socket and releasing the region.
+    //
+    for (;;) {
+        KeAcquireSpinLock(&Socket->Lock, &PrevIrql);
+        if (Socket->FreeSendBufferCount == Socket->SendBufferCount) {
+            KeReleaseSpinLock(&Socket->Lock, PrevIrql);
+            break;
+        }
+        KeClearEvent(&Socket->SendBufferEvent);
+        KeReleaseSpinLock(&Socket->Lock, PrevIrql);
 
-    case STATUS_REMOTE_NOT_LISTENING:
-    case STATUS_CONNECTION_REFUSED:
-        err = WSAECONNREFUSED;
-        break;
+        KeWaitForSingleObject(&Socket->SendBufferEvent, Executive, KernelMode, FALSE, NULL);
+    }
 
-    case STATUS_PIPE_DISCONNECTED:
-        err = WSAESHUTDOWN;
-        break;
+    if (Socket->Socket != NULL) {
+        FnSockClose(Socket->Socket);
+    }
 
-    case STATUS_INVALID_ADDRESS:
-    case STATUS_INVALID_ADDRESS_COMPONENT:
-        err = WSAEADDRNOTAVAIL;
-        break;
+    if (Socket->RegisteredRegion != NULL) {
+        WskDeregisterBuffer(Socket->RegisteredRegion);
+    }
 
-    case STATUS_NOT_SUPPORTED:
-    case STATUS_NOT_IMPLEMENTED:
-        err = WSAEOPNOTSUPP;
-        break;
+    if (Socket->Region != NULL) {
+        ExFreePoolWithTag(Socket->Region, POOLTAG_FNSOCK_SEND);
+    }
 
-    case STATUS_ACCESS_DENIED:
-        err = WSAEACCES;
-        break;
+    if (Socket->SendBuffers != NULL) {
+        ExFreePoolWithTag(Socket->SendBuffers, POOLTAG_FNSOCK_SEND);
+    }
 
-    case STATUS_CONNECTION_ACTIVE:
-        err = WSAEISCONN;
-        break;
+    if (Socket->FreeSendBuffers != NULL) {
+        ExFreePoolWithTag(Socket->FreeSendBuffers, POOLTAG_FNSOCK_SEND);
+    }
 
-    case STATUS_PROTOCOL_NOT_SUPPORTED:
-        return WSAEAFNOSUPPORT;
+    ExFreePoolWithTag(Socket, POOLTAG_FNSOCK_SOCKET);
+}
 
-    case STATUS_SUCCESS:
-        return NO_ERROR;
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+ReleaseRioSendBuffer(
+    _In_ FNSOCK_RIO_SOCKET* Socket,
+    _In_ UINT32 BufferIndex
+    )
+{
+    KIRQL PrevIrql;
 
-    default:
+    //
+    // A closing socket waits for its send buffers to be returned before
+    // freeing itself, so it must not be touched once the lock is released.
+    //
+    KeAcquireSpinLock(&Socket->Lock, &PrevIrql);
+    Socket->FreeSendBuffers[Socket->FreeSendBufferCount++] = BufferIndex;
+    KeSetEvent(&Socket->SendBufferEvent, EVENT_INCREMENT, FALSE);
+    KeReleaseSpinLock(&Socket->Lock, PrevIrql);
+}
 
-        if (NT_SUCCESS(Status)) {
-            NT_ASSERT(FALSE);
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+RioSendComplete(
+    _In_opt_ PVOID Context,
+    _In_ NTSTATUS Status,
+    _In_ ULONG_PTR Information
+    )
+{
+    FNSOCK_RIO_SEND_BUFFER* SendBuffer = (FNSOCK_RIO_SEND_BUFFER*)Context;
 
-            err = NO_ERROR;
+    UNREFERENCED_PARAMETER(Information);
+
+    NT_ASSERT(SendBuffer != NULL);
+
+    if (!NT_SUCCESS(Status)) {
+        TraceError(
+            "[data][%p] ERROR, %u, %s.",
+            SendBuffer->Socket,
+            Status,
+            "Registered send");
+    }
+
+    ReleaseRioSendBuffer(SendBuffer->Socket, SendBuffer->Index);
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+UINT32
+AcquireRioSendBuffer(
+    _In_ FNSOCK_RIO_SOCKET* Socket
+    )
+{
+    UINT32 BufferIndex;
+    KIRQL PrevIrql;
+
+    //
+    // Wait for a send to complete if all the send buffers are in use.
+    //
+    for (;;) {
+        KeAcquireSpinLock(&Socket->Lock, &PrevIrql);
+        if (Socket->FreeSendBufferCount > 0) {
+            BufferIndex = Socket->FreeSendBuffers[--Socket->FreeSendBufferCount];
+            KeReleaseSpinLock(&Socket->Lock, PrevIrql);
+            return BufferIndex;
+        }
+        KeClearEvent(&Socket->SendBufferEvent);
+        KeReleaseSpinLock(&Socket->Lock, PrevIrql);
+
+        KeWaitForSingleObject(&Socket->SendBufferEvent, Executive, KernelMode, FALSE, NULL);
+    }
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockRioCreate(
+    _In_ INT AddressFamily,
+    _In_ INT SocketType,
+    _In_ INT Protocol,
+    _In_ const FNSOCK_RIO_CONFIG* Config,
+    _Out_ FNSOCK_RIO_HANDLE* Handle
+    )
+{
+    FNSOCK_RIO_SOCKET* Socket = NULL;
+    UINT64 DataSize;
+    UINT64 RegionSize;
+    NTSTATUS Status;
+
+    *Handle = NULL;
+
+    DataSize = (UINT64)Config->SendBufferCount * Config->BufferSize;
+    RegionSize = DataSize + (UINT64)Config->SendBufferCount * sizeof(SOCKADDR_INET);
+
+    if (Config->BufferSize == 0 || Config->SendBufferCount == 0 ||
+        Config->RecvBufferCount == 0 || RegionSize > MAXULONG) {
+        TraceError(
+            "[data] ERROR, %s.",
+            "Invalid registered I/O config");
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Socket =
+#pragma warning( suppress : 4996 )
+        (FNSOCK_RIO_SOCKET*)ExAllocatePoolWithTag(
+            NonPagedPoolNx, sizeof(*Socket), POOLTAG_FNSOCK_SOCKET);
+    if (Socket == NULL) {
+        TraceError(
+            "[data] ERROR, %s.",
+            "Could not allocate memory for registered I/O socket");
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    RtlZeroMemory(Socket, sizeof(*Socket));
+    KeInitializeSpinLock(&Socket->Lock);
+    KeInitializeEvent(&Socket->SendBufferEvent, NotificationEvent, FALSE);
+    Socket->BufferSize = Config->BufferSize;
+
+    Socket->Region =
+#pragma warning( suppress : 4996 )
+        (CHAR*)ExAllocatePoolWithTag(NonPagedPoolNx, (SIZE_T)RegionSize, POOLTAG_FNSOCK_SEND);
+    Socket->SendBuffers =
+#pragma warning( suppress : 4996 )
+        (FNSOCK_RIO_SEND_BUFFER*)ExAllocatePoolWithTag(
+            NonPagedPoolNx, sizeof(*Socket->SendBuffers) * Config->SendBufferCount,
+            POOLTAG_FNSOCK_SEND);
+    Socket->FreeSendBuffers =
+#pragma warning( suppress : 4996 )
+        (UINT32*)ExAllocatePoolWithTag(
+            NonPagedPoolNx, sizeof(*Socket->FreeSendBuffers) * Config->SendBufferCount,
+            POOLTAG_FNSOCK_SEND);
+    if (Socket->Region == NULL || Socket->SendBuffers == NULL ||
+        Socket->FreeSendBuffers == NULL) {
+        TraceError(
+            "[data] ERROR, %s.",
+            "Could not allocate memory for registered I/O send buffers");
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    for (UINT32 Index = 0; Index < Config->SendBufferCount; Index++) {
+        Socket->SendBuffers[Index].Socket = Socket;
+        Socket->SendBuffers[Index].Index = Index;
+        Socket->FreeSendBuffers[Index] = Index;
+    }
+    Socket->SendBufferCount = Config->SendBufferCount;
+    Socket->FreeSendBufferCount = Config->SendBufferCount;
+
+    Status = WskRegisterBuffer(Socket->Region, (ULONG)DataSize, TRUE, &Socket->RegisteredRegion);
+    if (!NT_SUCCESS(Status)) {
+        TraceError(
+            "[data] ERROR, %u, %s.",
+            Status,
+            "WskRegisterBuffer");
+        Socket->RegisteredRegion = NULL;
+        goto Exit;
+    }
+
+    Status = FnSockCreate(AddressFamily, SocketType, Protocol, &Socket->Socket);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    *Handle = (FNSOCK_RIO_HANDLE)Socket;
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        if (Socket != NULL) {
+            CleanupRioSocket(Socket);
+        }
+    }
+
+    return Status;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+FnSockRioClose(
+    _In_ FNSOCK_RIO_HANDLE Handle
+    )
+{
+    CleanupRioSocket((FNSOCK_RIO_SOCKET*)Handle);
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_HANDLE
+FnSockRioGetSocket(
+    _In_ FNSOCK_RIO_HANDLE Handle
+    )
+{
+    return ((FNSOCK_RIO_SOCKET*)Handle)->Socket;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockRioBind(
+    _In_ FNSOCK_RIO_HANDLE Handle,
+    _In_reads_bytes_(AddressLength) const struct sockaddr* Address,
+    _In_ INT AddressLength
+    )
+{
+    return FnSockBind(((FNSOCK_RIO_SOCKET*)Handle)->Socket, Address, AddressLength);
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockRioSendBatch(
+    _In_ FNSOCK_RIO_HANDLE Handle,
+    _Inout_updates_(MessageCount) FNSOCK_MSG* Messages,
+    _In_ INT MessageCount
+    )
+{
+    FNSOCK_RIO_SOCKET* Socket = (FNSOCK_RIO_SOCKET*)Handle;
+    FNSOCK_SOCKET_BINDING* Binding = (FNSOCK_SOCKET_BINDING*)Socket->Socket;
+    SOCKADDR_INET* RemoteAddresses =
+        (SOCKADDR_INET*)(Socket->Region + (SIZE_T)Socket->SendBufferCount * Socket->BufferSize);
+    NTSTATUS Status = STATUS_SUCCESS;
+    INT Index = 0;
+
+    for (; Index < MessageCount; Index++) {
+        FNSOCK_MSG* Message = &Messages[Index];
+        VOID* SendCompletion;
+        UINT32 BufferIndex;
+
+        if (Message->BufferLength > 0 && (UINT32)Message->BufferLength > Socket->BufferSize) {
+            Status = STATUS_INVALID_BUFFER_SIZE;
             break;
         }
 
         //
-        // Fall over to default error code
+        // Registered sends need a payload.
         //
-    case STATUS_UNSUCCESSFUL:
-    case STATUS_INVALID_PARAMETER:
-    case STATUS_ADDRESS_CLOSED:
-    case STATUS_CONNECTION_INVALID:
-    case STATUS_ADDRESS_ALREADY_ASSOCIATED:
-    case STATUS_ADDRESS_NOT_ASSOCIATED:
-    case STATUS_INVALID_DEVICE_STATE:
-    case STATUS_INVALID_DEVICE_REQUEST:
-        err = WSAEINVAL;
-        break;
+        if (Message->BufferLength <= 0 || Message->AddressLength < 0 ||
+            Message->AddressLength > (INT)sizeof(*RemoteAddresses) ||
+            Message->ControlBufferLength != 0) {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        BufferIndex = AcquireRioSendBuffer(Socket);
+
+        RtlCopyMemory(
+            Socket->Region + (SIZE_T)BufferIndex * Socket->BufferSize, Message->Buffer,
+            Message->BufferLength);
+
+        if (Message->Address != NULL) {
+            RtlZeroMemory(&RemoteAddresses[BufferIndex], sizeof(RemoteAddresses[BufferIndex]));
+            RtlCopyMemory(
+                &RemoteAddresses[BufferIndex], Message->Address, Message->AddressLength);
+
+            Status =
+                WskSendToRegisteredAsync(
+                    Binding->Socket, Socket->RegisteredRegion, BufferIndex * Socket->BufferSize,
+                    Message->BufferLength, (PSOCKADDR)&RemoteAddresses[BufferIndex], 0, NULL,
+                    &SendCompletion);
+        } else {
+            Status =
+                WskSendRegisteredAsync(
+                    Binding->Socket, Binding->SockType, Socket->RegisteredRegion,
+                    BufferIndex * Socket->BufferSize, Message->BufferLength, 0,
+                    &SendCompletion);
+        }
+        if (!NT_SUCCESS(Status)) {
+            TraceError(
+                "[data][%p] ERROR, %u, %s.",
+                Socket,
+                Status,
+                "Registered send");
+            ReleaseRioSendBuffer(Socket, BufferIndex);
+            break;
+        }
 
+        WskSetCompletionCallback(
+            SendCompletion, WSKCLIENT_INFINITE, RioSendComplete,
+            &Socket->SendBuffers[BufferIndex]);
+        Message->BytesTransferred = Message->BufferLength;
     }
 
-    return err;
+    if (Index < MessageCount) {
+        Messages[Index].BytesTransferred = -1;
+        FnSockSocketLastError = Status;
+    }
+
+    return (Index > 0 || MessageCount == 0) ? Index : -1;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockRioRecvBatch(
+    _In_ FNSOCK_RIO_HANDLE Handle,
+    _Inout_updates_(MessageCount) FNSOCK_MSG* Messages,
+    _In_ INT MessageCount
+    )
+{
+    return
+        FnSockRecvMsgBatch(
+            ((FNSOCK_RIO_SOCKET*)Handle)->Socket, Messages, MessageCount, FALSE, 0);
 }
 
 FNSOCKAPI
@@ -0,0 +1,56 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+//
+// UDP segmentation control data helpers shared by the kernel and user mode
+// fnsock libraries.
+//
+
+#define FNSOCK_SEGMENT_SIZE_CONTROL_LENGTH WSA_CMSG_SPACE(sizeof(UINT32))
+
+inline
+VOID
+FnSockFormatSegmentSize(
+    _Out_writes_bytes_(FNSOCK_SEGMENT_SIZE_CONTROL_LENGTH) CMSGHDR* Cmsg,
+    _In_ UINT32 SegmentSize
+    )
+{
+    RtlZeroMemory(Cmsg, FNSOCK_SEGMENT_SIZE_CONTROL_LENGTH);
+    Cmsg->cmsg_len = WSA_CMSG_LEN(sizeof(UINT32));
+    Cmsg->cmsg_level = IPPROTO_UDP;
+    Cmsg->cmsg_type = UDP_SEND_MSG_SIZE;
+    *(UINT32*)WSA_CMSG_DATA(Cmsg) = SegmentSize;
+}
+
+inline
+BOOLEAN
+FnSockParseCoalescedInfo(
+    _In_reads_bytes_(ControlBufferLength) const CMSGHDR* ControlBuffer,
+    _In_ INT ControlBufferLength,
+    _Out_ UINT32* SegmentSize
+    )
+{
+    WSAMSG Msg = {0};
+
+    *SegmentSize = 0;
+
+    Msg.Control.buf = (CHAR*)ControlBuffer;
+    Msg.Control.len = ControlBufferLength;
+
+    for (CMSGHDR* Cmsg = WSA_CMSG_FIRSTHDR(&Msg);
+            Cmsg != NULL;
+            Cmsg = WSA_CMSG_NXTHDR(&Msg, Cmsg)) {
+        if (Cmsg->cmsg_level == IPPROTO_UDP &&
+            Cmsg->cmsg_type == UDP_COALESCED_INFO &&
+            Cmsg->cmsg_len >= WSA_CMSG_LEN(sizeof(UINT32))) {
+            *SegmentSize = *(UINT32*)WSA_CMSG_DATA(Cmsg);
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
@@ -13,6 +13,7 @@
 #define FNSOCKAPI __declspec(dllexport)
 
 #include "fnsock.h"
+#include "sockcmsg.h"
 #include "trace.h"
 
 #include "sock.tmh"
@@ -214,6 +215,47 @@ FnSockGetSockOpt(
     HRESULT Status;
     INT Error;
 
+    if (Level == FNSOCK_SOL_FNSOCK && OptionName == FNSOCK_SO_RECV_STATISTICS) {
+        FNSOCK_RECV_STATISTICS *Statistics = (FNSOCK_RECV_STATISTICS *)OptionValue;
+        u_long QueuedBytes;
+
+        if (*OptionLength < sizeof(*Statistics) || OptionValue == NULL) {
+            TraceError(
+                "[ lib] ERROR, %s.",
+                "FNSOCK_SO_RECV_STATISTICS invalid parameter");
+            return E_INVALIDARG;
+        }
+
+        Error = ioctlsocket((SOCKET)Socket, FIONREAD, &QueuedBytes);
+        if (Error == SOCKET_ERROR) {
+            TraceError(
+                "[ lib] ERROR, %u, %s.",
+                WSAGetLastError(),
+                "ioctlsocket");
+            return E_FAIL;
+        }
+
+        ZeroMemory(Statistics, sizeof(*Statistics));
+        Statistics->QueuedBytes = QueuedBytes;
+        *OptionLength = sizeof(*Statistics);
+        return S_OK;
+    }
+
+    if (Level == FNSOCK_SOL_FNSOCK && OptionName == FNSOCK_SO_SEND_STATISTICS) {
+        FNSOCK_SEND_STATISTICS *Statistics = (FNSOCK_SEND_STATISTICS *)OptionValue;
+
+        if (*OptionLength < sizeof(*Statistics) || OptionValue == NULL) {
+            TraceError(
+                "[ lib] ERROR, %s.",
+                "FNSOCK_SO_SEND_STATISTICS invalid parameter");
+            return E_INVALIDARG;
+        }
+
+        ZeroMemory(Statistics, sizeof(*Statistics));
+        *OptionLength = sizeof(*Statistics);
+        return S_OK;
+    }
+
     Error = getsockopt((SOCKET)Socket, Level, OptionName, (CHAR*)OptionValue, (INT*)OptionLength);
     if (Error == SOCKET_ERROR) {
         TraceError(
@@ -521,6 +563,1244 @@ FnSockRecvMsg(
     return BytesReceived;
 }
 
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockSendMsgBatch(
+    _In_ FNSOCK_HANDLE Socket,
+    _Inout_updates_(MessageCount) FNSOCK_MSG* Messages,
+    _In_ INT MessageCount,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _In_ INT Flags
+    )
+{
+    INT Index;
+
+    for (Index = 0; Index < MessageCount; Index++) {
+        FNSOCK_MSG* Message = &Messages[Index];
+
+        Message->BytesTransferred =
+            FnSockSendMsg(
+                Socket, Message->Buffer, Message->BufferLength, BufferIsNonPagedPool, Flags,
+                Message->Address, Message->AddressLength, Message->ControlBuffer,
+                Message->ControlBufferLength);
+        if (Message->BytesTransferred == SOCKET_ERROR) {
+            break;
+        }
+    }
+
+    return (Index > 0 || MessageCount == 0) ? Index : SOCKET_ERROR;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockRecvMsgBatch(
+    _In_ FNSOCK_HANDLE Socket,
+    _Inout_updates_(MessageCount) FNSOCK_MSG* Messages,
+    _In_ INT MessageCount,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _In_ INT Flags
+    )
+{
+    INT Index;
+
+    for (Index = 0; Index < MessageCount; Index++) {
+        FNSOCK_MSG* Message = &Messages[Index];
+
+        //
+        // Only the first receive may block; stop once nothing is queued.
+        //
+        if (Index > 0) {
+            u_long QueuedBytes;
+
+            if (ioctlsocket((SOCKET)Socket, FIONREAD, &QueuedBytes) == SOCKET_ERROR ||
+                QueuedBytes == 0) {
+                break;
+            }
+        }
+
+        Message->Flags = Flags;
+        Message->BytesTransferred =
+            FnSockRecvMsg(
+                Socket, Message->Buffer, Message->BufferLength, BufferIsNonPagedPool,
+                Message->ControlBuffer, &Message->ControlBufferLength, &Message->Flags);
+        if (Message->BytesTransferred == SOCKET_ERROR && WSAGetLastError() != WSAEMSGSIZE) {
+            if (Index == 0) {
+                return SOCKET_ERROR;
+            }
+            break;
+        }
+    }
+
+    return Index;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockSendSegments(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_reads_bytes_(BufferLength) const CHAR* Buffer,
+    _In_ INT BufferLength,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _In_ INT Flags,
+    _In_reads_bytes_(AddressLength) const struct sockaddr* Address,
+    _In_ INT AddressLength,
+    _In_ UINT32 SegmentSize
+    )
+{
+    DECLSPEC_ALIGN(MEMORY_ALLOCATION_ALIGNMENT)
+        CHAR ControlBuffer[FNSOCK_SEGMENT_SIZE_CONTROL_LENGTH];
+
+    FnSockFormatSegmentSize((CMSGHDR*)ControlBuffer, SegmentSize);
+
+    return
+        FnSockSendMsg(
+            Socket, Buffer, BufferLength, BufferIsNonPagedPool, Flags, Address, AddressLength,
+            (CMSGHDR*)ControlBuffer, sizeof(ControlBuffer));
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+BOOLEAN
+FnSockGetCoalescedInfo(
+    _In_reads_bytes_(ControlBufferLength) const CMSGHDR* ControlBuffer,
+    _In_ INT ControlBufferLength,
+    _Out_ UINT32* SegmentSize
+    )
+{
+    return FnSockParseCoalescedInfo(ControlBuffer, ControlBufferLength, SegmentSize);
+}
+
+//
+// AcceptEx requires room for the local and remote addresses, each at least
+// 16 bytes larger than the maximum address length of the transport.
+//
+#define FNSOCK_ACCEPT_ADDRESS_LENGTH (sizeof(SOCKADDR_INET) + 16)
+
+//
+// The maximum number of completions dequeued from the completion port at once.
+//
+#define FNSOCK_MAX_DEQUEUED_COMPLETIONS 64
+
+typedef struct FNSOCK_ASYNC_OPERATION {
+    OVERLAPPED Overlapped;
+    FNSOCK_HANDLE Socket;
+    FNSOCK_OPERATION Operation;
+    VOID* Context;
+    SOCKET AcceptSocket;
+    CHAR AcceptAddresses[2 * FNSOCK_ACCEPT_ADDRESS_LENGTH];
+} FNSOCK_ASYNC_OPERATION;
+
+static
+FNSOCK_ASYNC_OPERATION*
+AllocateAsyncOperation(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_ FNSOCK_OPERATION OperationType,
+    _In_opt_ VOID* Context
+    )
+{
+    FNSOCK_ASYNC_OPERATION* Operation;
+
+    Operation = malloc(sizeof(*Operation));
+    if (Operation == NULL) {
+        TraceError(
+            "[ lib] ERROR, %s.",
+            "Could not allocate memory for async operation");
+        WSASetLastError(WSAENOBUFS);
+        return NULL;
+    }
+
+    RtlZeroMemory(Operation, sizeof(*Operation));
+    Operation->Socket = Socket;
+    Operation->Operation = OperationType;
+    Operation->Context = Context;
+    Operation->AcceptSocket = INVALID_SOCKET;
+
+    return Operation;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockCreateCompletionQueue(
+    _Out_ FNSOCK_COMPLETION_QUEUE* Queue
+    )
+{
+    HANDLE Iocp;
+
+    *Queue = NULL;
+
+    Iocp = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+    if (Iocp == NULL) {
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            GetLastError(),
+            "CreateIoCompletionPort");
+        return E_FAIL;
+    }
+
+    *Queue = (FNSOCK_COMPLETION_QUEUE)Iocp;
+
+    return S_OK;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+FnSockCloseCompletionQueue(
+    _In_ FNSOCK_COMPLETION_QUEUE Queue
+    )
+{
+    CloseHandle((HANDLE)Queue);
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockAssociateCompletionQueue(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_ FNSOCK_COMPLETION_QUEUE Queue
+    )
+{
+    if (CreateIoCompletionPort((HANDLE)Socket, (HANDLE)Queue, 0, 0) != (HANDLE)Queue) {
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            GetLastError(),
+            "CreateIoCompletionPort");
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockSendAsync(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_reads_bytes_(BufferLength) const CHAR* Buffer,
+    _In_ INT BufferLength,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _In_ INT Flags,
+    _In_opt_ VOID* Context
+    )
+{
+    FNSOCK_ASYNC_OPERATION* Operation;
+    WSABUF Buf;
+
+    UNREFERENCED_PARAMETER(BufferIsNonPagedPool);
+
+    Operation = AllocateAsyncOperation(Socket, FnSockOperationSend, Context);
+    if (Operation == NULL) {
+        return E_OUTOFMEMORY;
+    }
+
+    Buf.buf = (CHAR*)Buffer;
+    Buf.len = BufferLength;
+
+    if (WSASend((SOCKET)Socket, &Buf, 1, NULL, Flags, &Operation->Overlapped, NULL) ==
+            SOCKET_ERROR &&
+        WSAGetLastError() != WSA_IO_PENDING) {
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            WSAGetLastError(),
+            "WSASend");
+        free(Operation);
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockRecvAsync(
+    _In_ FNSOCK_HANDLE Socket,
+    _Out_writes_bytes_(BufferLength) CHAR* Buffer,
+    _In_ INT BufferLength,
+    _In_ BOOLEAN BufferIsNonPagedPool,
+    _In_ INT Flags,
+    _In_opt_ VOID* Context
+    )
+{
+    FNSOCK_ASYNC_OPERATION* Operation;
+    WSABUF Buf;
+    DWORD RecvFlags = Flags;
+
+    UNREFERENCED_PARAMETER(BufferIsNonPagedPool);
+
+    Operation = AllocateAsyncOperation(Socket, FnSockOperationRecv, Context);
+    if (Operation == NULL) {
+        return E_OUTOFMEMORY;
+    }
+
+    Buf.buf = Buffer;
+    Buf.len = BufferLength;
+
+    if (WSARecv((SOCKET)Socket, &Buf, 1, NULL, &RecvFlags, &Operation->Overlapped, NULL) ==
+            SOCKET_ERROR &&
+        WSAGetLastError() != WSA_IO_PENDING) {
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            WSAGetLastError(),
+            "WSARecv");
+        free(Operation);
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockAcceptAsync(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_opt_ VOID* Context
+    )
+{
+    static LPFN_ACCEPTEX CachedAcceptEx = NULL;
+    LPFN_ACCEPTEX AcceptEx = (LPFN_ACCEPTEX)ReadPointerNoFence(&(VOID *)CachedAcceptEx);
+    FNSOCK_ASYNC_OPERATION* Operation;
+    WSAPROTOCOL_INFOW ProtocolInfo;
+    INT ProtocolInfoLength = sizeof(ProtocolInfo);
+    DWORD BytesReceived;
+
+    if (AcceptEx == NULL) {
+        GUID Guid = WSAID_ACCEPTEX;
+        DWORD BytesReturned;
+
+        if (WSAIoctl((SOCKET)Socket, SIO_GET_EXTENSION_FUNCTION_POINTER, &Guid, sizeof(Guid),
+                &AcceptEx, sizeof(AcceptEx), &BytesReturned, NULL, NULL) == SOCKET_ERROR) {
+            TraceError(
+                "[ lib] ERROR, %u, %s.",
+                WSAGetLastError(),
+                "WSAIoctl");
+            return E_FAIL;
+        }
+
+        WritePointerNoFence(&(VOID *)CachedAcceptEx, (VOID *)AcceptEx);
+    }
+
+    //
+    // AcceptEx accepts into a caller-provided socket, so create one that
+    // matches the listening socket.
+    //
+    if (getsockopt(
+            (SOCKET)Socket, SOL_SOCKET, SO_PROTOCOL_INFOW, (CHAR*)&ProtocolInfo,
+            &ProtocolInfoLength) == SOCKET_ERROR) {
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            WSAGetLastError(),
+            "getsockopt");
+        return E_FAIL;
+    }
+
+    Operation = AllocateAsyncOperation(Socket, FnSockOperationAccept, Context);
+    if (Operation == NULL) {
+        return E_OUTOFMEMORY;
+    }
+
+    Operation->AcceptSocket =
+        WSASocketW(
+            ProtocolInfo.iAddressFamily, ProtocolInfo.iSocketType, ProtocolInfo.iProtocol,
+            NULL, 0, WSA_FLAG_OVERLAPPED);
+    if (Operation->AcceptSocket == INVALID_SOCKET) {
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            WSAGetLastError(),
+            "WSASocketW");
+        free(Operation);
+        return E_FAIL;
+    }
+
+    if (!AcceptEx(
+            (SOCKET)Socket, Operation->AcceptSocket, Operation->AcceptAddresses, 0,
+            FNSOCK_ACCEPT_ADDRESS_LENGTH, FNSOCK_ACCEPT_ADDRESS_LENGTH, &BytesReceived,
+            &Operation->Overlapped) &&
+        WSAGetLastError() != WSA_IO_PENDING) {
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            WSAGetLastError(),
+            "AcceptEx");
+        closesocket(Operation->AcceptSocket);
+        free(Operation);
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockConnectAsync(
+    _In_ FNSOCK_HANDLE Socket,
+    _In_reads_bytes_(AddressLength) const struct sockaddr* Address,
+    _In_ INT AddressLength,
+    _In_opt_ VOID* Context
+    )
+{
+    static LPFN_CONNECTEX CachedConnectEx = NULL;
+    LPFN_CONNECTEX ConnectEx = (LPFN_CONNECTEX)ReadPointerNoFence(&(VOID *)CachedConnectEx);
+    FNSOCK_ASYNC_OPERATION* Operation;
+    SOCKADDR_INET LocalAddress;
+    INT LocalAddressLength = sizeof(LocalAddress);
+
+    if (ConnectEx == NULL) {
+        GUID Guid = WSAID_CONNECTEX;
+        DWORD BytesReturned;
+
+        if (WSAIoctl((SOCKET)Socket, SIO_GET_EXTENSION_FUNCTION_POINTER, &Guid, sizeof(Guid),
+                &ConnectEx, sizeof(ConnectEx), &BytesReturned, NULL, NULL) == SOCKET_ERROR) {
+            TraceError(
+                "[ lib] ERROR, %u, %s.",
+                WSAGetLastError(),
+                "WSAIoctl");
+            return E_FAIL;
+        }
+
+        WritePointerNoFence(&(VOID *)CachedConnectEx, (VOID *)ConnectEx);
+    }
+
+    //
+    // ConnectEx requires a bound socket, so bind to the wildcard address if
+    // not bound already.
+    //
+    if (getsockname((SOCKET)Socket, (struct sockaddr*)&LocalAddress, &LocalAddressLength) ==
+            SOCKET_ERROR) {
+        RtlZeroMemory(&LocalAddress, sizeof(LocalAddress));
+        LocalAddress.si_family = Address->sa_family;
+
+        if (bind((SOCKET)Socket, (struct sockaddr*)&LocalAddress, sizeof(LocalAddress)) ==
+                SOCKET_ERROR) {
+            TraceError(
+                "[ lib] ERROR, %u, %s.",
+                WSAGetLastError(),
+                "bind");
+            return E_FAIL;
+        }
+    }
+
+    Operation = AllocateAsyncOperation(Socket, FnSockOperationConnect, Context);
+    if (Operation == NULL) {
+        return E_OUTOFMEMORY;
+    }
+
+    if (!ConnectEx(
+            (SOCKET)Socket, Address, AddressLength, NULL, 0, NULL, &Operation->Overlapped) &&
+        WSAGetLastError() != WSA_IO_PENDING) {
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            WSAGetLastError(),
+            "ConnectEx");
+        free(Operation);
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockGetCompletions(
+    _In_ FNSOCK_COMPLETION_QUEUE Queue,
+    _Out_writes_to_(MaxCount, return) FNSOCK_COMPLETION* Completions,
+    _In_ INT MaxCount,
+    _In_ UINT32 TimeoutMs
+    )
+{
+    OVERLAPPED_ENTRY Entries[FNSOCK_MAX_DEQUEUED_COMPLETIONS];
+    ULONG EntryCount;
+
+    if (MaxCount <= 0) {
+        return 0;
+    }
+
+    if (!GetQueuedCompletionStatusEx(
+            (HANDLE)Queue, Entries, (ULONG)min(MaxCount, FNSOCK_MAX_DEQUEUED_COMPLETIONS),
+            &EntryCount, TimeoutMs, FALSE)) {
+        if (GetLastError() == WAIT_TIMEOUT) {
+            return 0;
+        }
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            GetLastError(),
+            "GetQueuedCompletionStatusEx");
+        return SOCKET_ERROR;
+    }
+
+    for (ULONG Index = 0; Index < EntryCount; Index++) {
+        FNSOCK_ASYNC_OPERATION* Operation =
+            CONTAINING_RECORD(Entries[Index].lpOverlapped, FNSOCK_ASYNC_OPERATION, Overlapped);
+        FNSOCK_COMPLETION* Completion = &Completions[Index];
+        DWORD BytesTransferred;
+        DWORD Flags;
+
+        RtlZeroMemory(Completion, sizeof(*Completion));
+        Completion->Socket = Operation->Socket;
+        Completion->Operation = Operation->Operation;
+        Completion->Context = Operation->Context;
+
+        if (WSAGetOverlappedResult(
+                (SOCKET)Operation->Socket, &Operation->Overlapped, &BytesTransferred, FALSE,
+                &Flags)) {
+            Completion->BytesTransferred = (INT)BytesTransferred;
+        } else {
+            Completion->Error = WSAGetLastError();
+        }
+
+        if (Operation->Operation == FnSockOperationAccept) {
+            SOCKET ListenSocket = (SOCKET)Operation->Socket;
+
+            //
+            // The accepted socket inherits the listening socket's properties
+            // only once its accept context is updated.
+            //
+            if (Completion->Error == 0 &&
+                setsockopt(
+                    Operation->AcceptSocket, SOL_SOCKET, SO_UPDATE_ACCEPT_CONTEXT,
+                    (CHAR*)&ListenSocket, sizeof(ListenSocket)) == SOCKET_ERROR) {
+                Completion->Error = WSAGetLastError();
+            }
+
+            if (Completion->Error == 0) {
+                Completion->AcceptedSocket = (FNSOCK_HANDLE)Operation->AcceptSocket;
+            } else {
+                closesocket(Operation->AcceptSocket);
+            }
+        } else if (Operation->Operation == FnSockOperationConnect) {
+            //
+            // Likewise, a socket connected by ConnectEx supports the full set
+            // of socket functions only once its connect context is updated.
+            //
+            if (Completion->Error == 0 &&
+                setsockopt(
+                    (SOCKET)Operation->Socket, SOL_SOCKET, SO_UPDATE_CONNECT_CONTEXT, NULL,
+                    0) == SOCKET_ERROR) {
+                Completion->Error = WSAGetLastError();
+            }
+        }
+
+        free(Operation);
+    }
+
+    return (INT)EntryCount;
+}
+
+C_ASSERT(sizeof(FNSOCK_POLL_FD) == sizeof(WSAPOLLFD));
+C_ASSERT(FIELD_OFFSET(FNSOCK_POLL_FD, Socket) == FIELD_OFFSET(WSAPOLLFD, fd));
+C_ASSERT(FIELD_OFFSET(FNSOCK_POLL_FD, Events) == FIELD_OFFSET(WSAPOLLFD, events));
+C_ASSERT(FIELD_OFFSET(FNSOCK_POLL_FD, ReturnedEvents) == FIELD_OFFSET(WSAPOLLFD, revents));
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockPoll(
+    _Inout_updates_(FdCount) FNSOCK_POLL_FD* Fds,
+    _In_ UINT32 FdCount,
+    _In_ INT TimeoutMs
+    )
+{
+    INT Result;
+
+    Result = WSAPoll((WSAPOLLFD*)Fds, FdCount, TimeoutMs);
+    if (Result == SOCKET_ERROR) {
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            WSAGetLastError(),
+            "WSAPoll");
+    }
+
+    return Result;
+}
+
+//
+// Registered I/O sockets copy data through a single registered region, laid
+// out as the send buffers, then the receive buffers, then one remote address
+// per send buffer.
+//
+typedef struct FNSOCK_RIO_SOCKET {
+    SOCKET Socket;
+    RIO_EXTENSION_FUNCTION_TABLE Rio;
+    RIO_RQ Rq;
+    RIO_CQ SendCq;
+    RIO_CQ RecvCq;
+    HANDLE SendEvent;
+    HANDLE RecvEvent;
+    CHAR* Region;
+    RIO_BUFFERID RegionId;
+    UINT32 BufferSize;
+    UINT32 SendBufferCount;
+    UINT32 RecvBufferCount;
+    BOOLEAN ReceivesPosted;
+    UINT32 FreeSendBufferCount;
+    UINT32* FreeSendBuffers;
+} FNSOCK_RIO_SOCKET;
+
+static
+VOID
+CleanupRioSocket(
+    _In_ FNSOCK_RIO_SOCKET* Socket
+    )
+{
+    //
+    // Closing the socket also closes its request queue.
+    //
+    if (Socket->Socket != INVALID_SOCKET) {
+        closesocket(Socket->Socket);
+    }
+
+    if (Socket->SendCq != RIO_INVALID_CQ) {
+        Socket->Rio.RIOCloseCompletionQueue(Socket->SendCq);
+    }
+
+    if (Socket->RecvCq != RIO_INVALID_CQ) {
+        Socket->Rio.RIOCloseCompletionQueue(Socket->RecvCq);
+    }
+
+    if (Socket->RegionId != RIO_INVALID_BUFFERID) {
+        Socket->Rio.RIODeregisterBuffer(Socket->RegionId);
+    }
+
+    if (Socket->Region != NULL) {
+        VirtualFree(Socket->Region, 0, MEM_RELEASE);
+    }
+
+    if (Socket->SendEvent != NULL) {
+        CloseHandle(Socket->SendEvent);
+    }
+
+    if (Socket->RecvEvent != NULL) {
+        CloseHandle(Socket->RecvEvent);
+    }
+
+    if (Socket->FreeSendBuffers != NULL) {
+        free(Socket->FreeSendBuffers);
+    }
+
+    free(Socket);
+}
+
+static
+RIO_CQ
+CreateRioCompletionQueue(
+    _In_ FNSOCK_RIO_SOCKET* Socket,
+    _In_ UINT32 QueueSize,
+    _In_ HANDLE Event
+    )
+{
+    RIO_NOTIFICATION_COMPLETION Notification = {0};
+    RIO_CQ Cq;
+
+    Notification.Type = RIO_EVENT_COMPLETION;
+    Notification.Event.EventHandle = Event;
+    Notification.Event.NotifyReset = TRUE;
+
+    Cq = Socket->Rio.RIOCreateCompletionQueue(QueueSize, &Notification);
+    if (Cq == RIO_INVALID_CQ) {
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            WSAGetLastError(),
+            "RIOCreateCompletionQueue");
+    }
+
+    return Cq;
+}
+
+static
+RIO_BUF
+GetRioBuffer(
+    _In_ FNSOCK_RIO_SOCKET* Socket,
+    _In_ UINT32 Offset,
+    _In_ UINT32 Length
+    )
+{
+    RIO_BUF Buffer;
+
+    Buffer.BufferId = Socket->RegionId;
+    Buffer.Offset = Offset;
+    Buffer.Length = Length;
+
+    return Buffer;
+}
+
+static
+INT
+WaitForRioCompletions(
+    _In_ FNSOCK_RIO_SOCKET* Socket,
+    _In_ RIO_CQ Cq,
+    _In_ HANDLE Event,
+    _In_ DWORD TimeoutMs
+    )
+{
+    INT Error;
+
+    //
+    // The event is signaled once the completion queue is non-empty, even if
+    // completions were queued before the notification was requested.
+    //
+    Error = Socket->Rio.RIONotify(Cq);
+    if (Error != ERROR_SUCCESS && Error != WSAEALREADY) {
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            Error,
+            "RIONotify");
+        return Error;
+    }
+
+    switch (WaitForSingleObject(Event, TimeoutMs)) {
+    case WAIT_OBJECT_0:
+        return 0;
+    case WAIT_TIMEOUT:
+        return WSAETIMEDOUT;
+    default:
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            GetLastError(),
+            "WaitForSingleObject");
+        return WSAEINVAL;
+    }
+}
+
+static
+INT
+ReapRioSends(
+    _In_ FNSOCK_RIO_SOCKET* Socket,
+    _In_ BOOLEAN Wait
+    )
+{
+    RIORESULT Results[FNSOCK_MAX_DEQUEUED_COMPLETIONS];
+    ULONG ResultCount;
+    INT Error;
+
+    //
+    // Return the buffers of completed sends to the free list, optionally
+    // waiting for at least one send to complete.
+    //
+    for (;;) {
+        ResultCount =
+            Socket->Rio.RIODequeueCompletion(Socket->SendCq, Results, RTL_NUMBER_OF(Results));
+        if (ResultCount == RIO_CORRUPT_CQ) {
+            TraceError(
+                "[ lib] ERROR, %s.",
+                "RIODequeueCompletion corrupt send completion queue");
+            return WSAEINVAL;
+        }
+
+        for (ULONG Index = 0; Index < ResultCount; Index++) {
+            if (Results[Index].Status != NO_ERROR) {
+                TraceError(
+                    "[ lib] ERROR, %u, %s.",
+                    Results[Index].Status,
+                    "RIOSendEx");
+            }
+
+            Socket->FreeSendBuffers[Socket->FreeSendBufferCount++] =
+                (UINT32)Results[Index].RequestContext;
+        }
+
+        if (ResultCount > 0 || !Wait) {
+            return 0;
+        }
+
+        Error = WaitForRioCompletions(Socket, Socket->SendCq, Socket->SendEvent, INFINITE);
+        if (Error != 0) {
+            return Error;
+        }
+    }
+}
+
+static
+INT
+PostRioReceive(
+    _In_ FNSOCK_RIO_SOCKET* Socket,
+    _In_ UINT32 BufferIndex
+    )
+{
+    RIO_BUF Buffer =
+        GetRioBuffer(
+            Socket, (Socket->SendBufferCount + BufferIndex) * Socket->BufferSize,
+            Socket->BufferSize);
+
+    if (!Socket->Rio.RIOReceive(
+            Socket->Rq, &Buffer, 1, RIO_MSG_DEFER, (VOID*)(ULONG_PTR)BufferIndex)) {
+        INT Error = WSAGetLastError();
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            Error,
+            "RIOReceive");
+        return Error;
+    }
+
+    return 0;
+}
+
+static
+INT
+CommitRioReceives(
+    _In_ FNSOCK_RIO_SOCKET* Socket
+    )
+{
+    if (!Socket->Rio.RIOReceive(Socket->Rq, NULL, 0, RIO_MSG_COMMIT_ONLY, NULL)) {
+        INT Error = WSAGetLastError();
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            Error,
+            "RIOReceive");
+        return Error;
+    }
+
+    return 0;
+}
+
+static
+INT
+PostRioReceives(
+    _In_ FNSOCK_RIO_SOCKET* Socket
+    )
+{
+    INT Error;
+
+    for (UINT32 Index = 0; Index < Socket->RecvBufferCount; Index++) {
+        Error = PostRioReceive(Socket, Index);
+        if (Error != 0) {
+            return Error;
+        }
+    }
+
+    Error = CommitRioReceives(Socket);
+    if (Error != 0) {
+        return Error;
+    }
+
+    Socket->ReceivesPosted = TRUE;
+
+    return 0;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockRioCreate(
+    _In_ INT AddressFamily,
+    _In_ INT SocketType,
+    _In_ INT Protocol,
+    _In_ const FNSOCK_RIO_CONFIG* Config,
+    _Out_ FNSOCK_RIO_HANDLE* Handle
+    )
+{
+    FNSOCK_RIO_SOCKET* Socket = NULL;
+    GUID RioFunctionTableId = WSAID_MULTIPLE_RIO;
+    UINT64 RegionSize;
+    DWORD Bytes;
+    HRESULT Status;
+
+    *Handle = NULL;
+
+    RegionSize =
+        ((UINT64)Config->SendBufferCount + Config->RecvBufferCount) * Config->BufferSize +
+        (UINT64)Config->SendBufferCount * sizeof(SOCKADDR_INET);
+
+    if (Config->BufferSize == 0 || Config->SendBufferCount == 0 ||
+        Config->RecvBufferCount == 0 || RegionSize > MAXDWORD) {
+        TraceError(
+            "[ lib] ERROR, %s.",
+            "Invalid registered I/O config");
+        Status = E_INVALIDARG;
+        goto Exit;
+    }
+
+    Socket = malloc(sizeof(*Socket));
+    if (Socket == NULL) {
+        TraceError(
+            "[ lib] ERROR, %s.",
+            "Could not allocate memory for registered I/O socket");
+        Status = E_OUTOFMEMORY;
+        goto Exit;
+    }
+
+    RtlZeroMemory(Socket, sizeof(*Socket));
+    Socket->Socket = INVALID_SOCKET;
+    Socket->RegionId = RIO_INVALID_BUFFERID;
+    Socket->BufferSize = Config->BufferSize;
+    Socket->SendBufferCount = Config->SendBufferCount;
+    Socket->RecvBufferCount = Config->RecvBufferCount;
+
+    Socket->FreeSendBuffers = malloc(sizeof(*Socket->FreeSendBuffers) * Config->SendBufferCount);
+    if (Socket->FreeSendBuffers == NULL) {
+        TraceError(
+            "[ lib] ERROR, %s.",
+            "Could not allocate memory for registered I/O send buffers");
+        Status = E_OUTOFMEMORY;
+        goto Exit;
+    }
+
+    for (UINT32 Index = 0; Index < Config->SendBufferCount; Index++) {
+        Socket->FreeSendBuffers[Index] = Index;
+    }
+    Socket->FreeSendBufferCount = Config->SendBufferCount;
+
+    Socket->Socket =
+        WSASocketW(AddressFamily, SocketType, Protocol, NULL, 0, WSA_FLAG_REGISTERED_IO);
+    if (Socket->Socket == INVALID_SOCKET) {
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            WSAGetLastError(),
+            "WSASocketW");
+        Status = E_FAIL;
+        goto Exit;
+    }
+
+    if (WSAIoctl(
+            Socket->Socket, SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER, &RioFunctionTableId,
+            sizeof(RioFunctionTableId), &Socket->Rio, sizeof(Socket->Rio), &Bytes, NULL,
+            NULL) == SOCKET_ERROR) {
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            WSAGetLastError(),
+            "WSAIoctl");
+        Status = E_FAIL;
+        goto Exit;
+    }
+
+    Socket->Region =
+        VirtualAlloc(NULL, (SIZE_T)RegionSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (Socket->Region == NULL) {
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            GetLastError(),
+            "VirtualAlloc");
+        Status = E_OUTOFMEMORY;
+        goto Exit;
+    }
+
+    Socket->RegionId = Socket->Rio.RIORegisterBuffer(Socket->Region, (DWORD)RegionSize);
+    if (Socket->RegionId == RIO_INVALID_BUFFERID) {
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            WSAGetLastError(),
+            "RIORegisterBuffer");
+        Status = E_FAIL;
+        goto Exit;
+    }
+
+    Socket->SendEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Socket->RecvEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    if (Socket->SendEvent == NULL || Socket->RecvEvent == NULL) {
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            GetLastError(),
+            "CreateEventW");
+        Status = E_FAIL;
+        goto Exit;
+    }
+
+    Socket->SendCq = CreateRioCompletionQueue(Socket, Config->SendBufferCount, Socket->SendEvent);
+    Socket->RecvCq = CreateRioCompletionQueue(Socket, Config->RecvBufferCount, Socket->RecvEvent);
+    if (Socket->SendCq == RIO_INVALID_CQ || Socket->RecvCq == RIO_INVALID_CQ) {
+        Status = E_FAIL;
+        goto Exit;
+    }
+
+    Socket->Rq =
+        Socket->Rio.RIOCreateRequestQueue(
+            Socket->Socket, Config->RecvBufferCount, 1, Config->SendBufferCount, 1,
+            Socket->RecvCq, Socket->SendCq, Socket);
+    if (Socket->Rq == RIO_INVALID_RQ) {
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            WSAGetLastError(),
+            "RIOCreateRequestQueue");
+        Status = E_FAIL;
+        goto Exit;
+    }
+
+    *Handle = (FNSOCK_RIO_HANDLE)Socket;
+    Status = S_OK;
+
+Exit:
+
+    if (FAILED(Status)) {
+        if (Socket != NULL) {
+            CleanupRioSocket(Socket);
+        }
+    }
+
+    return Status;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+FnSockRioClose(
+    _In_ FNSOCK_RIO_HANDLE Handle
+    )
+{
+    CleanupRioSocket((FNSOCK_RIO_SOCKET*)Handle);
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_HANDLE
+FnSockRioGetSocket(
+    _In_ FNSOCK_RIO_HANDLE Handle
+    )
+{
+    return (FNSOCK_HANDLE)((FNSOCK_RIO_SOCKET*)Handle)->Socket;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+FNSOCK_STATUS
+FnSockRioBind(
+    _In_ FNSOCK_RIO_HANDLE Handle,
+    _In_reads_bytes_(AddressLength) const struct sockaddr* Address,
+    _In_ INT AddressLength
+    )
+{
+    FNSOCK_RIO_SOCKET* Socket = (FNSOCK_RIO_SOCKET*)Handle;
+    INT Error;
+
+    if (bind(Socket->Socket, Address, AddressLength) == SOCKET_ERROR) {
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            WSAGetLastError(),
+            "bind");
+        return E_FAIL;
+    }
+
+    Error = PostRioReceives(Socket);
+    if (Error != 0) {
+        WSASetLastError(Error);
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockRioSendBatch(
+    _In_ FNSOCK_RIO_HANDLE Handle,
+    _Inout_updates_(MessageCount) FNSOCK_MSG* Messages,
+    _In_ INT MessageCount
+    )
+{
+    FNSOCK_RIO_SOCKET* Socket = (FNSOCK_RIO_SOCKET*)Handle;
+    CONST UINT32 AddressRegionOffset =
+        (Socket->SendBufferCount + Socket->RecvBufferCount) * Socket->BufferSize;
+    BOOLEAN Deferred = FALSE;
+    INT Error;
+    INT Index = 0;
+
+    Error = ReapRioSends(Socket, FALSE);
+
+    for (; Error == 0 && Index < MessageCount; Index++) {
+        FNSOCK_MSG* Message = &Messages[Index];
+        SOCKADDR_INET* RemoteAddress;
+        RIO_BUF DataBuffer;
+        RIO_BUF AddressBuffer = {0};
+        UINT32 BufferIndex;
+
+        if (Message->BufferLength < 0 || (UINT32)Message->BufferLength > Socket->BufferSize) {
+            Error = WSAEMSGSIZE;
+            break;
+        }
+
+        if (Message->AddressLength < 0 || Message->AddressLength > (INT)sizeof(*RemoteAddress) ||
+            Message->ControlBufferLength != 0) {
+            Error = WSAEINVAL;
+            break;
+        }
+
+        if (Socket->FreeSendBufferCount == 0) {
+            //
+            // Commit the deferred sends before waiting for any to complete.
+            //
+            if (Deferred) {
+                if (!Socket->Rio.RIOSendEx(
+                        Socket->Rq, NULL, 0, NULL, NULL, NULL, NULL, RIO_MSG_COMMIT_ONLY,
+                        NULL)) {
+                    Error = WSAGetLastError();
+                    TraceError(
+                        "[ lib] ERROR, %u, %s.",
+                        Error,
+                        "RIOSendEx");
+                    break;
+                }
+                Deferred = FALSE;
+            }
+
+            Error = ReapRioSends(Socket, TRUE);
+            if (Error != 0) {
+                break;
+            }
+        }
+
+        BufferIndex = Socket->FreeSendBuffers[--Socket->FreeSendBufferCount];
+
+        RtlCopyMemory(
+            Socket->Region + (SIZE_T)BufferIndex * Socket->BufferSize, Message->Buffer,
+            Message->BufferLength);
+        DataBuffer =
+            GetRioBuffer(Socket, BufferIndex * Socket->BufferSize, Message->BufferLength);
+
+        if (Message->Address != NULL) {
+            RemoteAddress =
+                (SOCKADDR_INET*)(Socket->Region + AddressRegionOffset) + BufferIndex;
+            RtlZeroMemory(RemoteAddress, sizeof(*RemoteAddress));
+            RtlCopyMemory(RemoteAddress, Message->Address, Message->AddressLength);
+            AddressBuffer =
+                GetRioBuffer(
+                    Socket, AddressRegionOffset + BufferIndex * sizeof(*RemoteAddress),
+                    sizeof(*RemoteAddress));
+        }
+
+        if (!Socket->Rio.RIOSendEx(
+                Socket->Rq, &DataBuffer, 1, NULL,
+                Message->Address != NULL ? &AddressBuffer : NULL, NULL, NULL, RIO_MSG_DEFER,
+                (VOID*)(ULONG_PTR)BufferIndex)) {
+            Error = WSAGetLastError();
+            TraceError(
+                "[ lib] ERROR, %u, %s.",
+                Error,
+                "RIOSendEx");
+            Socket->FreeSendBuffers[Socket->FreeSendBufferCount++] = BufferIndex;
+            break;
+        }
+
+        Deferred = TRUE;
+        Message->BytesTransferred = Message->BufferLength;
+    }
+
+    if (Deferred &&
+        !Socket->Rio.RIOSendEx(
+            Socket->Rq, NULL, 0, NULL, NULL, NULL, NULL, RIO_MSG_COMMIT_ONLY, NULL)) {
+        Error = WSAGetLastError();
+        TraceError(
+            "[ lib] ERROR, %u, %s.",
+            Error,
+            "RIOSendEx");
+        WSASetLastError(Error);
+        return SOCKET_ERROR;
+    }
+
+    if (Index < MessageCount) {
+        Messages[Index].BytesTransferred = SOCKET_ERROR;
+        WSASetLastError(Error);
+    }
+
+    return (Index > 0 || MessageCount == 0) ? Index : SOCKET_ERROR;
+}
+
+FNSOCKAPI
+_IRQL_requires_max_(PASSIVE_LEVEL)
+INT
+FnSockRioRecvBatch(
+    _In_ FNSOCK_RIO_HANDLE Handle,
+    _Inout_updates_(MessageCount) FNSOCK_MSG* Messages,
+    _In_ INT MessageCount
+    )
+{
+    FNSOCK_RIO_SOCKET* Socket = (FNSOCK_RIO_SOCKET*)Handle;
+    RIORESULT Results[FNSOCK_MAX_DEQUEUED_COMPLETIONS];
+    ULONG ResultCount;
+    INT Error;
+
+    if (MessageCount <= 0) {
+        return 0;
+    }
+
+    //
+    // Sockets that were implicitly bound by a send post their receives now.
+    //
+    if (!Socket->ReceivesPosted) {
+        Error = PostRioReceives(Socket);
+        if (Error != 0) {
+            WSASetLastError(Error);
+            return SOCKET_ERROR;
+        }
+    }
+
+    ResultCount =
+        Socket->Rio.RIODequeueCompletion(
+            Socket->RecvCq, Results, (ULONG)min(MessageCount, FNSOCK_MAX_DEQUEUED_COMPLETIONS));
+    if (ResultCount == 0) {
+        DWORD TimeoutMs;
+        INT OptionLength = sizeof(TimeoutMs);
+
+        if (getsockopt(
+                Socket->Socket, SOL_SOCKET, SO_RCVTIMEO, (CHAR*)&TimeoutMs,
+                &OptionLength) == SOCKET_ERROR) {
+            TraceError(
+                "[ lib] ERROR, %u, %s.",
+                WSAGetLastError(),
+                "getsockopt");
+            return SOCKET_ERROR;
+        }
+
+        Error =
+            WaitForRioCompletions(
+                Socket, Socket->RecvCq, Socket->RecvEvent,
+                TimeoutMs == 0 ? INFINITE : TimeoutMs);
+        if (Error != 0) {
+            WSASetLastError(Error);
+            return SOCKET_ERROR;
+        }
+
+        ResultCount =
+            Socket->Rio.RIODequeueCompletion(
+                Socket->RecvCq, Results,
+                (ULONG)min(MessageCount, FNSOCK_MAX_DEQUEUED_COMPLETIONS));
+    }
+
+    if (ResultCount == RIO_CORRUPT_CQ) {
+        TraceError(
+            "[ lib] ERROR, %s.",
+            "RIODequeueCompletion corrupt receive completion queue");
+        WSASetLastError(WSAEINVAL);
+        return SOCKET_ERROR;
+    }
+
+    for (ULONG Index = 0; Index < ResultCount; Index++) {
+        FNSOCK_MSG* Message = &Messages[Index];
+        RIORESULT* Result = &Results[Index];
+        UINT32 BufferIndex = (UINT32)Result->RequestContext;
+        CONST CHAR* Buffer =
+            Socket->Region + (SIZE_T)(Socket->SendBufferCount + BufferIndex) * Socket->BufferSize;
+
+        Message->Flags = 0;
+        Message->ControlBufferLength = 0;
+
+        if (Result->Status != NO_ERROR) {
+            Message->BytesTransferred = SOCKET_ERROR;
+        } else if (Result->BytesTransferred > (ULONG)Message->BufferLength) {
+            RtlCopyMemory(Message->Buffer, Buffer, Message->BufferLength);
+            Message->Flags = MSG_TRUNC;
+            Message->BytesTransferred = SOCKET_ERROR;
+        } else {
+            RtlCopyMemory(Message->Buffer, Buffer, Result->BytesTransferred);
+            Message->BytesTransferred = (INT)Result->BytesTransferred;
+        }
+
+        //
+        // A buffer that cannot be reposted is lost to the socket, but the
+        // datagrams already received are still returned.
+        //
+        PostRioReceive(Socket, BufferIndex);
+    }
+
+    CommitRioReceives(Socket);
+
+    return (INT)ResultCount;
+}
+
 FNSOCKAPI
 _IRQL_requires_max_(PASSIVE_LEVEL)
 INT
@@ -14,18 +14,113 @@ static WSK_REGISTRATION Registration;
 static WSK_CLIENT_NPI ClientNpi;
 static WSK_PROVIDER_NPI ProviderNpi;
 
+//
+// Completion contexts of async requests are cached per processor together
+// with their IRP and an MDL large enough for typical buffers, so steady-state
+// requests do not allocate.
+//
+#define WSKCLIENT_MAX_CACHED_COMPLETIONS 64
+#define WSKCLIENT_CACHED_MDL_LENGTH (64 * 1024)
+#define WSKCLIENT_CACHED_MDL_PAGES (WSKCLIENT_CACHED_MDL_LENGTH / PAGE_SIZE + 1)
+#define WSKCLIENT_CACHED_MDL_SIZE \
+    (sizeof(MDL) + sizeof(PFN_NUMBER) * WSKCLIENT_CACHED_MDL_PAGES)
+
+//
+// A completion used for a batched send keeps its message buffers for later
+// batches. They describe up to WSKCLIENT_CACHED_MESSAGE_COUNT datagrams, each
+// with an MDL for buffers spanning up to WSKCLIENT_CACHED_MESSAGE_MDL_PAGES
+// pages. Larger batches and datagrams allocate instead.
+//
+#define WSKCLIENT_CACHED_MESSAGE_COUNT 32
+#define WSKCLIENT_CACHED_MESSAGE_MDL_PAGES 2
+#define WSKCLIENT_CACHED_MESSAGE_MDL_SIZE \
+    (sizeof(MDL) + sizeof(PFN_NUMBER) * WSKCLIENT_CACHED_MESSAGE_MDL_PAGES)
+
+typedef struct DECLSPEC_CACHEALIGN _WSKCLIENT_COMPLETION_CACHE {
+    SLIST_HEADER FreeList;
+} WSKCLIENT_COMPLETION_CACHE;
+
+static WSKCLIENT_COMPLETION_CACHE* CompletionCaches;
+static ULONG CompletionCacheCount;
+
+//
+// Callback timeouts of all async requests share one timer, which is set for
+// the earliest deadline in the deadline-ordered TimerList.
+//
+#define WSKCLIENT_COMPLETION_IRP_DONE 0x1
+#define WSKCLIENT_COMPLETION_TIMER_QUEUED 0x2
+
+static KSPIN_LOCK TimerLock;
+static LIST_ENTRY TimerList;
+static KTIMER Timer;
+static KDPC TimerDpc;
+
+//
+// WskSendMessages is available starting with Windows 10 version 1703.
+//
+static BOOLEAN SendMessagesSupported;
+
+typedef struct _WSKCLIENT_MESSAGE_BUF {
+    WSK_BUF_LIST BufList;
+    BOOLEAN BufLocked;
+    PMDL CachedMdl;
+} WSKCLIENT_MESSAGE_BUF, *PWSKCLIENT_MESSAGE_BUF;
+
+typedef struct _WSKCLIENT_REGISTERED_BUFFER {
+    WSK_BUF WskBuf;
+    BOOLEAN BufLocked;
+} WSKCLIENT_REGISTERED_BUFFER, *PWSKCLIENT_REGISTERED_BUFFER;
+
+static
+VOID
+FreeCompletionCaches(
+    VOID
+    );
+
+static
+_Function_class_(KDEFERRED_ROUTINE)
+VOID
+TimerDpcRoutine(
+    _In_ PKDPC Dpc,
+    _In_opt_ PVOID DeferredContext,
+    _In_opt_ PVOID SystemArgument1,
+    _In_opt_ PVOID SystemArgument2
+    );
+
 NTSTATUS
 WskClientReg(
     VOID
     )
 {
     NTSTATUS Status;
+
+    CompletionCacheCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    CompletionCaches =
+    #pragma warning( suppress : 4996 )
+        ExAllocatePoolWithTag(
+            NonPagedPoolNxCacheAligned, sizeof(*CompletionCaches) * CompletionCacheCount,
+            'tseT');
+    if (CompletionCaches == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Fail;
+    }
+    for (ULONG Index = 0; Index < CompletionCacheCount; Index++) {
+        InitializeSListHead(&CompletionCaches[Index].FreeList);
+    }
+
+    SendMessagesSupported = RtlIsNtDdiVersionAvailable(NTDDI_WIN10_RS2);
+
+    KeInitializeSpinLock(&TimerLock);
+    InitializeListHead(&TimerList);
+    KeInitializeTimer(&Timer);
+    KeInitializeDpc(&TimerDpc, TimerDpcRoutine, NULL);
+
     ClientNpi.ClientContext = NULL;
     ClientNpi.Dispatch = &WskAppDispatch;
     Status = WskRegister(&ClientNpi, &Registration);
     if (!NT_SUCCESS(Status)) {
         LOG("WskRegister failed with %d\n", Status);
-        goto Fail;
+        goto FreeCaches;
     }
     Status = WskCaptureProviderNPI(&Registration, WSK_NO_WAIT, &ProviderNpi);
     if (!NT_SUCCESS(Status)) {
@@ -37,6 +132,8 @@ WskClientReg(
 
 Deregister:
     WskDeregister(&Registration);
+FreeCaches:
+    FreeCompletionCaches();
 Fail:
     return Status;
 }
@@ -48,6 +145,9 @@ WskClientDereg(
 {
     WskReleaseProviderNPI(&Registration);
     WskDeregister(&Registration);
+    KeCancelTimer(&Timer);
+    KeFlushQueuedDpcs();
+    FreeCompletionCaches();
 }
 
 static
@@ -57,6 +157,7 @@ InitializeWskBuf(
     _In_ ULONG BufLen,
     _In_ ULONG BufOffset,
     _In_ BOOLEAN BufIsNonPagedPool,
+    _In_opt_ PMDL CachedMdl,
     _Out_ WSK_BUF* WskBuf,
     _Out_ BOOLEAN* BufLocked
     )
@@ -67,10 +168,20 @@ InitializeWskBuf(
     RtlZeroMemory(WskBuf, sizeof(*WskBuf));
     *BufLocked = FALSE;
 
-    Mdl = IoAllocateMdl(Buf, BufLen, FALSE, FALSE, NULL);
-    if (Mdl == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto Cleanup;
+    //
+    // The cached MDL, if any, has room for WSKCLIENT_CACHED_MDL_PAGES pages.
+    // Smaller cached MDLs are only passed for buffers that fit them.
+    //
+    if (CachedMdl != NULL &&
+        ADDRESS_AND_SIZE_TO_SPAN_PAGES(Buf, BufLen) <= WSKCLIENT_CACHED_MDL_PAGES) {
+        MmInitializeMdl(CachedMdl, Buf, BufLen);
+        Mdl = CachedMdl;
+    } else {
+        Mdl = IoAllocateMdl(Buf, BufLen, FALSE, FALSE, NULL);
+        if (Mdl == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Cleanup;
+        }
     }
 
     if (BufIsNonPagedPool) {
@@ -93,24 +204,27 @@ InitializeWskBuf(
     Status = STATUS_SUCCESS;
 
 Cleanup:
-    if (Mdl != NULL) {
+    if (Mdl != NULL && Mdl != CachedMdl) {
         IoFreeMdl(Mdl);
     }
-    return STATUS_SUCCESS;
+    return Status;
 }
 
 static
 VOID
 UninitializeWskBuf(
     _In_ WSK_BUF* WskBuf,
-    _In_ BOOLEAN BufLocked
+    _In_ BOOLEAN BufLocked,
+    _In_opt_ PMDL CachedMdl
     )
 {
     if (WskBuf->Mdl != NULL) {
         if (BufLocked) {
             MmUnlockPages(WskBuf->Mdl);
         }
-        IoFreeMdl(WskBuf->Mdl);
+        if (WskBuf->Mdl != CachedMdl) {
+            IoFreeMdl(WskBuf->Mdl);
+        }
     }
 }
 
@@ -131,6 +245,471 @@ GenericCompletionRoutine(
     return STATUS_MORE_PROCESSING_REQUIRED;
 }
 
+static
+WSKCLIENT_COMPLETION_CACHE*
+GetCompletionCache(
+    VOID
+    )
+{
+    ULONG Index = KeGetCurrentProcessorIndex();
+
+    if (Index >= CompletionCacheCount) {
+        Index = 0;
+    }
+
+    return &CompletionCaches[Index];
+}
+
+static
+VOID
+DestroyIoRequestCompletion(
+    _In_ PWSKIOREQUEST_COMPLETION Completion
+    )
+{
+    if (Completion->CachedMessageBufs != NULL) {
+        ExFreePool(Completion->CachedMessageBufs);
+    }
+    IoFreeIrp(Completion->Irp);
+    ExFreePool(Completion);
+}
+
+static
+_Function_class_(IO_COMPLETION_ROUTINE)
+NTSTATUS
+IoRequestCompletionRoutine(
+    const DEVICE_OBJECT* DeviceObject,
+    const IRP* Irp,
+    PVOID Context
+    );
+
+static
+PWSKIOREQUEST_COMPLETION
+AllocateIoRequestCompletion(
+    VOID
+    )
+{
+    PWSKIOREQUEST_COMPLETION Completion;
+    PSLIST_ENTRY Entry;
+
+    Entry = InterlockedPopEntrySList(&GetCompletionCache()->FreeList);
+    if (Entry != NULL) {
+        Completion = CONTAINING_RECORD(Entry, WSKIOREQUEST_COMPLETION, CacheLink);
+    } else {
+        Completion =
+        #pragma warning( suppress : 4996 )
+            ExAllocatePoolWithTag(
+                NonPagedPoolNx, sizeof(*Completion) + WSKCLIENT_CACHED_MDL_SIZE, 'tseT');
+        if (Completion == NULL) {
+            return NULL;
+        }
+        RtlZeroMemory(Completion, sizeof(*Completion));
+
+        Completion->Irp = IoAllocateIrp(1, FALSE);
+        if (Completion->Irp == NULL) {
+            ExFreePool(Completion);
+            return NULL;
+        }
+        Completion->CachedMdl = (PMDL)(Completion + 1);
+    }
+
+    RtlZeroMemory(&Completion->WskBuf, sizeof(Completion->WskBuf));
+    Completion->Status = STATUS_SUCCESS;
+    Completion->BufLocked = FALSE;
+    Completion->BufRegistered = FALSE;
+    Completion->MessageBufs = NULL;
+    Completion->MessageCount = 0;
+    Completion->PendingRefs = 2;
+    Completion->State = 0;
+    Completion->Callback = NULL;
+    Completion->CallbackContext = NULL;
+    InitializeListHead(&Completion->TimerLink);
+    Completion->TimedOut = FALSE;
+    KeInitializeEvent(&Completion->Event, NotificationEvent, FALSE);
+    IoSetCompletionRoutine(
+        Completion->Irp, IoRequestCompletionRoutine, Completion, TRUE, TRUE, TRUE);
+
+    return Completion;
+}
+
+static
+VOID
+FreeIoRequestCompletion(
+    _In_ PWSKIOREQUEST_COMPLETION Completion
+    )
+{
+    WSKCLIENT_COMPLETION_CACHE* Cache;
+
+    if (!Completion->BufRegistered) {
+        UninitializeWskBuf(&Completion->WskBuf, Completion->BufLocked, Completion->CachedMdl);
+    }
+
+    if (Completion->MessageBufs != NULL) {
+        PWSKCLIENT_MESSAGE_BUF MessageBufs = (PWSKCLIENT_MESSAGE_BUF)Completion->MessageBufs;
+
+        for (ULONG Index = 0; Index < Completion->MessageCount; Index++) {
+            UninitializeWskBuf(
+                &MessageBufs[Index].BufList.Buffer, MessageBufs[Index].BufLocked,
+                MessageBufs[Index].CachedMdl);
+        }
+        if (MessageBufs != Completion->CachedMessageBufs) {
+            ExFreePool(MessageBufs);
+        }
+    }
+
+    IoReuseIrp(Completion->Irp, STATUS_UNSUCCESSFUL);
+
+    Cache = GetCompletionCache();
+    if (ExQueryDepthSList(&Cache->FreeList) < WSKCLIENT_MAX_CACHED_COMPLETIONS) {
+        InterlockedPushEntrySList(&Cache->FreeList, &Completion->CacheLink);
+    } else {
+        DestroyIoRequestCompletion(Completion);
+    }
+}
+
+static
+PWSKCLIENT_MESSAGE_BUF
+AllocateMessageBufs(
+    _Inout_ PWSKIOREQUEST_COMPLETION Completion,
+    _In_ ULONG MessageCount
+    )
+{
+    PWSKCLIENT_MESSAGE_BUF MessageBufs;
+
+    if (MessageCount > WSKCLIENT_CACHED_MESSAGE_COUNT) {
+        MessageBufs =
+        #pragma warning( suppress : 4996 )
+            ExAllocatePoolWithTag(NonPagedPoolNx, sizeof(*MessageBufs) * MessageCount, 'tseT');
+        if (MessageBufs != NULL) {
+            RtlZeroMemory(MessageBufs, sizeof(*MessageBufs) * MessageCount);
+        }
+        return MessageBufs;
+    }
+
+    if (Completion->CachedMessageBufs == NULL) {
+        PUCHAR CachedMdls;
+
+        MessageBufs =
+        #pragma warning( suppress : 4996 )
+            ExAllocatePoolWithTag(
+                NonPagedPoolNx,
+                (sizeof(*MessageBufs) + WSKCLIENT_CACHED_MESSAGE_MDL_SIZE) *
+                    WSKCLIENT_CACHED_MESSAGE_COUNT,
+                'tseT');
+        if (MessageBufs == NULL) {
+            return NULL;
+        }
+
+        CachedMdls = (PUCHAR)(MessageBufs + WSKCLIENT_CACHED_MESSAGE_COUNT);
+        for (ULONG Index = 0; Index < WSKCLIENT_CACHED_MESSAGE_COUNT; Index++) {
+            MessageBufs[Index].CachedMdl =
+                (PMDL)(CachedMdls + Index * WSKCLIENT_CACHED_MESSAGE_MDL_SIZE);
+        }
+        Completion->CachedMessageBufs = MessageBufs;
+    }
+
+    MessageBufs = (PWSKCLIENT_MESSAGE_BUF)Completion->CachedMessageBufs;
+    for (ULONG Index = 0; Index < MessageCount; Index++) {
+        RtlZeroMemory(&MessageBufs[Index].BufList, sizeof(MessageBufs[Index].BufList));
+        MessageBufs[Index].BufLocked = FALSE;
+    }
+
+    return MessageBufs;
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+ReleaseIoRequestCompletion(
+    _In_ PWSKIOREQUEST_COMPLETION Completion
+    )
+{
+    WSKCLIENT_COMPLETION_CALLBACK *Callback;
+    PVOID CallbackContext;
+    NTSTATUS Status;
+    ULONG_PTR Information;
+
+    if (InterlockedDecrement(&Completion->PendingRefs) != 0) {
+        return;
+    }
+
+    if (Completion->Callback == NULL) {
+        // The owner is waiting in AwaitIoRequestCompletion.
+        KeSetEvent(&Completion->Event, IO_NO_INCREMENT, FALSE);
+        return;
+    }
+
+    Callback = Completion->Callback;
+    CallbackContext = Completion->CallbackContext;
+    Status = Completion->Irp->IoStatus.Status;
+    Information = Completion->Irp->IoStatus.Information;
+
+    if (Status == STATUS_CANCELLED && Completion->TimedOut) {
+        Status = STATUS_TIMEOUT;
+    }
+
+    FreeIoRequestCompletion(Completion);
+    Callback(CallbackContext, Status, Information);
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+StartIoRequestTimer(
+    _In_ PWSKIOREQUEST_COMPLETION Completion,
+    _In_ ULONG TimeoutMs
+    )
+{
+    UINT64 Now = KeQueryInterruptTime();
+    PLIST_ENTRY Entry;
+    KIRQL PrevIrql;
+
+    Completion->Deadline = Now + UInt32x32To64(TimeoutMs, 10000);
+    InterlockedIncrement(&Completion->PendingRefs);
+
+    KeAcquireSpinLock(&TimerLock, &PrevIrql);
+
+    //
+    // Timeouts are mostly uniform, so the search from the tail usually stops
+    // at the first entry.
+    //
+    for (Entry = TimerList.Blink; Entry != &TimerList; Entry = Entry->Blink) {
+        PWSKIOREQUEST_COMPLETION Queued =
+            CONTAINING_RECORD(Entry, WSKIOREQUEST_COMPLETION, TimerLink);
+        if (Queued->Deadline <= Completion->Deadline) {
+            break;
+        }
+    }
+    InsertHeadList(Entry, &Completion->TimerLink);
+
+    if (TimerList.Flink == &Completion->TimerLink) {
+        LARGE_INTEGER DueTime;
+        DueTime.QuadPart = -(LONGLONG)max(Completion->Deadline - Now, 1);
+        KeSetTimer(&Timer, DueTime, &TimerDpc);
+    }
+
+    KeReleaseSpinLock(&TimerLock, PrevIrql);
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+StopIoRequestTimer(
+    _In_ PWSKIOREQUEST_COMPLETION Completion
+    )
+{
+    BOOLEAN Removed = FALSE;
+    KIRQL PrevIrql;
+
+    KeAcquireSpinLock(&TimerLock, &PrevIrql);
+    if (!IsListEmpty(&Completion->TimerLink)) {
+        RemoveEntryList(&Completion->TimerLink);
+        InitializeListHead(&Completion->TimerLink);
+        Removed = TRUE;
+    }
+    KeReleaseSpinLock(&TimerLock, PrevIrql);
+
+    if (Removed) {
+        ReleaseIoRequestCompletion(Completion);
+    }
+}
+
+static
+_Function_class_(KDEFERRED_ROUTINE)
+VOID
+TimerDpcRoutine(
+    _In_ PKDPC Dpc,
+    _In_opt_ PVOID DeferredContext,
+    _In_opt_ PVOID SystemArgument1,
+    _In_opt_ PVOID SystemArgument2
+    )
+{
+    PWSKIOREQUEST_COMPLETION Expired = NULL;
+    UINT64 Now;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(DeferredContext);
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+
+    KeAcquireSpinLockAtDpcLevel(&TimerLock);
+
+    Now = KeQueryInterruptTime();
+    while (!IsListEmpty(&TimerList)) {
+        PWSKIOREQUEST_COMPLETION Completion =
+            CONTAINING_RECORD(TimerList.Flink, WSKIOREQUEST_COMPLETION, TimerLink);
+
+        if (Completion->Deadline > Now) {
+            LARGE_INTEGER DueTime;
+            DueTime.QuadPart = -(LONGLONG)(Completion->Deadline - Now);
+            KeSetTimer(&Timer, DueTime, &TimerDpc);
+            break;
+        }
+
+        RemoveEntryList(&Completion->TimerLink);
+        InitializeListHead(&Completion->TimerLink);
+        Completion->TimedOut = TRUE;
+        Completion->TimerNext = Expired;
+        Expired = Completion;
+    }
+
+    KeReleaseSpinLockFromDpcLevel(&TimerLock);
+
+    //
+    // The timer's reference keeps each expired request's IRP valid until it
+    // has been cancelled.
+    //
+    while (Expired != NULL) {
+        PWSKIOREQUEST_COMPLETION Completion = Expired;
+        Expired = Completion->TimerNext;
+
+        IoCancelIrp(Completion->Irp);
+        ReleaseIoRequestCompletion(Completion);
+    }
+}
+
+static
+_Function_class_(IO_COMPLETION_ROUTINE)
+NTSTATUS
+IoRequestCompletionRoutine(
+    const DEVICE_OBJECT* DeviceObject,
+    const IRP* Irp,
+    PVOID Context
+    )
+{
+    PWSKIOREQUEST_COMPLETION Completion = (PWSKIOREQUEST_COMPLETION)Context;
+    LONG OldState;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+    UNREFERENCED_PARAMETER(Irp);
+
+    OldState = InterlockedOr(&Completion->State, WSKCLIENT_COMPLETION_IRP_DONE);
+    if (OldState & WSKCLIENT_COMPLETION_TIMER_QUEUED) {
+        StopIoRequestTimer(Completion);
+    }
+
+    ReleaseIoRequestCompletion(Completion);
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+VOID
+WskSetCompletionCallback(
+    _In_ PVOID AsyncCompletion,
+    _In_ ULONG TimeoutMs,
+    _In_ WSKCLIENT_COMPLETION_CALLBACK *Callback,
+    _In_opt_ PVOID CallbackContext
+    )
+{
+    PWSKIOREQUEST_COMPLETION Completion = (PWSKIOREQUEST_COMPLETION)AsyncCompletion;
+
+    ASSERT(NT_SUCCESS(Completion->Status));
+
+    Completion->Callback = Callback;
+    Completion->CallbackContext = CallbackContext;
+
+    if (TimeoutMs != WSKCLIENT_INFINITE) {
+        LONG OldState;
+
+        StartIoRequestTimer(Completion, TimeoutMs);
+
+        //
+        // If the IRP completed before the timer was queued, its completion
+        // routine did not dequeue the timer, so do it here.
+        //
+        OldState = InterlockedOr(&Completion->State, WSKCLIENT_COMPLETION_TIMER_QUEUED);
+        if (OldState & WSKCLIENT_COMPLETION_IRP_DONE) {
+            StopIoRequestTimer(Completion);
+        }
+    }
+
+    ReleaseIoRequestCompletion(Completion);
+}
+
+static
+VOID
+FreeCompletionCaches(
+    VOID
+    )
+{
+    if (CompletionCaches == NULL) {
+        return;
+    }
+
+    for (ULONG Index = 0; Index < CompletionCacheCount; Index++) {
+        PSLIST_ENTRY Entry;
+
+        while ((Entry = InterlockedPopEntrySList(&CompletionCaches[Index].FreeList)) != NULL) {
+            DestroyIoRequestCompletion(
+                CONTAINING_RECORD(Entry, WSKIOREQUEST_COMPLETION, CacheLink));
+        }
+    }
+
+    ExFreePool(CompletionCaches);
+    CompletionCaches = NULL;
+}
+
+NTSTATUS
+WskRegisterBuffer(
+    char *Buf,
+    ULONG BufLen,
+    BOOLEAN BufIsNonPagedPool,
+    _Out_ PVOID* RegisteredBuffer
+    )
+{
+    NTSTATUS Status;
+    PWSKCLIENT_REGISTERED_BUFFER Registered;
+
+    #pragma warning( suppress : 4996 )
+    Registered = ExAllocatePoolWithTag(NonPagedPoolNx, sizeof(*Registered), 'tseT');
+    if (Registered == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    RtlZeroMemory(Registered, sizeof(*Registered));
+
+    Status =
+        InitializeWskBuf(
+            Buf, BufLen, 0, BufIsNonPagedPool, NULL, &Registered->WskBuf,
+            &Registered->BufLocked);
+    if (!NT_SUCCESS(Status)) {
+        ExFreePool(Registered);
+        return Status;
+    }
+
+    *RegisteredBuffer = Registered;
+    return STATUS_SUCCESS;
+}
+
+VOID
+WskDeregisterBuffer(
+    _In_ PVOID RegisteredBuffer
+    )
+{
+    PWSKCLIENT_REGISTERED_BUFFER Registered = (PWSKCLIENT_REGISTERED_BUFFER)RegisteredBuffer;
+
+    UninitializeWskBuf(&Registered->WskBuf, Registered->BufLocked, NULL);
+    ExFreePool(Registered);
+}
+
+static
+VOID
+InitializeRegisteredWskBuf(
+    _In_ PVOID RegisteredBuffer,
+    _In_ ULONG Offset,
+    _In_ ULONG Length,
+    _Inout_ PWSKIOREQUEST_COMPLETION Completion
+    )
+{
+    PWSKCLIENT_REGISTERED_BUFFER Registered = (PWSKCLIENT_REGISTERED_BUFFER)RegisteredBuffer;
+
+    ASSERT(Length > 0);
+    ASSERT(Offset + Length <= Registered->WskBuf.Length);
+
+    Completion->WskBuf.Mdl = Registered->WskBuf.Mdl;
+    Completion->WskBuf.Offset = Registered->WskBuf.Offset + Offset;
+    Completion->WskBuf.Length = Length;
+    Completion->BufRegistered = TRUE;
+}
+
 NTSTATUS
 WskWaitForIrpCompletion(
     PKEVENT Event,
@@ -157,6 +736,21 @@ WskWaitForIrpCompletion(
     return Irp->IoStatus.Status;
 }
 
+static
+NTSTATUS
+AwaitIoRequestCompletion(
+    _In_ PWSKIOREQUEST_COMPLETION Completion,
+    _In_ ULONG TimeoutMs
+    )
+{
+    // Release the owner's reference; the IRP's reference wakes us.
+    if (InterlockedDecrement(&Completion->PendingRefs) != 0) {
+        WskWaitForIrpCompletion(&Completion->Event, Completion->Irp, TimeoutMs);
+    }
+
+    return Completion->Irp->IoStatus.Status;
+}
+
 NTSTATUS
 WskSocketSync(
     int WskSockType,
@@ -402,7 +996,7 @@ WskConnectExSync(
     IoSetCompletionRoutine(Irp, GenericCompletionRoutine, &Event, TRUE, TRUE, TRUE);
 
     if (Buf != NULL) {
-        Status = InitializeWskBuf(Buf, BufLen, 0, BufIsNonPagedPool, &WskBuf, &BufLocked);
+        Status = InitializeWskBuf(Buf, BufLen, 0, BufIsNonPagedPool, NULL, &WskBuf, &BufLocked);
         if (!NT_SUCCESS(Status)) {
             goto Cleanup;
         }
@@ -421,7 +1015,7 @@ Cleanup:
     if (Irp != NULL) {
         IoFreeIrp(Irp);
     }
-    UninitializeWskBuf(&WskBuf, BufLocked);
+    UninitializeWskBuf(&WskBuf, BufLocked, NULL);
     return Status;
 }
 
@@ -436,22 +1030,19 @@ WskConnectExAsync(
     _Out_ PVOID* ConnectCompletion
     )
 {
-    PIRP Irp = NULL;
     NTSTATUS Status;
     PFN_WSK_CONNECT_EX WskConnectEx;
-    PWSKCONNECTEX_COMPLETION Completion = NULL;
+    PWSKIOREQUEST_COMPLETION Completion = NULL;
 
     // On success, caller must follow up with a call to WskConnectExAwait
     // (regardless of whether the call was pended). If the call was pended, the
     // client can instead call WskConnectExCancel.
 
-    #pragma warning( suppress : 4996 )
-    Completion = ExAllocatePoolWithTag(NonPagedPoolNx, sizeof(*Completion), 'tseT');
+    Completion = AllocateIoRequestCompletion();
     if (Completion == NULL) {
         Status = STATUS_INSUFFICIENT_RESOURCES;
         goto Failure;
     }
-    RtlZeroMemory(Completion, sizeof(*Completion));
 
     switch (SockType) {
     case WSK_FLAG_CONNECTION_SOCKET:
@@ -466,29 +1057,21 @@ WskConnectExAsync(
         goto Failure;
     }
 
-    Irp = IoAllocateIrp(1, FALSE);
-    if (Irp == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto Failure;
-    }
-    KeInitializeEvent(&Completion->Event, NotificationEvent, FALSE);
-    IoSetCompletionRoutine(Irp, GenericCompletionRoutine, &Completion->Event, TRUE, TRUE, TRUE);
-
     if (Buf != NULL) {
         Status =
             InitializeWskBuf(
-                Buf, BufLen, 0, BufIsNonPagedPool, &Completion->WskBuf, &Completion->BufLocked);
+                Buf, BufLen, 0, BufIsNonPagedPool, Completion->CachedMdl, &Completion->WskBuf,
+                &Completion->BufLocked);
         if (!NT_SUCCESS(Status)) {
             goto Failure;
         }
-        Status = WskConnectEx(Sock, Addr, &Completion->WskBuf, 0, Irp);
+        Status = WskConnectEx(Sock, Addr, &Completion->WskBuf, 0, Completion->Irp);
     } else {
-        Status = WskConnectEx(Sock, Addr, NULL, 0, Irp);
+        Status = WskConnectEx(Sock, Addr, NULL, 0, Completion->Irp);
     }
     if (NT_SUCCESS(Status)) {
         // N.B. This includes the STATUS_PENDING case.
         Completion->Status = Status;
-        Completion->Irp = Irp;
         Status = STATUS_SUCCESS;
         *ConnectCompletion = Completion;
         return Status;
@@ -496,12 +1079,8 @@ WskConnectExAsync(
 
     LOG("WskConnectEx failed with %d\n", Status);
 Failure:
-    if (Irp != NULL) {
-        IoFreeIrp(Irp);
-    }
     if (Completion != NULL) {
-        UninitializeWskBuf(&Completion->WskBuf, Completion->BufLocked);
-        ExFreePool(Completion);
+        FreeIoRequestCompletion(Completion);
     }
 
     return Status;
@@ -513,24 +1092,19 @@ WskConnectExAwait(
     _In_ ULONG TimeoutMs
     )
 {
-    PWSKCONNECTEX_COMPLETION Completion = (PWSKCONNECTEX_COMPLETION)ConnectCompletion;
-    NTSTATUS Status = Completion->Status;
-    PIRP Irp = Completion->Irp;
+    PWSKIOREQUEST_COMPLETION Completion = (PWSKIOREQUEST_COMPLETION)ConnectCompletion;
+    NTSTATUS Status;
 
     ASSERT(NT_SUCCESS(Completion->Status));
 
-    if (Completion->Status == STATUS_PENDING) {
-        Status = WskWaitForIrpCompletion(&Completion->Event, Irp, TimeoutMs);
-    }
+    Status = AwaitIoRequestCompletion(Completion, TimeoutMs);
 
     if (Status == STATUS_CANCELLED) {
         // We hit our Timeout and cancelled the Irp. STATUS_TIMEOUT is a better
         // Status in this case.
         Status = STATUS_TIMEOUT;
     }
-    IoFreeIrp(Irp);
-    UninitializeWskBuf(&Completion->WskBuf, Completion->BufLocked);
-    ExFreePool(Completion);
+    FreeIoRequestCompletion(Completion);
     return Status;
 }
 
@@ -539,13 +1113,10 @@ WskConnectExCancel(
     _Inout_ PVOID ConnectCompletion
     )
 {
-    PWSKCONNECTEX_COMPLETION Completion = (PWSKCONNECTEX_COMPLETION)ConnectCompletion;
-    PIRP Irp = Completion->Irp;
-    IoCancelIrp(Irp);
-    KeWaitForSingleObject(&Completion->Event, Executive, KernelMode, FALSE, NULL);
-    IoFreeIrp(Irp);
-    UninitializeWskBuf(&Completion->WskBuf, Completion->BufLocked);
-    ExFreePool(Completion);
+    PWSKIOREQUEST_COMPLETION Completion = (PWSKIOREQUEST_COMPLETION)ConnectCompletion;
+    IoCancelIrp(Completion->Irp);
+    AwaitIoRequestCompletion(Completion, WSKCLIENT_INFINITE);
+    FreeIoRequestCompletion(Completion);
 }
 
 NTSTATUS
@@ -601,16 +1172,14 @@ WskAcceptAsync(
     _Out_ PVOID* AcceptCompletion
     )
 {
-    PIRP Irp = NULL;
     NTSTATUS Status;
     PFN_WSK_ACCEPT WskAccept;
-    PWSKACCEPT_COMPLETION Completion = NULL;
+    PWSKIOREQUEST_COMPLETION Completion = NULL;
 
     // On success, caller must follow up with a call to WskAcceptAwait
     // (regardless of whether the call was pended).
 
-    #pragma warning( suppress : 4996 )
-    Completion = ExAllocatePoolWithTag(NonPagedPoolNx, sizeof(*Completion), 'tseT');
+    Completion = AllocateIoRequestCompletion();
     if (Completion == NULL) {
         Status = STATUS_INSUFFICIENT_RESOURCES;
         goto Failure;
@@ -629,18 +1198,10 @@ WskAcceptAsync(
         goto Failure;
     }
 
-    Irp = IoAllocateIrp(1, FALSE);
-    if (Irp == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto Failure;
-    }
-    KeInitializeEvent(&Completion->Event, NotificationEvent, FALSE);
-    IoSetCompletionRoutine(Irp, GenericCompletionRoutine, &Completion->Event, TRUE, TRUE, TRUE);
-    Status = WskAccept(ListenSock, 0, NULL, NULL, NULL, NULL, Irp);
+    Status = WskAccept(ListenSock, 0, NULL, NULL, NULL, NULL, Completion->Irp);
     if (NT_SUCCESS(Status)) {
         // N.B. This includes the STATUS_PENDING case.
         Completion->Status = Status;
-        Completion->Irp = Irp;
         Status = STATUS_SUCCESS;
         *AcceptCompletion = Completion;
         return Status;
@@ -648,11 +1209,8 @@ WskAcceptAsync(
 
     LOG("WskAccept failed with %d\n", Status);
 Failure:
-    if (Irp != NULL) {
-        IoFreeIrp(Irp);
-    }
     if (Completion != NULL) {
-        ExFreePool(Completion);
+        FreeIoRequestCompletion(Completion);
     }
 
     return Status;
@@ -665,28 +1223,24 @@ WskAcceptAwait(
     _Out_ PWSK_SOCKET* AcceptSock
     )
 {
-    PWSKACCEPT_COMPLETION Completion = (PWSKACCEPT_COMPLETION)AcceptCompletion;
-    NTSTATUS Status = Completion->Status;
-    PIRP Irp = Completion->Irp;
+    PWSKIOREQUEST_COMPLETION Completion = (PWSKIOREQUEST_COMPLETION)AcceptCompletion;
+    NTSTATUS Status;
 
     ASSERT(NT_SUCCESS(Completion->Status));
 
     *AcceptSock = NULL;
 
-    if (Completion->Status == STATUS_PENDING) {
-        Status = WskWaitForIrpCompletion(&Completion->Event, Irp, TimeoutMs);
-    }
+    Status = AwaitIoRequestCompletion(Completion, TimeoutMs);
 
     if (NT_SUCCESS(Status)) {
-        *AcceptSock = (PWSK_SOCKET)Irp->IoStatus.Information;
+        *AcceptSock = (PWSK_SOCKET)Completion->Irp->IoStatus.Information;
     } else if (Status == STATUS_CANCELLED) {
         // We hit our Timeout and cancelled the Irp. STATUS_TIMEOUT is a better
         // Status in this case.
         Status = STATUS_TIMEOUT;
     }
 
-    IoFreeIrp(Irp);
-    ExFreePool(Completion);
+    FreeIoRequestCompletion(Completion);
     return Status;
 }
 
@@ -695,12 +1249,10 @@ WskAcceptCancel(
     _Inout_ PVOID AcceptCompletion
     )
 {
-    PWSKACCEPT_COMPLETION Completion = (PWSKACCEPT_COMPLETION)AcceptCompletion;
-    PIRP Irp = Completion->Irp;
-    IoCancelIrp(Irp);
-    KeWaitForSingleObject(&Completion->Event, Executive, KernelMode, FALSE, NULL);
-    IoFreeIrp(Irp);
-    ExFreePool(Completion);
+    PWSKIOREQUEST_COMPLETION Completion = (PWSKIOREQUEST_COMPLETION)AcceptCompletion;
+    IoCancelIrp(Completion->Irp);
+    AwaitIoRequestCompletion(Completion, WSKCLIENT_INFINITE);
+    FreeIoRequestCompletion(Completion);
 }
 
 NTSTATUS
@@ -769,7 +1321,7 @@ WskDisconnectSync(
     KeInitializeEvent(&Event, NotificationEvent, FALSE);
     IoSetCompletionRoutine(Irp, GenericCompletionRoutine, &Event, TRUE, TRUE, TRUE);
     if (Buf != NULL) {
-        Status = InitializeWskBuf(Buf, BufLen, 0, BufIsNonPagedPool, &WskBuf, &BufLocked);
+        Status = InitializeWskBuf(Buf, BufLen, 0, BufIsNonPagedPool, NULL, &WskBuf, &BufLocked);
         if (!NT_SUCCESS(Status)) {
             goto Cleanup;
         }
@@ -787,7 +1339,7 @@ Cleanup:
     if (Irp != NULL) {
         IoFreeIrp(Irp);
     }
-    UninitializeWskBuf(&WskBuf, BufLocked);
+    UninitializeWskBuf(&WskBuf, BufLocked, NULL);
     return Status;
 }
 
@@ -839,23 +1391,20 @@ WskDisconnectAsync(
     ULONG BufLen,
     BOOLEAN BufIsNonPagedPool,
     ULONG Flags,
-    _Out_ PWSKDISCONNECT_COMPLETION* DisconnectCompletion
+    _Out_ PVOID* DisconnectCompletion
     )
 {
-    PIRP Irp = NULL;
     NTSTATUS Status;
     PFN_WSK_DISCONNECT WskDisconnect;
-    PWSKDISCONNECT_COMPLETION Completion = NULL;
+    PWSKIOREQUEST_COMPLETION Completion = NULL;
 
     // On success, caller must follow up with a call to WskDisconnectAwait,
 
-    #pragma warning( suppress : 4996 )
-    Completion = ExAllocatePoolWithTag(NonPagedPoolNx, sizeof(*Completion), 'tseT');
+    Completion = AllocateIoRequestCompletion();
     if (Completion == NULL) {
         Status = STATUS_INSUFFICIENT_RESOURCES;
         goto Failure;
     }
-    RtlZeroMemory(Completion, sizeof(*Completion));
 
     switch (SockType) {
     case WSK_FLAG_CONNECTION_SOCKET:
@@ -870,31 +1419,23 @@ WskDisconnectAsync(
         goto Failure;
     }
 
-    Irp = IoAllocateIrp(1, FALSE);
-    if (Irp == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto Failure;
-    }
-    KeInitializeEvent(&Completion->Event, NotificationEvent, FALSE);
-    IoSetCompletionRoutine(Irp, GenericCompletionRoutine, &Completion->Event, TRUE, TRUE, TRUE);
-
     if (Buf != NULL) {
         ASSERT(Flags == 0);
         Status =
             InitializeWskBuf(
-                Buf, BufLen, 0, BufIsNonPagedPool, &Completion->WskBuf, &Completion->BufLocked);
+                Buf, BufLen, 0, BufIsNonPagedPool, Completion->CachedMdl, &Completion->WskBuf,
+                &Completion->BufLocked);
         if (!NT_SUCCESS(Status)) {
             goto Failure;
         }
-        Status = WskDisconnect(Sock, &Completion->WskBuf, Flags, Irp);
+        Status = WskDisconnect(Sock, &Completion->WskBuf, Flags, Completion->Irp);
     } else {
-        Status = WskDisconnect(Sock, NULL, Flags, Irp);
+        Status = WskDisconnect(Sock, NULL, Flags, Completion->Irp);
     }
 
     if (NT_SUCCESS(Status)) {
         // N.B. This includes the STATUS_PENDING case.
         Completion->Status = Status;
-        Completion->Irp = Irp;
         Status = STATUS_SUCCESS;
         *DisconnectCompletion = Completion;
         return Status;
@@ -902,12 +1443,8 @@ WskDisconnectAsync(
 
     LOG("WskDisconnect failed with %d\n", Status);
 Failure:
-    if (Irp != NULL) {
-        IoFreeIrp(Irp);
-    }
     if (Completion != NULL) {
-        UninitializeWskBuf(&Completion->WskBuf, Completion->BufLocked);
-        ExFreePool(Completion);
+        FreeIoRequestCompletion(Completion);
     }
 
     return Status;
@@ -915,18 +1452,16 @@ Failure:
 
 NTSTATUS
 WskDisconnectAwait(
-    _Inout_ PWSKDISCONNECT_COMPLETION Completion,
+    _Inout_ PVOID DisconnectCompletion,
     _In_ ULONG TimeoutMs
     )
 {
-    NTSTATUS Status = Completion->Status;
-    PIRP Irp = Completion->Irp;
+    PWSKIOREQUEST_COMPLETION Completion = (PWSKIOREQUEST_COMPLETION)DisconnectCompletion;
+    NTSTATUS Status;
 
     ASSERT(NT_SUCCESS(Completion->Status));
 
-    if (Completion->Status == STATUS_PENDING) {
-        Status = WskWaitForIrpCompletion(&Completion->Event, Irp, TimeoutMs);
-    }
+    Status = AwaitIoRequestCompletion(Completion, TimeoutMs);
 
     if (Status == STATUS_CANCELLED) {
         // We hit our Timeout and cancelled the Irp. STATUS_TIMEOUT is a better
@@ -934,9 +1469,7 @@ WskDisconnectAwait(
         Status = STATUS_TIMEOUT;
     }
 
-    IoFreeIrp(Irp);
-    UninitializeWskBuf(&Completion->WskBuf, Completion->BufLocked);
-    ExFreePool(Completion);
+    FreeIoRequestCompletion(Completion);
     return Status;
 }
 
@@ -965,7 +1498,7 @@ WskSendSync(
 
     ASSERT(BufLen > 0);
 
-    Status = InitializeWskBuf(Buf, BufLen, 0, BufIsNonPagedPool, &WskBuf, &BufLocked);
+    Status = InitializeWskBuf(Buf, BufLen, 0, BufIsNonPagedPool, NULL, &WskBuf, &BufLocked);
     if (!NT_SUCCESS(Status)) {
         goto Cleanup;
     }
@@ -1008,7 +1541,7 @@ Cleanup:
     if (Irp != NULL) {
         IoFreeIrp(Irp);
     }
-    UninitializeWskBuf(&WskBuf, BufLocked);
+    UninitializeWskBuf(&WskBuf, BufLocked, NULL);
     return Status;
 }
 
@@ -1039,7 +1572,7 @@ WskSendExSync(
 
     ASSERT(BufLen > 0);
 
-    Status = InitializeWskBuf(Buf, BufLen, 0, BufIsNonPagedPool, &WskBuf, &BufLocked);
+    Status = InitializeWskBuf(Buf, BufLen, 0, BufIsNonPagedPool, NULL, &WskBuf, &BufLocked);
     if (!NT_SUCCESS(Status)) {
         goto Cleanup;
     }
@@ -1082,37 +1615,22 @@ Cleanup:
     if (Irp != NULL) {
         IoFreeIrp(Irp);
     }
-    UninitializeWskBuf(&WskBuf, BufLocked);
+    UninitializeWskBuf(&WskBuf, BufLocked, NULL);
     return Status;
 }
 
+static
 NTSTATUS
-WskSendAsync(
+SendAsync(
     PWSK_SOCKET Sock,
     int SockType,
-    char *Buf,
-    ULONG BufLen,
-    BOOLEAN BufIsNonPagedPool,
+    _In_ PWSKIOREQUEST_COMPLETION Completion,
     ULONG Flags,
     _Out_ PVOID* SendCompletion
     )
 {
-    PIRP Irp = NULL;
     NTSTATUS Status;
     PFN_WSK_SEND WskSend;
-    PWSKIOREQUEST_COMPLETION Completion = NULL;
-
-    ASSERT(BufLen > 0);
-
-    // On success, caller must follow up with a call to WskSendAwait.
-
-    #pragma warning( suppress : 4996 )
-    Completion = ExAllocatePoolWithTag(NonPagedPoolNx, sizeof(*Completion), 'tseT');
-    if (Completion == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto Failure;
-    }
-    RtlZeroMemory(Completion, sizeof(*Completion));
 
     switch (SockType) {
     case WSK_FLAG_CONNECTION_SOCKET:
@@ -1127,27 +1645,11 @@ WskSendAsync(
         goto Failure;
     }
 
-    Irp = IoAllocateIrp(1, FALSE);
-    if (Irp == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto Failure;
-    }
-    KeInitializeEvent(&Completion->Event, NotificationEvent, FALSE);
-    IoSetCompletionRoutine(Irp, GenericCompletionRoutine, &Completion->Event, TRUE, TRUE, TRUE);
-
-    Status =
-        InitializeWskBuf(
-            Buf, BufLen, 0, BufIsNonPagedPool, &Completion->WskBuf, &Completion->BufLocked);
-    if (!NT_SUCCESS(Status)) {
-        goto Failure;
-    }
-
-    Status = WskSend(Sock, &Completion->WskBuf, Flags, Irp);
+    Status = WskSend(Sock, &Completion->WskBuf, Flags, Completion->Irp);
 
     if (NT_SUCCESS(Status)) {
         // N.B. This includes the STATUS_PENDING case.
         Completion->Status = Status;
-        Completion->Irp = Irp;
         Status = STATUS_SUCCESS;
         *SendCompletion = Completion;
         return Status;
@@ -1155,15 +1657,68 @@ WskSendAsync(
 
     LOG("WskSend failed with %d\n", Status);
 Failure:
-    if (Irp != NULL) {
-        IoFreeIrp(Irp);
+    FreeIoRequestCompletion(Completion);
+    return Status;
+}
+
+NTSTATUS
+WskSendAsync(
+    PWSK_SOCKET Sock,
+    int SockType,
+    char *Buf,
+    ULONG BufLen,
+    BOOLEAN BufIsNonPagedPool,
+    ULONG Flags,
+    _Out_ PVOID* SendCompletion
+    )
+{
+    NTSTATUS Status;
+    PWSKIOREQUEST_COMPLETION Completion;
+
+    ASSERT(BufLen > 0);
+
+    // On success, caller must follow up with a call to WskSendAwait.
+
+    Completion = AllocateIoRequestCompletion();
+    if (Completion == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
     }
-    if (Completion != NULL) {
-        UninitializeWskBuf(&Completion->WskBuf, Completion->BufLocked);
-        ExFreePool(Completion);
+
+    Status =
+        InitializeWskBuf(
+            Buf, BufLen, 0, BufIsNonPagedPool, Completion->CachedMdl, &Completion->WskBuf,
+            &Completion->BufLocked);
+    if (!NT_SUCCESS(Status)) {
+        FreeIoRequestCompletion(Completion);
+        return Status;
     }
 
-    return Status;
+    return SendAsync(Sock, SockType, Completion, Flags, SendCompletion);
+}
+
+NTSTATUS
+WskSendRegisteredAsync(
+    PWSK_SOCKET Sock,
+    int SockType,
+    PVOID RegisteredBuffer,
+    ULONG Offset,
+    ULONG Length,
+    ULONG Flags,
+    _Out_ PVOID* SendCompletion
+    )
+{
+    PWSKIOREQUEST_COMPLETION Completion;
+
+    // On success, caller must follow up with a call to WskSendAwait.
+
+    Completion = AllocateIoRequestCompletion();
+    if (Completion == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    InitializeRegisteredWskBuf(RegisteredBuffer, Offset, Length, Completion);
+
+    return SendAsync(Sock, SockType, Completion, Flags, SendCompletion);
 }
 
 NTSTATUS
@@ -1179,7 +1734,7 @@ WskSendAwait(
 #endif
 
     PWSKIOREQUEST_COMPLETION Completion = (PWSKIOREQUEST_COMPLETION)SendCompletion;
-    NTSTATUS Status = Completion->Status;
+    NTSTATUS Status;
     PIRP Irp = Completion->Irp;
 
     ASSERT(NT_SUCCESS(Completion->Status));
@@ -1188,9 +1743,7 @@ WskSendAwait(
         *BytesSent = 0;
     }
 
-    if (Completion->Status == STATUS_PENDING) {
-        Status = WskWaitForIrpCompletion(&Completion->Event, Irp, TimeoutMs);
-    }
+    Status = AwaitIoRequestCompletion(Completion, TimeoutMs);
 
     if (!NT_SUCCESS(Status)) {
         LOG("WskSend IO failed with %d\n", Status);
@@ -1208,9 +1761,7 @@ WskSendAwait(
         }
     }
 
-    IoFreeIrp(Irp);
-    UninitializeWskBuf(&Completion->WskBuf, Completion->BufLocked);
-    ExFreePool(Completion);
+    FreeIoRequestCompletion(Completion);
     return Status;
 }
 
@@ -1244,7 +1795,7 @@ WskReceiveSync(
         *BytesReceived = 0;
     }
 
-    Status = InitializeWskBuf(Buf, BufLen, 0, BufIsNonPagedPool, &WskBuf, &BufLocked);
+    Status = InitializeWskBuf(Buf, BufLen, 0, BufIsNonPagedPool, NULL, &WskBuf, &BufLocked);
     if (!NT_SUCCESS(Status)) {
         goto Cleanup;
     }
@@ -1303,7 +1854,7 @@ Cleanup:
     if (Irp != NULL) {
         IoFreeIrp(Irp);
     }
-    UninitializeWskBuf(&WskBuf, BufLocked);
+    UninitializeWskBuf(&WskBuf, BufLocked, NULL);
     return Status;
 }
 
@@ -1338,7 +1889,7 @@ WskReceiveExSync(
         *BytesReceived = 0;
     }
 
-    Status = InitializeWskBuf(Buf, BufLen, 0, BufIsNonPagedPool, &WskBuf, &BufLocked);
+    Status = InitializeWskBuf(Buf, BufLen, 0, BufIsNonPagedPool, NULL, &WskBuf, &BufLocked);
     if (!NT_SUCCESS(Status)) {
         goto Cleanup;
     }
@@ -1390,7 +1941,7 @@ Cleanup:
     if (Irp != NULL) {
         IoFreeIrp(Irp);
     }
-    UninitializeWskBuf(&WskBuf, BufLocked);
+    UninitializeWskBuf(&WskBuf, BufLocked, NULL);
     return Status;
 }
 
@@ -1404,7 +1955,6 @@ WskReceiveAsync(
     _Out_ PVOID* ReceiveCompletion
     )
 {
-    PIRP Irp = NULL;
     NTSTATUS Status;
     PFN_WSK_RECEIVE WskReceive;
     PWSKIOREQUEST_COMPLETION Completion = NULL;
@@ -1413,13 +1963,11 @@ WskReceiveAsync(
 
     // On success, caller must follow up with a call to WskSendAwait.
 
-    #pragma warning( suppress : 4996 )
-    Completion = ExAllocatePoolWithTag(NonPagedPoolNx, sizeof(*Completion), 'tseT');
+    Completion = AllocateIoRequestCompletion();
     if (Completion == NULL) {
         Status = STATUS_INSUFFICIENT_RESOURCES;
         goto Failure;
     }
-    RtlZeroMemory(Completion, sizeof(*Completion));
 
     switch (SockType) {
     case WSK_FLAG_CONNECTION_SOCKET:
@@ -1434,27 +1982,19 @@ WskReceiveAsync(
         goto Failure;
     }
 
-    Irp = IoAllocateIrp(1, FALSE);
-    if (Irp == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto Failure;
-    }
-    KeInitializeEvent(&Completion->Event, NotificationEvent, FALSE);
-    IoSetCompletionRoutine(Irp, GenericCompletionRoutine, &Completion->Event, TRUE, TRUE, TRUE);
-
     Status =
         InitializeWskBuf(
-            Buf, BufLen, 0, BufIsNonPagedPool, &Completion->WskBuf, &Completion->BufLocked);
+            Buf, BufLen, 0, BufIsNonPagedPool, Completion->CachedMdl, &Completion->WskBuf,
+            &Completion->BufLocked);
     if (!NT_SUCCESS(Status)) {
         goto Failure;
     }
 
-    Status = WskReceive(Sock, &Completion->WskBuf, WSK_FLAG_WAITALL, Irp);
+    Status = WskReceive(Sock, &Completion->WskBuf, WSK_FLAG_WAITALL, Completion->Irp);
 
     if (NT_SUCCESS(Status)) {
         // N.B. This includes the STATUS_PENDING case.
         Completion->Status = Status;
-        Completion->Irp = Irp;
         Status = STATUS_SUCCESS;
         *ReceiveCompletion = Completion;
         return Status;
@@ -1462,12 +2002,8 @@ WskReceiveAsync(
 
     LOG("WskReceive failed with %d\n", Status);
 Failure:
-    if (Irp != NULL) {
-        IoFreeIrp(Irp);
-    }
     if (Completion != NULL) {
-        UninitializeWskBuf(&Completion->WskBuf, Completion->BufLocked);
-        ExFreePool(Completion);
+        FreeIoRequestCompletion(Completion);
     }
 
     return Status;
@@ -1486,7 +2022,7 @@ WskReceiveAwait(
 #endif
 
     PWSKIOREQUEST_COMPLETION Completion = (PWSKIOREQUEST_COMPLETION)ReceiveCompletion;
-    NTSTATUS Status = Completion->Status;
+    NTSTATUS Status;
     PIRP Irp = Completion->Irp;
 
     ASSERT(NT_SUCCESS(Completion->Status));
@@ -1495,9 +2031,7 @@ WskReceiveAwait(
         *BytesReceived = 0;
     }
 
-    if (Completion->Status == STATUS_PENDING) {
-        Status = WskWaitForIrpCompletion(&Completion->Event, Irp, TimeoutMs);
-    }
+    Status = AwaitIoRequestCompletion(Completion, TimeoutMs);
 
     if (!NT_SUCCESS(Status)) {
         if (Status == STATUS_CANCELLED) {
@@ -1516,12 +2050,419 @@ WskReceiveAwait(
         }
     }
 
-    IoFreeIrp(Irp);
-    UninitializeWskBuf(&Completion->WskBuf, Completion->BufLocked);
-    ExFreePool(Completion);
+    FreeIoRequestCompletion(Completion);
+    return Status;
+}
+
+typedef struct _WSKCLIENT_RECEIVE_PIPELINE WSKCLIENT_RECEIVE_PIPELINE;
+
+typedef struct _WSKCLIENT_RECEIVE_SLOT {
+    WSKCLIENT_RECEIVE_PIPELINE* Pipeline;
+    char *Buf;
+    PIRP Irp;
+    WSK_BUF WskBuf;
+    BOOLEAN BufLocked;
+    BOOLEAN Posted;
+    BOOLEAN Submitted;
+    BOOLEAN Completed;
+    ULONG PostCount;
+} WSKCLIENT_RECEIVE_SLOT;
+
+typedef struct _WSKCLIENT_RECEIVE_PIPELINE {
+    PWSK_SOCKET Sock;
+    PFN_WSK_RECEIVE WskReceive;
+    WSKCLIENT_RECEIVE_CALLBACK *Callback;
+    PVOID CallbackContext;
+
+    //
+    // Receives are posted and delivered in ring order, which keeps the byte
+    // stream in order even though their IRPs may complete out of order.
+    //
+    KSPIN_LOCK Lock;
+    ULONG NextIndex;
+    BOOLEAN Delivering;
+    BOOLEAN Stopping;
+    BOOLEAN Ended;
+    KEVENT ReadyEvent;
+    WSKCLIENT_RECEIVE_SLOT *HeldSlot;
+
+    //
+    // Set once WskReceivePipelineGet has returned the receive that ended the
+    // stream. No receive is re-armed after it, so later calls return its
+    // status instead of waiting.
+    //
+    BOOLEAN EndReturned;
+    NTSTATUS EndStatus;
+
+    //
+    // Held by each posted receive until its completion routine returns, and
+    // by the posting thread until the receive has been submitted.
+    //
+    EX_RUNDOWN_REF Rundown;
+
+    ULONG SlotCount;
+    WSKCLIENT_RECEIVE_SLOT Slots[ANYSIZE_ARRAY];
+} WSKCLIENT_RECEIVE_PIPELINE;
+
+static
+_Function_class_(IO_COMPLETION_ROUTINE)
+NTSTATUS
+ReceivePipelineCompletionRoutine(
+    const DEVICE_OBJECT* DeviceObject,
+    const IRP* Irp,
+    PVOID Context
+    );
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+PostPipelineReceive(
+    _In_ WSKCLIENT_RECEIVE_PIPELINE* Pipeline,
+    _In_ WSKCLIENT_RECEIVE_SLOT* Slot
+    )
+{
+    KIRQL PrevIrql;
+    ULONG PostCount;
+    BOOLEAN Cancel = FALSE;
+
+    KeAcquireSpinLock(&Pipeline->Lock, &PrevIrql);
+    if (Pipeline->Stopping || Pipeline->Ended ||
+        !ExAcquireRundownProtectionEx(&Pipeline->Rundown, 2)) {
+        KeReleaseSpinLock(&Pipeline->Lock, PrevIrql);
+        return;
+    }
+    Slot->Posted = TRUE;
+    Slot->Submitted = FALSE;
+    PostCount = ++Slot->PostCount;
+    IoReuseIrp(Slot->Irp, STATUS_UNSUCCESSFUL);
+    IoSetCompletionRoutine(
+        Slot->Irp, ReceivePipelineCompletionRoutine, Slot, TRUE, TRUE, TRUE);
+    KeReleaseSpinLock(&Pipeline->Lock, PrevIrql);
+
+    // The completion routine runs even if WskReceive fails inline.
+    Pipeline->WskReceive(Pipeline->Sock, &Slot->WskBuf, 0, Slot->Irp);
+
+    //
+    // The IRP can only be cancelled once WSK owns it. If the pipeline started
+    // stopping while the receive was being submitted, the destroying thread
+    // skipped this slot, so cancel the receive here. If the receive already
+    // completed and the slot was posted again, that post owns the slot.
+    //
+    KeAcquireSpinLock(&Pipeline->Lock, &PrevIrql);
+    if (Slot->PostCount == PostCount) {
+        Slot->Submitted = TRUE;
+        Cancel = Pipeline->Stopping && Slot->Posted;
+    }
+    KeReleaseSpinLock(&Pipeline->Lock, PrevIrql);
+
+    if (Cancel) {
+        IoCancelIrp(Slot->Irp);
+    }
+
+    ExReleaseRundownProtection(&Pipeline->Rundown);
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+DeliverPipelineReceives(
+    _In_ WSKCLIENT_RECEIVE_PIPELINE* Pipeline
+    )
+{
+    KIRQL PrevIrql;
+
+    //
+    // Only one thread delivers at a time. A receive that completes inline
+    // when its slot is re-armed is picked up by the delivering thread rather
+    // than recursing.
+    //
+    KeAcquireSpinLock(&Pipeline->Lock, &PrevIrql);
+    if (Pipeline->Delivering) {
+        KeReleaseSpinLock(&Pipeline->Lock, PrevIrql);
+        return;
+    }
+    Pipeline->Delivering = TRUE;
+
+    for (;;) {
+        WSKCLIENT_RECEIVE_SLOT* Slot = &Pipeline->Slots[Pipeline->NextIndex];
+
+        if (!Slot->Completed) {
+            break;
+        }
+
+        Slot->Completed = FALSE;
+        Pipeline->NextIndex = (Pipeline->NextIndex + 1) % Pipeline->SlotCount;
+        KeReleaseSpinLock(&Pipeline->Lock, PrevIrql);
+
+        Pipeline->Callback(
+            Pipeline->CallbackContext, Slot->Irp->IoStatus.Status, Slot->Buf,
+            (ULONG)Slot->Irp->IoStatus.Information);
+        PostPipelineReceive(Pipeline, Slot);
+
+        KeAcquireSpinLock(&Pipeline->Lock, &PrevIrql);
+    }
+
+    Pipeline->Delivering = FALSE;
+    KeReleaseSpinLock(&Pipeline->Lock, PrevIrql);
+}
+
+static
+_Function_class_(IO_COMPLETION_ROUTINE)
+NTSTATUS
+ReceivePipelineCompletionRoutine(
+    const DEVICE_OBJECT* DeviceObject,
+    const IRP* Irp,
+    PVOID Context
+    )
+{
+    WSKCLIENT_RECEIVE_SLOT* Slot = (WSKCLIENT_RECEIVE_SLOT*)Context;
+    WSKCLIENT_RECEIVE_PIPELINE* Pipeline = Slot->Pipeline;
+    KIRQL PrevIrql;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    KeAcquireSpinLock(&Pipeline->Lock, &PrevIrql);
+    Slot->Posted = FALSE;
+    Slot->Completed = TRUE;
+    if (!NT_SUCCESS(Irp->IoStatus.Status) || Irp->IoStatus.Information == 0) {
+        // The connection was closed or failed; stop re-arming receives.
+        Pipeline->Ended = TRUE;
+    }
+    KeReleaseSpinLock(&Pipeline->Lock, PrevIrql);
+
+    if (Pipeline->Callback != NULL) {
+        DeliverPipelineReceives(Pipeline);
+    } else {
+        KeSetEvent(&Pipeline->ReadyEvent, IO_NO_INCREMENT, FALSE);
+    }
+
+    ExReleaseRundownProtection(&Pipeline->Rundown);
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+NTSTATUS
+WskReceivePipelineCreate(
+    PWSK_SOCKET Sock,
+    int SockType,
+    char *Bufs,
+    ULONG BufLen,
+    ULONG BufCount,
+    BOOLEAN BufIsNonPagedPool,
+    _In_opt_ WSKCLIENT_RECEIVE_CALLBACK *Callback,
+    _In_opt_ PVOID CallbackContext,
+    _Out_ PVOID* ReceivePipeline
+    )
+{
+    NTSTATUS Status;
+    WSKCLIENT_RECEIVE_PIPELINE* Pipeline = NULL;
+    PFN_WSK_RECEIVE WskReceive;
+
+    ASSERT(BufLen > 0);
+    ASSERT(BufCount > 0);
+
+    switch (SockType) {
+    case WSK_FLAG_CONNECTION_SOCKET:
+        WskReceive = ((PWSK_PROVIDER_CONNECTION_DISPATCH)Sock->Dispatch)->WskReceive;
+        break;
+    case WSK_FLAG_STREAM_SOCKET:
+        WskReceive = ((PWSK_PROVIDER_STREAM_DISPATCH)Sock->Dispatch)->WskReceive;
+        break;
+    default:
+        ASSERT(FALSE);
+        Status = STATUS_UNSUCCESSFUL;
+        goto Failure;
+    }
+
+    Pipeline =
+    #pragma warning( suppress : 4996 )
+        ExAllocatePoolWithTag(
+            NonPagedPoolNx,
+            FIELD_OFFSET(WSKCLIENT_RECEIVE_PIPELINE, Slots[BufCount]),
+            'tseT');
+    if (Pipeline == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Failure;
+    }
+    RtlZeroMemory(Pipeline, FIELD_OFFSET(WSKCLIENT_RECEIVE_PIPELINE, Slots[BufCount]));
+
+    Pipeline->Sock = Sock;
+    Pipeline->WskReceive = WskReceive;
+    Pipeline->Callback = Callback;
+    Pipeline->CallbackContext = CallbackContext;
+    KeInitializeSpinLock(&Pipeline->Lock);
+    KeInitializeEvent(&Pipeline->ReadyEvent, SynchronizationEvent, FALSE);
+    ExInitializeRundownProtection(&Pipeline->Rundown);
+    Pipeline->SlotCount = BufCount;
+
+    //
+    // Each slot owns its IRP and its buffer's MDL for the pipeline's lifetime,
+    // so re-arming a receive does not allocate.
+    //
+    for (ULONG Index = 0; Index < BufCount; Index++) {
+        WSKCLIENT_RECEIVE_SLOT* Slot = &Pipeline->Slots[Index];
+
+        Slot->Pipeline = Pipeline;
+        Slot->Buf = Bufs + (SIZE_T)Index * BufLen;
+
+        Slot->Irp = IoAllocateIrp(1, FALSE);
+        if (Slot->Irp == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Failure;
+        }
+
+        Status =
+            InitializeWskBuf(
+                Slot->Buf, BufLen, 0, BufIsNonPagedPool, NULL, &Slot->WskBuf, &Slot->BufLocked);
+        if (!NT_SUCCESS(Status)) {
+            goto Failure;
+        }
+    }
+
+    for (ULONG Index = 0; Index < BufCount; Index++) {
+        PostPipelineReceive(Pipeline, &Pipeline->Slots[Index]);
+    }
+
+    *ReceivePipeline = Pipeline;
+    return STATUS_SUCCESS;
+
+Failure:
+    if (Pipeline != NULL) {
+        WskReceivePipelineDestroy(Pipeline);
+    }
+
     return Status;
 }
 
+NTSTATUS
+WskReceivePipelineGet(
+    _In_ PVOID ReceivePipeline,
+    _In_ ULONG TimeoutMs,
+    _Outptr_ char **Buf,
+    _Out_ ULONG *BytesReceived
+    )
+{
+    WSKCLIENT_RECEIVE_PIPELINE* Pipeline = (WSKCLIENT_RECEIVE_PIPELINE*)ReceivePipeline;
+    WSKCLIENT_RECEIVE_SLOT* Slot = &Pipeline->Slots[Pipeline->NextIndex];
+    UINT64 Deadline = 0;
+    KIRQL PrevIrql;
+
+    ASSERT(Pipeline->Callback == NULL);
+
+    *Buf = NULL;
+    *BytesReceived = 0;
+
+    if (Pipeline->EndReturned) {
+        return Pipeline->EndStatus;
+    }
+
+    //
+    // The caller is done with the previously returned buffer, so re-arm it.
+    //
+    if (Pipeline->HeldSlot != NULL) {
+        PostPipelineReceive(Pipeline, Pipeline->HeldSlot);
+        Pipeline->HeldSlot = NULL;
+    }
+
+    if (TimeoutMs != WSKCLIENT_INFINITE) {
+        Deadline = KeQueryInterruptTime() + UInt32x32To64(TimeoutMs, 10000);
+    }
+
+    for (;;) {
+        LARGE_INTEGER Timeout;
+        LARGE_INTEGER* TimeoutPtr = NULL;
+        BOOLEAN Completed;
+        NTSTATUS Status;
+
+        KeAcquireSpinLock(&Pipeline->Lock, &PrevIrql);
+        Completed = Slot->Completed;
+        KeReleaseSpinLock(&Pipeline->Lock, PrevIrql);
+
+        if (Completed) {
+            break;
+        }
+
+        if (TimeoutMs != WSKCLIENT_INFINITE) {
+            UINT64 Now = KeQueryInterruptTime();
+
+            if (Now >= Deadline) {
+                return STATUS_TIMEOUT;
+            }
+
+            Timeout.QuadPart = -(INT64)(Deadline - Now);
+            TimeoutPtr = &Timeout;
+        }
+
+        // Later slots may complete first, so recheck the next slot on wakeup.
+        Status =
+            KeWaitForSingleObject(
+                &Pipeline->ReadyEvent, Executive, KernelMode, FALSE, TimeoutPtr);
+        if (Status == STATUS_TIMEOUT) {
+            return STATUS_TIMEOUT;
+        }
+    }
+
+    KeAcquireSpinLock(&Pipeline->Lock, &PrevIrql);
+    Slot->Completed = FALSE;
+    Pipeline->NextIndex = (Pipeline->NextIndex + 1) % Pipeline->SlotCount;
+    KeReleaseSpinLock(&Pipeline->Lock, PrevIrql);
+
+    Pipeline->HeldSlot = Slot;
+    *Buf = Slot->Buf;
+    *BytesReceived = (ULONG)Slot->Irp->IoStatus.Information;
+
+    if (!NT_SUCCESS(Slot->Irp->IoStatus.Status) || *BytesReceived == 0) {
+        Pipeline->EndReturned = TRUE;
+        Pipeline->EndStatus = Slot->Irp->IoStatus.Status;
+    }
+
+    return Slot->Irp->IoStatus.Status;
+}
+
+VOID
+WskReceivePipelineDestroy(
+    _In_ PVOID ReceivePipeline
+    )
+{
+    WSKCLIENT_RECEIVE_PIPELINE* Pipeline = (WSKCLIENT_RECEIVE_PIPELINE*)ReceivePipeline;
+    KIRQL PrevIrql;
+
+    KeAcquireSpinLock(&Pipeline->Lock, &PrevIrql);
+    Pipeline->Stopping = TRUE;
+    KeReleaseSpinLock(&Pipeline->Lock, PrevIrql);
+
+    //
+    // No receive is posted once Stopping is set, so cancel the submitted ones
+    // and wait for their completion routines to return. Receives still being
+    // submitted are cancelled by their posting thread.
+    //
+    for (ULONG Index = 0; Index < Pipeline->SlotCount; Index++) {
+        WSKCLIENT_RECEIVE_SLOT* Slot = &Pipeline->Slots[Index];
+        BOOLEAN Cancel;
+
+        KeAcquireSpinLock(&Pipeline->Lock, &PrevIrql);
+        Cancel = Slot->Posted && Slot->Submitted;
+        KeReleaseSpinLock(&Pipeline->Lock, PrevIrql);
+
+        if (Cancel) {
+            IoCancelIrp(Slot->Irp);
+        }
+    }
+
+    ExWaitForRundownProtectionRelease(&Pipeline->Rundown);
+
+    for (ULONG Index = 0; Index < Pipeline->SlotCount; Index++) {
+        WSKCLIENT_RECEIVE_SLOT* Slot = &Pipeline->Slots[Index];
+
+        UninitializeWskBuf(&Slot->WskBuf, Slot->BufLocked, NULL);
+        if (Slot->Irp != NULL) {
+            IoFreeIrp(Slot->Irp);
+        }
+    }
+
+    ExFreePool(Pipeline);
+}
+
 NTSTATUS
 WskSendToSync(
     PWSK_SOCKET Sock,
@@ -1548,7 +2489,7 @@ WskSendToSync(
 
     ASSERT(BufLen > 0);
 
-    Status = InitializeWskBuf(Buf, BufLen, 0, BufIsNonPagedPool, &WskBuf, &BufLocked);
+    Status = InitializeWskBuf(Buf, BufLen, 0, BufIsNonPagedPool, NULL, &WskBuf, &BufLocked);
     if (!NT_SUCCESS(Status)) {
         goto Cleanup;
     }
@@ -1579,7 +2520,48 @@ Cleanup:
     if (Irp != NULL) {
         IoFreeIrp(Irp);
     }
-    UninitializeWskBuf(&WskBuf, BufLocked);
+    UninitializeWskBuf(&WskBuf, BufLocked, NULL);
+    return Status;
+}
+
+static
+NTSTATUS
+SendToAsync(
+    PWSK_SOCKET Sock,
+    _In_ PWSKIOREQUEST_COMPLETION Completion,
+    _In_ PSOCKADDR RemoteAddr,
+    ULONG ControlLen,
+    _When_(ControlLen > 0, _In_) _When_(ControlLen == 0, _In_opt_) const CMSGHDR *Control,
+    _Out_ PVOID* SendCompletion
+    )
+{
+    NTSTATUS Status;
+    PFN_WSK_SEND_TO WskSendTo;
+
+    if (ControlLen > sizeof(Completion->ControlData)) {
+        Status = STATUS_NOT_SUPPORTED;
+        goto Failure;
+    }
+
+    RtlCopyMemory(Completion->ControlData, Control, ControlLen);
+
+    WskSendTo = ((PWSK_PROVIDER_DATAGRAM_DISPATCH)Sock->Dispatch)->WskSendTo;
+    Status =
+        WskSendTo(
+            Sock, &Completion->WskBuf, 0, RemoteAddr, ControlLen,
+            (CMSGHDR *)Completion->ControlData, Completion->Irp);
+
+    if (NT_SUCCESS(Status)) {
+        // N.B. This includes the STATUS_PENDING case.
+        Completion->Status = Status;
+        Status = STATUS_SUCCESS;
+        *SendCompletion = Completion;
+        return Status;
+    }
+
+    LOG("WskSendTo failed with %d\n", Status);
+Failure:
+    FreeIoRequestCompletion(Completion);
     return Status;
 }
 
@@ -1595,28 +2577,79 @@ WskSendToAsync(
     _Out_ PVOID* SendCompletion
     )
 {
-    PIRP Irp = NULL;
     NTSTATUS Status;
-    PFN_WSK_SEND_TO WskSendTo;
-    PWSKIOREQUEST_COMPLETION Completion = NULL;
+    PWSKIOREQUEST_COMPLETION Completion;
 
     // On success, caller must follow up with a call to WskSendToAwait.
 
     ASSERT(BufLen > 0);
 
-
-    #pragma warning( suppress : 4996 )
-    Completion = ExAllocatePoolWithTag(NonPagedPoolNx, sizeof(*Completion), 'tseT');
+    Completion = AllocateIoRequestCompletion();
     if (Completion == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto Failure;
+        return STATUS_INSUFFICIENT_RESOURCES;
     }
-    RtlZeroMemory(Completion, sizeof(*Completion));
 
     Status =
         InitializeWskBuf(
-            Buf, BufLen, 0, BufIsNonPagedPool, &Completion->WskBuf, &Completion->BufLocked);
+            Buf, BufLen, 0, BufIsNonPagedPool, Completion->CachedMdl, &Completion->WskBuf,
+            &Completion->BufLocked);
     if (!NT_SUCCESS(Status)) {
+        FreeIoRequestCompletion(Completion);
+        return Status;
+    }
+
+    return SendToAsync(Sock, Completion, RemoteAddr, ControlLen, Control, SendCompletion);
+}
+
+NTSTATUS
+WskSendToRegisteredAsync(
+    PWSK_SOCKET Sock,
+    PVOID RegisteredBuffer,
+    ULONG Offset,
+    ULONG Length,
+    _In_ PSOCKADDR RemoteAddr,
+    ULONG ControlLen,
+    _When_(ControlLen > 0, _In_) _When_(ControlLen == 0, _In_opt_) const CMSGHDR *Control,
+    _Out_ PVOID* SendCompletion
+    )
+{
+    PWSKIOREQUEST_COMPLETION Completion;
+
+    // On success, caller must follow up with a call to WskSendToAwait.
+
+    Completion = AllocateIoRequestCompletion();
+    if (Completion == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    InitializeRegisteredWskBuf(RegisteredBuffer, Offset, Length, Completion);
+
+    return SendToAsync(Sock, Completion, RemoteAddr, ControlLen, Control, SendCompletion);
+}
+
+NTSTATUS
+WskSendMessagesAsync(
+    PWSK_SOCKET Sock,
+    _In_reads_(MessageCount) const WSKCLIENT_MESSAGE *Messages,
+    ULONG MessageCount,
+    BOOLEAN BufIsNonPagedPool,
+    _In_opt_ PSOCKADDR RemoteAddr,
+    ULONG ControlLen,
+    _When_(ControlLen > 0, _In_) _When_(ControlLen == 0, _In_opt_) const CMSGHDR *Control,
+    _Out_ PVOID* SendCompletion
+    )
+{
+    NTSTATUS Status;
+    PFN_WSK_SEND_MESSAGES WskSendMessages;
+    PWSKIOREQUEST_COMPLETION Completion = NULL;
+    PWSKCLIENT_MESSAGE_BUF MessageBufs;
+
+    // On success, caller must follow up with a call to WskSendMessagesAwait.
+
+    ASSERT(MessageCount > 0);
+
+    if (!SendMessagesSupported) {
+        Status = STATUS_NOT_SUPPORTED;
         goto Failure;
     }
 
@@ -1625,42 +2658,114 @@ WskSendToAsync(
         goto Failure;
     }
 
-    RtlCopyMemory(Completion->ControlData, Control, ControlLen);
+    Completion = AllocateIoRequestCompletion();
+    if (Completion == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Failure;
+    }
 
-    WskSendTo = ((PWSK_PROVIDER_DATAGRAM_DISPATCH)Sock->Dispatch)->WskSendTo;
-    Irp = IoAllocateIrp(1, FALSE);
-    if (Irp == NULL) {
+    MessageBufs = AllocateMessageBufs(Completion, MessageCount);
+    if (MessageBufs == NULL) {
         Status = STATUS_INSUFFICIENT_RESOURCES;
         goto Failure;
     }
-    KeInitializeEvent(&Completion->Event, NotificationEvent, FALSE);
-    IoSetCompletionRoutine(Irp, GenericCompletionRoutine, &Completion->Event, TRUE, TRUE, TRUE);
+    Completion->MessageBufs = MessageBufs;
+    Completion->MessageCount = MessageCount;
+
+    //
+    // Chain one buffer per datagram, so the whole batch is sent with one IRP.
+    //
+    for (ULONG Index = 0; Index < MessageCount; Index++) {
+        PMDL CachedMdl = MessageBufs[Index].CachedMdl;
+
+        ASSERT(Messages[Index].BufLen > 0);
+
+        if (ADDRESS_AND_SIZE_TO_SPAN_PAGES(Messages[Index].Buf, Messages[Index].BufLen) >
+                WSKCLIENT_CACHED_MESSAGE_MDL_PAGES) {
+            CachedMdl = NULL;
+        }
+
+        Status =
+            InitializeWskBuf(
+                Messages[Index].Buf, Messages[Index].BufLen, 0, BufIsNonPagedPool, CachedMdl,
+                &MessageBufs[Index].BufList.Buffer, &MessageBufs[Index].BufLocked);
+        if (!NT_SUCCESS(Status)) {
+            goto Failure;
+        }
+
+        MessageBufs[Index].BufList.Next =
+            (Index + 1 < MessageCount) ? &MessageBufs[Index + 1].BufList : NULL;
+    }
+
+    RtlCopyMemory(Completion->ControlData, Control, ControlLen);
+
+    WskSendMessages = ((PWSK_PROVIDER_DATAGRAM_DISPATCH)Sock->Dispatch)->WskSendMessages;
     Status =
-        WskSendTo(
-            Sock, &Completion->WskBuf, 0, RemoteAddr, ControlLen,
-            (CMSGHDR *)Completion->ControlData, Irp);
+        WskSendMessages(
+            Sock, &MessageBufs[0].BufList, 0, RemoteAddr, ControlLen,
+            (CMSGHDR *)Completion->ControlData, Completion->Irp);
 
     if (NT_SUCCESS(Status)) {
         // N.B. This includes the STATUS_PENDING case.
         Completion->Status = Status;
-        Completion->Irp = Irp;
         Status = STATUS_SUCCESS;
         *SendCompletion = Completion;
         return Status;
     }
 
-    LOG("WskSendTo failed with %d\n", Status);
+    LOG("WskSendMessages failed with %d\n", Status);
 Failure:
-    if (Irp != NULL) {
-        IoFreeIrp(Irp);
-    }
     if (Completion != NULL) {
-        UninitializeWskBuf(&Completion->WskBuf, Completion->BufLocked);
-        ExFreePool(Completion);
+        FreeIoRequestCompletion(Completion);
     }
     return Status;
 }
 
+NTSTATUS
+WskSendMessagesAwait(
+    _Inout_ PVOID SendCompletion,
+    _In_ ULONG TimeoutMs,
+    _In_ ULONG MessageCount,
+    _Out_writes_opt_(MessageCount) ULONG *BytesSent
+    )
+{
+    PWSKIOREQUEST_COMPLETION Completion = (PWSKIOREQUEST_COMPLETION)SendCompletion;
+    PWSKCLIENT_MESSAGE_BUF MessageBufs = (PWSKCLIENT_MESSAGE_BUF)Completion->MessageBufs;
+    NTSTATUS Status;
+    PIRP Irp = Completion->Irp;
+    ULONG TotalBytesSent = 0;
+
+    ASSERT(NT_SUCCESS(Completion->Status));
+    ASSERT(MessageCount == Completion->MessageCount);
+
+    Status = AwaitIoRequestCompletion(Completion, TimeoutMs);
+
+    if (!NT_SUCCESS(Status)) {
+        LOG("WskSendMessages IO failed with %d\n", Status);
+        if (Status == STATUS_CANCELLED) {
+            // We hit our Timeout and cancelled the Irp. STATUS_TIMEOUT is a better
+            // Status in this case.
+            Status = STATUS_TIMEOUT;
+        }
+    } else {
+        TotalBytesSent = (ULONG)Irp->IoStatus.Information;
+    }
+
+    //
+    // The provider reports only the total number of bytes sent, which covers
+    // the datagrams in order.
+    //
+    if (BytesSent != NULL) {
+        for (ULONG Index = 0; Index < MessageCount; Index++) {
+            BytesSent[Index] = min(TotalBytesSent, MessageBufs[Index].BufList.Buffer.Length);
+            TotalBytesSent -= BytesSent[Index];
+        }
+    }
+
+    FreeIoRequestCompletion(Completion);
+    return Status;
+}
+
 NTSTATUS
 WskSendToAwait(
     _Inout_ PVOID SendCompletion,
@@ -329,6 +329,30 @@ size_t IOCTL_BUFFER_SIZES[] =
     sizeof(USHORT),
     0,
     0,
+    0,
+    0,
+    0,
+    sizeof(USHORT),
+    sizeof(USHORT),
+    sizeof(USHORT),
+    sizeof(USHORT),
+    sizeof(USHORT),
+    sizeof(USHORT),
+    sizeof(USHORT),
+    sizeof(USHORT),
+    0,
+    sizeof(USHORT),
+    sizeof(USHORT),
+    0,
+    0,
+    0,
+    sizeof(USHORT),
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
 };
 
 static_assert(
@@ -449,6 +473,15 @@ TestDrvCtlEvtIoDeviceControl(
     case IOCTL_MP_BASIC_PORT:
         TestDrvCtlRun(MpBasicPort());
         break;
+    case IOCTL_MP_CHECKSUM_EMULATION:
+        TestDrvCtlRun(MpChecksumEmulation());
+        break;
+    case IOCTL_MP_STATISTICS:
+        TestDrvCtlRun(MpStatistics());
+        break;
+    case IOCTL_MP_LATENCY_HISTOGRAM:
+        TestDrvCtlRun(MpLatencyHistogram());
+        break;
     case IOCTL_LWF_BASIC_RX:
         TestDrvCtlRun(LwfBasicRx());
         break;
@@ -466,6 +499,80 @@ TestDrvCtlEvtIoDeviceControl(
         NT_FRE_ASSERT(Params != nullptr);
         TestDrvCtlRun(SockBasicRaw(Params->AddressFamily));
         break;
+    case IOCTL_SOCK_UDP_RECEIVE_BUFFER:
+        NT_FRE_ASSERT(Params != nullptr);
+        TestDrvCtlRun(SockUdpReceiveBuffer(Params->AddressFamily));
+        break;
+    case IOCTL_SOCK_UDP_SEND_WINDOW:
+        NT_FRE_ASSERT(Params != nullptr);
+        TestDrvCtlRun(SockUdpSendWindow(Params->AddressFamily));
+        break;
+    case IOCTL_SOCK_UDP_RETAINED_RECEIVE:
+        NT_FRE_ASSERT(Params != nullptr);
+        TestDrvCtlRun(SockUdpRetainedReceive(Params->AddressFamily));
+        break;
+    case IOCTL_SOCK_UDP_BATCH:
+        NT_FRE_ASSERT(Params != nullptr);
+        TestDrvCtlRun(SockUdpBatch(Params->AddressFamily));
+        break;
+    case IOCTL_SOCK_UDP_SEGMENTATION:
+        NT_FRE_ASSERT(Params != nullptr);
+        TestDrvCtlRun(SockUdpSegmentation(Params->AddressFamily));
+        break;
+    case IOCTL_SOCK_ASYNC_TCP:
+        NT_FRE_ASSERT(Params != nullptr);
+        TestDrvCtlRun(SockAsyncTcp(Params->AddressFamily));
+        break;
+    case IOCTL_SOCK_POLL:
+        NT_FRE_ASSERT(Params != nullptr);
+        TestDrvCtlRun(SockPoll(Params->AddressFamily));
+        break;
+    case IOCTL_SOCK_UDP_RIO:
+        NT_FRE_ASSERT(Params != nullptr);
+        TestDrvCtlRun(SockUdpRio(Params->AddressFamily));
+        break;
+    case IOCTL_SOCK_TCP_CONNECT_CHURN:
+        NT_FRE_ASSERT(Params != nullptr);
+        TestDrvCtlRun(SockTcpConnectChurn(Params->AddressFamily));
+        break;
+    case IOCTL_PKT_UDP_SUPER_FRAME:
+        NT_FRE_ASSERT(Params != nullptr);
+        TestDrvCtlRun(PktUdpSuperFrame(Params->AddressFamily));
+        break;
+    case IOCTL_PKT_QUIC_COALESCED_PACKETS:
+        TestDrvCtlRun(PktQuicCoalescedPackets());
+        break;
+    case IOCTL_PKT_FRAME_TEMPLATES:
+        NT_FRE_ASSERT(Params != nullptr);
+        TestDrvCtlRun(PktFrameTemplates(Params->AddressFamily));
+        break;
+    case IOCTL_ISR_CAPTURE_OUTPUT:
+        TestDrvCtlRun(IsrCaptureOutput());
+        break;
+    case IOCTL_ISR_CLIENT_BATCH_AND_ASYNC:
+        TestDrvCtlRun(IsrClientBatchAndAsync());
+        break;
+    case IOCTL_ISR_SERVICE_STOP:
+        TestDrvCtlRun(IsrServiceStop());
+        break;
+    case IOCTL_ISR_PERSISTENT_SHELL:
+        TestDrvCtlRun(IsrPersistentShell());
+        break;
+    case IOCTL_FN_TIMER_WHEEL:
+        TestDrvCtlRun(FnTimerWheel());
+        break;
+    case IOCTL_WSK_REGISTERED_SEND_CACHE:
+        TestDrvCtlRun(WskRegisteredSendCache());
+        break;
+    case IOCTL_WSK_SEND_MESSAGES_BATCH:
+        TestDrvCtlRun(WskSendMessagesBatch());
+        break;
+    case IOCTL_WSK_RECEIVE_PIPELINE:
+        TestDrvCtlRun(WskReceivePipeline());
+        break;
+    case IOCTL_WSK_COMPLETION_CALLBACK_TIMEOUT:
+        TestDrvCtlRun(WskCompletionCallbackTimeout());
+        break;
     default:
         Status = STATUS_INVALID_PARAMETER;
         break;
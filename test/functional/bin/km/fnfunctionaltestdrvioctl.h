@@ -53,6 +53,78 @@ EXTERN_C_START
 #define IOCTL_MP_BASIC_PORT \
     CTL_CODE(FILE_DEVICE_NETWORK, 11, METHOD_BUFFERED, FILE_WRITE_DATA)
 
-#define MAX_IOCTL_FUNC_CODE 11
+#define IOCTL_MP_CHECKSUM_EMULATION \
+    CTL_CODE(FILE_DEVICE_NETWORK, 12, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_MP_STATISTICS \
+    CTL_CODE(FILE_DEVICE_NETWORK, 13, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_MP_LATENCY_HISTOGRAM \
+    CTL_CODE(FILE_DEVICE_NETWORK, 14, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_SOCK_UDP_RECEIVE_BUFFER \
+    CTL_CODE(FILE_DEVICE_NETWORK, 15, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_SOCK_UDP_BATCH \
+    CTL_CODE(FILE_DEVICE_NETWORK, 16, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_SOCK_UDP_SEGMENTATION \
+    CTL_CODE(FILE_DEVICE_NETWORK, 17, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_SOCK_ASYNC_TCP \
+    CTL_CODE(FILE_DEVICE_NETWORK, 18, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_SOCK_POLL \
+    CTL_CODE(FILE_DEVICE_NETWORK, 19, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_SOCK_UDP_RIO \
+    CTL_CODE(FILE_DEVICE_NETWORK, 20, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_SOCK_TCP_CONNECT_CHURN \
+    CTL_CODE(FILE_DEVICE_NETWORK, 21, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_PKT_UDP_SUPER_FRAME \
+    CTL_CODE(FILE_DEVICE_NETWORK, 22, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_PKT_QUIC_COALESCED_PACKETS \
+    CTL_CODE(FILE_DEVICE_NETWORK, 23, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_SOCK_UDP_SEND_WINDOW \
+    CTL_CODE(FILE_DEVICE_NETWORK, 24, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_SOCK_UDP_RETAINED_RECEIVE \
+    CTL_CODE(FILE_DEVICE_NETWORK, 25, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_ISR_CAPTURE_OUTPUT \
+    CTL_CODE(FILE_DEVICE_NETWORK, 26, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_ISR_CLIENT_BATCH_AND_ASYNC \
+    CTL_CODE(FILE_DEVICE_NETWORK, 27, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_FN_TIMER_WHEEL \
+    CTL_CODE(FILE_DEVICE_NETWORK, 28, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_PKT_FRAME_TEMPLATES \
+    CTL_CODE(FILE_DEVICE_NETWORK, 29, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_WSK_REGISTERED_SEND_CACHE \
+    CTL_CODE(FILE_DEVICE_NETWORK, 30, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_WSK_SEND_MESSAGES_BATCH \
+    CTL_CODE(FILE_DEVICE_NETWORK, 31, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_WSK_RECEIVE_PIPELINE \
+    CTL_CODE(FILE_DEVICE_NETWORK, 32, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_WSK_COMPLETION_CALLBACK_TIMEOUT \
+    CTL_CODE(FILE_DEVICE_NETWORK, 33, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_ISR_SERVICE_STOP \
+    CTL_CODE(FILE_DEVICE_NETWORK, 34, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define IOCTL_ISR_PERSISTENT_SHELL \
+    CTL_CODE(FILE_DEVICE_NETWORK, 35, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#define MAX_IOCTL_FUNC_CODE 35
 
 EXTERN_C_END
@@ -484,6 +484,30 @@ public:
             ::MpBasicPort();
         }
     }
+
+    TEST_METHOD(MpChecksumEmulation) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_MP_CHECKSUM_EMULATION));
+        } else {
+            ::MpChecksumEmulation();
+        }
+    }
+
+    TEST_METHOD(MpStatistics) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_MP_STATISTICS));
+        } else {
+            ::MpStatistics();
+        }
+    }
+
+    TEST_METHOD(MpLatencyHistogram) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_MP_LATENCY_HISTOGRAM));
+        } else {
+            ::MpLatencyHistogram();
+        }
+    }
 };
 
 TEST_CLASS(fnlwffunctionaltests)
@@ -533,6 +557,150 @@ public:
         }
     }
 
+    TEST_METHOD(SockUdpReceiveBufferV4) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_SOCK_UDP_RECEIVE_BUFFER, AF_INET));
+        } else {
+            ::SockUdpReceiveBuffer(AF_INET);
+        }
+    }
+
+    TEST_METHOD(SockUdpReceiveBufferV6) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_SOCK_UDP_RECEIVE_BUFFER, AF_INET6));
+        } else {
+            ::SockUdpReceiveBuffer(AF_INET6);
+        }
+    }
+
+    TEST_METHOD(SockUdpSendWindowV4) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_SOCK_UDP_SEND_WINDOW, AF_INET));
+        } else {
+            ::SockUdpSendWindow(AF_INET);
+        }
+    }
+
+    TEST_METHOD(SockUdpSendWindowV6) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_SOCK_UDP_SEND_WINDOW, AF_INET6));
+        } else {
+            ::SockUdpSendWindow(AF_INET6);
+        }
+    }
+
+    TEST_METHOD(SockUdpRetainedReceiveV4) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_SOCK_UDP_RETAINED_RECEIVE, AF_INET));
+        } else {
+            ::SockUdpRetainedReceive(AF_INET);
+        }
+    }
+
+    TEST_METHOD(SockUdpRetainedReceiveV6) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_SOCK_UDP_RETAINED_RECEIVE, AF_INET6));
+        } else {
+            ::SockUdpRetainedReceive(AF_INET6);
+        }
+    }
+
+    TEST_METHOD(SockUdpBatchV4) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_SOCK_UDP_BATCH, AF_INET));
+        } else {
+            ::SockUdpBatch(AF_INET);
+        }
+    }
+
+    TEST_METHOD(SockUdpBatchV6) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_SOCK_UDP_BATCH, AF_INET6));
+        } else {
+            ::SockUdpBatch(AF_INET6);
+        }
+    }
+
+    TEST_METHOD(SockUdpSegmentationV4) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_SOCK_UDP_SEGMENTATION, AF_INET));
+        } else {
+            ::SockUdpSegmentation(AF_INET);
+        }
+    }
+
+    TEST_METHOD(SockUdpSegmentationV6) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_SOCK_UDP_SEGMENTATION, AF_INET6));
+        } else {
+            ::SockUdpSegmentation(AF_INET6);
+        }
+    }
+
+    TEST_METHOD(SockAsyncTcpV4) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_SOCK_ASYNC_TCP, AF_INET));
+        } else {
+            ::SockAsyncTcp(AF_INET);
+        }
+    }
+
+    TEST_METHOD(SockAsyncTcpV6) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_SOCK_ASYNC_TCP, AF_INET6));
+        } else {
+            ::SockAsyncTcp(AF_INET6);
+        }
+    }
+
+    TEST_METHOD(SockPollV4) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_SOCK_POLL, AF_INET));
+        } else {
+            ::SockPoll(AF_INET);
+        }
+    }
+
+    TEST_METHOD(SockPollV6) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_SOCK_POLL, AF_INET6));
+        } else {
+            ::SockPoll(AF_INET6);
+        }
+    }
+
+    TEST_METHOD(SockUdpRioV4) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_SOCK_UDP_RIO, AF_INET));
+        } else {
+            ::SockUdpRio(AF_INET);
+        }
+    }
+
+    TEST_METHOD(SockUdpRioV6) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_SOCK_UDP_RIO, AF_INET6));
+        } else {
+            ::SockUdpRio(AF_INET6);
+        }
+    }
+
+    TEST_METHOD(SockTcpConnectChurnV4) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_SOCK_TCP_CONNECT_CHURN, AF_INET));
+        } else {
+            ::SockTcpConnectChurn(AF_INET);
+        }
+    }
+
+    TEST_METHOD(SockTcpConnectChurnV6) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_SOCK_TCP_CONNECT_CHURN, AF_INET6));
+        } else {
+            ::SockTcpConnectChurn(AF_INET6);
+        }
+    }
+
     TEST_METHOD(SockBasicRawV4) {
         if (TestingKernelMode) {
             TEST_TRUE(TestDriverClient.Run(IOCTL_SOCK_BASIC_RAW, AF_INET));
@@ -549,3 +717,131 @@ public:
         }
     }
 };
+
+TEST_CLASS(pkthlpfunctionaltests)
+{
+public:
+    TEST_METHOD(PktUdpSuperFrameV4) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_PKT_UDP_SUPER_FRAME, AF_INET));
+        } else {
+            ::PktUdpSuperFrame(AF_INET);
+        }
+    }
+
+    TEST_METHOD(PktUdpSuperFrameV6) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_PKT_UDP_SUPER_FRAME, AF_INET6));
+        } else {
+            ::PktUdpSuperFrame(AF_INET6);
+        }
+    }
+
+    TEST_METHOD(PktQuicCoalescedPackets) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_PKT_QUIC_COALESCED_PACKETS));
+        } else {
+            ::PktQuicCoalescedPackets();
+        }
+    }
+
+    TEST_METHOD(PktFrameTemplatesV4) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_PKT_FRAME_TEMPLATES, AF_INET));
+        } else {
+            ::PktFrameTemplates(AF_INET);
+        }
+    }
+
+    TEST_METHOD(PktFrameTemplatesV6) {
+        if (TestingKernelMode) {
+            TEST_TRUE(TestDriverClient.Run(IOCTL_PKT_FRAME_TEMPLATES, AF_INET6));
+        } else {
+            ::PktFrameTemplates(AF_INET6);
+        }
+    }
+};
+
+TEST_CLASS(isrfunctionaltests)
+{
+public:
+    TEST_METHOD(IsrCaptureOutput) {
+        if (!TestingKernelMode) {
+            Logger::WriteMessage(L"Skipping kernel-mode only test");
+            return;
+        }
+        TEST_TRUE(TestDriverClient.Run(IOCTL_ISR_CAPTURE_OUTPUT));
+    }
+
+    TEST_METHOD(IsrClientBatchAndAsync) {
+        if (!TestingKernelMode) {
+            Logger::WriteMessage(L"Skipping kernel-mode only test");
+            return;
+        }
+        TEST_TRUE(TestDriverClient.Run(IOCTL_ISR_CLIENT_BATCH_AND_ASYNC));
+    }
+
+    TEST_METHOD(IsrServiceStop) {
+        if (!TestingKernelMode) {
+            Logger::WriteMessage(L"Skipping kernel-mode only test");
+            return;
+        }
+        TEST_TRUE(TestDriverClient.Run(IOCTL_ISR_SERVICE_STOP));
+    }
+
+    TEST_METHOD(IsrPersistentShell) {
+        if (!TestingKernelMode) {
+            Logger::WriteMessage(L"Skipping kernel-mode only test");
+            return;
+        }
+        TEST_TRUE(TestDriverClient.Run(IOCTL_ISR_PERSISTENT_SHELL));
+    }
+};
+
+TEST_CLASS(commonfunctionaltests)
+{
+public:
+    TEST_METHOD(FnTimerWheel) {
+        if (!TestingKernelMode) {
+            Logger::WriteMessage(L"Skipping kernel-mode only test");
+            return;
+        }
+        TEST_TRUE(TestDriverClient.Run(IOCTL_FN_TIMER_WHEEL));
+    }
+};
+
+TEST_CLASS(wskclientfunctionaltests)
+{
+public:
+    TEST_METHOD(WskRegisteredSendCache) {
+        if (!TestingKernelMode) {
+            Logger::WriteMessage(L"Skipping kernel-mode only test");
+            return;
+        }
+        TEST_TRUE(TestDriverClient.Run(IOCTL_WSK_REGISTERED_SEND_CACHE));
+    }
+
+    TEST_METHOD(WskSendMessagesBatch) {
+        if (!TestingKernelMode) {
+            Logger::WriteMessage(L"Skipping kernel-mode only test");
+            return;
+        }
+        TEST_TRUE(TestDriverClient.Run(IOCTL_WSK_SEND_MESSAGES_BATCH));
+    }
+
+    TEST_METHOD(WskReceivePipeline) {
+        if (!TestingKernelMode) {
+            Logger::WriteMessage(L"Skipping kernel-mode only test");
+            return;
+        }
+        TEST_TRUE(TestDriverClient.Run(IOCTL_WSK_RECEIVE_PIPELINE));
+    }
+
+    TEST_METHOD(WskCompletionCallbackTimeout) {
+        if (!TestingKernelMode) {
+            Logger::WriteMessage(L"Skipping kernel-mode only test");
+            return;
+        }
+        TEST_TRUE(TestDriverClient.Run(IOCTL_WSK_COMPLETION_CALLBACK_TIMEOUT));
+    }
+};
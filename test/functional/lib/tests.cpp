@@ -8,6 +8,7 @@
 #include <ntintsafe.h>
 #include <ntstrsafe.h>
 #include <ndis.h>
+#include <wsk.h>
 #else
 // Windows and WIL includes need to be ordered in a certain way.
 #include <winsock2.h>
@@ -38,6 +39,8 @@
 #include <fnlwfapi.h>
 #if defined(_KERNEL_MODE)
 #include <invokesystemrelay.h>
+#include <fntimer.h>
+#include <wskclient.h>
 #endif
 #include <qeo_ndis.h>
 #include <fnoid.h>
@@ -77,7 +80,17 @@ using unique_malloc_ptr = wistd::unique_ptr<T, wil::function_deleter<decltype(&:
 using unique_fnmp_handle = wil::unique_any<FNMP_HANDLE, decltype(::FnMpClose), ::FnMpClose>;
 using unique_fnlwf_handle = wil::unique_any<FNLWF_HANDLE, decltype(::FnLwfClose), ::FnLwfClose>;
 using unique_fnsock_handle = wil::unique_any<FNSOCK_HANDLE, decltype(::FnSockClose), ::FnSockClose>;
+using unique_fnsock_completion_queue =
+    wil::unique_any<
+        FNSOCK_COMPLETION_QUEUE, decltype(::FnSockCloseCompletionQueue),
+        ::FnSockCloseCompletionQueue>;
+using unique_fnsock_rio_handle =
+    wil::unique_any<FNSOCK_RIO_HANDLE, decltype(::FnSockRioClose), ::FnSockRioClose>;
 using unique_cxplat_thread = wil::unique_any<CXPLAT_THREAD, decltype(::CxPlatThreadDelete), ::CxPlatThreadDelete>;
+#if defined(_KERNEL_MODE)
+using unique_wsk_socket =
+    wil::unique_any<PWSK_SOCKET, decltype(::WskCloseSocketSync), ::WskCloseSocketSync>;
+#endif
 
 #if defined(_KERNEL_MODE)
 #define TEST_FNMPAPI TEST_NTSTATUS
@@ -610,6 +623,41 @@ MpUpdateTaskOffload(
     return true;
 }
 
+static
+bool
+MpSetChecksumEmulation(
+    _In_ const unique_fnmp_handle& Handle,
+    _In_ BOOLEAN Transmit,
+    _In_ BOOLEAN Receive
+    )
+{
+    TEST_FNMPAPI_RET(FnMpSetChecksumEmulation(Handle.get(), Transmit, Receive), false);
+    return true;
+}
+
+static
+bool
+MpGetChecksumCounters(
+    _In_ const unique_fnmp_handle& Handle,
+    _Out_ MINIPORT_CHECKSUM_COUNTERS *Counters
+    )
+{
+    TEST_FNMPAPI_RET(FnMpGetChecksumCounters(Handle.get(), Counters), false);
+    return true;
+}
+
+static
+bool
+MpGetLatencyHistogram(
+    _In_ const unique_fnmp_handle& Handle,
+    _In_ BOOLEAN Reset,
+    _Out_ MINIPORT_LATENCY_HISTOGRAM *Histogram
+    )
+{
+    TEST_FNMPAPI_RET(FnMpGetLatencyHistogram(Handle.get(), Reset, Histogram), false);
+    return true;
+}
+
 static
 bool
 MpOidFilter(
@@ -1188,6 +1236,18 @@ MpBasicRx()
             UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
             &RemoteHw, AF_INET, &LocalIp, &RemoteIp, LocalPort, RemotePort));
 
+    //
+    // The compile-time frame template must emit the same bytes as the C builder.
+    //
+    PktUdpFrameTemplate<AF_INET> UdpTemplate(
+        &LocalHw, &RemoteHw, &LocalIp.Ipv4, &RemoteIp.Ipv4, LocalPort, RemotePort);
+    UCHAR TemplateFrame[sizeof(UdpFrame)];
+    UINT32 TemplateFrameLength = sizeof(TemplateFrame);
+    TEST_TRUE(
+        UdpTemplate.Build(TemplateFrame, &TemplateFrameLength, UdpPayload, sizeof(UdpPayload)));
+    TEST_EQUAL(UdpFrameLength, TemplateFrameLength);
+    TEST_TRUE(RtlEqualMemory(UdpFrame, TemplateFrame, UdpFrameLength));
+
     RX_FRAME RxFrame;
     RxInitializeFrame(&RxFrame, FnMpIf->GetQueueId(), UdpFrame, UdpFrameLength);
     TEST_FNMPAPI(MpRxIndicateFrame(SharedMp, &RxFrame));
@@ -1732,6 +1792,299 @@ MpBasicPort()
     TEST_NOT_EQUAL(LeakActivatedNumber, LeakDeactivatedNumber);
 }
 
+EXTERN_C
+VOID
+MpChecksumEmulation()
+{
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    MINIPORT_CHECKSUM_COUNTERS Before, After;
+    auto UdpSocket = CreateUdpSocket(AF_INET, NULL, &LocalPort);
+    auto SharedMp = MpOpenShared(FnMpIf->GetIfIndex());
+    auto MpTaskOffloadCleanup = wil::scope_exit([&]() {
+        MpSetChecksumEmulation(SharedMp, FALSE, FALSE);
+        MpUpdateTaskOffload(SharedMp, FnOffloadCurrentConfig, NULL);
+    });
+
+    TEST_NOT_NULL(UdpSocket.get());
+    TEST_NOT_NULL(SharedMp.get());
+
+    RemotePort = htons(1234);
+    FnMpIf->GetHwAddress(&LocalHw);
+    FnMpIf->GetRemoteHwAddress(&RemoteHw);
+    FnMpIf->GetIpv4Address(&LocalIp.Ipv4);
+    FnMpIf->GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    UCHAR UdpPayload[] = "ChecksumEmulation";
+    CHAR RecvPayload[sizeof(UdpPayload)];
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, AF_INET, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    NDIS_OFFLOAD_PARAMETERS OffloadParams;
+    InitializeOffloadParameters(&OffloadParams);
+    OffloadParams.UDPIPv4Checksum = NDIS_OFFLOAD_PARAMETERS_TX_RX_ENABLED;
+    TEST_TRUE(MpUpdateTaskOffload(SharedMp, FnOffloadCurrentConfig, &OffloadParams));
+    TEST_TRUE(MpSetChecksumEmulation(SharedMp, TRUE, TRUE));
+
+    //
+    // With receive emulation enabled, fnmp verifies the checksum itself and
+    // ignores the OOB bits supplied by the test: a mangled checksum is
+    // reported as failed, and an intact one as succeeded.
+    //
+    TEST_TRUE(MpGetChecksumCounters(SharedMp, &Before));
+
+    RX_FRAME RxFrame;
+    RxInitializeFrame(&RxFrame, FnMpIf->GetQueueId(), UdpFrame, UdpFrameLength);
+    RxFrame.Frame.Input.Checksum.Receive.UdpChecksumSucceeded = TRUE;
+    UDP_HDR *UdpHdr = (UDP_HDR *)&UdpFrame[UDP_HEADER_BACKFILL(AF_INET) - sizeof(*UdpHdr)];
+    UdpHdr->uh_sum++;
+    TEST_FNMPAPI(MpRxIndicateFrame(SharedMp, &RxFrame));
+    UdpHdr->uh_sum--;
+    TEST_FNMPAPI(MpRxIndicateFrame(SharedMp, &RxFrame));
+
+    TEST_EQUAL(
+        sizeof(UdpPayload),
+        FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
+
+    TEST_TRUE(MpGetChecksumCounters(SharedMp, &After));
+    TEST_EQUAL(Before.Udp.ReceiveFailed + 1, After.Udp.ReceiveFailed);
+    TEST_EQUAL(Before.Udp.ReceiveSucceeded + 1, After.Udp.ReceiveSucceeded);
+
+    //
+    // With transmit emulation enabled, frames requesting UDP checksum offload
+    // leave fnmp with a valid checksum.
+    //
+    UCHAR Pattern[UDP_HEADER_BACKFILL(AF_INET) + sizeof(UdpPayload)];
+    UCHAR Mask[sizeof(Pattern)];
+
+    RtlZeroMemory(Pattern, sizeof(Pattern));
+    RtlCopyMemory(Pattern + UDP_HEADER_BACKFILL(AF_INET), UdpPayload, sizeof(UdpPayload));
+
+    RtlZeroMemory(Mask, sizeof(Mask));
+    for (int i = UDP_HEADER_BACKFILL(AF_INET); i < sizeof(Mask); i++) {
+        Mask[i] = 0xff;
+    }
+
+    TEST_TRUE(MpTxFilter(SharedMp, Pattern, Mask, sizeof(Pattern)));
+
+    SOCKADDR_STORAGE RemoteAddr;
+    TEST_TRUE(SetSockAddr(FNMP_NEIGHBOR_IPV4_ADDRESS, 1234, AF_INET, &RemoteAddr));
+
+    TEST_EQUAL(
+        (int)sizeof(UdpPayload),
+        FnSockSendto(
+            UdpSocket.get(), (PCHAR)UdpPayload, sizeof(UdpPayload), FALSE, 0,
+            (PSOCKADDR)&RemoteAddr, sizeof(RemoteAddr)));
+
+    auto MpTxFrame = MpTxAllocateAndGetFrame(SharedMp, 0);
+    TEST_NOT_NULL(MpTxFrame.get());
+    TEST_TRUE(MpTxFrame->Output.Checksum.Transmit.UdpChecksum);
+
+    //
+    // The UDP TX path places the headers and the payload in separate buffers.
+    //
+    TEST_EQUAL(2, MpTxFrame->BufferCount);
+    TEST_EQUAL(MpTxFrame->Buffers[0].DataLength, UDP_HEADER_BACKFILL(AF_INET));
+    TEST_EQUAL(MpTxFrame->Buffers[1].DataLength, sizeof(UdpPayload));
+
+    CONST DATA_BUFFER *HeaderBuffer = &MpTxFrame->Buffers[0];
+    CONST DATA_BUFFER *PayloadBuffer = &MpTxFrame->Buffers[1];
+    CONST IPV4_HEADER *TxIpHdr =
+        (CONST IPV4_HEADER *)
+            (HeaderBuffer->VirtualAddress + HeaderBuffer->DataOffset + sizeof(ETHERNET_HEADER));
+    CONST UDP_HDR *TxUdpHdr = (CONST UDP_HDR *)(TxIpHdr + 1);
+    UINT32 Checksum =
+        PktPseudoHeaderChecksum(
+            &TxIpHdr->SourceAddress, &TxIpHdr->DestinationAddress,
+            sizeof(TxIpHdr->SourceAddress), sizeof(*TxUdpHdr) + sizeof(UdpPayload),
+            IPPROTO_UDP);
+    Checksum += PktPartialChecksum(TxUdpHdr, sizeof(*TxUdpHdr));
+    Checksum +=
+        PktPartialChecksum(
+            PayloadBuffer->VirtualAddress + PayloadBuffer->DataOffset, sizeof(UdpPayload));
+
+    TEST_NOT_EQUAL(0, TxUdpHdr->uh_sum);
+    TEST_EQUAL(0xFFFF, PktChecksumFold(Checksum));
+
+    TEST_TRUE(MpTxDequeueFrame(SharedMp, 0));
+    TEST_TRUE(MpTxFlush(SharedMp));
+
+    TEST_TRUE(MpGetChecksumCounters(SharedMp, &After));
+    TEST_EQUAL(Before.Udp.Transmit + 1, After.Udp.Transmit);
+}
+
+EXTERN_C
+VOID
+MpStatistics()
+{
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    OID_KEY OidKey;
+    UINT32 BytesReturned;
+    auto UdpSocket = CreateUdpSocket(AF_INET, NULL, &LocalPort);
+    auto SharedMp = MpOpenShared(FnMpIf->GetIfIndex());
+    auto DefaultLwf = LwfOpenDefault(FnMpIf->GetIfIndex());
+
+    TEST_NOT_NULL(UdpSocket.get());
+    TEST_NOT_NULL(SharedMp.get());
+    TEST_NOT_NULL(DefaultLwf.get());
+
+    RemotePort = htons(1234);
+    FnMpIf->GetHwAddress(&LocalHw);
+    FnMpIf->GetRemoteHwAddress(&RemoteHw);
+    FnMpIf->GetIpv4Address(&LocalIp.Ipv4);
+    FnMpIf->GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    InitializeOidKey(&OidKey, OID_GEN_STATISTICS, NdisRequestQueryInformation);
+
+    auto Before =
+        LwfOidAllocateAndSubmitRequest<NDIS_STATISTICS_INFO>(DefaultLwf, OidKey, &BytesReturned);
+    TEST_NOT_NULL(Before.get());
+    TEST_EQUAL(sizeof(NDIS_STATISTICS_INFO), BytesReturned);
+
+    UCHAR UdpPayload[] = "Statistics";
+    CHAR RecvPayload[sizeof(UdpPayload)];
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, AF_INET, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    RX_FRAME RxFrame;
+    RxInitializeFrame(&RxFrame, FnMpIf->GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_FNMPAPI(MpRxIndicateFrame(SharedMp, &RxFrame));
+    TEST_EQUAL(
+        sizeof(UdpPayload),
+        FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+
+    SOCKADDR_STORAGE RemoteAddr;
+    TEST_TRUE(SetSockAddr(FNMP_NEIGHBOR_IPV4_ADDRESS, 1234, AF_INET, &RemoteAddr));
+    TEST_EQUAL(
+        (int)sizeof(UdpPayload),
+        FnSockSendto(
+            UdpSocket.get(), (PCHAR)UdpPayload, sizeof(UdpPayload), FALSE, 0,
+            (PSOCKADDR)&RemoteAddr, sizeof(RemoteAddr)));
+
+    //
+    // The stack may send and receive unrelated traffic concurrently, so only
+    // verify the counters advanced by at least the test's frames. The send
+    // completes asynchronously, so poll until it is counted.
+    //
+    unique_malloc_ptr<NDIS_STATISTICS_INFO> After;
+    Stopwatch Watchdog(TEST_TIMEOUT_ASYNC_MS);
+    do {
+        After =
+            LwfOidAllocateAndSubmitRequest<NDIS_STATISTICS_INFO>(
+                DefaultLwf, OidKey, &BytesReturned);
+        TEST_NOT_NULL(After.get());
+        if (After->ifHCOutUcastPkts > Before->ifHCOutUcastPkts) {
+            break;
+        }
+    } while (CxPlatSleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
+
+    TEST_TRUE(After->SupportedStatistics & NDIS_STATISTICS_FLAGS_VALID_DIRECTED_FRAMES_RCV);
+    TEST_TRUE(After->SupportedStatistics & NDIS_STATISTICS_FLAGS_VALID_DIRECTED_FRAMES_XMIT);
+    TEST_TRUE(After->ifHCInUcastPkts >= Before->ifHCInUcastPkts + 1);
+    TEST_TRUE(After->ifHCInOctets >= Before->ifHCInOctets + UdpFrameLength);
+    TEST_TRUE(After->ifHCOutUcastPkts >= Before->ifHCOutUcastPkts + 1);
+    TEST_TRUE(After->ifHCOutOctets >= Before->ifHCOutOctets + UdpFrameLength);
+}
+
+EXTERN_C
+VOID
+MpLatencyHistogram()
+{
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    auto UdpSocket = CreateUdpSocket(AF_INET, NULL, &LocalPort);
+    auto SharedMp = MpOpenShared(FnMpIf->GetIfIndex());
+    unique_malloc_ptr<MINIPORT_LATENCY_HISTOGRAM> Histogram(
+        (MINIPORT_LATENCY_HISTOGRAM *)CxPlatAllocNonPaged(sizeof(*Histogram), POOL_TAG));
+
+    TEST_NOT_NULL(UdpSocket.get());
+    TEST_NOT_NULL(SharedMp.get());
+    TEST_NOT_NULL(Histogram.get());
+
+    RemotePort = htons(1234);
+    FnMpIf->GetHwAddress(&LocalHw);
+    FnMpIf->GetRemoteHwAddress(&RemoteHw);
+    FnMpIf->GetIpv4Address(&LocalIp.Ipv4);
+    FnMpIf->GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    TEST_TRUE(MpGetLatencyHistogram(SharedMp, TRUE, Histogram.get()));
+
+    UCHAR UdpPayload[] = "LatencyHistogram";
+    CHAR RecvPayload[sizeof(UdpPayload)];
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, AF_INET, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    RX_FRAME RxFrame;
+    RxInitializeFrame(&RxFrame, FnMpIf->GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_FNMPAPI(MpRxIndicateFrame(SharedMp, &RxFrame));
+    TEST_EQUAL(
+        sizeof(UdpPayload),
+        FnSockRecv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+
+    SOCKADDR_STORAGE RemoteAddr;
+    TEST_TRUE(SetSockAddr(FNMP_NEIGHBOR_IPV4_ADDRESS, 1234, AF_INET, &RemoteAddr));
+    TEST_EQUAL(
+        (int)sizeof(UdpPayload),
+        FnSockSendto(
+            UdpSocket.get(), (PCHAR)UdpPayload, sizeof(UdpPayload), FALSE, 0,
+            (PSOCKADDR)&RemoteAddr, sizeof(RemoteAddr)));
+
+    //
+    // The stack returns and sends NBLs asynchronously, so poll until both
+    // directions have recorded a sample.
+    //
+    Stopwatch Watchdog(TEST_TIMEOUT_ASYNC_MS);
+    do {
+        TEST_TRUE(MpGetLatencyHistogram(SharedMp, FALSE, Histogram.get()));
+        if (Histogram->Receive.Count > 0 && Histogram->Transmit.Count > 0) {
+            break;
+        }
+    } while (CxPlatSleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
+
+    TEST_TRUE(Histogram->Receive.Count > 0);
+    TEST_TRUE(Histogram->Transmit.Count > 0);
+
+    //
+    // Buckets are updated before the sample count, and the count is read
+    // first, so the buckets can never account for fewer samples.
+    //
+    const MINIPORT_LATENCY_HISTOGRAM_DIRECTION *Directions[] = {
+        &Histogram->Receive, &Histogram->Transmit
+    };
+
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Directions); Index++) {
+        UINT64 Count = 0;
+
+        for (UINT32 Bucket = 0; Bucket < RTL_NUMBER_OF(Directions[Index]->Buckets); Bucket++) {
+            Count += Directions[Index]->Buckets[Bucket];
+        }
+
+        TEST_TRUE(Count >= Directions[Index]->Count);
+    }
+
+    TEST_EQUAL(8, FnMpLatencyBucketLowerBound(8));
+    TEST_EQUAL(16, FnMpLatencyBucketLowerBound(16));
+    TEST_EQUAL(18, FnMpLatencyBucketLowerBound(17));
+    TEST_EQUAL(32, FnMpLatencyBucketLowerBound(24));
+}
+
 EXTERN_C
 VOID
 LwfBasicRx()
@@ -1992,6 +2345,47 @@ SockBasicTcp(
     TEST_EQUAL(Msg2Len, FnSockRecv(ClientSocket.get(), RecvBuffer, sizeof(RecvBuffer), FALSE, 0));
     TEST_TRUE(RtlEqualMemory(RecvBuffer, Msg2, Msg2Len));
 
+    //
+    // Stream data can be peeked, partially read, and gathered across sends.
+    //
+    CONST CHAR *Msg3 = "SockBasicTcp-Stream";
+    CONST INT Msg3Len = (CONST INT)strlen(Msg3);
+    CONST INT Msg3Split = 4;
+    TEST_EQUAL(Msg3Len, FnSockSend(ClientSocket.get(), Msg3, Msg3Len, FALSE, 0));
+    TEST_EQUAL(Msg3Len, FnSockSend(ClientSocket.get(), Msg3, Msg3Len, FALSE, 0));
+
+    TEST_EQUAL(Msg3Split, FnSockRecv(AcceptSocket.get(), RecvBuffer, Msg3Split, FALSE, MSG_PEEK));
+    TEST_TRUE(RtlEqualMemory(RecvBuffer, Msg3, Msg3Split));
+    TEST_EQUAL(Msg3Split, FnSockRecv(AcceptSocket.get(), RecvBuffer, Msg3Split, FALSE, 0));
+    TEST_TRUE(RtlEqualMemory(RecvBuffer, Msg3, Msg3Split));
+
+    CONST INT Msg3Remaining = 2 * Msg3Len - Msg3Split;
+    TEST_EQUAL(
+        Msg3Remaining,
+        FnSockRecv(AcceptSocket.get(), RecvBuffer, Msg3Remaining, FALSE, MSG_WAITALL));
+    TEST_TRUE(RtlEqualMemory(RecvBuffer, Msg3 + Msg3Split, Msg3Len - Msg3Split));
+    TEST_TRUE(RtlEqualMemory(RecvBuffer + Msg3Len - Msg3Split, Msg3, Msg3Len));
+
+#if defined(_KERNEL_MODE)
+    //
+    // A MSG_WAITALL receive that times out returns the bytes it consumed, and
+    // a receive that times out with no data fails.
+    //
+    TEST_EQUAL(Msg3Len, FnSockSend(ClientSocket.get(), Msg3, Msg3Len, FALSE, 0));
+    TEST_EQUAL(Msg3Len, FnSockRecv(AcceptSocket.get(), RecvBuffer, Msg3Len, FALSE, MSG_PEEK));
+
+    INT ShortTimeoutMs = POLL_INTERVAL_MS;
+    TEST_CXPLAT(
+        FnSockSetSockOpt(
+            AcceptSocket.get(), SOL_SOCKET, SO_RCVTIMEO, (CHAR *)&ShortTimeoutMs,
+            sizeof(ShortTimeoutMs)));
+    TEST_EQUAL(
+        Msg3Len,
+        FnSockRecv(AcceptSocket.get(), RecvBuffer, sizeof(RecvBuffer), FALSE, MSG_WAITALL));
+    TEST_TRUE(RtlEqualMemory(RecvBuffer, Msg3, Msg3Len));
+    TEST_EQUAL(-1, FnSockRecv(AcceptSocket.get(), RecvBuffer, sizeof(RecvBuffer), FALSE, 0));
+#endif
+
     DWORD Opt;
     SIZE_T OptLen = sizeof(Opt);
     TEST_CXPLAT(FnSockGetSockOpt(ClientSocket.get(), IPPROTO_TCP, TCP_KEEPCNT, &Opt, &OptLen));
@@ -2008,36 +2402,2440 @@ SockBasicTcp(
 
 EXTERN_C
 VOID
-SockBasicRaw(
+SockUdpReceiveBuffer(
     USHORT AddressFamily
     )
 {
-    unique_fnsock_handle Socket;
-    TEST_CXPLAT(FnSockCreate(AddressFamily, SOCK_RAW, IPPROTO_IP, &Socket));
-    TEST_NOT_NULL(Socket.get());
+    CONST UINT32 DatagramCount = 8;
+    CHAR Payload[64] = "SockUdpReceiveBuffer";
+    CONST INT ReceiveBufferSize = 2 * sizeof(Payload);
 
-    SOCKADDR_INET Address = {0};
+    unique_fnsock_handle ReceiveSocket;
+    TEST_CXPLAT(FnSockCreate(AddressFamily, SOCK_DGRAM, IPPROTO_UDP, &ReceiveSocket));
+    TEST_NOT_NULL(ReceiveSocket.get());
+
+    INT Opt = ReceiveBufferSize;
+    TEST_CXPLAT(
+        FnSockSetSockOpt(ReceiveSocket.get(), SOL_SOCKET, SO_RCVBUF, (CHAR *)&Opt, sizeof(Opt)));
+
+    SIZE_T OptLength = sizeof(Opt);
+    Opt = 0;
+    TEST_CXPLAT(FnSockGetSockOpt(ReceiveSocket.get(), SOL_SOCKET, SO_RCVBUF, &Opt, &OptLength));
+    TEST_EQUAL(ReceiveBufferSize, Opt);
+
+    SOCKADDR_INET Address = {0};
     Address.si_family = AddressFamily;
+    if (AddressFamily == AF_INET) {
+        Address.Ipv4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    } else {
+        IN6_SET_ADDR_LOOPBACK(&Address.Ipv6.sin6_addr);
+    }
+
+    TEST_CXPLAT(FnSockBind(ReceiveSocket.get(), (SOCKADDR *)&Address, sizeof(Address)));
+
+    INT AddressLength = sizeof(Address);
+    TEST_CXPLAT(FnSockGetSockName(ReceiveSocket.get(), (SOCKADDR *)&Address, &AddressLength));
+
+    INT TimeoutMs = POLL_INTERVAL_MS;
+    TEST_CXPLAT(
+        FnSockSetSockOpt(
+            ReceiveSocket.get(), SOL_SOCKET, SO_RCVTIMEO, (CHAR *)&TimeoutMs, sizeof(TimeoutMs)));
+
+    unique_fnsock_handle SendSocket;
+    TEST_CXPLAT(FnSockCreate(AddressFamily, SOCK_DGRAM, IPPROTO_UDP, &SendSocket));
+    TEST_NOT_NULL(SendSocket.get());
+
+    for (UINT32 Index = 0; Index < DatagramCount; Index++) {
+        TEST_EQUAL(
+            (INT)sizeof(Payload),
+            FnSockSendto(
+                SendSocket.get(), Payload, sizeof(Payload), FALSE, 0, (SOCKADDR *)&Address,
+                AddressLength));
+    }
+
+    //
+    // Datagrams beyond the receive buffer size are dropped, and kernel mode
+    // counts the drops.
+    //
+    FNSOCK_RECV_STATISTICS Statistics;
+    Stopwatch Watchdog(TEST_TIMEOUT_ASYNC_MS);
+    do {
+        SIZE_T StatisticsLength = sizeof(Statistics);
+        TEST_CXPLAT(
+            FnSockGetSockOpt(
+                ReceiveSocket.get(), FNSOCK_SOL_FNSOCK, FNSOCK_SO_RECV_STATISTICS, &Statistics,
+                &StatisticsLength));
+#if defined(_KERNEL_MODE)
+        if (Statistics.DroppedPackets == DatagramCount - 2) {
+            break;
+        }
+#else
+        if (Statistics.QueuedBytes >= (UINT64)ReceiveBufferSize) {
+            break;
+        }
+#endif
+    } while (CxPlatSleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
+
+#if defined(_KERNEL_MODE)
+    TEST_EQUAL(DatagramCount - 2, Statistics.DroppedPackets);
+    TEST_EQUAL((DatagramCount - 2) * sizeof(Payload), Statistics.DroppedBytes);
+    TEST_EQUAL((UINT64)ReceiveBufferSize, Statistics.QueuedBytes);
+#endif
+
+    UINT32 ReceivedCount = 0;
+    CHAR RecvPayload[sizeof(Payload)];
+    while (FnSockRecv(ReceiveSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0) > 0) {
+        TEST_TRUE(RtlEqualMemory(RecvPayload, Payload, sizeof(Payload)));
+        ReceivedCount++;
+    }
+
+    TEST_TRUE(ReceivedCount > 0);
+    TEST_TRUE(ReceivedCount < DatagramCount);
+#if defined(_KERNEL_MODE)
+    TEST_EQUAL(2u, ReceivedCount);
+#endif
+}
+
+EXTERN_C
+VOID
+SockUdpSendWindow(
+    USHORT AddressFamily
+    )
+{
+    CONST UINT32 DatagramCount = 512;
+    CHAR Payload[64] = "SockUdpSendWindow";
+
+    unique_fnsock_handle ReceiveSocket;
+    TEST_CXPLAT(FnSockCreate(AddressFamily, SOCK_DGRAM, IPPROTO_UDP, &ReceiveSocket));
+    TEST_NOT_NULL(ReceiveSocket.get());
 
+    SOCKADDR_INET Address = {0};
+    Address.si_family = AddressFamily;
     if (AddressFamily == AF_INET) {
-        PCSTR Terminator;
-        TEST_NTSTATUS(
-            RtlIpv4StringToAddressA(FNMP_IPV4_ADDRESS, FALSE, &Terminator, &Address.Ipv4.sin_addr));
+        Address.Ipv4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
     } else {
-        PCSTR Terminator;
-        TEST_NTSTATUS(
-            RtlIpv6StringToAddressA(FNMP_IPV6_ADDRESS, &Terminator, &Address.Ipv6.sin6_addr));
+        IN6_SET_ADDR_LOOPBACK(&Address.Ipv6.sin6_addr);
     }
 
-    TEST_CXPLAT(FnSockBind(Socket.get(), (SOCKADDR *)&Address, sizeof(Address)));
+    TEST_CXPLAT(FnSockBind(ReceiveSocket.get(), (SOCKADDR *)&Address, sizeof(Address)));
 
-    DWORD Opt = RCVALL_ON;
-    DWORD BytesReturned;
+    INT AddressLength = sizeof(Address);
+    TEST_CXPLAT(FnSockGetSockName(ReceiveSocket.get(), (SOCKADDR *)&Address, &AddressLength));
+
+    unique_fnsock_handle SendSocket;
+    TEST_CXPLAT(FnSockCreate(AddressFamily, SOCK_DGRAM, IPPROTO_UDP, &SendSocket));
+    TEST_NOT_NULL(SendSocket.get());
+
+    //
+    // Kernel mode blocks sends while the window is full, so sending several
+    // windows' worth of datagrams must never leave more than the window
+    // outstanding.
+    //
+    FNSOCK_SEND_STATISTICS Statistics;
+    for (UINT32 Index = 0; Index < DatagramCount; Index++) {
+        TEST_EQUAL(
+            (INT)sizeof(Payload),
+            FnSockSendto(
+                SendSocket.get(), Payload, sizeof(Payload), FALSE, 0, (SOCKADDR *)&Address,
+                AddressLength));
+
+        SIZE_T StatisticsLength = sizeof(Statistics);
+        TEST_CXPLAT(
+            FnSockGetSockOpt(
+                SendSocket.get(), FNSOCK_SOL_FNSOCK, FNSOCK_SO_SEND_STATISTICS, &Statistics,
+                &StatisticsLength));
+        TEST_EQUAL(sizeof(Statistics), StatisticsLength);
+        TEST_TRUE(Statistics.OutstandingSends <= Statistics.MaxOutstandingSends);
+    }
+
+    TEST_TRUE(Statistics.PeakOutstandingSends <= Statistics.MaxOutstandingSends);
+#if defined(_KERNEL_MODE)
+    TEST_TRUE(Statistics.MaxOutstandingSends > 0);
+    TEST_TRUE(Statistics.MaxOutstandingSends < DatagramCount);
+    TEST_TRUE(Statistics.PeakOutstandingSends > 0);
+#endif
+}
+
+EXTERN_C
+VOID
+SockUdpRetainedReceive(
+    USHORT AddressFamily
+    )
+{
+    CONST UINT32 DatagramCount = 256;
+    CONST UINT32 UnreceivedCount = 8;
+    CONST INT ReceiveBufferSize = 1024 * 1024;
+    UINT32 Payload[16] = {0};
+    BOOLEAN Received[DatagramCount] = {0};
+
+    unique_fnsock_handle ReceiveSocket;
+    TEST_CXPLAT(FnSockCreate(AddressFamily, SOCK_DGRAM, IPPROTO_UDP, &ReceiveSocket));
+    TEST_NOT_NULL(ReceiveSocket.get());
+
+    INT Opt = ReceiveBufferSize;
     TEST_CXPLAT(
-        FnSockIoctl(Socket.get(), SIO_RCVALL, &Opt, sizeof(Opt), NULL, 0, &BytesReturned));
+        FnSockSetSockOpt(ReceiveSocket.get(), SOL_SOCKET, SO_RCVBUF, (CHAR *)&Opt, sizeof(Opt)));
+
+    SOCKADDR_INET Address = {0};
+    Address.si_family = AddressFamily;
+    if (AddressFamily == AF_INET) {
+        Address.Ipv4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    } else {
+        IN6_SET_ADDR_LOOPBACK(&Address.Ipv6.sin6_addr);
+    }
+
+    TEST_CXPLAT(FnSockBind(ReceiveSocket.get(), (SOCKADDR *)&Address, sizeof(Address)));
+
+    INT AddressLength = sizeof(Address);
+    TEST_CXPLAT(FnSockGetSockName(ReceiveSocket.get(), (SOCKADDR *)&Address, &AddressLength));
+
+    INT TimeoutMs = TEST_TIMEOUT_ASYNC_MS;
+    TEST_CXPLAT(
+        FnSockSetSockOpt(
+            ReceiveSocket.get(), SOL_SOCKET, SO_RCVTIMEO, (CHAR *)&TimeoutMs, sizeof(TimeoutMs)));
+
+    unique_fnsock_handle SendSocket;
+    TEST_CXPLAT(FnSockCreate(AddressFamily, SOCK_DGRAM, IPPROTO_UDP, &SendSocket));
+    TEST_NOT_NULL(SendSocket.get());
+
+    for (UINT32 Index = 0; Index < DatagramCount; Index++) {
+        Payload[0] = Index;
+        TEST_EQUAL(
+            (INT)sizeof(Payload),
+            FnSockSendto(
+                SendSocket.get(), (CHAR *)Payload, sizeof(Payload), FALSE, 0,
+                (SOCKADDR *)&Address, AddressLength));
+    }
 
     //
-    // The TX datapath will form non-contiguous data indications, which FnSock
-    // discards on the RX path. Skipping datapath validation for now.
+    // Kernel mode retains a bounded number of WSK indications and copies the
+    // datagrams beyond that budget, so both paths hold queued datagrams.
+    //
+    FNSOCK_RECV_STATISTICS Statistics;
+    SIZE_T StatisticsLength;
+#if defined(_KERNEL_MODE)
+    Stopwatch Watchdog(TEST_TIMEOUT_ASYNC_MS);
+    do {
+        StatisticsLength = sizeof(Statistics);
+        TEST_CXPLAT(
+            FnSockGetSockOpt(
+                ReceiveSocket.get(), FNSOCK_SOL_FNSOCK, FNSOCK_SO_RECV_STATISTICS, &Statistics,
+                &StatisticsLength));
+        if (Statistics.QueuedBytes == DatagramCount * sizeof(Payload)) {
+            break;
+        }
+    } while (CxPlatSleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
+
+    TEST_EQUAL(DatagramCount * sizeof(Payload), Statistics.QueuedBytes);
+    TEST_EQUAL(0u, Statistics.DroppedPackets);
+    TEST_TRUE(Statistics.RetainedPackets > 0);
+    TEST_TRUE(Statistics.RetainedPackets < DatagramCount);
+#endif
+
+    for (UINT32 Count = 0; Count < DatagramCount; Count++) {
+        UINT32 RecvPayload[ARRAYSIZE(Payload)];
+
+        TEST_EQUAL(
+            (INT)sizeof(RecvPayload),
+            FnSockRecv(ReceiveSocket.get(), (CHAR *)RecvPayload, sizeof(RecvPayload), FALSE, 0));
+        TEST_TRUE(RecvPayload[0] < DatagramCount);
+        TEST_FALSE(Received[RecvPayload[0]]);
+        Received[RecvPayload[0]] = TRUE;
+    }
+
+    //
+    // Receiving releases every retained indication.
+    //
+    StatisticsLength = sizeof(Statistics);
+    TEST_CXPLAT(
+        FnSockGetSockOpt(
+            ReceiveSocket.get(), FNSOCK_SOL_FNSOCK, FNSOCK_SO_RECV_STATISTICS, &Statistics,
+            &StatisticsLength));
+    TEST_EQUAL(0u, Statistics.QueuedBytes);
+    TEST_EQUAL(0u, Statistics.RetainedPackets);
+
+    //
+    // Closing a socket with retained indications queued releases them.
+    //
+    for (UINT32 Index = 0; Index < UnreceivedCount; Index++) {
+        Payload[0] = Index;
+        TEST_EQUAL(
+            (INT)sizeof(Payload),
+            FnSockSendto(
+                SendSocket.get(), (CHAR *)Payload, sizeof(Payload), FALSE, 0,
+                (SOCKADDR *)&Address, AddressLength));
+    }
+
+#if defined(_KERNEL_MODE)
+    Watchdog.Reset();
+    do {
+        StatisticsLength = sizeof(Statistics);
+        TEST_CXPLAT(
+            FnSockGetSockOpt(
+                ReceiveSocket.get(), FNSOCK_SOL_FNSOCK, FNSOCK_SO_RECV_STATISTICS, &Statistics,
+                &StatisticsLength));
+        if (Statistics.RetainedPackets == UnreceivedCount) {
+            break;
+        }
+    } while (CxPlatSleep(POLL_INTERVAL_MS), !Watchdog.IsExpired());
+
+    TEST_EQUAL(UnreceivedCount, Statistics.RetainedPackets);
+#endif
+
+    ReceiveSocket.reset();
+}
+
+EXTERN_C
+VOID
+SockUdpBatch(
+    USHORT AddressFamily
+    )
+{
+    CONST INT MessageCount = 4;
+    CHAR Payloads[MessageCount][32];
+    CHAR RecvPayloads[MessageCount][32];
+    FNSOCK_MSG Messages[MessageCount];
+
+    unique_fnsock_handle ReceiveSocket;
+    TEST_CXPLAT(FnSockCreate(AddressFamily, SOCK_DGRAM, IPPROTO_UDP, &ReceiveSocket));
+    TEST_NOT_NULL(ReceiveSocket.get());
+
+    SOCKADDR_INET Address = {0};
+    Address.si_family = AddressFamily;
+    if (AddressFamily == AF_INET) {
+        Address.Ipv4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    } else {
+        IN6_SET_ADDR_LOOPBACK(&Address.Ipv6.sin6_addr);
+    }
+
+    TEST_CXPLAT(FnSockBind(ReceiveSocket.get(), (SOCKADDR *)&Address, sizeof(Address)));
+
+    INT AddressLength = sizeof(Address);
+    TEST_CXPLAT(FnSockGetSockName(ReceiveSocket.get(), (SOCKADDR *)&Address, &AddressLength));
+
+    INT TimeoutMs = TEST_TIMEOUT_ASYNC_MS;
+    TEST_CXPLAT(
+        FnSockSetSockOpt(
+            ReceiveSocket.get(), SOL_SOCKET, SO_RCVTIMEO, (CHAR *)&TimeoutMs, sizeof(TimeoutMs)));
+
+    unique_fnsock_handle SendSocket;
+    TEST_CXPLAT(FnSockCreate(AddressFamily, SOCK_DGRAM, IPPROTO_UDP, &SendSocket));
+    TEST_NOT_NULL(SendSocket.get());
+
+    RtlZeroMemory(Messages, sizeof(Messages));
+    for (INT Index = 0; Index < MessageCount; Index++) {
+        RtlFillMemory(Payloads[Index], sizeof(Payloads[Index]), (UCHAR)Index);
+        Messages[Index].Buffer = Payloads[Index];
+        Messages[Index].BufferLength = sizeof(Payloads[Index]) - Index;
+        Messages[Index].Address = (SOCKADDR *)&Address;
+        Messages[Index].AddressLength = AddressLength;
+    }
+
+#if defined(_KERNEL_MODE)
+    //
+    // WSK sends take no flags, so kernel mode rejects them.
+    //
+    TEST_EQUAL(
+        -1, FnSockSendMsgBatch(SendSocket.get(), Messages, MessageCount, FALSE, MSG_DONTROUTE));
+#endif
+
+    TEST_EQUAL(
+        MessageCount, FnSockSendMsgBatch(SendSocket.get(), Messages, MessageCount, FALSE, 0));
+    for (INT Index = 0; Index < MessageCount; Index++) {
+        TEST_EQUAL((INT)sizeof(Payloads[Index]) - Index, Messages[Index].BytesTransferred);
+    }
+
+    //
+    // A batch receive returns the datagrams that are already queued, so keep
+    // receiving until all of them arrive.
+    //
+    INT Received = 0;
+    while (Received < MessageCount) {
+        RtlZeroMemory(Messages, sizeof(Messages));
+        for (INT Index = Received; Index < MessageCount; Index++) {
+            Messages[Index - Received].Buffer = RecvPayloads[Index];
+            Messages[Index - Received].BufferLength = sizeof(RecvPayloads[Index]);
+        }
+
+        INT Count =
+            FnSockRecvMsgBatch(
+                ReceiveSocket.get(), Messages, MessageCount - Received, FALSE, 0);
+        TEST_TRUE(Count > 0);
+
+        for (INT Index = 0; Index < Count; Index++) {
+            TEST_EQUAL(
+                (INT)sizeof(Payloads[Received + Index]) - (Received + Index),
+                Messages[Index].BytesTransferred);
+        }
+
+        Received += Count;
+    }
+
+    for (INT Index = 0; Index < MessageCount; Index++) {
+        TEST_TRUE(
+            RtlEqualMemory(
+                RecvPayloads[Index], Payloads[Index], sizeof(Payloads[Index]) - Index));
+    }
+}
+
+EXTERN_C
+VOID
+SockUdpSegmentation(
+    USHORT AddressFamily
+    )
+{
+    CONST UINT32 SegmentSize = 1000;
+    CONST UINT32 SegmentCount = 4;
+    CONST UINT32 PayloadLength = SegmentSize * SegmentCount;
+
+    unique_malloc_ptr<CHAR> Payload((CHAR *)CxPlatAllocNonPaged(PayloadLength, POOL_TAG));
+    TEST_NOT_NULL(Payload.get());
+    unique_malloc_ptr<CHAR> RecvPayload((CHAR *)CxPlatAllocNonPaged(PayloadLength, POOL_TAG));
+    TEST_NOT_NULL(RecvPayload.get());
+
+    unique_fnsock_handle ReceiveSocket;
+    TEST_CXPLAT(FnSockCreate(AddressFamily, SOCK_DGRAM, IPPROTO_UDP, &ReceiveSocket));
+    TEST_NOT_NULL(ReceiveSocket.get());
+
+    SOCKADDR_INET Address = {0};
+    Address.si_family = AddressFamily;
+    if (AddressFamily == AF_INET) {
+        Address.Ipv4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    } else {
+        IN6_SET_ADDR_LOOPBACK(&Address.Ipv6.sin6_addr);
+    }
+
+    TEST_CXPLAT(FnSockBind(ReceiveSocket.get(), (SOCKADDR *)&Address, sizeof(Address)));
+
+    INT AddressLength = sizeof(Address);
+    TEST_CXPLAT(FnSockGetSockName(ReceiveSocket.get(), (SOCKADDR *)&Address, &AddressLength));
+
+    INT TimeoutMs = TEST_TIMEOUT_ASYNC_MS;
+    TEST_CXPLAT(
+        FnSockSetSockOpt(
+            ReceiveSocket.get(), SOL_SOCKET, SO_RCVTIMEO, (CHAR *)&TimeoutMs, sizeof(TimeoutMs)));
+
+    //
+    // Receive coalescing is best effort; the datagrams are validated either
+    // way.
+    //
+    DWORD MaxCoalescedSize = PayloadLength;
+    FnSockSetSockOpt(
+        ReceiveSocket.get(), IPPROTO_UDP, UDP_RECV_MAX_COALESCED_SIZE,
+        (CHAR *)&MaxCoalescedSize, sizeof(MaxCoalescedSize));
+
+    unique_fnsock_handle SendSocket;
+    TEST_CXPLAT(FnSockCreate(AddressFamily, SOCK_DGRAM, IPPROTO_UDP, &SendSocket));
+    TEST_NOT_NULL(SendSocket.get());
+
+    for (UINT32 Index = 0; Index < PayloadLength; Index++) {
+        Payload.get()[Index] = (CHAR)(Index / SegmentSize + Index);
+    }
+
+    INT BytesSent =
+        FnSockSendSegments(
+            SendSocket.get(), Payload.get(), PayloadLength, FALSE, 0, (SOCKADDR *)&Address,
+            AddressLength, SegmentSize);
+    if (BytesSent == -1) {
+        //
+        // Segmentation offload is not supported on this platform.
+        //
+        TEST_EQUAL(WSAEINVAL, FnSockGetLastError());
+        return;
+    }
+    TEST_EQUAL((INT)PayloadLength, BytesSent);
+
+    UINT32 Received = 0;
+    while (Received < PayloadLength) {
+        CHAR ControlBuffer[WSA_CMSG_SPACE(sizeof(UINT32))];
+        INT ControlBufferLength = sizeof(ControlBuffer);
+        INT Flags = 0;
+        UINT32 CoalescedSegmentSize;
+
+        INT BytesReceived =
+            FnSockRecvMsg(
+                ReceiveSocket.get(), RecvPayload.get() + Received, PayloadLength - Received,
+                FALSE, (CMSGHDR *)ControlBuffer, &ControlBufferLength, &Flags);
+        TEST_TRUE(BytesReceived > 0);
+        TEST_FALSE(Flags & MSG_CTRUNC);
+
+        if (FnSockGetCoalescedInfo(
+                (CMSGHDR *)ControlBuffer, ControlBufferLength, &CoalescedSegmentSize)) {
+            TEST_EQUAL(SegmentSize, CoalescedSegmentSize);
+        } else {
+            TEST_EQUAL((INT)SegmentSize, BytesReceived);
+        }
+
+        Received += BytesReceived;
+    }
+
+    TEST_EQUAL(PayloadLength, Received);
+    TEST_TRUE(RtlEqualMemory(RecvPayload.get(), Payload.get(), PayloadLength));
+}
+
+EXTERN_C
+VOID
+SockAsyncTcp(
+    USHORT AddressFamily
+    )
+{
+    CONST CHAR *Msg = "SockAsyncTcp-Request";
+    CONST INT MsgLen = (CONST INT)strlen(Msg);
+    CHAR RecvBuffer[64];
+    INT Received = 0;
+    BOOLEAN SendCompleted = FALSE;
+    FNSOCK_COMPLETION Completions[4];
+    INT Count;
+
+    unique_fnsock_completion_queue Queue;
+    TEST_CXPLAT(FnSockCreateCompletionQueue(&Queue));
+    TEST_NOT_NULL(Queue.get());
+
+    unique_fnsock_handle ListenSocket;
+    TEST_CXPLAT(FnSockCreate(AddressFamily, SOCK_STREAM, IPPROTO_TCP, &ListenSocket));
+    TEST_NOT_NULL(ListenSocket.get());
+
+    SOCKADDR_INET Address = {0};
+    Address.si_family = AddressFamily;
+    TEST_CXPLAT(FnSockBind(ListenSocket.get(), (SOCKADDR *)&Address, sizeof(Address)));
+
+    INT AddressLength = sizeof(Address);
+    TEST_CXPLAT(FnSockGetSockName(ListenSocket.get(), (SOCKADDR *)&Address, &AddressLength));
+
+    TEST_CXPLAT(FnSockListen(ListenSocket.get(), 32));
+    TEST_CXPLAT(FnSockAssociateCompletionQueue(ListenSocket.get(), Queue.get()));
+    TEST_CXPLAT(FnSockAcceptAsync(ListenSocket.get(), ListenSocket.addressof()));
+
+    unique_fnsock_handle ClientSocket;
+    TEST_CXPLAT(FnSockCreate(AddressFamily, SOCK_STREAM, IPPROTO_TCP, &ClientSocket));
+    TEST_NOT_NULL(ClientSocket.get());
+
+    if (AddressFamily == AF_INET) {
+        Address.Ipv4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    } else {
+        IN6_SET_ADDR_LOOPBACK(&Address.Ipv6.sin6_addr);
+    }
+
+    TEST_CXPLAT(FnSockConnect(ClientSocket.get(), (SOCKADDR *)&Address, AddressLength));
+
+    Count = FnSockGetCompletions(Queue.get(), Completions, 1, TEST_TIMEOUT_ASYNC_MS);
+    TEST_EQUAL(1, Count);
+    TEST_EQUAL(ListenSocket.get(), Completions[0].Socket);
+    TEST_EQUAL(FnSockOperationAccept, Completions[0].Operation);
+    TEST_EQUAL(ListenSocket.addressof(), Completions[0].Context);
+    TEST_EQUAL(0, Completions[0].Error);
+    TEST_NOT_NULL(Completions[0].AcceptedSocket);
+
+    unique_fnsock_handle AcceptSocket(Completions[0].AcceptedSocket);
+    TEST_CXPLAT(FnSockAssociateCompletionQueue(AcceptSocket.get(), Queue.get()));
+    TEST_CXPLAT(FnSockAssociateCompletionQueue(ClientSocket.get(), Queue.get()));
+
+    TEST_CXPLAT(
+        FnSockRecvAsync(
+            AcceptSocket.get(), RecvBuffer, sizeof(RecvBuffer), FALSE, 0,
+            AcceptSocket.addressof()));
+    TEST_CXPLAT(
+        FnSockSendAsync(
+            ClientSocket.get(), Msg, MsgLen, FALSE, 0, ClientSocket.addressof()));
+
+    //
+    // Stream receives complete with whatever data is available, so post
+    // another receive until the whole message has arrived.
+    //
+    while (!SendCompleted || Received < MsgLen) {
+        Count =
+            FnSockGetCompletions(
+                Queue.get(), Completions, RTL_NUMBER_OF(Completions), TEST_TIMEOUT_ASYNC_MS);
+        TEST_TRUE(Count > 0);
+
+        for (INT Index = 0; Index < Count; Index++) {
+            FNSOCK_COMPLETION *Completion = &Completions[Index];
+
+            TEST_EQUAL(0, Completion->Error);
+
+            if (Completion->Operation == FnSockOperationSend) {
+                TEST_FALSE(SendCompleted);
+                TEST_EQUAL(ClientSocket.get(), Completion->Socket);
+                TEST_EQUAL(ClientSocket.addressof(), Completion->Context);
+                TEST_EQUAL(MsgLen, Completion->BytesTransferred);
+                SendCompleted = TRUE;
+            } else {
+                TEST_EQUAL(FnSockOperationRecv, Completion->Operation);
+                TEST_EQUAL(AcceptSocket.get(), Completion->Socket);
+                TEST_EQUAL(AcceptSocket.addressof(), Completion->Context);
+                TEST_TRUE(Completion->BytesTransferred > 0);
+                Received += Completion->BytesTransferred;
+
+                if (Received < MsgLen) {
+                    TEST_CXPLAT(
+                        FnSockRecvAsync(
+                            AcceptSocket.get(), RecvBuffer + Received,
+                            (INT)sizeof(RecvBuffer) - Received, FALSE, 0,
+                            AcceptSocket.addressof()));
+                }
+            }
+        }
+    }
+
+    TEST_EQUAL(MsgLen, Received);
+    TEST_TRUE(RtlEqualMemory(RecvBuffer, Msg, MsgLen));
+
     //
+    // Nothing else is pending, so the queue times out.
+    //
+    TEST_EQUAL(0, FnSockGetCompletions(Queue.get(), Completions, RTL_NUMBER_OF(Completions), 0));
+}
+
+EXTERN_C
+VOID
+SockPoll(
+    USHORT AddressFamily
+    )
+{
+    CONST CHAR Payload[] = "SockPoll";
+    CHAR RecvPayload[sizeof(Payload)];
+    unique_fnsock_handle ReceiveSockets[2];
+    SOCKADDR_INET Addresses[RTL_NUMBER_OF(ReceiveSockets)];
+    FNSOCK_POLL_FD Fds[RTL_NUMBER_OF(ReceiveSockets)] = {0};
+
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(ReceiveSockets); Index++) {
+        TEST_CXPLAT(
+            FnSockCreate(AddressFamily, SOCK_DGRAM, IPPROTO_UDP, &ReceiveSockets[Index]));
+        TEST_NOT_NULL(ReceiveSockets[Index].get());
+
+        RtlZeroMemory(&Addresses[Index], sizeof(Addresses[Index]));
+        Addresses[Index].si_family = AddressFamily;
+        if (AddressFamily == AF_INET) {
+            Addresses[Index].Ipv4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        } else {
+            IN6_SET_ADDR_LOOPBACK(&Addresses[Index].Ipv6.sin6_addr);
+        }
+
+        TEST_CXPLAT(
+            FnSockBind(
+                ReceiveSockets[Index].get(), (SOCKADDR *)&Addresses[Index],
+                sizeof(Addresses[Index])));
+
+        INT AddressLength = sizeof(Addresses[Index]);
+        TEST_CXPLAT(
+            FnSockGetSockName(
+                ReceiveSockets[Index].get(), (SOCKADDR *)&Addresses[Index], &AddressLength));
+
+        Fds[Index].Socket = ReceiveSockets[Index].get();
+        Fds[Index].Events = POLLIN;
+    }
+
+    //
+    // Nothing has been received, so a zero timeout poll reports no sockets.
+    //
+    TEST_EQUAL(0, FnSockPoll(Fds, RTL_NUMBER_OF(Fds), 0));
+    TEST_EQUAL(0, Fds[0].ReturnedEvents);
+    TEST_EQUAL(0, Fds[1].ReturnedEvents);
+
+    unique_fnsock_handle SendSocket;
+    TEST_CXPLAT(FnSockCreate(AddressFamily, SOCK_DGRAM, IPPROTO_UDP, &SendSocket));
+    TEST_NOT_NULL(SendSocket.get());
+
+    TEST_EQUAL(
+        (INT)sizeof(Payload),
+        FnSockSendto(
+            SendSocket.get(), Payload, sizeof(Payload), FALSE, 0, (SOCKADDR *)&Addresses[1],
+            sizeof(Addresses[1])));
+
+    //
+    // Only the socket the datagram was sent to becomes readable.
+    //
+    TEST_EQUAL(1, FnSockPoll(Fds, RTL_NUMBER_OF(Fds), TEST_TIMEOUT_ASYNC_MS));
+    TEST_EQUAL(0, Fds[0].ReturnedEvents);
+    TEST_TRUE(Fds[1].ReturnedEvents & POLLRDNORM);
+
+    FNSOCK_POLL_FD SendFd = {0};
+    SendFd.Socket = SendSocket.get();
+    SendFd.Events = POLLOUT;
+    TEST_EQUAL(1, FnSockPoll(&SendFd, 1, TEST_TIMEOUT_ASYNC_MS));
+    TEST_TRUE(SendFd.ReturnedEvents & POLLWRNORM);
+
+    TEST_EQUAL(
+        (INT)sizeof(Payload),
+        FnSockRecv(ReceiveSockets[1].get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+    TEST_TRUE(RtlEqualMemory(RecvPayload, Payload, sizeof(Payload)));
+
+    //
+    // Draining the datagram clears readiness again.
+    //
+    TEST_EQUAL(0, FnSockPoll(Fds, RTL_NUMBER_OF(Fds), 0));
+
+    //
+    // An indefinite poll without sockets fails instead of waiting forever.
+    //
+    TEST_EQUAL(-1, FnSockPoll(NULL, 0, -1));
+    TEST_EQUAL(WSAEINVAL, FnSockGetLastError());
+
+#if defined(_KERNEL_MODE)
+    FNSOCK_POLL_FD NullFd = {0};
+    NullFd.Events = POLLIN;
+    TEST_EQUAL(-1, FnSockPoll(&NullFd, 1, 0));
+    TEST_EQUAL(WSAEINVAL, FnSockGetLastError());
+#endif
+}
+
+//
+// The payloads and message descriptors of SockUdpRio, which are too large for
+// the kernel stack.
+//
+#define SOCK_RIO_MESSAGE_COUNT 32
+
+typedef struct _SOCK_RIO_BUFFERS {
+    CHAR Payloads[SOCK_RIO_MESSAGE_COUNT][64];
+    CHAR RecvPayloads[SOCK_RIO_MESSAGE_COUNT][64];
+    FNSOCK_MSG Messages[SOCK_RIO_MESSAGE_COUNT];
+} SOCK_RIO_BUFFERS;
+
+EXTERN_C
+VOID
+SockUdpRio(
+    USHORT AddressFamily
+    )
+{
+    CONST INT MessageCount = SOCK_RIO_MESSAGE_COUNT;
+    FNSOCK_RIO_CONFIG Config = {0};
+
+    unique_malloc_ptr<SOCK_RIO_BUFFERS> Buffers(
+        (SOCK_RIO_BUFFERS *)CxPlatAllocNonPaged(sizeof(SOCK_RIO_BUFFERS), POOL_TAG));
+    TEST_NOT_NULL(Buffers.get());
+    auto &Payloads = Buffers->Payloads;
+    auto &RecvPayloads = Buffers->RecvPayloads;
+    auto &Messages = Buffers->Messages;
+
+    //
+    // Use fewer send buffers than messages so that sends wait for buffers to
+    // be returned.
+    //
+    Config.BufferSize = sizeof(Payloads[0]);
+    Config.SendBufferCount = MessageCount / 4;
+    Config.RecvBufferCount = MessageCount;
+
+    unique_fnsock_rio_handle ReceiveSocket;
+    TEST_CXPLAT(
+        FnSockRioCreate(AddressFamily, SOCK_DGRAM, IPPROTO_UDP, &Config, &ReceiveSocket));
+    TEST_NOT_NULL(ReceiveSocket.get());
+
+    SOCKADDR_INET Address = {0};
+    Address.si_family = AddressFamily;
+    if (AddressFamily == AF_INET) {
+        Address.Ipv4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    } else {
+        IN6_SET_ADDR_LOOPBACK(&Address.Ipv6.sin6_addr);
+    }
+
+    TEST_CXPLAT(FnSockRioBind(ReceiveSocket.get(), (SOCKADDR *)&Address, sizeof(Address)));
+
+    INT AddressLength = sizeof(Address);
+    TEST_CXPLAT(
+        FnSockGetSockName(
+            FnSockRioGetSocket(ReceiveSocket.get()), (SOCKADDR *)&Address, &AddressLength));
+
+    INT TimeoutMs = TEST_TIMEOUT_ASYNC_MS;
+    TEST_CXPLAT(
+        FnSockSetSockOpt(
+            FnSockRioGetSocket(ReceiveSocket.get()), SOL_SOCKET, SO_RCVTIMEO,
+            (CHAR *)&TimeoutMs, sizeof(TimeoutMs)));
+
+    unique_fnsock_rio_handle SendSocket;
+    TEST_CXPLAT(FnSockRioCreate(AddressFamily, SOCK_DGRAM, IPPROTO_UDP, &Config, &SendSocket));
+    TEST_NOT_NULL(SendSocket.get());
+
+    RtlZeroMemory(Messages, sizeof(Messages));
+    for (INT Index = 0; Index < MessageCount; Index++) {
+        RtlFillMemory(Payloads[Index], sizeof(Payloads[Index]), (UCHAR)Index);
+        Messages[Index].Buffer = Payloads[Index];
+        Messages[Index].BufferLength = sizeof(Payloads[Index]) - Index;
+        Messages[Index].Address = (SOCKADDR *)&Address;
+        Messages[Index].AddressLength = AddressLength;
+    }
+
+    TEST_EQUAL(MessageCount, FnSockRioSendBatch(SendSocket.get(), Messages, MessageCount));
+    for (INT Index = 0; Index < MessageCount; Index++) {
+        TEST_EQUAL((INT)sizeof(Payloads[Index]) - Index, Messages[Index].BytesTransferred);
+    }
+
+    INT Received = 0;
+    while (Received < MessageCount) {
+        RtlZeroMemory(Messages, sizeof(Messages));
+        for (INT Index = Received; Index < MessageCount; Index++) {
+            Messages[Index - Received].Buffer = RecvPayloads[Index];
+            Messages[Index - Received].BufferLength = sizeof(RecvPayloads[Index]);
+        }
+
+        INT Count = FnSockRioRecvBatch(ReceiveSocket.get(), Messages, MessageCount - Received);
+        TEST_TRUE(Count > 0);
+
+        for (INT Index = 0; Index < Count; Index++) {
+            TEST_EQUAL(
+                (INT)sizeof(Payloads[Received + Index]) - (Received + Index),
+                Messages[Index].BytesTransferred);
+        }
+
+        Received += Count;
+    }
+
+    for (INT Index = 0; Index < MessageCount; Index++) {
+        TEST_TRUE(
+            RtlEqualMemory(
+                RecvPayloads[Index], Payloads[Index], sizeof(Payloads[Index]) - Index));
+    }
+
+    //
+    // A connected socket sends without a remote address.
+    //
+    TEST_CXPLAT(
+        FnSockConnect(
+            FnSockRioGetSocket(SendSocket.get()), (SOCKADDR *)&Address, AddressLength));
+    RtlZeroMemory(Messages, sizeof(Messages));
+    Messages[0].Buffer = Payloads[0];
+    Messages[0].BufferLength = sizeof(Payloads[0]);
+    TEST_EQUAL(1, FnSockRioSendBatch(SendSocket.get(), Messages, 1));
+
+    RtlZeroMemory(Messages, sizeof(Messages));
+    Messages[0].Buffer = RecvPayloads[0];
+    Messages[0].BufferLength = sizeof(RecvPayloads[0]);
+    TEST_EQUAL(1, FnSockRioRecvBatch(ReceiveSocket.get(), Messages, 1));
+    TEST_EQUAL((INT)sizeof(Payloads[0]), Messages[0].BytesTransferred);
+    TEST_TRUE(RtlEqualMemory(RecvPayloads[0], Payloads[0], sizeof(Payloads[0])));
+
+    //
+    // Datagrams larger than the registered buffers cannot be sent.
+    //
+    CHAR LargePayload[sizeof(Payloads[0]) + 1] = {0};
+    RtlZeroMemory(Messages, sizeof(Messages));
+    Messages[0].Buffer = LargePayload;
+    Messages[0].BufferLength = sizeof(LargePayload);
+    Messages[0].Address = (SOCKADDR *)&Address;
+    Messages[0].AddressLength = AddressLength;
+    TEST_EQUAL(-1, FnSockRioSendBatch(SendSocket.get(), Messages, 1));
+    TEST_EQUAL(WSAEMSGSIZE, FnSockGetLastError());
+}
+
+//
+// The number of connects and accepts SockTcpConnectChurn keeps outstanding,
+// and the total number of connections it sets up and tears down.
+//
+#define SOCK_CHURN_OUTSTANDING 16
+#define SOCK_CHURN_CONNECTIONS 1000
+
+typedef struct _SOCK_CHURN_CONNECT {
+    unique_fnsock_handle Socket;
+    UINT64 StartTime;
+} SOCK_CHURN_CONNECT;
+
+static
+BOOLEAN
+PostChurnConnect(
+    _In_ FNSOCK_COMPLETION_QUEUE Queue,
+    _In_ USHORT AddressFamily,
+    _In_ CONST SOCKADDR_INET *Address,
+    _In_ INT AddressLength,
+    _Inout_ SOCK_CHURN_CONNECT *Connect
+    )
+{
+    TEST_CXPLAT_RET(
+        FnSockCreate(AddressFamily, SOCK_STREAM, IPPROTO_TCP, &Connect->Socket), FALSE);
+    TEST_NOT_NULL_RET(Connect->Socket.get(), FALSE);
+    TEST_CXPLAT_RET(FnSockAssociateCompletionQueue(Connect->Socket.get(), Queue), FALSE);
+
+    Connect->StartTime = CxPlatTimePlat();
+    TEST_CXPLAT_RET(
+        FnSockConnectAsync(
+            Connect->Socket.get(), (CONST SOCKADDR *)Address, AddressLength, Connect),
+        FALSE);
+
+    return TRUE;
+}
+
+static
+VOID
+SortUint64(
+    _Inout_updates_(Count) UINT64 *Values,
+    _In_ UINT32 Count
+    )
+{
+    for (UINT32 Index = 1; Index < Count; Index++) {
+        UINT64 Value = Values[Index];
+        UINT32 Position = Index;
+
+        while (Position > 0 && Values[Position - 1] > Value) {
+            Values[Position] = Values[Position - 1];
+            Position--;
+        }
+
+        Values[Position] = Value;
+    }
+}
+
+EXTERN_C
+VOID
+SockTcpConnectChurn(
+    USHORT AddressFamily
+    )
+{
+    FNSOCK_COMPLETION Completions[2 * SOCK_CHURN_OUTSTANDING];
+    UINT32 Posted = 0;
+    UINT32 Connected = 0;
+    UINT32 Accepted = 0;
+    UINT64 StartTime;
+    UINT64 ElapsedUs;
+
+    unique_malloc_ptr<UINT64> Latencies(
+        (UINT64 *)CxPlatAllocNonPaged(SOCK_CHURN_CONNECTIONS * sizeof(UINT64), POOL_TAG));
+    TEST_NOT_NULL(Latencies.get());
+
+    unique_fnsock_completion_queue Queue;
+    TEST_CXPLAT(FnSockCreateCompletionQueue(&Queue));
+    TEST_NOT_NULL(Queue.get());
+
+    //
+    // Declared after the queue so that on an early return the sockets are
+    // closed before the queue they are associated with.
+    //
+    SOCK_CHURN_CONNECT Connects[SOCK_CHURN_OUTSTANDING];
+
+    unique_fnsock_handle ListenSocket;
+    TEST_CXPLAT(FnSockCreate(AddressFamily, SOCK_STREAM, IPPROTO_TCP, &ListenSocket));
+    TEST_NOT_NULL(ListenSocket.get());
+
+    SOCKADDR_INET Address = {0};
+    Address.si_family = AddressFamily;
+    TEST_CXPLAT(FnSockBind(ListenSocket.get(), (SOCKADDR *)&Address, sizeof(Address)));
+
+    INT AddressLength = sizeof(Address);
+    TEST_CXPLAT(FnSockGetSockName(ListenSocket.get(), (SOCKADDR *)&Address, &AddressLength));
+
+    TEST_CXPLAT(FnSockListen(ListenSocket.get(), 2 * SOCK_CHURN_OUTSTANDING));
+    TEST_CXPLAT(FnSockAssociateCompletionQueue(ListenSocket.get(), Queue.get()));
+
+    if (AddressFamily == AF_INET) {
+        Address.Ipv4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    } else {
+        IN6_SET_ADDR_LOOPBACK(&Address.Ipv6.sin6_addr);
+    }
+
+    StartTime = CxPlatTimePlat();
+
+    for (UINT32 Index = 0; Index < SOCK_CHURN_OUTSTANDING; Index++) {
+        TEST_CXPLAT(FnSockAcceptAsync(ListenSocket.get(), ListenSocket.addressof()));
+        TEST_TRUE(
+            PostChurnConnect(
+                Queue.get(), AddressFamily, &Address, AddressLength, &Connects[Index]));
+        Posted++;
+    }
+
+    //
+    // Close both ends of each connection as soon as it is set up, and replace
+    // its connect and accept to keep the pipeline full.
+    //
+    while (Connected < SOCK_CHURN_CONNECTIONS || Accepted < SOCK_CHURN_CONNECTIONS) {
+        INT Count =
+            FnSockGetCompletions(
+                Queue.get(), Completions, RTL_NUMBER_OF(Completions), TEST_TIMEOUT_ASYNC_MS);
+        TEST_TRUE(Count > 0);
+
+        for (INT Index = 0; Index < Count; Index++) {
+            FNSOCK_COMPLETION *Completion = &Completions[Index];
+
+            TEST_EQUAL(0, Completion->Error);
+
+            if (Completion->Operation == FnSockOperationAccept) {
+                TEST_EQUAL(ListenSocket.get(), Completion->Socket);
+                TEST_NOT_NULL(Completion->AcceptedSocket);
+                FnSockClose(Completion->AcceptedSocket);
+
+                if (++Accepted + SOCK_CHURN_OUTSTANDING <= SOCK_CHURN_CONNECTIONS) {
+                    TEST_CXPLAT(FnSockAcceptAsync(ListenSocket.get(), ListenSocket.addressof()));
+                }
+            } else {
+                SOCK_CHURN_CONNECT *Connect = (SOCK_CHURN_CONNECT *)Completion->Context;
+
+                TEST_EQUAL(FnSockOperationConnect, Completion->Operation);
+                TEST_EQUAL(Connect->Socket.get(), Completion->Socket);
+                TEST_TRUE(Connected < SOCK_CHURN_CONNECTIONS);
+
+                Latencies.get()[Connected++] =
+                    CxPlatTimePlatToUs64(CxPlatTimePlat() - Connect->StartTime);
+                Connect->Socket.reset();
+
+                if (Posted < SOCK_CHURN_CONNECTIONS) {
+                    TEST_TRUE(
+                        PostChurnConnect(
+                            Queue.get(), AddressFamily, &Address, AddressLength, Connect));
+                    Posted++;
+                }
+            }
+        }
+    }
+
+    ElapsedUs = max(CxPlatTimePlatToUs64(CxPlatTimePlat() - StartTime), 1);
+
+    SortUint64(Latencies.get(), SOCK_CHURN_CONNECTIONS);
+
+    TraceInfo(
+        "AddressFamily=%u Connections=%u ConnectsPerSec=%llu "
+        "LatencyUs P50=%llu P90=%llu P99=%llu Max=%llu",
+        AddressFamily, SOCK_CHURN_CONNECTIONS,
+        SOCK_CHURN_CONNECTIONS * 1000000ui64 / ElapsedUs,
+        Latencies.get()[(SOCK_CHURN_CONNECTIONS - 1) * 50 / 100],
+        Latencies.get()[(SOCK_CHURN_CONNECTIONS - 1) * 90 / 100],
+        Latencies.get()[(SOCK_CHURN_CONNECTIONS - 1) * 99 / 100],
+        Latencies.get()[SOCK_CHURN_CONNECTIONS - 1]);
+
+    //
+    // Every connect and accept has completed, so the queue times out.
+    //
+    TEST_EQUAL(0, FnSockGetCompletions(Queue.get(), Completions, RTL_NUMBER_OF(Completions), 0));
+}
+
+EXTERN_C
+VOID
+SockBasicRaw(
+    USHORT AddressFamily
+    )
+{
+    unique_fnsock_handle Socket;
+    TEST_CXPLAT(FnSockCreate(AddressFamily, SOCK_RAW, IPPROTO_IP, &Socket));
+    TEST_NOT_NULL(Socket.get());
+
+    SOCKADDR_INET Address = {0};
+    Address.si_family = AddressFamily;
+
+    if (AddressFamily == AF_INET) {
+        PCSTR Terminator;
+        TEST_NTSTATUS(
+            RtlIpv4StringToAddressA(FNMP_IPV4_ADDRESS, FALSE, &Terminator, &Address.Ipv4.sin_addr));
+    } else {
+        PCSTR Terminator;
+        TEST_NTSTATUS(
+            RtlIpv6StringToAddressA(FNMP_IPV6_ADDRESS, &Terminator, &Address.Ipv6.sin6_addr));
+    }
+
+    TEST_CXPLAT(FnSockBind(Socket.get(), (SOCKADDR *)&Address, sizeof(Address)));
+
+    DWORD Opt = RCVALL_ON;
+    DWORD BytesReturned;
+    TEST_CXPLAT(
+        FnSockIoctl(Socket.get(), SIO_RCVALL, &Opt, sizeof(Opt), NULL, 0, &BytesReturned));
+
+    //
+    // The TX datapath will form non-contiguous data indications, which FnSock
+    // discards on the RX path. Skipping datapath validation for now.
+    //
+}
+
+static
+VOID
+PktInitializeTestAddresses(
+    _In_ ADDRESS_FAMILY AddressFamily,
+    _Out_ INET_ADDR *IpSource,
+    _Out_ INET_ADDR *IpDestination
+    )
+{
+    RtlZeroMemory(IpSource, sizeof(*IpSource));
+    RtlZeroMemory(IpDestination, sizeof(*IpDestination));
+
+    if (AddressFamily == AF_INET) {
+        IpSource->Ipv4.s_addr = htonl(0xC0A80001);
+        IpDestination->Ipv4.s_addr = htonl(0xC0A80002);
+    } else {
+        IpSource->Ipv6.u.Byte[0] = 0xFE;
+        IpSource->Ipv6.u.Byte[1] = 0x80;
+        IpSource->Ipv6.u.Byte[15] = 1;
+        IpDestination->Ipv6 = IpSource->Ipv6;
+        IpDestination->Ipv6.u.Byte[15] = 2;
+    }
+}
+
+static
+bool
+PktVerifyUdpSegment(
+    _In_ ADDRESS_FAMILY AddressFamily,
+    _In_reads_bytes_(FrameLength) UCHAR *Frame,
+    _In_ UINT32 FrameLength,
+    _In_reads_bytes_(ExpectedLength) CONST UCHAR *ExpectedPayload,
+    _In_ UINT32 ExpectedLength
+    )
+{
+    ADDRESS_FAMILY ParsedFamily;
+    UDP_HDR *UdpHeader;
+    VOID *Payload;
+    UINT32 PayloadLength;
+    CONST VOID *IpSource;
+    CONST VOID *IpDestination;
+    UINT8 AddressLength;
+
+    TEST_TRUE_RET(
+        PktParseUdpFrame(
+            Frame, FrameLength, &ParsedFamily, &UdpHeader, &Payload, &PayloadLength),
+        false);
+    TEST_EQUAL_RET(AddressFamily, ParsedFamily, false);
+    TEST_EQUAL_RET(ExpectedLength, PayloadLength, false);
+    TEST_TRUE_RET(RtlEqualMemory(ExpectedPayload, Payload, ExpectedLength), false);
+    TEST_EQUAL_RET(sizeof(*UdpHeader) + ExpectedLength, ntohs(UdpHeader->uh_ulen), false);
+
+    if (AddressFamily == AF_INET) {
+        IPV4_HEADER *IpHeader = (IPV4_HEADER *)(Frame + sizeof(ETHERNET_HEADER));
+
+        TEST_EQUAL_RET(
+            sizeof(*IpHeader) + sizeof(*UdpHeader) + ExpectedLength,
+            ntohs(IpHeader->TotalLength), false);
+        TEST_EQUAL_RET(
+            0xFFFF, PktChecksumFold(PktPartialChecksum(IpHeader, sizeof(*IpHeader))), false);
+        IpSource = &IpHeader->SourceAddress;
+        IpDestination = &IpHeader->DestinationAddress;
+        AddressLength = sizeof(IN_ADDR);
+    } else {
+        IPV6_HEADER *IpHeader = (IPV6_HEADER *)(Frame + sizeof(ETHERNET_HEADER));
+
+        TEST_EQUAL_RET(sizeof(*UdpHeader) + ExpectedLength, ntohs(IpHeader->PayloadLength), false);
+        IpSource = &IpHeader->SourceAddress;
+        IpDestination = &IpHeader->DestinationAddress;
+        AddressLength = sizeof(IN6_ADDR);
+    }
+
+    UINT32 Checksum =
+        PktPseudoHeaderChecksum(
+            IpSource, IpDestination, AddressLength,
+            (UINT16)(sizeof(*UdpHeader) + ExpectedLength), IPPROTO_UDP);
+    Checksum += PktPartialChecksum(UdpHeader, (UINT16)(sizeof(*UdpHeader) + ExpectedLength));
+    TEST_EQUAL_RET(0xFFFF, PktChecksumFold(Checksum), false);
+
+    return true;
+}
+
+template<ADDRESS_FAMILY AddressFamily>
+static
+bool
+PktVerifyFrameTemplates(
+    _In_ CONST typename PktUdpFrameTemplate<AddressFamily>::IpAddress *IpSource,
+    _In_ CONST typename PktUdpFrameTemplate<AddressFamily>::IpAddress *IpDestination
+    )
+{
+    CONST UINT16 PortSource = htons(4321);
+    CONST UINT16 PortDestination = htons(1234);
+    CONST UINT16 PayloadLengths[] = {0, 1, 100};
+    ETHERNET_ADDRESS EthernetSource = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    ETHERNET_ADDRESS EthernetDestination = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+    UCHAR Payload[100];
+    UCHAR Frame[TCP_HEADER_STORAGE + sizeof(Payload)];
+    UCHAR TemplateFrame[sizeof(Frame)];
+
+    for (UINT32 Index = 0; Index < sizeof(Payload); Index++) {
+        Payload[Index] = (UCHAR)Index;
+    }
+
+    PktUdpFrameTemplate<AddressFamily> UdpTemplate(
+        &EthernetDestination, &EthernetSource, IpDestination, IpSource, PortDestination,
+        PortSource);
+    PktTcpFrameTemplate<AddressFamily> TcpTemplate(
+        &EthernetDestination, &EthernetSource, IpDestination, IpSource, PortDestination,
+        PortSource);
+
+    //
+    // Each template must emit the same bytes as the C builder, including odd
+    // and empty payloads.
+    //
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(PayloadLengths); Index++) {
+        CONST UINT16 PayloadLength = PayloadLengths[Index];
+        UINT32 FrameLength = sizeof(Frame);
+        UINT32 TemplateFrameLength = sizeof(TemplateFrame);
+
+        TEST_TRUE_RET(
+            PktBuildUdpFrame(
+                Frame, &FrameLength, Payload, PayloadLength, &EthernetDestination,
+                &EthernetSource, AddressFamily, IpDestination, IpSource, PortDestination,
+                PortSource),
+            false);
+        TEST_TRUE_RET(
+            UdpTemplate.Build(TemplateFrame, &TemplateFrameLength, Payload, PayloadLength),
+            false);
+        TEST_EQUAL_RET(FrameLength, TemplateFrameLength, false);
+        TEST_TRUE_RET(RtlEqualMemory(Frame, TemplateFrame, FrameLength), false);
+
+        FrameLength = sizeof(Frame);
+        TemplateFrameLength = sizeof(TemplateFrame);
+
+        TEST_TRUE_RET(
+            PktBuildTcpFrame(
+                Frame, &FrameLength, Payload, PayloadLength, NULL, 0, 0x01020304, 0x05060708,
+                TH_ACK | TH_PSH, 0x1234, &EthernetDestination, &EthernetSource,
+                AddressFamily, IpDestination, IpSource, PortDestination, PortSource),
+            false);
+        TEST_TRUE_RET(
+            TcpTemplate.Build(
+                TemplateFrame, &TemplateFrameLength, Payload, PayloadLength, 0x01020304,
+                0x05060708, TH_ACK | TH_PSH, 0x1234),
+            false);
+        TEST_EQUAL_RET(FrameLength, TemplateFrameLength, false);
+        TEST_TRUE_RET(RtlEqualMemory(Frame, TemplateFrame, FrameLength), false);
+    }
+
+    //
+    // Both templates reject buffers too small for the frame.
+    //
+    UINT32 ShortFrameLength = PktFrameLayout<AddressFamily, IPPROTO_UDP>::HeaderLength;
+    TEST_FALSE_RET(
+        UdpTemplate.Build(TemplateFrame, &ShortFrameLength, Payload, 1), false);
+    ShortFrameLength = PktFrameLayout<AddressFamily, IPPROTO_TCP>::HeaderLength;
+    TEST_FALSE_RET(
+        TcpTemplate.Build(TemplateFrame, &ShortFrameLength, Payload, 1, 0, 0, TH_ACK, 0),
+        false);
+
+    return true;
+}
+
+EXTERN_C
+VOID
+PktFrameTemplates(
+    USHORT AddressFamily
+    )
+{
+    INET_ADDR IpSource;
+    INET_ADDR IpDestination;
+
+    PktInitializeTestAddresses(AddressFamily, &IpSource, &IpDestination);
+
+    if (AddressFamily == AF_INET) {
+        TEST_TRUE(PktVerifyFrameTemplates<AF_INET>(&IpSource.Ipv4, &IpDestination.Ipv4));
+    } else {
+        TEST_TRUE(PktVerifyFrameTemplates<AF_INET6>(&IpSource.Ipv6, &IpDestination.Ipv6));
+    }
+}
+
+EXTERN_C
+VOID
+PktUdpSuperFrame(
+    USHORT AddressFamily
+    )
+{
+    CONST UINT16 SegmentSize = 1200;
+    CONST UINT32 PayloadLength = 2 * SegmentSize + 600;
+    CONST UINT32 LargePayloadLength = MAXUINT16 + 4096;
+    CONST UINT32 FrameCapacity = UDP_HEADER_STORAGE + LargePayloadLength;
+    ETHERNET_ADDRESS EthernetSource = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    ETHERNET_ADDRESS EthernetDestination = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+    INET_ADDR IpSource;
+    INET_ADDR IpDestination;
+    unique_malloc_ptr<UCHAR> Payload;
+    unique_malloc_ptr<UCHAR> SuperFrame;
+    unique_malloc_ptr<UCHAR> Segment;
+    UINT32 SuperFrameLength = FrameCapacity;
+    ADDRESS_FAMILY ParsedFamily;
+    UDP_HDR *UdpHeader;
+    VOID *ParsedPayload;
+    UINT32 ParsedPayloadLength;
+
+    PktInitializeTestAddresses(AddressFamily, &IpSource, &IpDestination);
+
+    Payload.reset((UCHAR *)CxPlatAllocNonPaged(LargePayloadLength, POOL_TAG));
+    TEST_NOT_NULL(Payload.get());
+    SuperFrame.reset((UCHAR *)CxPlatAllocNonPaged(FrameCapacity, POOL_TAG));
+    TEST_NOT_NULL(SuperFrame.get());
+    Segment.reset((UCHAR *)CxPlatAllocNonPaged(FrameCapacity, POOL_TAG));
+    TEST_NOT_NULL(Segment.get());
+
+    for (UINT32 Index = 0; Index < LargePayloadLength; Index++) {
+        Payload.get()[Index] = (UCHAR)Index;
+    }
+
+    TEST_EQUAL(3, PktUdpSegmentCount(PayloadLength, SegmentSize));
+    TEST_EQUAL(2, PktUdpSegmentCount(2 * SegmentSize, SegmentSize));
+    TEST_EQUAL(0, PktUdpSegmentCount(PayloadLength, 0));
+
+    TEST_TRUE(
+        PktBuildUdpSuperFrame(
+            SuperFrame.get(), &SuperFrameLength, Payload.get(), PayloadLength, SegmentSize,
+            &EthernetDestination, &EthernetSource, AddressFamily, &IpDestination, &IpSource,
+            htons(1234), htons(4321)));
+    TEST_EQUAL(UDP_HEADER_BACKFILL(AddressFamily) + PayloadLength, SuperFrameLength);
+
+    //
+    // The super-frame parses back to the original payload.
+    //
+    TEST_TRUE(
+        PktParseUdpFrame(
+            SuperFrame.get(), SuperFrameLength, &ParsedFamily, &UdpHeader, &ParsedPayload,
+            &ParsedPayloadLength));
+    TEST_EQUAL(AddressFamily, ParsedFamily);
+    TEST_EQUAL(PayloadLength, ParsedPayloadLength);
+    TEST_TRUE(RtlEqualMemory(Payload.get(), ParsedPayload, PayloadLength));
+    TEST_EQUAL(htons(4321), UdpHeader->uh_sport);
+    TEST_EQUAL(htons(1234), UdpHeader->uh_dport);
+
+    //
+    // Each segment is a standalone, correctly checksummed datagram, and the
+    // last one carries the short tail.
+    //
+    for (UINT32 Index = 0; Index < PktUdpSegmentCount(PayloadLength, SegmentSize); Index++) {
+        CONST UINT32 Offset = Index * SegmentSize;
+        CONST UINT32 Length =
+            PayloadLength - Offset < SegmentSize ? PayloadLength - Offset : SegmentSize;
+        UINT32 SegmentLength = FrameCapacity;
+
+        TEST_TRUE(
+            PktSplitUdpSuperFrame(
+                SuperFrame.get(), SuperFrameLength, SegmentSize, Index, Segment.get(),
+                &SegmentLength));
+        TEST_EQUAL(UDP_HEADER_BACKFILL(AddressFamily) + Length, SegmentLength);
+        TEST_TRUE(
+            PktVerifyUdpSegment(
+                AddressFamily, Segment.get(), SegmentLength, Payload.get() + Offset, Length));
+    }
+
+    UINT32 SegmentLength = FrameCapacity;
+    TEST_FALSE(
+        PktSplitUdpSuperFrame(
+            SuperFrame.get(), SuperFrameLength, SegmentSize, 3, Segment.get(), &SegmentLength));
+
+    //
+    // Super-frames larger than 64KB carry zero length fields. A segment whose
+    // datagram length would not fit in 16 bits is rejected rather than
+    // truncated, while a short tail segment still splits correctly.
+    //
+    SuperFrameLength = FrameCapacity;
+    TEST_TRUE(
+        PktBuildUdpSuperFrame(
+            SuperFrame.get(), &SuperFrameLength, Payload.get(), LargePayloadLength, MAXUINT16,
+            &EthernetDestination, &EthernetSource, AddressFamily, &IpDestination, &IpSource,
+            htons(1234), htons(4321)));
+    TEST_TRUE(
+        PktParseUdpFrame(
+            SuperFrame.get(), SuperFrameLength, &ParsedFamily, &UdpHeader, NULL,
+            &ParsedPayloadLength));
+    TEST_EQUAL(LargePayloadLength, ParsedPayloadLength);
+    TEST_EQUAL(0, UdpHeader->uh_ulen);
+
+    SegmentLength = FrameCapacity;
+    TEST_FALSE(
+        PktSplitUdpSuperFrame(
+            SuperFrame.get(), SuperFrameLength, MAXUINT16, 0, Segment.get(), &SegmentLength));
+
+    SegmentLength = FrameCapacity;
+    TEST_TRUE(
+        PktSplitUdpSuperFrame(
+            SuperFrame.get(), SuperFrameLength, MAXUINT16, 1, Segment.get(), &SegmentLength));
+    TEST_TRUE(
+        PktVerifyUdpSegment(
+            AddressFamily, Segment.get(), SegmentLength, Payload.get() + MAXUINT16,
+            LargePayloadLength - MAXUINT16));
+
+    if (AddressFamily == AF_INET) {
+        IPV4_HEADER *IpHeader = (IPV4_HEADER *)(SuperFrame.get() + sizeof(ETHERNET_HEADER));
+
+        //
+        // Malformed IPv4 header lengths are rejected.
+        //
+        IpHeader->HeaderLength = (sizeof(*IpHeader) / 4) - 1;
+        TEST_FALSE(
+            PktParseUdpFrame(
+                SuperFrame.get(), SuperFrameLength, &ParsedFamily, &UdpHeader, NULL, NULL));
+        SegmentLength = FrameCapacity;
+        TEST_FALSE(
+            PktSplitUdpSuperFrame(
+                SuperFrame.get(), SuperFrameLength, SegmentSize, 0, Segment.get(),
+                &SegmentLength));
+    }
+}
+
+EXTERN_C
+VOID
+PktQuicCoalescedPackets()
+{
+    UCHAR DestConnId[] = {0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17};
+    UCHAR SrcConnId[] = {0x20, 0x21, 0x22, 0x23};
+    UCHAR InitialPayload[] = "QuicInitial";
+    UCHAR HandshakePayload[] = "QuicHandshake";
+    UCHAR OneRttPayload[] = "QuicOneRtt";
+    PKT_QUIC_PACKET Packets[3] = {0};
+    PKT_QUIC_PACKET Parsed;
+    UCHAR Datagram[256];
+    UINT32 DatagramLength = sizeof(Datagram);
+    UINT32 Offset = 0;
+
+    Packets[0].TypeAndSpecificBits = 0x00;
+    Packets[0].DestConnId = DestConnId;
+    Packets[0].DestConnIdLength = sizeof(DestConnId);
+    Packets[0].SrcConnId = SrcConnId;
+    Packets[0].SrcConnIdLength = sizeof(SrcConnId);
+    Packets[0].Payload = InitialPayload;
+    Packets[0].PayloadLength = sizeof(InitialPayload);
+
+    Packets[1] = Packets[0];
+    Packets[1].TypeAndSpecificBits = 0x20;
+    Packets[1].Payload = HandshakePayload;
+    Packets[1].PayloadLength = sizeof(HandshakePayload);
+
+    Packets[2].TypeAndSpecificBits = 0x01;
+    Packets[2].UseShortHeader = TRUE;
+    Packets[2].DestConnId = DestConnId;
+    Packets[2].DestConnIdLength = sizeof(DestConnId);
+    Packets[2].Payload = OneRttPayload;
+    Packets[2].PayloadLength = sizeof(OneRttPayload);
+
+    TEST_TRUE(
+        PktBuildQuicCoalescedPackets(
+            Datagram, &DatagramLength, Packets, RTL_NUMBER_OF(Packets)));
+
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Packets); Index++) {
+        TEST_TRUE(
+            PktParseQuicCoalescedPacket(
+                Datagram, DatagramLength, sizeof(DestConnId), &Offset, &Parsed));
+        TEST_EQUAL(Packets[Index].UseShortHeader, Parsed.UseShortHeader);
+        TEST_EQUAL(Packets[Index].TypeAndSpecificBits, Parsed.TypeAndSpecificBits);
+        TEST_EQUAL(Packets[Index].DestConnIdLength, Parsed.DestConnIdLength);
+        TEST_TRUE(RtlEqualMemory(DestConnId, Parsed.DestConnId, sizeof(DestConnId)));
+        TEST_EQUAL(Packets[Index].SrcConnIdLength, Parsed.SrcConnIdLength);
+        if (!Parsed.UseShortHeader) {
+            TEST_TRUE(RtlEqualMemory(SrcConnId, Parsed.SrcConnId, sizeof(SrcConnId)));
+        }
+        TEST_EQUAL(Packets[Index].PayloadLength, Parsed.PayloadLength);
+        TEST_TRUE(
+            RtlEqualMemory(Packets[Index].Payload, Parsed.Payload, Parsed.PayloadLength));
+    }
+
+    TEST_EQUAL(DatagramLength, Offset);
+    TEST_FALSE(
+        PktParseQuicCoalescedPacket(
+            Datagram, DatagramLength, sizeof(DestConnId), &Offset, &Parsed));
+
+    //
+    // A truncated datagram fails to parse its last long header packet.
+    //
+    Offset = 0;
+    TEST_TRUE(
+        PktParseQuicCoalescedPacket(
+            Datagram, DatagramLength, sizeof(DestConnId), &Offset, &Parsed));
+    TEST_FALSE(
+        PktParseQuicCoalescedPacket(
+            Datagram, Offset + 8, sizeof(DestConnId), &Offset, &Parsed));
+
+    //
+    // Only the last packet may use a short header.
+    //
+    Packets[0].UseShortHeader = TRUE;
+    DatagramLength = sizeof(Datagram);
+    TEST_FALSE(
+        PktBuildQuicCoalescedPackets(
+            Datagram, &DatagramLength, Packets, RTL_NUMBER_OF(Packets)));
+
+    //
+    // The buffer must hold every packet.
+    //
+    Packets[0].UseShortHeader = FALSE;
+    DatagramLength = sizeof(InitialPayload);
+    TEST_FALSE(
+        PktBuildQuicCoalescedPackets(
+            Datagram, &DatagramLength, Packets, RTL_NUMBER_OF(Packets)));
+
+    //
+    // A short header payload too long for its 16-bit length, e.g. the tail of a
+    // super-frame, fails to parse instead of being truncated.
+    //
+    CONST UINT32 LargeDatagramLength = 1 + sizeof(DestConnId) + MAXUINT16 + 1;
+    unique_malloc_ptr<UCHAR> LargeDatagram(
+        (UCHAR *)CxPlatAllocNonPaged(LargeDatagramLength, POOL_TAG));
+    TEST_NOT_NULL(LargeDatagram.get());
+    LargeDatagram.get()[0] = 0x40;
+
+    Offset = 0;
+    TEST_FALSE(
+        PktParseQuicCoalescedPacket(
+            LargeDatagram.get(), LargeDatagramLength, sizeof(DestConnId), &Offset, &Parsed));
+    TEST_TRUE(
+        PktParseQuicCoalescedPacket(
+            LargeDatagram.get(), LargeDatagramLength - 1, sizeof(DestConnId), &Offset,
+            &Parsed));
+    TEST_EQUAL(MAXUINT16, Parsed.PayloadLength);
+}
+
+EXTERN_C
+VOID
+IsrCaptureOutput()
+{
+#if defined(_KERNEL_MODE)
+    CONST CHAR Marker[] = "IsrCaptureOutput";
+    CHAR Output[256];
+    UINT32 OutputLength;
+    BOOLEAN OutputTruncated;
+
+    //
+    // The captured output holds the command's stdout.
+    //
+    TEST_EQUAL(
+        0,
+        InvokeSystemRelayWithOutput(
+            "echo IsrCaptureOutput", Output, sizeof(Output), &OutputLength,
+            &OutputTruncated));
+    TEST_FALSE(OutputTruncated);
+    TEST_TRUE(OutputLength >= sizeof(Marker) - 1);
+    TEST_TRUE(RtlEqualMemory(Output, Marker, sizeof(Marker) - 1));
+
+    //
+    // Output beyond the caller's buffer is truncated and flagged as such.
+    //
+    CONST UINT32 ShortOutputSize = 4;
+    TEST_EQUAL(
+        0,
+        InvokeSystemRelayWithOutput(
+            "echo IsrCaptureOutput", Output, ShortOutputSize, &OutputLength,
+            &OutputTruncated));
+    TEST_TRUE(OutputTruncated);
+    TEST_EQUAL(ShortOutputSize, OutputLength);
+    TEST_TRUE(RtlEqualMemory(Output, Marker, ShortOutputSize));
+
+    //
+    // The exit code is preserved alongside captured output.
+    //
+    TEST_EQUAL(
+        3,
+        InvokeSystemRelayWithOutput(
+            "cmd /c exit 3", Output, sizeof(Output), &OutputLength, &OutputTruncated));
+    TEST_FALSE(OutputTruncated);
+#endif
+}
+
+#if defined(_KERNEL_MODE)
+typedef struct _ISR_ASYNC_TEST_CONTEXT {
+    KEVENT Event;
+    INT Result;
+} ISR_ASYNC_TEST_CONTEXT;
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+IsrAsyncTestComplete(
+    _In_opt_ VOID *Context,
+    _In_ INT Result
+    )
+{
+    ISR_ASYNC_TEST_CONTEXT *AsyncContext = (ISR_ASYNC_TEST_CONTEXT *)Context;
+
+    AsyncContext->Result = Result;
+    KeSetEvent(&AsyncContext->Event, IO_NO_INCREMENT, FALSE);
+}
+#endif
+
+EXTERN_C
+VOID
+IsrClientBatchAndAsync()
+{
+#if defined(_KERNEL_MODE)
+    ISR_CLIENT Client;
+    TEST_NTSTATUS(IsrClientOpen(&Client));
+    auto ClientCleanup = wil::scope_exit([&]() {
+        IsrClientClose(&Client);
+    });
+
+    //
+    // An ordered batch runs each command after the previous one completes, so
+    // later commands observe earlier commands' side effects.
+    //
+    const CHAR *OrderedCommands[] = {
+        "echo IsrClientBatchAndAsync> %TEMP%\\IsrClientBatchAndAsync.txt",
+        "type %TEMP%\\IsrClientBatchAndAsync.txt",
+        "del %TEMP%\\IsrClientBatchAndAsync.txt",
+        "type %TEMP%\\IsrClientBatchAndAsync.txt",
+    };
+    INT OrderedResults[RTL_NUMBER_OF(OrderedCommands)];
+    TEST_NTSTATUS(
+        IsrClientInvokeBatch(
+            &Client, OrderedCommands, RTL_NUMBER_OF(OrderedCommands), TRUE, OrderedResults));
+    TEST_EQUAL(0, OrderedResults[0]);
+    TEST_EQUAL(0, OrderedResults[1]);
+    TEST_EQUAL(0, OrderedResults[2]);
+    TEST_NOT_EQUAL(0, OrderedResults[3]);
+
+    //
+    // A parallel batch returns each command's exit code at its own index.
+    //
+    const CHAR *ParallelCommands[] = {
+        "cmd /c exit 0",
+        "cmd /c exit 1",
+        "cmd /c exit 2",
+        "cmd /c exit 3",
+    };
+    INT ParallelResults[RTL_NUMBER_OF(ParallelCommands)];
+    TEST_NTSTATUS(
+        IsrClientInvokeBatch(
+            &Client, ParallelCommands, RTL_NUMBER_OF(ParallelCommands), FALSE,
+            ParallelResults));
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(ParallelResults); Index++) {
+        TEST_EQUAL((INT)Index, ParallelResults[Index]);
+    }
+
+    //
+    // Each asynchronous command invokes its completion exactly once with its
+    // own exit code. Wait for every submitted command before checking
+    // anything, since the completions write to this stack frame.
+    //
+    ISR_ASYNC_TEST_CONTEXT AsyncContexts[RTL_NUMBER_OF(ParallelCommands)];
+    NTSTATUS AsyncStatus = STATUS_SUCCESS;
+    UINT32 SubmittedCount = 0;
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(AsyncContexts); Index++) {
+        KeInitializeEvent(&AsyncContexts[Index].Event, NotificationEvent, FALSE);
+        AsyncContexts[Index].Result = -1;
+    }
+    for (; SubmittedCount < RTL_NUMBER_OF(AsyncContexts); SubmittedCount++) {
+        AsyncStatus =
+            IsrClientInvokeAsync(
+                &Client, ParallelCommands[SubmittedCount], IsrAsyncTestComplete,
+                &AsyncContexts[SubmittedCount]);
+        if (!NT_SUCCESS(AsyncStatus)) {
+            break;
+        }
+    }
+    for (UINT32 Index = 0; Index < SubmittedCount; Index++) {
+        KeWaitForSingleObject(&AsyncContexts[Index].Event, Executive, KernelMode, FALSE, NULL);
+    }
+    TEST_NTSTATUS(AsyncStatus);
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(AsyncContexts); Index++) {
+        TEST_EQUAL((INT)Index, AsyncContexts[Index].Result);
+    }
+#endif
+}
+
+#if defined(_KERNEL_MODE)
+#define ISR_TEST_SERVICE_TIMEOUT_MS (30 * 1000)
+
+#define ISR_TEST_PARAMETERS_KEY "HKLM\\SYSTEM\\CurrentControlSet\\Services\\isrsvc\\Parameters"
+
+//
+// Terminates the service that runs it, and restarts it a little later from a
+// detached command.
+//
+#define ISR_TEST_RESTART_COMMAND \
+    "start \"\" /b cmd /c \"ping -n 3 127.0.0.1 >NUL & sc start isrsvc >NUL\" & " \
+        "taskkill /f /im isrsvc.exe >NUL"
+
+//
+// Waits for the service to run commands again after a restart, and returns
+// the result of the last attempt.
+//
+static
+INT
+IsrTestWaitForService(
+    _In_ ISR_CLIENT *Client
+    )
+{
+    Stopwatch Watchdog(ISR_TEST_SERVICE_TIMEOUT_MS);
+    INT Result;
+
+    while ((Result = IsrClientInvoke(Client, "cmd /c exit 0")) != 0 &&
+            !Watchdog.IsExpired()) {
+        CxPlatSleep(10 * POLL_INTERVAL_MS);
+    }
+
+    return Result;
+}
+#endif
+
+EXTERN_C
+VOID
+IsrServiceStop()
+{
+#if defined(_KERNEL_MODE)
+    LARGE_INTEGER Timeout;
+    BOOLEAN TimedOut = FALSE;
+
+    ISR_CLIENT Client;
+    TEST_NTSTATUS(IsrClientOpen(&Client));
+    auto ClientCleanup = wil::scope_exit([&]() {
+        IsrClientClose(&Client);
+    });
+
+    //
+    // Terminate the service while one command is still running, from a second
+    // command that is itself outstanding. Neither result is ever posted, so
+    // both requests must fail once the service's handle is closed. A detached
+    // command restarts the service a little later.
+    //
+    const CHAR *Commands[] = {
+        "ping -n 30 127.0.0.1 >NUL",
+        ISR_TEST_RESTART_COMMAND,
+    };
+    unique_malloc_ptr<ISR_ASYNC_TEST_CONTEXT> AsyncContexts(
+        (ISR_ASYNC_TEST_CONTEXT *)CxPlatAllocNonPaged(
+            sizeof(ISR_ASYNC_TEST_CONTEXT) * RTL_NUMBER_OF(Commands), POOL_TAG));
+    TEST_NOT_NULL(AsyncContexts.get());
+
+    NTSTATUS AsyncStatus = STATUS_SUCCESS;
+    UINT32 SubmittedCount = 0;
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Commands); Index++) {
+        KeInitializeEvent(&AsyncContexts.get()[Index].Event, NotificationEvent, FALSE);
+        AsyncContexts.get()[Index].Result = 0;
+    }
+    for (; SubmittedCount < RTL_NUMBER_OF(Commands); SubmittedCount++) {
+        AsyncStatus =
+            IsrClientInvokeAsync(
+                &Client, Commands[SubmittedCount], IsrAsyncTestComplete,
+                &AsyncContexts.get()[SubmittedCount]);
+        if (!NT_SUCCESS(AsyncStatus)) {
+            break;
+        }
+    }
+
+    Timeout.QuadPart = -10000LL * ISR_TEST_SERVICE_TIMEOUT_MS;
+    for (UINT32 Index = 0; Index < SubmittedCount; Index++) {
+        if (KeWaitForSingleObject(
+                &AsyncContexts.get()[Index].Event, Executive, KernelMode, FALSE,
+                &Timeout) == STATUS_TIMEOUT) {
+            TimedOut = TRUE;
+        }
+    }
+    if (TimedOut) {
+        //
+        // The requests may still complete later, so leak their contexts.
+        //
+        AsyncContexts.release();
+    }
+    TEST_FALSE(TimedOut);
+    TEST_NTSTATUS(AsyncStatus);
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Commands); Index++) {
+        TEST_EQUAL(-1, AsyncContexts.get()[Index].Result);
+    }
+
+    //
+    // Commands run again once the service has restarted.
+    //
+    TEST_EQUAL(0, IsrTestWaitForService(&Client));
+#endif
+}
+
+EXTERN_C
+VOID
+IsrPersistentShell()
+{
+#if defined(_KERNEL_MODE)
+    ISR_CLIENT Client;
+    TEST_NTSTATUS(IsrClientOpen(&Client));
+    auto ClientCleanup = wil::scope_exit([&]() {
+        IsrClientClose(&Client);
+    });
+
+    //
+    // Restart the service with a single persistent shell, so that every
+    // command below runs on the same interpreter. The restarting command never
+    // completes, since it terminates the service that runs it.
+    //
+    TEST_EQUAL(
+        -1,
+        IsrClientInvoke(
+            &Client,
+            "reg add " ISR_TEST_PARAMETERS_KEY " /v PersistentShell /t REG_DWORD /d 1 /f >NUL & "
+            "reg add " ISR_TEST_PARAMETERS_KEY " /v WorkerCount /t REG_DWORD /d 1 /f >NUL & "
+            ISR_TEST_RESTART_COMMAND));
+    auto ServiceCleanup = wil::scope_exit([&]() {
+        IsrClientInvoke(
+            &Client,
+            "reg delete " ISR_TEST_PARAMETERS_KEY " /v PersistentShell /f >NUL & "
+            "reg delete " ISR_TEST_PARAMETERS_KEY " /v WorkerCount /f >NUL & "
+            ISR_TEST_RESTART_COMMAND);
+        IsrTestWaitForService(&Client);
+    });
+    TEST_EQUAL(0, IsrTestWaitForService(&Client));
+
+    //
+    // Exit codes are preserved, and built-in commands that do not set the
+    // error level succeed regardless of the previous command.
+    //
+    TEST_EQUAL(3, IsrClientInvoke(&Client, "cmd /c exit 3"));
+    TEST_EQUAL(0, IsrClientInvoke(&Client, "rem"));
+    TEST_EQUAL(5, IsrClientInvoke(&Client, "exit /b 5"));
+    TEST_EQUAL(0, IsrClientInvoke(&Client, "ver >NUL"));
+
+    //
+    // Changes to the environment and working directory do not carry over.
+    //
+    TEST_EQUAL(0, IsrClientInvoke(&Client, "set ISR_PERSISTENT_SHELL_TEST=1"));
+    TEST_EQUAL(0, IsrClientInvoke(&Client, "if defined ISR_PERSISTENT_SHELL_TEST exit /b 1"));
+    TEST_EQUAL(
+        0, IsrClientInvoke(&Client, "cd /d %SystemRoot%\\System32\\drivers"));
+    TEST_EQUAL(
+        0,
+        IsrClientInvoke(
+            &Client, "if /i \"%CD%\"==\"%SystemRoot%\\System32\\drivers\" exit /b 1"));
+
+    //
+    // A command that exits the interpreter returns its exit code, and the
+    // interpreter is restarted for the next command.
+    //
+    TEST_EQUAL(7, IsrClientInvoke(&Client, "exit 7"));
+    TEST_EQUAL(0, IsrClientInvoke(&Client, "cmd /c exit 0"));
+#endif
+}
+
+#if defined(_KERNEL_MODE)
+//
+// A timer may fire up to a wheel tick early, and the interrupt time read by
+// the wheel only advances once per clock interrupt.
+//
+#define TIMER_WHEEL_EARLY_SLACK_MS (2 * FN_TIMER_WHEEL_TICK_MS + 16)
+
+typedef struct _TIMER_WHEEL_TEST_TIMER {
+    FN_TIMER_HANDLE Handle;
+    UINT32 IntervalMs;
+    UINT64 ArmTime;
+    UINT64 FirstFireTime;
+    LONG FireCount;
+} TIMER_WHEEL_TEST_TIMER;
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+TimerWheelTestCallback(
+    _In_ VOID *CallbackContext
+    )
+{
+    TIMER_WHEEL_TEST_TIMER *Timer = (TIMER_WHEEL_TEST_TIMER *)CallbackContext;
+
+    //
+    // Callbacks are serialized on the wheel thread, so only the fire count
+    // needs to be published atomically.
+    //
+    if (Timer->FireCount == 0) {
+        Timer->FirstFireTime = CxPlatTimePlat();
+    }
+    InterlockedIncrement(&Timer->FireCount);
+}
+
+static
+VOID
+TimerWheelTestClose(
+    _Inout_ TIMER_WHEEL_TEST_TIMER *Timer
+    )
+{
+    if (Timer->Handle != NULL) {
+        FnTimerClose(Timer->Handle);
+        Timer->Handle = NULL;
+    }
+}
+#endif
+
+EXTERN_C
+VOID
+FnTimerWheel()
+{
+#if defined(_KERNEL_MODE)
+    //
+    // Intervals span more than one revolution of the root level, so later
+    // timers cascade down from the next level before expiring, and cancelled
+    // timers sit far enough out to never fire.
+    //
+    CONST UINT32 TimerCount = 4096;
+    CONST UINT32 MaxIntervalTicks = FN_TIMER_WHEEL_ROOT_SLOTS + FN_TIMER_WHEEL_ROOT_SLOTS / 4;
+    CONST UINT32 MaxIntervalMs = MaxIntervalTicks * FN_TIMER_WHEEL_TICK_MS;
+    CONST UINT32 CancelledIntervalMs = 60 * 1000;
+
+    FN_TIMER_WHEEL_HANDLE Wheel;
+    TEST_NTSTATUS(FnTimerWheelCreate(&Wheel));
+    auto WheelCleanup = wil::scope_exit([&]() {
+        FnTimerWheelClose(Wheel);
+    });
+
+    unique_malloc_ptr<TIMER_WHEEL_TEST_TIMER> Timers(
+        (TIMER_WHEEL_TEST_TIMER *)
+            CxPlatAllocNonPaged(TimerCount * sizeof(TIMER_WHEEL_TEST_TIMER), POOL_TAG));
+    TEST_NOT_NULL(Timers.get());
+    auto TimersCleanup = wil::scope_exit([&]() {
+        for (UINT32 Index = 0; Index < TimerCount; Index++) {
+            TimerWheelTestClose(&Timers.get()[Index]);
+        }
+    });
+
+    for (UINT32 Index = 0; Index < TimerCount; Index++) {
+        TIMER_WHEEL_TEST_TIMER *Timer = &Timers.get()[Index];
+
+        if (Index % 2 == 0) {
+            Timer->IntervalMs = FN_TIMER_WHEEL_TICK_MS * (1 + (Index / 2) % MaxIntervalTicks);
+        } else {
+            Timer->IntervalMs = CancelledIntervalMs;
+        }
+
+        Timer->ArmTime = CxPlatTimePlat();
+        TEST_NTSTATUS(
+            FnTimerCreate(
+                Wheel, &Timer->Handle, TimerWheelTestCallback, Timer, Timer->IntervalMs));
+    }
+
+    //
+    // Cancel every other timer before it fires.
+    //
+    for (UINT32 Index = 1; Index < TimerCount; Index += 2) {
+        TimerWheelTestClose(&Timers.get()[Index]);
+    }
+
+    //
+    // Every armed timer fires, and none fires meaningfully early.
+    //
+    Stopwatch Watchdog(MaxIntervalMs + TEST_TIMEOUT_ASYNC_MS);
+    for (UINT32 Index = 0; Index < TimerCount; Index += 2) {
+        TIMER_WHEEL_TEST_TIMER *Timer = &Timers.get()[Index];
+
+        while (ReadNoFence(&Timer->FireCount) == 0 && !Watchdog.IsExpired()) {
+            CxPlatSleep(POLL_INTERVAL_MS);
+        }
+
+        TEST_NOT_EQUAL(0, ReadNoFence(&Timer->FireCount));
+        TEST_TRUE(
+            US_TO_MS(CxPlatTimePlatToUs64(Timer->FirstFireTime - Timer->ArmTime)) +
+                TIMER_WHEEL_EARLY_SLACK_MS >= Timer->IntervalMs);
+    }
+
+    for (UINT32 Index = 1; Index < TimerCount; Index += 2) {
+        TEST_EQUAL(0, ReadNoFence(&Timers.get()[Index].FireCount));
+    }
+
+    //
+    // A timer armed while the wheel thread sleeps for a distant timer is armed
+    // relative to the current time, not to when the wheel last ticked.
+    //
+    for (UINT32 Index = 0; Index < TimerCount; Index += 2) {
+        TimerWheelTestClose(&Timers.get()[Index]);
+    }
+
+    TIMER_WHEEL_TEST_TIMER *DistantTimer = &Timers.get()[1];
+    TEST_NTSTATUS(
+        FnTimerCreate(
+            Wheel, &DistantTimer->Handle, TimerWheelTestCallback, DistantTimer,
+            DistantTimer->IntervalMs));
+    CxPlatSleep(MaxIntervalMs / 4);
+
+    TIMER_WHEEL_TEST_TIMER *LateTimer = &Timers.get()[0];
+    LateTimer->IntervalMs = MaxIntervalMs / 8;
+    LateTimer->FireCount = 0;
+    LateTimer->ArmTime = CxPlatTimePlat();
+    TEST_NTSTATUS(
+        FnTimerCreate(
+            Wheel, &LateTimer->Handle, TimerWheelTestCallback, LateTimer,
+            LateTimer->IntervalMs));
+
+    Stopwatch LateWatchdog(LateTimer->IntervalMs + TEST_TIMEOUT_ASYNC_MS);
+    while (ReadNoFence(&LateTimer->FireCount) == 0 && !LateWatchdog.IsExpired()) {
+        CxPlatSleep(POLL_INTERVAL_MS);
+    }
+
+    TEST_NOT_EQUAL(0, ReadNoFence(&LateTimer->FireCount));
+    TEST_TRUE(
+        US_TO_MS(CxPlatTimePlatToUs64(LateTimer->FirstFireTime - LateTimer->ArmTime)) +
+            TIMER_WHEEL_EARLY_SLACK_MS >= LateTimer->IntervalMs);
+    TEST_EQUAL(0, ReadNoFence(&DistantTimer->FireCount));
+#endif
+}
+
+#if defined(_KERNEL_MODE)
+static
+unique_wsk_socket
+WskCreateUdpSocket()
+{
+    unique_wsk_socket Socket;
+    PWSK_SOCKET Sock;
+
+    TEST_NTSTATUS_RET(
+        WskSocketSync(
+            WSK_FLAG_DATAGRAM_SOCKET, AF_INET, SOCK_DGRAM, IPPROTO_UDP, &Sock, NULL, NULL),
+        unique_wsk_socket());
+    Socket.reset(Sock);
+
+    SOCKADDR_IN Address = {0};
+    Address.sin_family = AF_INET;
+    TEST_NTSTATUS_RET(
+        WskBindSync(Sock, WSK_FLAG_DATAGRAM_SOCKET, (PSOCKADDR)&Address), unique_wsk_socket());
+
+    return Socket;
+}
+
+static
+unique_wsk_socket
+WskConnectTcpSocket(
+    _In_ const SOCKADDR_IN *RemoteAddress
+    )
+{
+    PWSK_SOCKET Sock;
+    SOCKADDR_IN LocalAddress = {0};
+
+    LocalAddress.sin_family = AF_INET;
+    TEST_NTSTATUS_RET(
+        WskSocketConnectSync(
+            SOCK_STREAM, IPPROTO_TCP, (PSOCKADDR)&LocalAddress, (PSOCKADDR)RemoteAddress,
+            &Sock, NULL, NULL),
+        unique_wsk_socket());
+
+    return unique_wsk_socket(Sock);
+}
+
+typedef struct _WSK_CALLBACK_TEST_CONTEXT {
+    KEVENT Event;
+    LONG CallbackCount;
+    NTSTATUS Status;
+    ULONG_PTR Information;
+} WSK_CALLBACK_TEST_CONTEXT;
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+WskCallbackTestComplete(
+    _In_opt_ PVOID Context,
+    _In_ NTSTATUS Status,
+    _In_ ULONG_PTR Information
+    )
+{
+    WSK_CALLBACK_TEST_CONTEXT *CallbackContext = (WSK_CALLBACK_TEST_CONTEXT *)Context;
+
+    CallbackContext->Status = Status;
+    CallbackContext->Information = Information;
+    InterlockedIncrement(&CallbackContext->CallbackCount);
+    KeSetEvent(&CallbackContext->Event, IO_NO_INCREMENT, FALSE);
+}
+
+static
+VOID
+WskCallbackTestWait(
+    _Inout_ WSK_CALLBACK_TEST_CONTEXT *CallbackContext,
+    _In_ ULONG TimeoutMs,
+    _Inout_ unique_wsk_socket *Socket
+    )
+{
+    LARGE_INTEGER Timeout;
+
+    Timeout.QuadPart = -10000LL * TimeoutMs;
+    if (KeWaitForSingleObject(
+            &CallbackContext->Event, Executive, KernelMode, FALSE, &Timeout) == STATUS_TIMEOUT) {
+        //
+        // Closing the socket completes the request, so its callback no longer
+        // refers to the context once the caller fails.
+        //
+        Socket->reset();
+        KeWaitForSingleObject(&CallbackContext->Event, Executive, KernelMode, FALSE, NULL);
+    }
+}
+#endif
+
+EXTERN_C
+VOID
+WskRegisteredSendCache()
+{
+#if defined(_KERNEL_MODE)
+    //
+    // Each round keeps more sends in flight than a processor's completion
+    // cache holds, so completions overflow the cache when they are freed, and
+    // the second round reuses cached completions along with their IRPs.
+    //
+    CONST UINT32 SendCount = 2 * 64 + 1;
+    CONST UINT32 RoundCount = 2;
+    CONST UINT32 SliceLength = 32;
+    CHAR RecvPayload[SliceLength];
+
+    TEST_NTSTATUS(WskClientReg());
+    auto WskClientCleanup = wil::scope_exit([&]() {
+        WskClientDereg();
+    });
+
+    UINT16 LocalPort;
+    auto ReceiveSocket = CreateUdpSocket(AF_INET, NULL, &LocalPort);
+    TEST_NOT_NULL(ReceiveSocket.get());
+
+    SOCKADDR_IN Address = {0};
+    Address.sin_family = AF_INET;
+    Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    Address.sin_port = LocalPort;
+
+    auto SendSocket = WskCreateUdpSocket();
+    TEST_NOT_NULL(SendSocket.get());
+
+    unique_malloc_ptr<CHAR> Buffer(
+        (CHAR *)CxPlatAllocNonPaged(SendCount * SliceLength, POOL_TAG));
+    TEST_NOT_NULL(Buffer.get());
+    unique_malloc_ptr<PVOID> Completions(
+        (PVOID *)CxPlatAllocNonPaged(sizeof(PVOID) * SendCount, POOL_TAG));
+    TEST_NOT_NULL(Completions.get());
+    unique_malloc_ptr<ULONG> BytesSent(
+        (ULONG *)CxPlatAllocNonPaged(sizeof(ULONG) * SendCount, POOL_TAG));
+    TEST_NOT_NULL(BytesSent.get());
+    unique_malloc_ptr<BOOLEAN> Received(
+        (BOOLEAN *)CxPlatAllocNonPaged(sizeof(BOOLEAN) * SendCount, POOL_TAG));
+    TEST_NOT_NULL(Received.get());
+
+    //
+    // Every datagram is a slice of one registered buffer, filled with the
+    // slice's index.
+    //
+    for (UINT32 Index = 0; Index < SendCount; Index++) {
+        RtlFillMemory(Buffer.get() + Index * SliceLength, SliceLength, (UCHAR)Index);
+    }
+
+    PVOID RegisteredBuffer;
+    TEST_NTSTATUS(
+        WskRegisterBuffer(Buffer.get(), SendCount * SliceLength, TRUE, &RegisteredBuffer));
+    auto RegisteredBufferCleanup = wil::scope_exit([&]() {
+        WskDeregisterBuffer(RegisteredBuffer);
+    });
+
+    for (UINT32 Round = 0; Round < RoundCount; Round++) {
+        NTSTATUS SendStatus = STATUS_SUCCESS;
+        UINT32 SubmittedCount = 0;
+
+        for (; SubmittedCount < SendCount; SubmittedCount++) {
+            SendStatus =
+                WskSendToRegisteredAsync(
+                    SendSocket.get(), RegisteredBuffer, SubmittedCount * SliceLength,
+                    SliceLength, (PSOCKADDR)&Address, 0, NULL,
+                    &Completions.get()[SubmittedCount]);
+            if (!NT_SUCCESS(SendStatus)) {
+                break;
+            }
+        }
+
+        //
+        // Await every submitted send before checking anything, so none of
+        // them outlives the registered buffer.
+        //
+        for (UINT32 Index = 0; Index < SubmittedCount; Index++) {
+            NTSTATUS Status =
+                WskSendToAwait(
+                    Completions.get()[Index], TEST_TIMEOUT_ASYNC_MS, WSKCLIENT_UNKNOWN_BYTES,
+                    &BytesSent.get()[Index]);
+            if (NT_SUCCESS(SendStatus)) {
+                SendStatus = Status;
+            }
+        }
+        TEST_NTSTATUS(SendStatus);
+
+        for (UINT32 Index = 0; Index < SendCount; Index++) {
+            TEST_EQUAL(SliceLength, BytesSent.get()[Index]);
+        }
+
+        //
+        // Each slice arrives exactly once with its own contents.
+        //
+        RtlZeroMemory(Received.get(), sizeof(BOOLEAN) * SendCount);
+        for (UINT32 Index = 0; Index < SendCount; Index++) {
+            TEST_EQUAL(
+                (INT)SliceLength,
+                FnSockRecv(ReceiveSocket.get(), RecvPayload, sizeof(RecvPayload), FALSE, 0));
+
+            UINT32 Slice = (UCHAR)RecvPayload[0];
+            TEST_TRUE(Slice < SendCount);
+            TEST_FALSE(Received.get()[Slice]);
+            Received.get()[Slice] = TRUE;
+            TEST_TRUE(
+                RtlEqualMemory(RecvPayload, Buffer.get() + Slice * SliceLength, SliceLength));
+        }
+    }
+#endif
+}
+
+EXTERN_C
+VOID
+WskSendMessagesBatch()
+{
+#if defined(_KERNEL_MODE)
+    //
+    // The first two batches fit the message buffers cached with a completion,
+    // so the second one normally reuses them. The last batch has more messages
+    // than are cached, and its last datagram spans more pages than a cached
+    // message MDL, so both fall back to allocating.
+    //
+    CONST UINT32 MaxMessageCount = 33;
+    CONST UINT32 SmallMessageStride = 64;
+    CONST UINT32 LargeMessageLength = 3 * PAGE_SIZE;
+    CONST UINT32 BatchCounts[] = { 4, 4, MaxMessageCount };
+    WSKCLIENT_MESSAGE Messages[MaxMessageCount];
+    ULONG BytesSent[MaxMessageCount];
+    BOOLEAN Received[MaxMessageCount];
+
+    TEST_NTSTATUS(WskClientReg());
+    auto WskClientCleanup = wil::scope_exit([&]() {
+        WskClientDereg();
+    });
+
+    UINT16 LocalPort;
+    auto ReceiveSocket = CreateUdpSocket(AF_INET, NULL, &LocalPort);
+    TEST_NOT_NULL(ReceiveSocket.get());
+
+    SOCKADDR_IN Address = {0};
+    Address.sin_family = AF_INET;
+    Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    Address.sin_port = LocalPort;
+
+    auto SendSocket = WskCreateUdpSocket();
+    TEST_NOT_NULL(SendSocket.get());
+
+    unique_malloc_ptr<CHAR> SmallPayloads(
+        (CHAR *)CxPlatAllocNonPaged(MaxMessageCount * SmallMessageStride, POOL_TAG));
+    TEST_NOT_NULL(SmallPayloads.get());
+    unique_malloc_ptr<CHAR> LargePayload(
+        (CHAR *)CxPlatAllocNonPaged(LargeMessageLength, POOL_TAG));
+    TEST_NOT_NULL(LargePayload.get());
+    unique_malloc_ptr<CHAR> RecvPayload(
+        (CHAR *)CxPlatAllocNonPaged(LargeMessageLength, POOL_TAG));
+    TEST_NOT_NULL(RecvPayload.get());
+
+    //
+    // Every message has its own length and is filled with its index.
+    //
+    for (UINT32 Index = 0; Index < MaxMessageCount; Index++) {
+        if (Index == MaxMessageCount - 1) {
+            Messages[Index].Buf = LargePayload.get();
+            Messages[Index].BufLen = LargeMessageLength;
+        } else {
+            Messages[Index].Buf = SmallPayloads.get() + Index * SmallMessageStride;
+            Messages[Index].BufLen = SmallMessageStride - Index;
+        }
+        RtlFillMemory(Messages[Index].Buf, Messages[Index].BufLen, (UCHAR)Index);
+    }
+
+    for (UINT32 Batch = 0; Batch < RTL_NUMBER_OF(BatchCounts); Batch++) {
+        CONST UINT32 MessageCount = BatchCounts[Batch];
+        PVOID SendCompletion;
+
+        TEST_NTSTATUS(
+            WskSendMessagesAsync(
+                SendSocket.get(), Messages, MessageCount, TRUE, (PSOCKADDR)&Address, 0, NULL,
+                &SendCompletion));
+        TEST_NTSTATUS(
+            WskSendMessagesAwait(
+                SendCompletion, TEST_TIMEOUT_ASYNC_MS, MessageCount, BytesSent));
+
+        for (UINT32 Index = 0; Index < MessageCount; Index++) {
+            TEST_EQUAL(Messages[Index].BufLen, BytesSent[Index]);
+        }
+
+        //
+        // Each message arrives exactly once as its own datagram.
+        //
+        RtlZeroMemory(Received, sizeof(Received));
+        for (UINT32 Index = 0; Index < MessageCount; Index++) {
+            INT Bytes =
+                FnSockRecv(
+                    ReceiveSocket.get(), RecvPayload.get(), LargeMessageLength, FALSE, 0);
+            TEST_TRUE(Bytes > 0);
+
+            UINT32 Message = (UCHAR)RecvPayload.get()[0];
+            TEST_TRUE(Message < MessageCount);
+            TEST_FALSE(Received[Message]);
+            Received[Message] = TRUE;
+            TEST_EQUAL(Messages[Message].BufLen, (ULONG)Bytes);
+            TEST_TRUE(RtlEqualMemory(RecvPayload.get(), Messages[Message].Buf, Bytes));
+        }
+    }
+#endif
+}
+
+EXTERN_C
+VOID
+WskReceivePipeline()
+{
+#if defined(_KERNEL_MODE)
+    CONST UINT32 BufCount = 4;
+    CONST UINT32 BufLen = 16;
+    CONST UINT32 SendCount = 8;
+    CONST UINT32 SendLength = 48;
+    CHAR Payload[SendCount * SendLength];
+    CHAR Received[sizeof(Payload)];
+    CHAR *Buf;
+    ULONG Bytes;
+
+    TEST_NTSTATUS(WskClientReg());
+    auto WskClientCleanup = wil::scope_exit([&]() {
+        WskClientDereg();
+    });
+
+    unique_fnsock_handle ListenSocket;
+    TEST_CXPLAT(FnSockCreate(AF_INET, SOCK_STREAM, IPPROTO_TCP, &ListenSocket));
+    TEST_NOT_NULL(ListenSocket.get());
+
+    SOCKADDR_IN Address = {0};
+    Address.sin_family = AF_INET;
+    Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_CXPLAT(FnSockBind(ListenSocket.get(), (SOCKADDR *)&Address, sizeof(Address)));
+
+    INT AddressLength = sizeof(Address);
+    TEST_CXPLAT(FnSockGetSockName(ListenSocket.get(), (SOCKADDR *)&Address, &AddressLength));
+    TEST_CXPLAT(FnSockListen(ListenSocket.get(), 32));
+
+    INT TimeoutMs = TEST_TIMEOUT_ASYNC_MS;
+    TEST_CXPLAT(
+        FnSockSetSockOpt(
+            ListenSocket.get(), SOL_SOCKET, SO_RCVTIMEO, (CHAR *)&TimeoutMs, sizeof(TimeoutMs)));
+
+    unique_malloc_ptr<CHAR> Bufs((CHAR *)CxPlatAllocNonPaged(BufCount * BufLen, POOL_TAG));
+    TEST_NOT_NULL(Bufs.get());
+    unique_malloc_ptr<CHAR> IdleBufs((CHAR *)CxPlatAllocNonPaged(BufCount * BufLen, POOL_TAG));
+    TEST_NOT_NULL(IdleBufs.get());
+
+    auto Socket = WskConnectTcpSocket(&Address);
+    TEST_NOT_NULL(Socket.get());
+
+    SOCKADDR_INET PeerAddress;
+    INT PeerAddressLength = sizeof(PeerAddress);
+    unique_fnsock_handle AcceptSocket(
+        FnSockAccept(ListenSocket.get(), (SOCKADDR *)&PeerAddress, &PeerAddressLength));
+    TEST_NOT_NULL(AcceptSocket.get());
+
+    PVOID Pipeline;
+    TEST_NTSTATUS(
+        WskReceivePipelineCreate(
+            Socket.get(), WSK_FLAG_CONNECTION_SOCKET, Bufs.get(), BufLen, BufCount, TRUE, NULL,
+            NULL, &Pipeline));
+    auto PipelineCleanup = wil::scope_exit([&]() {
+        WskReceivePipelineDestroy(Pipeline);
+    });
+
+    //
+    // Sends are larger than the pipeline's buffers, so the stream is spread
+    // across the whole ring, and must still be returned in order.
+    //
+    for (UINT32 Index = 0; Index < sizeof(Payload); Index++) {
+        Payload[Index] = (CHAR)(Index * 7);
+    }
+    for (UINT32 Index = 0; Index < SendCount; Index++) {
+        TEST_EQUAL(
+            (INT)SendLength,
+            FnSockSend(AcceptSocket.get(), Payload + Index * SendLength, SendLength, FALSE, 0));
+    }
+
+    UINT32 ReceivedLength = 0;
+    while (ReceivedLength < sizeof(Payload)) {
+        TEST_EQUAL(
+            STATUS_SUCCESS,
+            WskReceivePipelineGet(Pipeline, TEST_TIMEOUT_ASYNC_MS, &Buf, &Bytes));
+        TEST_TRUE(Bytes > 0 && Bytes <= BufLen);
+        TEST_TRUE(Bytes <= sizeof(Payload) - ReceivedLength);
+        RtlCopyMemory(Received + ReceivedLength, Buf, Bytes);
+        ReceivedLength += Bytes;
+    }
+    TEST_TRUE(RtlEqualMemory(Payload, Received, sizeof(Payload)));
+
+    //
+    // Closing the peer ends the stream, gracefully or not. Every later call
+    // returns the status that ended it instead of waiting for a receive that
+    // is never re-armed.
+    //
+    AcceptSocket.reset();
+
+    NTSTATUS EndStatus = WskReceivePipelineGet(Pipeline, TEST_TIMEOUT_ASYNC_MS, &Buf, &Bytes);
+    TEST_NOT_EQUAL(STATUS_TIMEOUT, EndStatus);
+    TEST_TRUE(!NT_SUCCESS(EndStatus) || Bytes == 0);
+
+    for (UINT32 Index = 0; Index < 2; Index++) {
+        TEST_EQUAL(
+            EndStatus, WskReceivePipelineGet(Pipeline, TEST_TIMEOUT_ASYNC_MS, &Buf, &Bytes));
+        TEST_TRUE(Buf == NULL);
+        TEST_EQUAL(0u, Bytes);
+    }
+
+    //
+    // Destroying a pipeline cancels its outstanding receives.
+    //
+    auto IdleSocket = WskConnectTcpSocket(&Address);
+    TEST_NOT_NULL(IdleSocket.get());
+
+    PeerAddressLength = sizeof(PeerAddress);
+    unique_fnsock_handle IdleAcceptSocket(
+        FnSockAccept(ListenSocket.get(), (SOCKADDR *)&PeerAddress, &PeerAddressLength));
+    TEST_NOT_NULL(IdleAcceptSocket.get());
+
+    PVOID IdlePipeline;
+    TEST_NTSTATUS(
+        WskReceivePipelineCreate(
+            IdleSocket.get(), WSK_FLAG_CONNECTION_SOCKET, IdleBufs.get(), BufLen, BufCount,
+            TRUE, NULL, NULL, &IdlePipeline));
+    NTSTATUS IdleStatus = WskReceivePipelineGet(IdlePipeline, POLL_INTERVAL_MS, &Buf, &Bytes);
+    WskReceivePipelineDestroy(IdlePipeline);
+    TEST_EQUAL(STATUS_TIMEOUT, IdleStatus);
+#endif
+}
+
+EXTERN_C
+VOID
+WskCompletionCallbackTimeout()
+{
+#if defined(_KERNEL_MODE)
+    CONST ULONG CallbackTimeoutMs = 100;
+    CONST CHAR Data[] = "WskCompletionCallbackTimeout";
+    WSK_CALLBACK_TEST_CONTEXT Contexts[2];
+    PVOID Completion;
+
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Contexts); Index++) {
+        KeInitializeEvent(&Contexts[Index].Event, NotificationEvent, FALSE);
+        Contexts[Index].CallbackCount = 0;
+        Contexts[Index].Status = STATUS_PENDING;
+        Contexts[Index].Information = 0;
+    }
+
+    TEST_NTSTATUS(WskClientReg());
+    auto WskClientCleanup = wil::scope_exit([&]() {
+        WskClientDereg();
+    });
+
+    unique_fnsock_handle ListenSocket;
+    TEST_CXPLAT(FnSockCreate(AF_INET, SOCK_STREAM, IPPROTO_TCP, &ListenSocket));
+    TEST_NOT_NULL(ListenSocket.get());
+
+    SOCKADDR_IN Address = {0};
+    Address.sin_family = AF_INET;
+    Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_CXPLAT(FnSockBind(ListenSocket.get(), (SOCKADDR *)&Address, sizeof(Address)));
+
+    INT AddressLength = sizeof(Address);
+    TEST_CXPLAT(FnSockGetSockName(ListenSocket.get(), (SOCKADDR *)&Address, &AddressLength));
+    TEST_CXPLAT(FnSockListen(ListenSocket.get(), 32));
+
+    INT TimeoutMs = TEST_TIMEOUT_ASYNC_MS;
+    TEST_CXPLAT(
+        FnSockSetSockOpt(
+            ListenSocket.get(), SOL_SOCKET, SO_RCVTIMEO, (CHAR *)&TimeoutMs, sizeof(TimeoutMs)));
+
+    unique_malloc_ptr<CHAR> RecvBuf((CHAR *)CxPlatAllocNonPaged(sizeof(Data), POOL_TAG));
+    TEST_NOT_NULL(RecvBuf.get());
+
+    auto Socket = WskConnectTcpSocket(&Address);
+    TEST_NOT_NULL(Socket.get());
+
+    SOCKADDR_INET PeerAddress;
+    INT PeerAddressLength = sizeof(PeerAddress);
+    unique_fnsock_handle AcceptSocket(
+        FnSockAccept(ListenSocket.get(), (SOCKADDR *)&PeerAddress, &PeerAddressLength));
+    TEST_NOT_NULL(AcceptSocket.get());
+
+    //
+    // A receive that completes before its deadline runs its callback once with
+    // its own result, and the timer does not run it again once the deadline
+    // passes.
+    //
+    TEST_EQUAL((INT)sizeof(Data), FnSockSend(AcceptSocket.get(), Data, sizeof(Data), FALSE, 0));
+    TEST_NTSTATUS(
+        WskReceiveAsync(
+            Socket.get(), WSK_FLAG_CONNECTION_SOCKET, RecvBuf.get(), sizeof(Data), TRUE,
+            &Completion));
+    WskSetCompletionCallback(Completion, CallbackTimeoutMs, WskCallbackTestComplete, &Contexts[0]);
+    WskCallbackTestWait(&Contexts[0], CallbackTimeoutMs + TEST_TIMEOUT_ASYNC_MS, &Socket);
+    CxPlatSleep(2 * CallbackTimeoutMs);
+
+    TEST_EQUAL(1, ReadNoFence(&Contexts[0].CallbackCount));
+    TEST_EQUAL(STATUS_SUCCESS, Contexts[0].Status);
+    TEST_TRUE(Contexts[0].Information > 0 && Contexts[0].Information <= sizeof(Data));
+    TEST_TRUE(RtlEqualMemory(RecvBuf.get(), Data, Contexts[0].Information));
+
+    //
+    // A receive on an idle connection is still pending at its deadline, so the
+    // shared timer cancels it, and its callback runs once with STATUS_TIMEOUT.
+    //
+    TEST_NTSTATUS(
+        WskReceiveAsync(
+            Socket.get(), WSK_FLAG_CONNECTION_SOCKET, RecvBuf.get(), sizeof(Data), TRUE,
+            &Completion));
+    WskSetCompletionCallback(Completion, CallbackTimeoutMs, WskCallbackTestComplete, &Contexts[1]);
+    WskCallbackTestWait(&Contexts[1], CallbackTimeoutMs + TEST_TIMEOUT_ASYNC_MS, &Socket);
+    CxPlatSleep(2 * CallbackTimeoutMs);
+
+    TEST_EQUAL(1, ReadNoFence(&Contexts[1].CallbackCount));
+    TEST_EQUAL(STATUS_TIMEOUT, Contexts[1].Status);
+#endif
 }
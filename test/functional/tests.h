@@ -31,6 +31,15 @@ MpBasicWatchdog();
 VOID
 MpBasicPort();
 
+VOID
+MpChecksumEmulation();
+
+VOID
+MpStatistics();
+
+VOID
+MpLatencyHistogram();
+
 VOID
 LwfBasicRx();
 
@@ -43,7 +52,70 @@ LwfBasicOid();
 VOID
 SockBasicTcp(USHORT AddressFamily);
 
+VOID
+SockUdpReceiveBuffer(USHORT AddressFamily);
+
+VOID
+SockUdpSendWindow(USHORT AddressFamily);
+
+VOID
+SockUdpRetainedReceive(USHORT AddressFamily);
+
+VOID
+SockUdpBatch(USHORT AddressFamily);
+
+VOID
+SockUdpSegmentation(USHORT AddressFamily);
+
+VOID
+SockAsyncTcp(USHORT AddressFamily);
+
+VOID
+SockPoll(USHORT AddressFamily);
+
+VOID
+SockUdpRio(USHORT AddressFamily);
+
+VOID
+SockTcpConnectChurn(USHORT AddressFamily);
+
 VOID
 SockBasicRaw(USHORT AddressFamily);
 
+VOID
+PktUdpSuperFrame(USHORT AddressFamily);
+
+VOID
+PktQuicCoalescedPackets();
+
+VOID
+PktFrameTemplates(USHORT AddressFamily);
+
+VOID
+IsrCaptureOutput();
+
+VOID
+IsrClientBatchAndAsync();
+
+VOID
+IsrServiceStop();
+
+VOID
+IsrPersistentShell();
+
+VOID
+FnTimerWheel();
+
+VOID
+WskRegisteredSendCache();
+
+VOID
+WskSendMessagesBatch();
+
+VOID
+WskReceivePipeline();
+
+VOID
+WskCompletionCallbackTimeout();
+
 EXTERN_C_END